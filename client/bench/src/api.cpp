@@ -0,0 +1,325 @@
+// Measures the end-to-end latency of the blocking client calls which require a
+// round-trip between the client and real sandbox processes, and how it scales
+// with the number of sandboxes and with the size of the device state, which is
+// swept using the "State KB" parameter of scuff.test.big-state. With --json the results are written to stdout
+// as a JSON document so that they can be compared between revisions. This only
+// uses the public API so it can also be built against older revisions.
+#include "setup.hpp"
+#include "stats.hpp"
+#include <algorithm>
+#include <boost/program_options.hpp>
+#include <chrono>
+#include <filesystem>
+#include <functional>
+#include <iostream>
+#include <nlohmann/json.hpp>
+#include <scuff/client.hpp>
+#include <sstream>
+#include <thread>
+#include <tuple>
+#include <vector>
+
+namespace fs = std::filesystem;
+namespace po = boost::program_options;
+
+static constexpr auto BIG_STATE_PLUGIN = "scuff.test.big-state";
+
+struct options {
+	int calls                  = 200;
+	int state_calls            = 20;
+	bool json                  = false;
+	fs::path sbox_exe          = SBOX_EXE_PATH;
+	fs::path scan_exe          = SCAN_EXE_PATH;
+	std::string plugin         = "scuff.test.gain";
+	std::string sandbox_counts = "1,2,4";
+	std::string state_kbs      = "1,64,1024,8192";
+};
+
+struct result {
+	std::string op;
+	int sandboxes      = 0;
+	int calls          = 0;
+	size_t state_bytes = 0;
+	double throughput  = 0.0; // Calls per second.
+	scuff::bench::stats stats;
+};
+
+// The devices which the calls are spread across, one per sandbox.
+struct fixture {
+	scuff::id::group group;
+	std::vector<scuff::id::sandbox> sandboxes;
+	std::vector<scuff::id::device> devices;
+	scuff::bytes state;
+};
+
+static
+auto get_options(int argc, const char* argv[]) -> options {
+	options opts;
+	auto desc = po::options_description{"Allowed options"};
+	desc.add_options()
+		("calls",       po::value<int>(&opts.calls), "number of calls to time for each operation")
+		("state-calls", po::value<int>(&opts.state_calls), "number of calls to time for each operation of the state size sweep")
+		("json",        po::bool_switch(&opts.json), "write the results to stdout as JSON")
+		("sbox",        po::value<fs::path>(&opts.sbox_exe), "path to the sandbox executable")
+		("scan",        po::value<fs::path>(&opts.scan_exe), "path to the scanner executable")
+		("plugin",      po::value<std::string>(&opts.plugin), "ID of the CLAP plugin to create")
+		("sandboxes",   po::value<std::string>(&opts.sandbox_counts), "comma-separated list of sandbox counts to run each operation with")
+		("state-kb",    po::value<std::string>(&opts.state_kbs), "comma-separated list of state sizes in KB to run save, load and duplicate with (empty to skip)")
+		;
+	auto vm = po::variables_map{};
+	po::store(po::parse_command_line(argc, argv, desc), vm);
+	po::notify(vm);
+	opts.calls       = std::max(opts.calls, 1);
+	opts.state_calls = std::max(opts.state_calls, 1);
+	return opts;
+}
+
+[[nodiscard]] static
+auto get_list(std::string_view list, int min) -> std::vector<int> {
+	std::vector<int> values;
+	auto stream = std::istringstream{std::string{list}};
+	auto token  = std::string{};
+	while (std::getline(stream, token, ',')) {
+		values.push_back(std::max(std::stoi(token), min));
+	}
+	return values;
+}
+
+[[nodiscard]] static
+auto create_device(std::string_view plugin, scuff::id::sandbox sbox) -> scuff::id::device {
+	const auto device = scuff::create_device(sbox, scuff::plugin_type::clap, {std::string{plugin}});
+	if (!device.success) {
+		throw std::runtime_error{std::format("Failed to create a device for plugin '{}'", plugin)};
+	}
+	return device.id;
+}
+
+[[nodiscard]] static
+auto make_fixture(const options& opts, int sandbox_count, std::string_view plugin) -> fixture {
+	fixture f;
+	f.group = scuff::create_group(nullptr);
+	for (int i = 0; i < sandbox_count; i++) {
+		const auto sbox = scuff::create_sandbox(f.group, opts.sbox_exe.string());
+		f.sandboxes.push_back(sbox);
+		f.devices.push_back(create_device(plugin, sbox));
+	}
+	f.state = scuff::save(f.devices.front());
+	return f;
+}
+
+// Set the "State KB" parameter of every device in the fixture and save the
+// new state. Parameter events only reach a plugin while it is processing,
+// so the group is processed until the new value can be read back.
+static
+auto set_state_kb(fixture* f, int kb) -> void {
+	const auto value = static_cast<double>(kb);
+	for (const auto dev : f->devices) {
+		scuff::events::param_value ev = {};
+		ev.header.event_type = scuff::events::type::param_value;
+		ev.param             = 0;
+		ev.note_id           = -1;
+		ev.port_index        = -1;
+		ev.channel           = -1;
+		ev.key               = -1;
+		ev.value             = value;
+		scuff::push_event(dev, ev);
+	}
+	scuff::group_process gp;
+	gp.group              = f->group;
+	gp.input_events.count = [] { return 0; };
+	gp.input_events.pop   = [](size_t, scuff::input_event*) { return 0; };
+	gp.output_events.push = [](const scuff::output_event&) {};
+	const auto is_set = [f, value] {
+		return std::ranges::all_of(f->devices, [value](scuff::id::device dev) {
+			return scuff::get_value(dev, scuff::idx::param{0}) == value;
+		});
+	};
+	const auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds{10};
+	while (!is_set()) {
+		if (std::chrono::steady_clock::now() > deadline) {
+			throw std::runtime_error{std::format("Timed out setting the state size to {} KB", kb)};
+		}
+		scuff::audio_process(gp);
+		std::this_thread::sleep_for(std::chrono::milliseconds{5});
+	}
+	f->state = scuff::save(f->devices.front());
+}
+
+static
+auto destroy(const fixture& f) -> void {
+	for (const auto dev : f.devices) {
+		scuff::erase(dev);
+	}
+	for (const auto sbox : f.sandboxes) {
+		scuff::erase(sbox);
+	}
+	scuff::erase(f.group);
+}
+
+// Call fn(i) the given number of times, timing each call. Calls are spread
+// across the sandboxes by the caller using the index.
+[[nodiscard]] static
+auto run(std::string_view op, const fixture& f, int calls, std::function<void(size_t)> fn) -> result {
+	using clock = std::chrono::steady_clock;
+	std::vector<double> times;
+	times.reserve(calls);
+	auto total = 0.0;
+	for (int i = 0; i < calls; i++) {
+		const auto start = clock::now();
+		fn(static_cast<size_t>(i));
+		const auto end = clock::now();
+		const auto us  = std::chrono::duration<double, std::micro>(end - start).count();
+		times.push_back(us);
+		total += us;
+	}
+	result r;
+	r.op          = op;
+	r.sandboxes   = static_cast<int>(f.sandboxes.size());
+	r.calls       = calls;
+	r.state_bytes = f.state.size();
+	r.throughput  = total > 0.0 ? calls / (total / 1'000'000.0) : 0.0;
+	r.stats       = scuff::bench::make_stats(std::move(times));
+	return r;
+}
+
+// The operations whose cost depends on the size of the device state.
+[[nodiscard]] static
+auto run_state_ops(const fixture& f, int calls) -> std::vector<result> {
+	const auto device = [&f](size_t i) { return f.devices[i % f.devices.size()]; };
+	const auto sbox   = [&f](size_t i) { return f.sandboxes[i % f.sandboxes.size()]; };
+	std::vector<result> results;
+	// Devices created by the benchmark are erased as it goes, outside of the
+	// timed section, so that they don't pile up in the sandboxes.
+	std::vector<scuff::id::device> created;
+	results.push_back(run("save", f, calls, [&](size_t i) {
+		std::ignore = scuff::save(device(i));
+	}));
+	results.push_back(run("load", f, calls, [&](size_t i) {
+		std::ignore = scuff::load(device(i), f.state);
+	}));
+	results.push_back(run("duplicate", f, calls, [&](size_t i) {
+		// Duplicate into the next sandbox along, so that with more than
+		// one sandbox the state has to cross between processes.
+		const auto dup = scuff::duplicate(device(i), sbox(i + 1));
+		if (dup.success) {
+			created.push_back(dup.id);
+		}
+	}));
+	for (const auto dev : created) { scuff::erase(dev); }
+	return results;
+}
+
+[[nodiscard]] static
+auto run_all(const options& opts, const fixture& f) -> std::vector<result> {
+	const auto param  = scuff::idx::param{0};
+	const auto device = [&f](size_t i) { return f.devices[i % f.devices.size()]; };
+	const auto sbox   = [&f](size_t i) { return f.sandboxes[i % f.sandboxes.size()]; };
+	std::vector<result> results;
+	std::vector<scuff::id::device> created;
+	results.push_back(run("get_value", f, opts.calls, [&](size_t i) {
+		std::ignore = scuff::get_value(device(i), param);
+	}));
+	results.push_back(run("get_value_text", f, opts.calls, [&](size_t i) {
+		std::ignore = scuff::get_value_text(device(i), param, 0.5);
+	}));
+	results.push_back(run("create_device", f, opts.calls, [&](size_t i) {
+		created.push_back(create_device(opts.plugin, sbox(i)));
+	}));
+	for (const auto dev : created) { scuff::erase(dev); }
+	for (auto& r : run_state_ops(f, opts.calls)) {
+		results.push_back(std::move(r));
+	}
+	return results;
+}
+
+// Run the state operations with each of the state sizes, using
+// scuff.test.big-state rather than the plugin given on the command line.
+[[nodiscard]] static
+auto run_state_sweep(const options& opts, int sandbox_count) -> std::vector<result> {
+	std::vector<result> results;
+	auto f = make_fixture(opts, sandbox_count, BIG_STATE_PLUGIN);
+	scuff::activate(f.group, 44100.0);
+	for (const auto kb : get_list(opts.state_kbs, 0)) {
+		set_state_kb(&f, kb);
+		for (auto& r : run_state_ops(f, opts.state_calls)) {
+			results.push_back(std::move(r));
+		}
+	}
+	scuff::deactivate(f.group);
+	destroy(f);
+	return results;
+}
+
+[[nodiscard]] static
+auto to_json(const result& r) -> nlohmann::json {
+	auto j = nlohmann::json{};
+	j["op"]               = r.op;
+	j["sandboxes"]        = r.sandboxes;
+	j["calls"]            = r.calls;
+	j["state_bytes"]      = r.state_bytes;
+	j["throughput_per_s"] = r.throughput;
+	j["mean_us"]          = r.stats.mean;
+	j["stddev_us"]        = r.stats.stddev;
+	j["p50_us"]           = r.stats.p50;
+	j["p99_us"]           = r.stats.p99;
+	j["p999_us"]          = r.stats.p999;
+	j["max_us"]           = r.stats.max;
+	return j;
+}
+
+static
+auto print_json(const options& opts, const std::vector<result>& results) -> void {
+	auto j = nlohmann::json{};
+	j["plugin"]  = opts.plugin;
+	j["results"] = nlohmann::json::array();
+	for (const auto& r : results) {
+		j["results"].push_back(to_json(r));
+	}
+	std::cout << j.dump(2) << std::endl;
+}
+
+static
+auto print_table(const std::vector<result>& results) -> void {
+	for (const auto& r : results) {
+		scuff::bench::print(std::format("{} x{} ({} bytes)", r.op, r.sandboxes, r.state_bytes), r.stats);
+	}
+}
+
+auto fatal(std::string_view err) -> int {
+	std::cerr << err << std::endl;
+	return EXIT_FAILURE;
+}
+
+auto go(int argc, const char* argv[]) -> int {
+	const auto opts = get_options(argc, argv);
+	scuff::test_plugins::add_to_clap_path();
+	scuff::init();
+	try {
+		scuff::bench::wait_for_scan(opts.scan_exe);
+		std::vector<result> results;
+		for (const auto count : get_list(opts.sandbox_counts, 1)) {
+			const auto f = make_fixture(opts, count, opts.plugin);
+			for (auto& r : run_all(opts, f)) {
+				results.push_back(std::move(r));
+			}
+			destroy(f);
+			for (auto& r : run_state_sweep(opts, count)) {
+				results.push_back(std::move(r));
+			}
+		}
+		if (opts.json) { print_json(opts, results); }
+		else           { print_table(results); }
+	}
+	catch (...) {
+		scuff::shutdown();
+		throw;
+	}
+	scuff::shutdown();
+	return EXIT_SUCCESS;
+}
+
+auto main(int argc, const char* argv[]) -> int {
+	try                               { return go(argc, argv); }
+	catch (const std::exception& err) { return fatal(err.what()); }
+	catch (...)                       { return fatal("Unknown error"); }
+}
@@ -0,0 +1,505 @@
+// Calls audio_process() at a fixed rate from a realtime thread, as a host's
+// audio callback would, and measures how long each stage of the cycle takes
+// (see scuff::process_timings) and how often the cycle overran its period.
+// The measurement is repeated for each combination of sandbox count, devices
+// per sandbox, connection topology, render mode and spin time. With --json the
+// results are written to stdout as a JSON document.
+#include "setup.hpp"
+#include "stats.hpp"
+#include <algorithm>
+#include <atomic>
+#include <boost/program_options.hpp>
+#include <chrono>
+#include <filesystem>
+#include <format>
+#include <iostream>
+#include <nlohmann/json.hpp>
+#include <scuff/client.hpp>
+#include <sstream>
+#include <thread>
+#include <vector>
+#if defined(_WIN32)
+#	define NOMINMAX
+#	include <Windows.h>
+#else
+#	include <pthread.h>
+#	include <sched.h>
+#endif
+
+namespace fs = std::filesystem;
+namespace po = boost::program_options;
+
+enum class topology {
+	serial,   // The devices in each sandbox are connected in a chain.
+	parallel, // No connections. Every device has its own input and output.
+	cross,    // All the devices are connected in one chain which alternates between sandboxes.
+};
+
+struct options {
+	int cycles                 = 2000;
+	int warmup                 = 200;
+	int priority               = 80;
+	double sample_rate         = 48000.0;
+	bool json                  = false;
+	bool pipelined             = false;
+	bool float64               = false;
+	fs::path sbox_exe          = SBOX_EXE_PATH;
+	fs::path scan_exe          = SCAN_EXE_PATH;
+	std::string plugin         = "scuff.test.passthrough";
+	std::string sandbox_counts = "1,2,4,8,16,32,64";
+	std::string device_counts  = "1,4";
+	std::string topologies     = "serial,parallel,cross";
+	std::string render_modes   = "realtime";
+	std::string spin_times     = "0,100";
+};
+
+struct config {
+	int sandboxes;
+	int devices; // Per sandbox.
+	topology topo;
+	scuff::render_mode mode;
+	std::chrono::microseconds spin;
+};
+
+struct stage {
+	scuff::bench::stats stats;
+	scuff::bench::histogram histogram;
+};
+
+struct result {
+	config cfg;
+	double period_us     = 0.0;
+	uint64_t xruns       = 0; // Cycles which finished after the next one was due.
+	uint64_t dropouts    = 0; // Cycles which output zeros because the sandboxes didn't respond.
+	stage wake;               // How late the audio thread woke up for each cycle.
+	stage inputs;
+	stage sandboxes;
+	stage outputs;
+	stage total;
+};
+
+struct fixture {
+	scuff::id::group group;
+	std::vector<scuff::id::sandbox> sandboxes;
+	std::vector<scuff::id::device> devices;
+	scuff::group_process process;
+};
+
+[[nodiscard]] static
+auto to_string(topology topo) -> std::string_view {
+	switch (topo) {
+		case topology::serial:   { return "serial"; }
+		case topology::parallel: { return "parallel"; }
+		case topology::cross:    { return "cross"; }
+	}
+	return "unknown";
+}
+
+[[nodiscard]] static
+auto to_string(scuff::render_mode mode) -> std::string_view {
+	return mode == scuff::render_mode::offline ? "offline" : "realtime";
+}
+
+[[nodiscard]] static
+auto split(std::string_view list) -> std::vector<std::string> {
+	std::vector<std::string> tokens;
+	auto stream = std::istringstream{std::string{list}};
+	auto token  = std::string{};
+	while (std::getline(stream, token, ',')) {
+		tokens.push_back(token);
+	}
+	return tokens;
+}
+
+[[nodiscard]] static
+auto to_topology(std::string_view s) -> topology {
+	if (s == "serial")   { return topology::serial; }
+	if (s == "parallel") { return topology::parallel; }
+	if (s == "cross")    { return topology::cross; }
+	throw std::runtime_error{std::format("Unknown topology '{}'", s)};
+}
+
+[[nodiscard]] static
+auto to_render_mode(std::string_view s) -> scuff::render_mode {
+	if (s == "realtime") { return scuff::render_mode::realtime; }
+	if (s == "offline")  { return scuff::render_mode::offline; }
+	throw std::runtime_error{std::format("Unknown render mode '{}'", s)};
+}
+
+static
+auto get_options(int argc, const char* argv[]) -> options {
+	options opts;
+	auto desc = po::options_description{"Allowed options"};
+	desc.add_options()
+		("cycles",       po::value<int>(&opts.cycles), "number of audio cycles to measure for each configuration")
+		("warmup",       po::value<int>(&opts.warmup), "number of audio cycles to run before measuring")
+		("priority",     po::value<int>(&opts.priority), "SCHED_FIFO priority of the audio thread")
+		("sample-rate",  po::value<double>(&opts.sample_rate), "sample rate, which determines the cycle period")
+		("json",         po::bool_switch(&opts.json), "write the results to stdout as JSON")
+		("pipelined",    po::bool_switch(&opts.pipelined), "enable pipelined processing for the group")
+		("float64",      po::bool_switch(&opts.float64), "process the group in 64-bit")
+		("sbox",         po::value<fs::path>(&opts.sbox_exe), "path to the sandbox executable")
+		("scan",         po::value<fs::path>(&opts.scan_exe), "path to the scanner executable")
+		("plugin",       po::value<std::string>(&opts.plugin), "ID of the CLAP plugin to create")
+		("sandboxes",    po::value<std::string>(&opts.sandbox_counts), "comma-separated list of sandbox counts")
+		("devices",      po::value<std::string>(&opts.device_counts), "comma-separated list of device counts per sandbox")
+		("topologies",   po::value<std::string>(&opts.topologies), "comma-separated list of topologies: serial, parallel, cross")
+		("render-modes", po::value<std::string>(&opts.render_modes), "comma-separated list of render modes: realtime, offline")
+		("spin",         po::value<std::string>(&opts.spin_times), "comma-separated list of spin times in microseconds")
+		;
+	auto vm = po::variables_map{};
+	po::store(po::parse_command_line(argc, argv, desc), vm);
+	po::notify(vm);
+	opts.cycles = std::max(opts.cycles, 1);
+	opts.warmup = std::max(opts.warmup, 0);
+	return opts;
+}
+
+[[nodiscard]] static
+auto get_configs(const options& opts) -> std::vector<config> {
+	std::vector<config> configs;
+	for (const auto& sandboxes : split(opts.sandbox_counts)) {
+		for (const auto& devices : split(opts.device_counts)) {
+			for (const auto& topo : split(opts.topologies)) {
+				for (const auto& mode : split(opts.render_modes)) {
+					for (const auto& spin : split(opts.spin_times)) {
+						config cfg;
+						cfg.sandboxes = std::max(std::stoi(sandboxes), 1);
+						cfg.devices   = std::max(std::stoi(devices), 1);
+						cfg.topo      = to_topology(topo);
+						cfg.mode      = to_render_mode(mode);
+						cfg.spin      = std::chrono::microseconds{std::max(std::stoi(spin), 0)};
+						configs.push_back(cfg);
+					}
+				}
+			}
+		}
+	}
+	return configs;
+}
+
+// Returns false if the priority couldn't be set, which usually
+// means the process doesn't have permission.
+[[nodiscard]] static
+auto set_realtime_priority(int priority) -> bool {
+#if defined(_WIN32)
+	return SetThreadPriority(GetCurrentThread(), THREAD_PRIORITY_TIME_CRITICAL) != 0;
+#else
+	sched_param param = {};
+	param.sched_priority = priority;
+	return pthread_setschedparam(pthread_self(), SCHED_FIFO, &param) == 0;
+#endif
+}
+
+[[nodiscard]] static
+auto make_group_ui() -> scuff::group_ui {
+	auto ui = scuff::group_ui{};
+	ui.on_error        = [](std::string_view err) { std::cerr << err << std::endl; };
+	ui.on_sbox_crashed = [](scuff::id::sandbox, std::string_view err) { std::cerr << err << std::endl; };
+	ui.on_sbox_error   = [](scuff::id::sandbox, std::string_view err) { std::cerr << err << std::endl; };
+	return ui;
+}
+
+[[nodiscard]] static
+auto create_device(const options& opts, scuff::id::sandbox sbox) -> scuff::id::device {
+	const auto device = scuff::create_device(sbox, scuff::plugin_type::clap, {opts.plugin});
+	if (!device.success) {
+		throw std::runtime_error{std::format("Failed to create a device for plugin '{}'", opts.plugin)};
+	}
+	return device.id;
+}
+
+static
+auto add_input(fixture* f, scuff::id::device dev) -> void {
+	scuff::audio_input in;
+	in.dev_id     = dev;
+	in.port_index = 0;
+	const auto info     = scuff::get_port_info(dev);
+	const auto channels = info.audio_input_channels.empty() ? 0 : info.audio_input_channels[0];
+	in.write_to   = [channels](float* floats) {
+		std::fill_n(floats, scuff::VECTOR_SIZE * channels, 0.5f);
+	};
+	f->process.audio_inputs.push_back(in);
+}
+
+static
+auto add_output(fixture* f, scuff::id::device dev) -> void {
+	scuff::audio_output out;
+	out.dev_id     = dev;
+	out.port_index = 0;
+	out.read_from  = [](const float* floats) {};
+	f->process.audio_outputs.push_back(out);
+}
+
+// Connects the devices in the order given, feeding the
+// first one and reading the output of the last one.
+static
+auto make_chain(fixture* f, const std::vector<scuff::id::device>& chain) -> void {
+	for (size_t i = 1; i < chain.size(); i++) {
+		scuff::connect(chain[i - 1], 0, chain[i], 0);
+	}
+	add_input(f, chain.front());
+	add_output(f, chain.back());
+}
+
+static
+auto connect(fixture* f, const config& cfg) -> void {
+	const auto device = [&f, &cfg](int sbox, int index) {
+		return f->devices[static_cast<size_t>(sbox * cfg.devices + index)];
+	};
+	switch (cfg.topo) {
+		case topology::serial: {
+			for (int s = 0; s < cfg.sandboxes; s++) {
+				std::vector<scuff::id::device> chain;
+				for (int d = 0; d < cfg.devices; d++) {
+					chain.push_back(device(s, d));
+				}
+				make_chain(f, chain);
+			}
+			break;
+		}
+		case topology::parallel: {
+			for (const auto dev : f->devices) {
+				add_input(f, dev);
+				add_output(f, dev);
+			}
+			break;
+		}
+		case topology::cross: {
+			std::vector<scuff::id::device> chain;
+			for (int d = 0; d < cfg.devices; d++) {
+				for (int s = 0; s < cfg.sandboxes; s++) {
+					chain.push_back(device(s, d));
+				}
+			}
+			make_chain(f, chain);
+			break;
+		}
+	}
+}
+
+[[nodiscard]] static
+auto make_fixture(const options& opts, const config& cfg) -> fixture {
+	fixture f;
+	f.group = scuff::create_group(nullptr);
+	scuff::set_sample_format(f.group, opts.float64 ? scuff::sample_format::float64 : scuff::sample_format::float32);
+	for (int s = 0; s < cfg.sandboxes; s++) {
+		const auto sbox = scuff::create_sandbox(f.group, opts.sbox_exe.string());
+		f.sandboxes.push_back(sbox);
+		for (int d = 0; d < cfg.devices; d++) {
+			f.devices.push_back(create_device(opts, sbox));
+		}
+	}
+	connect(&f, cfg);
+	scuff::set_render_mode(f.group, cfg.mode);
+	scuff::set_spin_time(f.group, cfg.spin);
+	scuff::set_pipelined(f.group, opts.pipelined);
+	scuff::activate(f.group, opts.sample_rate);
+	f.process.group              = f.group;
+	f.process.input_events.count = [] { return 0; };
+	f.process.input_events.pop   = [](size_t, scuff::input_event*) { return 0; };
+	f.process.output_events.push = [](const scuff::output_event&) {};
+	return f;
+}
+
+static
+auto destroy(const fixture& f) -> void {
+	scuff::deactivate(f.group);
+	for (const auto dev : f.devices) {
+		scuff::erase(dev);
+	}
+	for (const auto sbox : f.sandboxes) {
+		scuff::erase(sbox);
+	}
+	scuff::erase(f.group);
+}
+
+[[nodiscard]] static
+auto to_us(std::chrono::steady_clock::duration d) -> double {
+	return std::chrono::duration<double, std::micro>(d).count();
+}
+
+[[nodiscard]] static
+auto make_stage(std::vector<double> times) -> stage {
+	stage s;
+	s.histogram = scuff::bench::make_histogram(times);
+	s.stats     = scuff::bench::make_stats(std::move(times));
+	return s;
+}
+
+// The audio thread. Runs the warmup cycles and then the measured cycles, each
+// one scheduled a period after the last. If a cycle overruns, the schedule is
+// reset rather than trying to catch up, like an audio device would.
+[[nodiscard]] static
+auto run_cycles(const options& opts, const config& cfg, fixture* f) -> result {
+	using clock = std::chrono::steady_clock;
+	const auto period = std::chrono::duration_cast<clock::duration>(std::chrono::duration<double>{scuff::VECTOR_SIZE / opts.sample_rate});
+	std::vector<double> wake, inputs, sandboxes, outputs, total;
+	wake.reserve(opts.cycles);
+	inputs.reserve(opts.cycles);
+	sandboxes.reserve(opts.cycles);
+	outputs.reserve(opts.cycles);
+	total.reserve(opts.cycles);
+	result r;
+	r.cfg       = cfg;
+	r.period_us = to_us(period);
+	scuff::process_timings timings;
+	f->process.timings = &timings;
+	auto due = clock::now();
+	for (int i = 0; i < opts.warmup + opts.cycles; i++) {
+		std::this_thread::sleep_until(due);
+		const auto start = clock::now();
+		scuff::audio_process(f->process);
+		const auto end = clock::now();
+		const auto next_due = due + period;
+		if (i >= opts.warmup) {
+			wake.push_back(to_us(start - due));
+			inputs.push_back(to_us(timings.inputs));
+			sandboxes.push_back(to_us(timings.sandboxes));
+			outputs.push_back(to_us(timings.outputs));
+			total.push_back(to_us(end - start));
+			if (end > next_due)        { r.xruns++; }
+			if (!timings.outputs_used) { r.dropouts++; }
+		}
+		due = std::max(next_due, end);
+	}
+	f->process.timings = nullptr;
+	r.wake      = make_stage(std::move(wake));
+	r.inputs    = make_stage(std::move(inputs));
+	r.sandboxes = make_stage(std::move(sandboxes));
+	r.outputs   = make_stage(std::move(outputs));
+	r.total     = make_stage(std::move(total));
+	return r;
+}
+
+// Runs the cycles on a realtime thread while this thread keeps
+// the UI queue for the group drained.
+[[nodiscard]] static
+auto run(const options& opts, const config& cfg) -> result {
+	using clock = std::chrono::steady_clock;
+	auto f    = make_fixture(opts, cfg);
+	auto ui   = make_group_ui();
+	auto r    = result{};
+	auto done = std::atomic_bool{false};
+	// Give the sandboxes a moment to confirm that they are active.
+	const auto settle_until = clock::now() + std::chrono::milliseconds{500};
+	while (clock::now() < settle_until) {
+		scuff::ui_update(f.group, ui);
+		std::this_thread::sleep_for(std::chrono::milliseconds{10});
+	}
+	auto thread = std::thread{[&] {
+		if (!set_realtime_priority(opts.priority)) {
+			std::cerr << "Warning: failed to set the realtime priority of the audio thread" << std::endl;
+		}
+		r    = run_cycles(opts, cfg, &f);
+		done = true;
+	}};
+	while (!done) {
+		scuff::ui_update(f.group, ui);
+		std::this_thread::sleep_for(std::chrono::milliseconds{50});
+	}
+	thread.join();
+	destroy(f);
+	return r;
+}
+
+[[nodiscard]] static
+auto to_json(const stage& s) -> nlohmann::json {
+	auto j = nlohmann::json{};
+	j["mean_us"]   = s.stats.mean;
+	j["stddev_us"] = s.stats.stddev;
+	j["p50_us"]    = s.stats.p50;
+	j["p99_us"]    = s.stats.p99;
+	j["p999_us"]   = s.stats.p999;
+	j["max_us"]    = s.stats.max;
+	j["histogram"] = nlohmann::json::array();
+	for (size_t i = 0; i < scuff::bench::histogram::BUCKETS; i++) {
+		if (s.histogram.counts[i] > 0) {
+			j["histogram"].push_back({{"below_us", scuff::bench::get_upper_bound_us(i)}, {"count", s.histogram.counts[i]}});
+		}
+	}
+	return j;
+}
+
+[[nodiscard]] static
+auto to_json(const result& r) -> nlohmann::json {
+	auto j = nlohmann::json{};
+	j["sandboxes"]    = r.cfg.sandboxes;
+	j["devices"]      = r.cfg.devices;
+	j["topology"]     = to_string(r.cfg.topo);
+	j["render_mode"]  = to_string(r.cfg.mode);
+	j["spin_us"]      = r.cfg.spin.count();
+	j["period_us"]    = r.period_us;
+	j["xruns"]        = r.xruns;
+	j["dropouts"]     = r.dropouts;
+	j["wake"]         = to_json(r.wake);
+	j["inputs"]       = to_json(r.inputs);
+	j["sandbox_wait"] = to_json(r.sandboxes);
+	j["outputs"]      = to_json(r.outputs);
+	j["total"]        = to_json(r.total);
+	return j;
+}
+
+static
+auto print_json(const options& opts, const std::vector<result>& results) -> void {
+	auto j = nlohmann::json{};
+	j["plugin"]      = opts.plugin;
+	j["cycles"]      = opts.cycles;
+	j["sample_rate"] = opts.sample_rate;
+	j["vector_size"] = scuff::VECTOR_SIZE;
+	j["pipelined"]   = opts.pipelined;
+	j["results"]     = nlohmann::json::array();
+	for (const auto& r : results) {
+		j["results"].push_back(to_json(r));
+	}
+	std::cout << j.dump(2) << std::endl;
+}
+
+static
+auto print_table(const result& r) -> void {
+	std::cout << std::format("{} sandboxes x {} devices, {}, {}, spin {}us: {} xruns, {} dropouts ({:.0f}us period)",
+		r.cfg.sandboxes, r.cfg.devices, to_string(r.cfg.topo), to_string(r.cfg.mode), r.cfg.spin.count(), r.xruns, r.dropouts, r.period_us) << std::endl;
+	scuff::bench::print("  wake", r.wake.stats);
+	scuff::bench::print("  inputs", r.inputs.stats);
+	scuff::bench::print("  sandbox wait", r.sandboxes.stats);
+	scuff::bench::print("  outputs", r.outputs.stats);
+	scuff::bench::print("  total", r.total.stats);
+	scuff::bench::print("  total histogram", r.total.histogram);
+}
+
+auto fatal(std::string_view err) -> int {
+	std::cerr << err << std::endl;
+	return EXIT_FAILURE;
+}
+
+auto go(int argc, const char* argv[]) -> int {
+	const auto opts = get_options(argc, argv);
+	scuff::test_plugins::add_to_clap_path();
+	scuff::init();
+	try {
+		scuff::bench::wait_for_scan(opts.scan_exe);
+		std::vector<result> results;
+		for (const auto& cfg : get_configs(opts)) {
+			auto r = run(opts, cfg);
+			if (!opts.json) {
+				print_table(r);
+			}
+			results.push_back(std::move(r));
+		}
+		if (opts.json) {
+			print_json(opts, results);
+		}
+	}
+	catch (...) {
+		scuff::shutdown();
+		throw;
+	}
+	scuff::shutdown();
+	return EXIT_SUCCESS;
+}
+
+auto main(int argc, const char* argv[]) -> int {
+	try                               { return go(argc, argv); }
+	catch (const std::exception& err) { return fatal(err.what()); }
+	catch (...)                       { return fatal("Unknown error"); }
+}
@@ -0,0 +1,33 @@
+#pragma once
+
+#include <chrono>
+#include <filesystem>
+#include <iostream>
+#include <scuff/client.hpp>
+#include <scuff-test-plugins.hpp>
+#include <string>
+#include <thread>
+
+namespace scuff::bench {
+
+static
+auto wait_for_scan(const std::filesystem::path& scan_exe) -> void {
+	auto done = false;
+	auto ui   = scuff::general_ui{};
+	ui.on_error            = [](std::string_view err) { std::cerr << err << std::endl; };
+	ui.on_plugfile_broken  = [](scuff::id::plugfile) {};
+	ui.on_plugfile_scanned = [](scuff::id::plugfile) {};
+	ui.on_plugin_broken    = [](scuff::id::plugin) {};
+	ui.on_plugin_scanned   = [](scuff::id::plugin) {};
+	ui.on_scan_complete    = [&done] { done = true; };
+	ui.on_scan_error       = [](std::string_view err) { std::cerr << err << std::endl; };
+	ui.on_scan_started     = [] {};
+	ui.on_scan_warning     = [](std::string_view) {};
+	scuff::scan(scan_exe.string(), {});
+	while (!done) {
+		scuff::ui_update(ui);
+		std::this_thread::sleep_for(std::chrono::milliseconds{10});
+	}
+}
+
+} // scuff::bench
@@ -0,0 +1,217 @@
+// Compares the per-cycle cost and jitter of moving audio through device shared
+// memory segments created by the native backend (memfds on Linux) against the
+// same data structures in boost's managed_shared_memory, which is what the
+// segments were before the native backend, in a file mapped from the data home
+// directory, which is what the boost shared memory emulation does, and against
+// devices carved out of a group's arena. Also reports how long it took to create
+// the devices.
+#include "common-os.hpp"
+#include "common-shm.hpp"
+#include "stats.hpp"
+#include <algorithm>
+#include <boost/interprocess/managed_mapped_file.hpp>
+#include <boost/interprocess/managed_shared_memory.hpp>
+#include <boost/program_options.hpp>
+#include <chrono>
+#include <fulog.hpp>
+#include <iostream>
+#include <numeric>
+#include <thread>
+#include <vector>
+
+namespace po = boost::program_options;
+
+struct options {
+	int cycles    = 2000;
+	int devices   = 8;
+	int ports     = 2;
+	int channels  = 2;
+	int frames    = 256;
+	int period_us = 5333; // 256 frames at 48kHz
+};
+
+static
+auto get_options(int argc, const char* argv[]) -> options {
+	options opts;
+	auto desc = po::options_description{"Allowed options"};
+	desc.add_options()
+		("cycles",    po::value<int>(&opts.cycles), "number of audio cycles to run for each backend")
+		("devices",   po::value<int>(&opts.devices), "number of device segments")
+		("ports",     po::value<int>(&opts.ports), "number of audio input and output ports per device")
+		("channels",  po::value<int>(&opts.channels), "number of channels per audio port")
+		("frames",    po::value<int>(&opts.frames), "block size the device buffers are sized for")
+		("period-us", po::value<int>(&opts.period_us), "audio cycle period in microseconds, or 0 to run flat out")
+		;
+	auto vm = po::variables_map{};
+	po::store(po::parse_command_line(argc, argv, desc), vm);
+	po::notify(vm);
+	opts.ports    = std::max(opts.ports, 1);
+	opts.channels = std::clamp(opts.channels, 1, static_cast<int>(scuff::MAX_CHANNELS));
+	opts.frames   = std::clamp(opts.frames, 1, static_cast<int>(scuff::MAX_VECTOR_SIZE));
+	return opts;
+}
+
+[[nodiscard]] static
+auto make_layout(const options& opts) -> scuff::shm::port_layout {
+	const auto channels = std::vector<uint32_t>(opts.ports, static_cast<uint32_t>(opts.channels));
+	return {channels, channels, scuff::sample_format::float32, static_cast<uint32_t>(opts.frames)};
+}
+
+// Roughly what happens to a device's buffers during an audio cycle: the client
+// writes the inputs, the sandbox copies them through the plugin to the outputs,
+// and the client reads the outputs back.
+[[nodiscard]] static
+auto process_cycle(const std::vector<scuff::shm::device_data*>& devices, int cycle) -> float {
+	auto sum = 0.0f;
+	for (const auto data : devices) {
+		auto& buffers     = data->buffers[scuff::signaling::get_buffer_index(static_cast<uint32_t>(cycle))];
+		const auto stride = data->max_frames;
+		for (auto& port : buffers.audio_in) {
+			std::fill_n(port.samples.get(), port.channel_count * stride, static_cast<float>(cycle));
+		}
+		for (size_t i = 0; i < buffers.audio_out.size(); i++) {
+			const auto& in = buffers.audio_in[i];
+			std::copy_n(in.samples.get(), in.channel_count * stride, buffers.audio_out[i].samples.get());
+		}
+		for (const auto& port : buffers.audio_out) {
+			const auto samples = port.samples.get();
+			sum += std::accumulate(samples, samples + (port.channel_count * stride), 0.0f);
+		}
+	}
+	return sum;
+}
+
+[[nodiscard]] static
+auto run_cycles(const options& opts, const std::vector<scuff::shm::device_data*>& devices) -> std::vector<double> {
+	using clock = std::chrono::steady_clock;
+	std::vector<double> times;
+	times.reserve(opts.cycles);
+	auto sum        = 0.0f;
+	auto next_cycle = clock::now();
+	for (int i = 0; i < opts.cycles; i++) {
+		const auto start = clock::now();
+		sum += process_cycle(devices, i);
+		const auto end = clock::now();
+		times.push_back(std::chrono::duration<double, std::micro>(end - start).count());
+		if (opts.period_us > 0) {
+			next_cycle += std::chrono::microseconds{opts.period_us};
+			std::this_thread::sleep_until(next_cycle);
+		}
+	}
+	// Stop the compiler from optimizing the work away.
+	if (sum < 0.0f) {
+		std::cout << sum << std::endl;
+	}
+	return times;
+}
+
+static
+auto print_creation_time(std::string_view name, std::chrono::steady_clock::time_point start, int devices) -> void {
+	const auto us = std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - start).count();
+	std::cout << std::format("{}: created {} devices in {:.0f}us", name, devices, us) << std::endl;
+}
+
+[[nodiscard]] static
+auto bench_native(const options& opts) -> scuff::bench::stats {
+	const auto prefix = std::format("scuff-bench-shm+{}", scuff::os::get_process_id());
+	const auto start  = std::chrono::steady_clock::now();
+	std::vector<scuff::shm::device> segments;
+	std::vector<scuff::shm::device_data*> devices;
+	for (int i = 0; i < opts.devices; i++) {
+		auto shm = scuff::shm::create_device(scuff::shm::make_device_id(prefix, {i}), make_layout(opts), true);
+		devices.push_back(shm.data);
+		segments.push_back(std::move(shm));
+	}
+	print_creation_time("native", start, opts.devices);
+	return scuff::bench::make_stats(run_cycles(opts, devices));
+}
+
+[[nodiscard]] static
+auto bench_arena(const options& opts) -> scuff::bench::stats {
+	const auto prefix = std::format("scuff-bench-shm-arena+{}", scuff::os::get_process_id());
+	const auto data   = std::make_unique<scuff::shm::arena_data>();
+	const auto arena  = scuff::shm::make_arena(data.get(), prefix, true);
+	const auto start  = std::chrono::steady_clock::now();
+	std::vector<scuff::shm::device> blocks;
+	std::vector<scuff::shm::device_data*> devices;
+	for (int i = 0; i < opts.devices; i++) {
+		// Normally done by the client's poll thread.
+		scuff::shm::reserve_slab(arena.get());
+		auto shm = scuff::shm::create_device(arena.get(), make_layout(opts));
+		if (!shm) {
+			shm = scuff::shm::create_device(scuff::shm::make_device_id(prefix, {i}), make_layout(opts), true);
+		}
+		devices.push_back(shm->data);
+		blocks.push_back(std::move(*shm));
+	}
+	print_creation_time("arena", start, opts.devices);
+	return scuff::bench::make_stats(run_cycles(opts, devices));
+}
+
+[[nodiscard]] static
+auto bench_boost(const options& opts) -> scuff::bench::stats {
+	const auto prefix = std::format("scuff-bench-shm-boost+{}", scuff::os::get_process_id());
+	const auto name   = [&prefix](int i) { return std::format("{}+{}", prefix, i); };
+	const auto start  = std::chrono::steady_clock::now();
+	scuff::bench::stats s;
+	{
+		std::vector<bip::managed_shared_memory> segments;
+		std::vector<scuff::shm::device_data*> devices;
+		for (int i = 0; i < opts.devices; i++) {
+			const auto layout = make_layout(opts);
+			auto seg          = bip::managed_shared_memory{bip::create_only, name(i).c_str(), scuff::shm::get_device_segment_size(layout)};
+			const auto data   = scuff::shm::construct_device_data(&seg, layout);
+			devices.push_back(data);
+			segments.push_back(std::move(seg));
+		}
+		print_creation_time("boost", start, opts.devices);
+		s = scuff::bench::make_stats(run_cycles(opts, devices));
+	}
+	for (int i = 0; i < opts.devices; i++) {
+		bip::shared_memory_object::remove(name(i).c_str());
+	}
+	return s;
+}
+
+[[nodiscard]] static
+auto bench_emulation(const options& opts) -> scuff::bench::stats {
+	const auto dir = scuff::shm::get_shm_emulation_process_dir(fu::detail::os::get_data_home_dir(), std::format("bench+{}", scuff::os::get_process_id()));
+	fs::create_directories(dir);
+	scuff::bench::stats s;
+	{
+		std::vector<bip::managed_mapped_file> files;
+		std::vector<scuff::shm::device_data*> devices;
+		for (int i = 0; i < opts.devices; i++) {
+			const auto path = dir / std::to_string(i);
+			const auto layout = make_layout(opts);
+			auto file         = bip::managed_mapped_file{bip::create_only, path.string().c_str(), scuff::shm::get_device_segment_size(layout)};
+			const auto data   = scuff::shm::construct_device_data(&file, layout);
+			devices.push_back(data);
+			files.push_back(std::move(file));
+		}
+		s = scuff::bench::make_stats(run_cycles(opts, devices));
+	}
+	fs::remove_all(dir);
+	return s;
+}
+
+auto fatal(std::string_view err) -> int {
+	std::cerr << err << std::endl;
+	return EXIT_FAILURE;
+}
+
+auto go(int argc, const char* argv[]) -> int {
+	const auto opts = get_options(argc, argv);
+	std::cout << std::format("{} cycles, {} devices, {} ports, {} channels, {} frames, {}us period", opts.cycles, opts.devices, opts.ports, opts.channels, opts.frames, opts.period_us) << std::endl;
+	scuff::bench::print("boost", bench_boost(opts));
+	scuff::bench::print("native", bench_native(opts));
+	scuff::bench::print("arena", bench_arena(opts));
+	scuff::bench::print("emulation", bench_emulation(opts));
+	return EXIT_SUCCESS;
+}
+
+auto main(int argc, const char* argv[]) -> int {
+	try                               { return go(argc, argv); }
+	catch (const std::exception& err) { return fatal(err.what()); }
+	catch (...)                       { return fatal("Unknown error"); }
+}
@@ -0,0 +1,99 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <format>
+#include <iostream>
+#include <numeric>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace scuff::bench {
+
+struct stats {
+	double mean   = 0.0;
+	double stddev = 0.0;
+	double p50    = 0.0;
+	double p99    = 0.0;
+	double p999   = 0.0;
+	double max    = 0.0;
+};
+
+[[nodiscard]] static
+auto make_stats(std::vector<double> times) -> stats {
+	stats s;
+	if (times.empty()) {
+		return s;
+	}
+	std::sort(times.begin(), times.end());
+	const auto percentile = [&times](double p) {
+		return times[std::min(times.size() - 1, static_cast<size_t>(p * times.size()))];
+	};
+	s.mean = std::accumulate(times.begin(), times.end(), 0.0) / times.size();
+	for (const auto t : times) {
+		s.stddev += (t - s.mean) * (t - s.mean);
+	}
+	s.stddev = std::sqrt(s.stddev / times.size());
+	s.p50    = percentile(0.5);
+	s.p99    = percentile(0.99);
+	s.p999   = percentile(0.999);
+	s.max    = times.back();
+	return s;
+}
+
+static
+auto print(std::string_view name, const stats& s) -> void {
+	std::cout << std::format("{:<20} mean {:8.2f}us  stddev {:8.2f}us  p50 {:8.2f}us  p99 {:8.2f}us  p99.9 {:8.2f}us  max {:8.2f}us",
+		name, s.mean, s.stddev, s.p50, s.p99, s.p999, s.max) << std::endl;
+}
+
+// Counts of times in power-of-two microsecond buckets. Bucket 0 is everything
+// under 1us, bucket i is [2^(i-1), 2^i) us and the last bucket is open-ended.
+struct histogram {
+	static constexpr auto BUCKETS = size_t{24};
+	std::array<uint64_t, BUCKETS> counts = {};
+};
+
+[[nodiscard]] static
+auto get_upper_bound_us(size_t bucket) -> double {
+	return std::ldexp(1.0, static_cast<int>(bucket));
+}
+
+static
+auto add(histogram* h, double us) -> void {
+	auto bucket = size_t{0};
+	while (bucket < histogram::BUCKETS - 1 && us >= get_upper_bound_us(bucket)) {
+		bucket++;
+	}
+	h->counts[bucket]++;
+}
+
+[[nodiscard]] static
+auto make_histogram(const std::vector<double>& times) -> histogram {
+	histogram h;
+	for (const auto t : times) {
+		add(&h, t);
+	}
+	return h;
+}
+
+// Only the range of buckets which have anything in them is printed.
+static
+auto print(std::string_view name, const histogram& h) -> void {
+	const auto first = std::find_if(h.counts.begin(), h.counts.end(), [](uint64_t n) { return n > 0; });
+	if (first == h.counts.end()) {
+		return;
+	}
+	const auto last  = std::find_if(h.counts.rbegin(), h.counts.rend(), [](uint64_t n) { return n > 0; }).base();
+	const auto total = std::accumulate(h.counts.begin(), h.counts.end(), uint64_t{0});
+	std::cout << name << std::endl;
+	for (auto it = first; it != last; it++) {
+		const auto bucket = static_cast<size_t>(it - h.counts.begin());
+		const auto bar    = std::string(static_cast<size_t>(40.0 * *it / total), '#');
+		std::cout << std::format("  < {:>8.0f}us {:>8} {}", get_upper_bound_us(bucket), *it, bar) << std::endl;
+	}
+}
+
+} // scuff::bench
@@ -4,13 +4,18 @@
 #include "common-constants.hpp"
 #include "common-device-info.hpp"
 #include "common-events.hpp"
+#include "common-memory-options.hpp"
 #include "common-param-info.hpp"
 #include "common-plugin-type.hpp"
 #include "common-render-mode.hpp"
+#include "common-sample-format.hpp"
 #include "common-types.hpp"
+#include <array>
 #include <chrono>
 #include <functional>
+#include <memory>
 #include <optional>
+#include <span>
 #include <stdexcept>
 #include <string_view>
 #include <vector>
@@ -78,6 +83,105 @@ struct load_device_result {
 
 using bytes = std::vector<std::byte>;
 
+// How often the audio threads of a group received the signal they were
+// waiting for while spinning, versus having to go to sleep.
+struct wait_stats {
+	uint64_t client_spun   = 0; // Waits in audio_process() for the sandboxes to finish.
+	uint64_t client_slept  = 0;
+	uint64_t sandbox_spun  = 0; // Sandbox waits for audio_process() to begin, summed over the group.
+	uint64_t sandbox_slept = 0;
+};
+
+// Counts of durations in power-of-two microsecond buckets. Bucket 0 counts
+// everything under 1us, bucket i counts [2^(i-1), 2^i) us, and the last
+// bucket is open-ended.
+struct duration_histogram {
+	static constexpr auto BUCKETS = size_t{24};
+	std::array<uint64_t, BUCKETS> counts = {};
+};
+
+struct sandbox_finished_last {
+	id::sandbox sbox;
+	uint64_t cycles = 0;
+};
+
+// Telemetry for the audio_process() cycles of a group, accumulated since the
+// group was created. Take the difference between two snapshots to get the
+// figures for the period in between. See get_group_telemetry().
+struct group_telemetry {
+	uint64_t cycles        = 0;
+	uint64_t late_cycles   = 0; // Cycles in which at least one sandbox missed the deadline.
+	uint64_t zeroed_cycles = 0; // Cycles in which the sandboxes didn't respond and zeros were output.
+	duration_histogram cycle_time; // Total time spent in audio_process().
+	duration_histogram wait_time;  // Time spent blocked waiting for the sandboxes to finish.
+	// How many cycles each sandbox in the group was the last one to finish.
+	// A sandbox which is often last, or late, is likely to have a plugin
+	// problem. If the wait time is high but no sandbox stands out, the
+	// problem is more likely to be scheduling.
+	std::vector<sandbox_finished_last> finished_last;
+};
+
+// DSP timing for a device, measured by its sandbox around each call
+// to the plugin's process function. See get_device_stats().
+struct device_stats {
+	uint64_t processed = 0; // Cycles the plugin's process function was called.
+	uint64_t skipped   = 0; // Cycles the device wasn't processed because it isn't active.
+	uint64_t asleep    = 0; // Cycles the device wasn't processed because the plugin is asleep.
+	std::chrono::nanoseconds last    = {};
+	std::chrono::nanoseconds average = {};
+	std::chrono::nanoseconds max     = {};
+};
+
+// Output levels of one audio port of a device, measured by its
+// sandbox after each call to the plugin's process function. One
+// value per channel of the port. See get_device_meters().
+struct port_meter {
+	std::vector<float> peak; // Highest absolute sample since the last call to get_device_meters().
+	std::vector<float> rms;  // Of the last block. Zero if the plugin is asleep.
+};
+
+struct message_type_stats {
+	std::string_view name;
+	uint64_t count = 0;
+	uint64_t bytes = 0; // Serialized size.
+};
+
+// Round-trip times for one kind of callback-based operation,
+// from sending the request to receiving the response.
+struct round_trip_stats {
+	std::string_view name;
+	uint64_t completed = 0;
+	uint64_t pending   = 0; // Requests still waiting for a response.
+	std::chrono::nanoseconds average = {};
+	std::chrono::nanoseconds max     = {};
+};
+
+// Control-plane message traffic between the client and a sandbox,
+// accumulated since the sandbox was created. See get_message_stats().
+struct message_stats {
+	std::vector<message_type_stats> sent;     // Client to sandbox, one entry per message type.
+	std::vector<message_type_stats> received; // Sandbox to client, one entry per message type.
+	size_t send_queue_high_water = 0;         // The most messages there have ever been waiting to be sent.
+	std::vector<round_trip_stats> round_trips;
+};
+
+// How long audio_process() spent in each stage of a cycle.
+// See group_process::timings. In pipelined mode the sandbox stage is the
+// wait for the previous cycle plus signaling the sandboxes for this one.
+struct process_timings {
+	std::chrono::nanoseconds inputs;    // Writing the audio inputs and input events to the device buffers.
+	std::chrono::nanoseconds sandboxes; // Signaling the sandboxes and waiting for them to finish.
+	std::chrono::nanoseconds outputs;   // Reading the audio outputs and output events.
+	bool outputs_used = true;           // False if the sandboxes didn't respond and zeros were output instead.
+};
+
+// What a device outputs for a cycle which its sandbox didn't finish
+// processing before the deadline. See set_deadline().
+enum class late_output {
+	silence,
+	repeat_last_block,
+};
+
 struct input_event {
 	id::device device_id;
 	scuff::event event;
@@ -102,7 +206,9 @@ using on_plugin_scanned                = std::function<auto (id::plugin plugin)
 using on_sbox_crashed                  = std::function<auto (id::sandbox sbox, std::string_view error) -> void>;
 using on_sbox_error                    = std::function<auto (id::sandbox sbox, std::string_view error) -> void>;
 using on_sbox_info                     = std::function<auto (id::sandbox sbox, std::string_view info) -> void>;
+using on_sbox_late                     = std::function<auto (id::sandbox sbox, uint64_t missed) -> void>;
 using on_sbox_started                  = std::function<auto (id::sandbox sbox) -> void>;
+using on_sbox_transfer_progress        = std::function<auto (id::sandbox sbox, uint64_t transferred, uint64_t total) -> void>;
 using on_sbox_warning                  = std::function<auto (id::sandbox sbox, std::string_view warning) -> void>;
 using on_scan_complete                 = std::function<auto () -> void>;
 using on_scan_error                    = std::function<auto (std::string_view error) -> void>;
@@ -115,6 +221,8 @@ using return_double                    = std::function<auto (double value) -> vo
 using return_string                    = std::function<auto (std::string_view text) -> void>;
 using write_audio                      = std::function<auto (float* floats) -> void>;
 using read_audio                       = std::function<auto (const float* floats) -> void>;
+using write_audio64                    = std::function<auto (double* doubles) -> void>;
+using read_audio64                     = std::function<auto (const double* doubles) -> void>;
 using get_input_events_count           = std::function<auto () -> size_t>;
 using pop_input_events                 = std::function<auto (size_t count, scuff::input_event* buffer) -> size_t>;
 using push_output_event                = std::function<auto (const scuff::output_event& event) -> void>;
@@ -123,12 +231,14 @@ struct audio_input {
 	id::device dev_id;
 	size_t port_index;
 	write_audio write_to;
+	write_audio64 write_to64; // Optional. See set_sample_format().
 };
 
 struct audio_output {
 	id::device dev_id;
 	size_t port_index;
 	read_audio read_from;
+	read_audio64 read_from64; // Optional. See set_sample_format().
 };
 
 struct input_events {
@@ -149,6 +259,74 @@ struct group_process {
 	scuff::audio_outputs audio_outputs;
 	scuff::input_events input_events;
 	scuff::output_events output_events;
+	// The number of frames to process. Zero means the max_frames the group was
+	// activated with, and anything higher than that is clamped to it.
+	uint32_t frames = 0;
+	// Optional. If set, the time spent in each stage of the cycle is written here.
+	scuff::process_timings* timings = nullptr;
+};
+
+// A device audio port, for resolve_ports().
+struct port_ref {
+	id::device dev_id;
+	size_t port_index;
+};
+
+// Where the samples of one port are written or read directly. The channels are laid
+// out as described for activate(). Only one of the sample pointers is set, depending
+// on the format the device's sandbox is currently using (see set_sample_format().)
+// Both are null if the port can't be used, in which case channel_count is zero too.
+struct direct_input {
+	float* samples         = nullptr;
+	double* samples64      = nullptr;
+	uint32_t channel_count = 0;
+};
+
+struct direct_output {
+	const float* samples    = nullptr;
+	const double* samples64 = nullptr;
+	uint32_t channel_count  = 0;
+	// Bit N is set if channel N is known to be silent, in which case its samples
+	// are all zeros and don't need to be read. A clear bit means nothing is known.
+	uint64_t silent_mask    = 0;
+};
+
+// Defined by the library.
+struct direct_ports_data;
+
+// The device ports found by resolve_ports(). The pointers in here are updated by
+// each call to audio_process(const direct_process&) and shouldn't be kept anywhere else.
+struct direct_ports {
+	id::group group;
+	// One for each port that was passed to resolve_ports(), in the same order.
+	// Where to write the inputs of the next cycle.
+	std::vector<scuff::direct_input> inputs;
+	// One for each port that was passed to resolve_ports(), in the same order.
+	// Where to read the outputs of the last cycle.
+	std::vector<scuff::direct_output> outputs;
+	std::shared_ptr<scuff::direct_ports_data> data;
+};
+
+struct direct_process {
+	scuff::direct_ports* ports = nullptr;
+	// Written to the devices they are for.
+	std::span<const scuff::input_event> input_events;
+	// Filled with the output events of the cycle. Any which don't fit are dropped.
+	std::span<scuff::output_event> output_events;
+	// See group_process::frames.
+	uint32_t frames = 0;
+	// See group_process::timings.
+	scuff::process_timings* timings = nullptr;
+};
+
+struct direct_result {
+	size_t output_event_count    = 0; // How much of direct_process::output_events was filled.
+	size_t output_events_dropped = 0;
+	// True if any of the ports couldn't be used, because something they were
+	// resolved against has changed since, or because the group was activated
+	// with a new block size and the device's buffers haven't been moved to fit
+	// it yet. Call resolve_ports() again.
+	bool stale = false;
 };
 
 struct general_ui {
@@ -173,7 +351,9 @@ struct group_ui {
 	scuff::on_sbox_crashed on_sbox_crashed;
 	scuff::on_sbox_error on_sbox_error;
 	scuff::on_sbox_info on_sbox_info;
+	scuff::on_sbox_late on_sbox_late;
 	scuff::on_sbox_started on_sbox_started;
+	scuff::on_sbox_transfer_progress on_sbox_transfer_progress;
 	scuff::on_sbox_warning on_sbox_warning;
 };
 
@@ -184,6 +364,16 @@ struct group_ui {
 // Process the sandbox group. This is safe to call in a realtime thread.
 auto audio_process(const group_process& process) -> void;
 
+// Process the sandbox group, reading and writing the device ports through the
+// pointers in process.ports instead of calling anything for them. This is safe
+// to call in a realtime thread.
+//  - Write the inputs for the cycle through process.ports->inputs before calling
+//    this, and read its outputs through process.ports->outputs afterwards.
+//  - The input pointers are for the next call to this one, so don't call the other
+//    audio_process() for the same group in between.
+[[nodiscard]]
+auto audio_process(const direct_process& process) -> direct_result;
+
 /////////////////////////////////////////////////////////////////////////////////////////
 // The rest of these functions are thread-safe, but NOT necessarily realtime-safe.
 // 
@@ -216,17 +406,40 @@ auto ui_update(const general_ui& ui) -> void;
 auto ui_update(scuff::id::group group, const group_ui& ui) -> void;
 
 // Activate audio processing for the sandbox group.
-auto activate(id::group group, double sr) -> void;
+//  - max_frames is the largest number of frames that will be passed to audio_process(),
+//    up to scuff::MAX_VECTOR_SIZE. Each call can process fewer frames than this.
+//  - The audio buffers passed to the write_to and read_from callbacks hold
+//    the channels of the port (see get_port_info()) with max_frames frames each,
+//    one after another.
+//    Only the first group_process::frames frames of each channel are used.
+//    The 64-bit callbacks are laid out the same way.
+//  - Calling this again with a different max_frames reactivates the plugins.
+auto activate(id::group group, double sr, uint32_t max_frames = VECTOR_SIZE) -> void;
 
 // Deactivate audio processing for the sandbox group.
 auto deactivate(id::group group) -> void;
 
+// Cancel any large transfers (e.g. device states) which are in progress
+// between the client and the sandbox process.
+// - Messages which are big enough are streamed through a separate shared memory
+//   segment instead of the normal message buffers. Their progress is reported
+//   through group_ui::on_sbox_transfer_progress.
+// - Whatever was waiting on a cancelled message is failed straight away: a cancelled
+//   load reports failure and a cancelled save returns no bytes.
+auto cancel_transfers(id::sandbox sbox) -> void;
+
 // Close all editor windows.
 auto close_all_editors(void) -> void;
 
 // Connect the audio output of one device to the audio input of another device.
 //  - The devices don't have to belong to the same sandbox - the connections are allowed
 //    to cross from one sandbox to another, within the same sandbox group.
+//  - A connection between two sandboxes delays the audio by one block. If the output
+//    device's sandbox misses the group's deadline, the input device receives silence for
+//    that block.
+//  - Any number of outputs can be connected to the same input, in which case the input
+//    receives their sum. An input which has anything connected to it ignores the audio
+//    passed to it by audio_process().
 auto connect(id::device dev_out, size_t port_out, id::device dev_in, size_t port_in) -> void;
 
 // Create a device and add it to the sandbox, synchronously.
@@ -258,8 +471,12 @@ auto create_group(void* parent_window_handle) -> id::group;
 // Create a new sandbox.
 // - Every sandbox has to belong to a group.
 // - Data can travel between sandboxes in the same group.
+// - msg_buffer_size is the capacity in bytes of each of the two message
+//   buffers between the client and the sandbox. Messages are streamed
+//   through them in chunks so a bigger buffer only means fewer round
+//   trips for bursts of messages.
 [[nodiscard]]
-auto create_sandbox(id::group group, std::string_view sbox_exe_path) -> id::sandbox;
+auto create_sandbox(id::group group, std::string_view sbox_exe_path, size_t msg_buffer_size = MSG_BUFFER_SIZE) -> id::sandbox;
 
 // Remove the given connection between two devices.
 auto disconnect(id::device dev_out, size_t port_out, id::device dev_in, size_t port_in) -> void;
@@ -321,6 +538,23 @@ auto get_category(id::plugin plugin) -> std::string_view;
 [[nodiscard]]
 auto get_devices(id::sandbox sbox) -> std::vector<id::device>;
 
+// Return the DSP timing counters for the device.
+// - These are read directly from shared memory so this doesn't involve a
+//   round-trip to the sandbox process, and can be called at a high rate to
+//   drive a CPU meter.
+// - The counters accumulate from when the device was created.
+[[nodiscard]]
+auto get_device_stats(id::device dev) -> device_stats;
+
+// Return the output levels of the device, one for each audio output port.
+// - These are read directly from shared memory so this doesn't involve a
+//   round-trip to the sandbox process or the audio thread, and can be called
+//   at a high rate to drive level meters.
+// - Reading the peaks resets them, so there should only be one caller for
+//   each device.
+[[nodiscard]]
+auto get_device_meters(id::device dev) -> std::vector<port_meter>;
+
 // If the device failed to load successfully, return the error string.
 [[nodiscard]]
 auto get_error(id::device dev) -> std::string_view;
@@ -338,6 +572,8 @@ auto get_error(id::plugin plugin) -> std::string_view;
 auto get_ext_id(id::plugin plugin) -> ext::id::plugin;
 
 // Return device port info.
+// - This includes the number of channels of each audio port, which is
+//   whatever the plugin asked for.
 [[nodiscard]]
 auto get_port_info(id::device dev) -> device_port_info;
 
@@ -416,6 +652,23 @@ auto get_value_text(id::device dev, idx::param param, double value) -> std::stri
 //  - When it is ready, call the given function with it, on the next call to ui_update(group).
 auto get_value_text_async(id::device dev, idx::param param, double value, return_string fn) -> void;
 
+// Return the control-plane message metrics for the sandbox.
+// - Use this to find out which kind of message is the bottleneck when
+//   operations such as loading a project are slow.
+[[nodiscard]]
+auto get_message_stats(id::sandbox sbox) -> message_stats;
+
+// Return the cycle telemetry for the group.
+// - This reads counters which the audio thread updates without locking, so it
+//   can be called from any thread at any rate.
+[[nodiscard]]
+auto get_group_telemetry(id::group group) -> group_telemetry;
+
+// Return counts of how the audio thread waits in the group were satisfied.
+// See set_spin_time().
+[[nodiscard]]
+auto get_wait_stats(id::group group) -> wait_stats;
+
 // Return a list of plugins which at least appear to be working
 // (they did not fail to load during plugin scanning.)
 [[nodiscard]]
@@ -475,16 +728,28 @@ auto panic() -> void;
 // Push a device event
 auto push_event(id::device dev, const scuff::event& event) -> void;
 
+// Find the device ports which audio_process(const direct_process&) will read and write.
+//  - Call this again after changing the devices of the group. audio_process() also
+//    reports when this has to be called again, e.g. because a plugin changed its ports
+//    or a sandbox crashed, and until then the ports affected are unusable.
+//  - Ports which don't exist yet, e.g. because the device is still being created,
+//    are found but unusable.
+//  - Throws if a device doesn't belong to the group.
+[[nodiscard]]
+auto resolve_ports(id::group group, std::span<const port_ref> inputs, std::span<const port_ref> outputs) -> direct_ports;
+
 // Restart the sandbox.
 auto restart(id::sandbox sbox, std::string_view sbox_exe_path) -> void;
 
 // Save the device state.
+//  - Throws if the state couldn't be saved or the transfer was cancelled.
 [[nodiscard]]
 auto save(id::device dev) -> scuff::bytes;
 
 // Save the device state, asynchronously.
 //  - When the operation is complete, call the given function with the result,
 //    on the next call to ui_update(group).
+//  - The bytes are empty if the state couldn't be saved or the transfer was cancelled.
 auto save_async(id::device dev, return_bytes fn) -> void;
 
 // Scan the system for plugins. If the scanner process is already
@@ -501,17 +766,81 @@ auto set_autosave_callback(id::device dev, return_bytes bytes) -> void;
 // The default autosave interval in milliseconds is scuff::DEFAULT_AUTOSAVE_MS.
 auto set_autosave_interval(id::device dev, std::chrono::steady_clock::duration interval) -> void;
 
+// Set a processing deadline for the group, as a fraction of the period of each block.
+// - audio_process() will stop waiting for the sandboxes once the deadline has passed.
+// - Devices in sandboxes which missed the deadline output either silence or their
+//   last good block, and don't receive any new input until they have caught up.
+// - Missed deadlines are reported through group_ui::on_sbox_late.
+// - A fraction of zero (the default) means wait for the sandboxes indefinitely.
+auto set_deadline(id::group group, double fraction, late_output output) -> void;
+
+// Set what is done with the memory which the audio threads of the group touch, to keep
+// them from page faulting. See memory_options.
+// - This applies to the shared memory of the group and its sandboxes and devices, in the
+//   client and in the sandbox processes, and to the stacks of the sandbox audio threads.
+// - The stacks are prepared when the sandbox audio threads start, so a change only
+//   reaches them the next time the group is activated.
+// - Anything which couldn't be done is reported through group_ui::on_sbox_warning.
+//   Locking memory usually needs a raised limit (RLIMIT_MEMLOCK on Linux.)
+// - Everything is disabled by default.
+auto set_memory_options(id::group group, const memory_options& options) -> void;
+
+// Enable or disable pipelined processing for the group.
+// - In pipelined mode, audio_process() writes the inputs for the current block and
+//   starts processing it, then returns the outputs of the previous block without
+//   waiting for the sandboxes to finish.
+// - This adds one block of latency to every device in the group, which is not
+//   included in get_latency().
+// - Processing deadlines (see set_deadline()) don't apply in pipelined mode.
+// - Pipelined mode is disabled by default.
+auto set_pipelined(id::group group, bool pipelined) -> void;
+
 // Set the render mode for the given group.
 auto set_render_mode(id::group group, render_mode mode) -> void;
 
+// Set the sample format the devices in the group process audio in.
+// - float64 is meant for offline rendering. Plugins which support 64-bit processing
+//   are given 64-bit buffers, and the audio passed between devices stays 64-bit, even
+//   between sandboxes.
+// - Plugins which don't support it are processed in 32-bit, and the audio is converted
+//   at their ports.
+// - In a float64 group the write_to64 and read_from64 callbacks of audio_process() are
+//   used if they are set. Otherwise write_to and read_from are used, and the audio is
+//   converted.
+// - Changing the format reactivates the plugins. The default is float32.
+auto set_sample_format(id::group group, sample_format format) -> void;
+
+// Set how long the audio threads in the group should spin before going to sleep,
+// when the client is waiting for the sandboxes to finish processing and when the
+// sandboxes are waiting for the next call to audio_process().
+// - Spinning can reduce wake-up latency at the cost of burning CPU time.
+// - The default is zero, meaning audio threads go straight to sleep.
+auto set_spin_time(id::group group, std::chrono::microseconds spin) -> void;
+
 // Associate a track color with the device.
 auto set_track_color(id::device dev, std::optional<rgba32> color) -> void;
 
 // Associate a track name with the device.
 auto set_track_name(id::device dev, std::string_view name) -> void;
 
+// Enable or disable timeline tracing.
+// - While tracing is enabled, the client's audio and poll threads and the audio
+//   and main threads of every sandbox record when each stage of their work begins
+//   and ends, including each call to a plugin's process function.
+// - Enabling tracing discards anything recorded previously.
+// - Tracing is disabled by default.
+// - See write_trace().
+auto set_tracing(bool enabled) -> void;
+
 // Return true if the device was created successfully.
 [[nodiscard]]
 auto was_created_successfully(id::device dev) -> bool;
 
+// Write everything recorded since tracing was enabled to a file in the Chrome trace
+// event format, which can be opened in Perfetto (https://ui.perfetto.dev) or
+// chrome://tracing. See set_tracing().
+// - Records reach the client on the poll thread so the last few milliseconds of
+//   activity may be missing.
+auto write_trace(std::string_view path) -> void;
+
 } // scuff
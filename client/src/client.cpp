@@ -5,12 +5,15 @@
 #include "common-visit.hpp"
 #include "managed.hpp"
 #include "scan.hpp"
+#include "trace.hpp"
+#include <bit>
 #include <clap/plugin-features.h>
 #include <fulog.hpp>
 #include <mutex>
 #include <readerwriterqueue.h>
 #include <source_location>
 #include <string>
+#include <tuple>
 #include <variant>
 
 #define SCUFF_EXCEPTION_WRAPPER \
@@ -26,10 +29,12 @@ using poll_t = ez::nort_t;
 static constexpr auto poll = poll_t{};
 
 [[nodiscard]] static
-auto make_sbox_exe_args(std::string_view pid, std::string_view group_id, std::string_view sandbox_id, uint64_t parent_window) -> std::vector<std::string> {
+auto make_sbox_exe_args(std::string_view pid, std::string_view doorbell_id, std::string_view group_id, std::string_view sandbox_id, uint64_t parent_window) -> std::vector<std::string> {
 	std::vector<std::string> args;
 	args.push_back("--pid");
 	args.push_back(std::string{pid});
+	args.push_back("--doorbell");
+	args.push_back(std::string{doorbell_id});
 	args.push_back("--group");
 	args.push_back(std::string{group_id});
 	args.push_back("--sandbox");
@@ -39,103 +44,512 @@ auto make_sbox_exe_args(std::string_view pid, std::string_view group_id, std::st
 	return args;
 }
 
+[[nodiscard]] static
+auto get_signaler(const sandbox& sbox) -> signaling::clientside_sandbox {
+	return {&sbox.service->shm.signaling, &sbox.service->shm.data->signaling};
+}
+
+[[nodiscard]] static
+// Deadlines don't apply in pipelined mode.
+auto has_deadline(const scuff::group& group) -> bool {
+	return group.deadline > 0.0 && group.sample_rate > 0.0 && !group.pipelined;
+}
+
+[[nodiscard]] static
+// Returns true if the sandbox missed a deadline and is still processing.
+// Its buffers mustn't be touched until it catches up.
+auto is_late(const scuff::group& group, const sandbox& sbox) -> bool {
+	return has_deadline(group) && signaling::is_busy(get_signaler(sbox));
+}
+
+[[nodiscard]] static
+auto is_late(const scuff::model& m, const scuff::group& group, const device& dev) -> bool {
+	return is_late(group, m.sandboxes.at(dev.sbox));
+}
+
+[[nodiscard]] static
+// Returns true if the sandbox has no output for the current cycle. Either it
+// missed the deadline, or it was skipped when the cycle began because it was
+// still busy with an earlier one.
+auto missed_cycle(const scuff::group& group, const sandbox& sbox) -> bool {
+	const auto signaler = get_signaler(sbox);
+	return has_deadline(group) && (signaling::is_busy(signaler) || signaler.shm->cycle.load(std::memory_order_relaxed) != group.service->signaler.local->cycle);
+}
+
+[[nodiscard]] static
+auto missed_cycle(const scuff::model& m, const scuff::group& group, const device& dev) -> bool {
+	return missed_cycle(group, m.sandboxes.at(dev.sbox));
+}
+
+[[nodiscard]] static
+// A device's ports only have room for the max_frames its segment was laid out
+// for. When the group is activated with a different one they can't be used
+// until the sandbox has moved the device to a new segment.
+auto ports_fit(const scuff::group& group, const device_ports& ports) -> bool {
+	return ports.shm.data->max_frames == group.max_frames;
+}
+
+static
+// 64-bit ports are written directly by write_to64 if it was given,
+// otherwise what write_to writes is converted.
+auto write_audio_input(ez::audio_t, const scuff::group& group, const scuff::audio_input& input, const shm::audio_port& port) -> void {
+	if (const auto samples = shm::get_samples<float>(port)) {
+		input.write_to(samples);
+		return;
+	}
+	const auto samples64 = shm::get_samples<double>(port);
+	if (input.write_to64) {
+		input.write_to64(samples64);
+		return;
+	}
+	const auto floats = group.service->conversion_buffer.data();
+	input.write_to(floats);
+	std::copy_n(floats, size_t{port.channel_count} * group.max_frames, samples64);
+}
+
 static
-auto write_audio_input(ez::audio_t, const scuff::model& m, const scuff::audio_input& input) -> void {
+auto write_audio_input(ez::audio_t, const scuff::model& m, const scuff::group& group, const scuff::audio_input& input, size_t buffer) -> void {
 	if (const auto dev = m.devices.find(input.dev_id)) {
-		if (dev->flags.value & client_device_flags::has_remote) {
-			auto& buffer   = dev->service->shm.data->audio_in[input.port_index];
-			input.write_to(buffer.data());
+		if (dev->flags.value & client_device_flags::has_remote && ports_fit(group, *dev->ports) && !is_late(m, group, *dev)) {
+			auto& audio_in = dev->ports->shm.data->buffers[buffer].audio_in;
+			if (input.port_index >= audio_in.size()) {
+				return;
+			}
+			auto& port = audio_in[input.port_index];
+			write_audio_input(ez::audio, group, input, port);
+			// We don't know anything about what was written.
+			port.flags = {};
 		}
 	}
 }
 
 static
-auto write_audio_inputs(ez::audio_t, const scuff::model& m, const scuff::audio_inputs& inputs) -> void {
+auto write_audio_inputs(ez::audio_t, const scuff::model& m, const scuff::group& group, const scuff::audio_inputs& inputs, size_t buffer) -> void {
 	for (const auto& input : inputs) {
-		write_audio_input(ez::audio, m, input);
+		write_audio_input(ez::audio, m, group, input, buffer);
+	}
+}
+
+static
+// Events for a device whose event buffer is already full are dropped.
+auto write_input_events(ez::audio_t, const scuff::model& m, const scuff::group& group, std::span<const scuff::input_event> events, size_t buffer) -> void {
+	for (const auto& event : events) {
+		if (const auto dev = m.devices.find(event.device_id)) {
+			if (is_late(m, group, *dev)) {
+				// Dropped. The sandbox may still be reading its input events.
+				continue;
+			}
+			if (dev->ports) {
+				auto& events_in = dev->ports->shm.data->buffers[buffer].events_in;
+				if (events_in.size() < events_in.capacity()) {
+					events_in.push_back(event.event);
+				}
+			}
+		}
 	}
 }
 
 static
-auto write_input_events(ez::audio_t, const scuff::model& m, const scuff::input_events& input_events) -> void {
+auto write_input_events(ez::audio_t, const scuff::model& m, const scuff::group& group, const scuff::input_events& input_events, size_t buffer) -> void {
 	bc::static_vector<scuff::input_event, EVENT_PORT_SIZE> event_buffer;
 	event_buffer.resize(input_events.count());
 	const auto events_to_pop = std::min(size_t(EVENT_PORT_SIZE), event_buffer.size());
 	const auto events_popped = input_events.pop(events_to_pop, event_buffer.data());
 	event_buffer.resize(events_popped);
-	for (const auto& event : event_buffer) {
-		if (const auto dev = m.devices.find(event.device_id)) {
-			dev->service->shm.data->events_in.push_back(event.event);
-		}
+	write_input_events(ez::audio, m, group, {event_buffer.data(), event_buffer.size()}, buffer);
+}
+
+static
+auto process_inputs(ez::audio_t, const scuff::model& m, const scuff::group& group, const group_process& process, uint32_t frames, size_t buffer) -> void {
+	// The sandboxes read this once they are signaled.
+	group.service->shm.data->frames[buffer].store(frames, std::memory_order_relaxed);
+	write_audio_inputs(ez::audio, m, group, process.audio_inputs, buffer);
+	write_input_events(ez::audio, m, group, process.input_events, buffer);
+}
+
+[[nodiscard]] static
+// Enough silence for any port.
+auto get_zeros() -> const float* {
+	static float zeros[MAX_CHANNELS * MAX_VECTOR_SIZE] = {};
+	return zeros;
+}
+
+[[nodiscard]] static
+auto get_zeros64() -> const double* {
+	static double zeros[MAX_CHANNELS * MAX_VECTOR_SIZE] = {};
+	return zeros;
+}
+
+static
+auto read_from(ez::audio_t, const scuff::group& group, const audio_output& output, const float* samples, size_t count) -> void {
+	output.read_from(samples);
+}
+
+static
+// Passed to read_from64 if it was given, otherwise converted for read_from.
+auto read_from(ez::audio_t, const scuff::group& group, const audio_output& output, const double* samples, size_t count) -> void {
+	if (output.read_from64) {
+		output.read_from64(samples);
+		return;
 	}
+	const auto floats = group.service->conversion_buffer.data();
+	std::transform(samples, samples + count, floats, [](double x) { return static_cast<float>(x); });
+	output.read_from(floats);
 }
 
 static
-auto process_inputs(ez::audio_t, const scuff::model& m, const scuff::audio_inputs& audio_inputs, const scuff::input_events& input_events) -> void {
-	write_audio_inputs(ez::audio, m, audio_inputs);
-	write_input_events(ez::audio, m, input_events);
+auto read_zeros(ez::audio_t, const scuff::group& group, const audio_output& output) -> void {
+	if (group.sample_format == sample_format::float64 && output.read_from64) {
+		output.read_from64(get_zeros64());
+		return;
+	}
+	output.read_from(get_zeros());
 }
 
 static
-auto read_audio_output(ez::audio_t, const scuff::model& m, const audio_output& output) -> void {
-	if (const auto dev = m.devices.find(output.dev_id)) {
-		if (dev->flags.value & client_device_flags::has_remote) {
-			const auto& buffer = dev->service->shm.data->audio_out[output.port_index];
-			output.read_from(buffer.data());
-		}
+// Called in place of reading the device's output for a cycle its sandbox missed.
+auto read_late_audio_output(ez::audio_t, const scuff::group& group, const audio_output& output, const device_ports& ports, size_t count) -> void {
+	if (group.late_output != late_output::repeat_last_block) {
+		read_zeros(ez::audio, group, output);
+		return;
+	}
+	if (ports.shm.data->format == sample_format::float64) {
+		read_from(ez::audio, group, output, ports.last_good_audio_out64[output.port_index].data(), count);
+		return;
+	}
+	read_from(ez::audio, group, output, ports.last_good_audio_out[output.port_index].data(), count);
+}
+
+static
+auto read_audio_output(ez::audio_t, const scuff::model& m, const scuff::group& group, const audio_output& output, size_t buffer) -> void {
+	const auto dev = m.devices.find(output.dev_id);
+	if (!dev || !(dev->flags.value & client_device_flags::has_remote)) {
+		return;
+	}
+	const auto& audio_out = dev->ports->shm.data->buffers[buffer].audio_out;
+	if (output.port_index >= audio_out.size() || !ports_fit(group, *dev->ports)) {
+		read_zeros(ez::audio, group, output);
+		return;
 	}
+	const auto& port = audio_out[output.port_index];
+	const auto count = size_t{port.channel_count} * group.max_frames;
+	if (missed_cycle(m, group, *dev)) {
+		read_late_audio_output(ez::audio, group, output, *dev->ports, count);
+		return;
+	}
+	if (const auto samples = shm::get_samples<float>(port)) {
+		read_from(ez::audio, group, output, samples, count);
+		return;
+	}
+	read_from(ez::audio, group, output, shm::get_samples<double>(port), count);
 }
 
 static
-auto read_audio_outputs(ez::audio_t, const scuff::model& m, const audio_outputs& output) -> void {
+auto read_audio_outputs(ez::audio_t, const scuff::model& m, const scuff::group& group, const audio_outputs& output, size_t buffer) -> void {
 	for (const auto& output : output) {
-		read_audio_output(ez::audio, m, output);
+		read_audio_output(ez::audio, m, group, output, buffer);
 	}
 }
 
 static
-auto read_zeros(ez::audio_t, const scuff::model& m, const audio_outputs& outputs) -> void {
-	std::array<float, CHANNEL_COUNT * VECTOR_SIZE> zeros = {0.0f};
+auto read_zeros(ez::audio_t, const scuff::group& group, const audio_outputs& outputs) -> void {
 	for (const auto& output : outputs) {
-		output.read_from(zeros.data());
+		read_zeros(ez::audio, group, output);
 	}
 }
 
-static
-auto read_output_events(ez::audio_t, const scuff::model& m, const scuff::group& group, const output_events& output_events) -> void {
+template <typename Fn> static
+// Pass each output event of the cycle to fn, then clear them.
+auto read_output_events(ez::audio_t, const scuff::model& m, const scuff::group& group, size_t buffer, Fn&& fn) -> void {
 	for (const auto sbox_id : group.sandboxes) {
 		const auto& sbox = m.sandboxes.at(sbox_id);
+		if (is_late(group, sbox)) {
+			// The sandbox is still writing its output events.
+			continue;
+		}
 		for (const auto dev_id : sbox.devices) {
 			const auto& dev = m.devices.at(dev_id);
 			if (dev.flags.value & client_device_flags::has_remote) {
-				auto& buffer = dev.service->shm.data->events_out;
-				for (const auto& event : buffer) {
-					output_events.push({dev_id, event});
+				auto& events_out = dev.ports->shm.data->buffers[buffer].events_out;
+				for (const auto& event : events_out) {
+					fn(scuff::output_event{dev_id, event});
 				}
-				buffer.clear();
+				events_out.clear();
 			}
 		}
 	}
 }
 
 static
-auto process_cross_sbox_connections(ez::audio_t, const scuff::model& m, const scuff::group& group) -> void {
-	for (const auto& conn : group.cross_sbox_conns) {
-		const auto& dev_out = m.devices.at(conn.out_dev_id);
-		const auto& dev_in  = m.devices.at(conn.in_dev_id);
-		if ((dev_out.flags.value & dev_in.flags.value) & client_device_flags::has_remote) {
-			const auto& out_buf = dev_out.service->shm.data->audio_out[conn.out_port];
-			auto& in_buf        = dev_in.service->shm.data->audio_in[conn.in_port];
-			std::copy(out_buf.begin(), out_buf.end(), in_buf.begin());
+auto read_output_events(ez::audio_t, const scuff::model& m, const scuff::group& group, const output_events& output_events, size_t buffer) -> void {
+	read_output_events(ez::audio, m, group, buffer, [&output_events](const scuff::output_event& event) {
+		output_events.push(event);
+	});
+}
+
+static
+// When a sandbox misses the deadline, the outputs of its devices are replaced
+// by what they output in the previous cycle. The sandbox won't write to those
+// buffers again until it is given another cycle, so they are only copied when
+// the sandbox first becomes late. Called before the outputs are read.
+auto save_last_good_audio_outputs(ez::audio_t, const scuff::model& m, const scuff::group& group) -> void {
+	if (!has_deadline(group) || group.late_output != late_output::repeat_last_block) {
+		return;
+	}
+	const auto cycle       = group.service->signaler.local->cycle;
+	const auto prev_buffer = signaling::get_buffer_index(cycle - 1);
+	for (const auto sbox_id : group.sandboxes) {
+		const auto& sbox = m.sandboxes.at(sbox_id);
+		if (!missed_cycle(group, sbox)) {
+			continue;
+		}
+		if (std::exchange(sbox.service->late_cycle, cycle) == cycle - 1) {
+			// Still late from the previous cycle, which was already saved.
+			continue;
+		}
+		for (const auto dev_id : sbox.devices) {
+			const auto& dev = m.devices.at(dev_id);
+			if (dev.flags.value & client_device_flags::has_remote && ports_fit(group, *dev.ports)) {
+				const auto& audio_out = dev.ports->shm.data->buffers[prev_buffer].audio_out;
+				for (size_t i = 0; i < audio_out.size(); i++) {
+					const auto count = size_t{group.max_frames} * audio_out[i].channel_count;
+					if (audio_out[i].samples64) { std::copy_n(audio_out[i].samples64.get(), count, dev.ports->last_good_audio_out64[i].data()); }
+					else                        { std::copy_n(audio_out[i].samples.get(), count, dev.ports->last_good_audio_out[i].data()); }
+				}
+			}
 		}
 	}
 }
 
 static
-auto process_outputs(ez::audio_t, const scuff::model& m, const scuff::group& group, const scuff::audio_outputs& audio_outputs, const scuff::output_events& output_events) -> void {
-	read_audio_outputs(ez::audio, m, audio_outputs);
-	read_output_events(ez::audio, m, group, output_events);
-	process_cross_sbox_connections(ez::audio, m, group);
+auto process_outputs(ez::audio_t, const scuff::model& m, const scuff::group& group, const group_process& process, size_t buffer) -> void {
+	save_last_good_audio_outputs(ez::audio, m, group);
+	read_audio_outputs(ez::audio, m, group, process.audio_outputs, buffer);
+	read_output_events(ez::audio, m, group, process.output_events, buffer);
+}
+
+static
+auto read_zeros(ez::audio_t, const scuff::group& group, const group_process& process) -> void {
+	read_zeros(ez::audio, group, process.audio_outputs);
+}
+
+// audio_process(const direct_process&) reads and writes the device buffers through
+// the pointers it gives the host, so all that has to be done here is keep them
+// pointing at the right buffers. The devices are only looked up again if something
+// which the ports were resolved against might have changed.
+
+[[nodiscard]] static
+// Checked once per cycle, so that the ports of a direct_ports
+// only have to be looked at individually when a sandbox is late.
+auto any_late(const scuff::model& m, const scuff::group& group) -> bool {
+	if (!has_deadline(group)) {
+		return false;
+	}
+	for (const auto sbox_id : group.sandboxes) {
+		if (is_late(group, m.sandboxes.at(sbox_id))) {
+			return true;
+		}
+	}
+	return false;
+}
+
+[[nodiscard]] static
+auto any_missed_cycle(const scuff::model& m, const scuff::group& group) -> bool {
+	if (!has_deadline(group)) {
+		return false;
+	}
+	for (const auto sbox_id : group.sandboxes) {
+		if (missed_cycle(group, m.sandboxes.at(sbox_id))) {
+			return true;
+		}
+	}
+	return false;
+}
+
+[[nodiscard]] static
+auto make_direct_input(const direct_port& port, float* samples, double* samples64) -> direct_input {
+	direct_input in;
+	in.samples       = samples;
+	in.samples64     = samples64;
+	in.channel_count = port.channel_count;
+	return in;
+}
+
+[[nodiscard]] static
+auto make_direct_output(const direct_port& port, const float* samples, const double* samples64, uint64_t silent_mask) -> direct_output {
+	direct_output out;
+	out.samples       = samples;
+	out.samples64     = samples64;
+	out.channel_count = port.channel_count;
+	out.silent_mask   = silent_mask & shm::get_channels_mask(port.channel_count);
+	return out;
+}
+
+[[nodiscard]] static
+auto get_scratch_input(direct_port* port) -> direct_input {
+	const auto samples   = port->scratch.empty() ? nullptr : port->scratch.data();
+	const auto samples64 = port->scratch64.empty() ? nullptr : port->scratch64.data();
+	return make_direct_input(*port, samples, samples64);
+}
+
+[[nodiscard]] static
+auto get_zeros_output(const direct_port& port) -> direct_output {
+	if (port.ports->shm.data->format == sample_format::float64) {
+		return make_direct_output(port, nullptr, get_zeros64(), shm::SILENT_BUFFER.silent_mask);
+	}
+	return make_direct_output(port, get_zeros(), nullptr, shm::SILENT_BUFFER.silent_mask);
+}
+
+[[nodiscard]] static
+// Given in place of the device's output for a cycle its sandbox missed.
+auto get_late_output(const scuff::group& group, const direct_port& port) -> direct_output {
+	if (group.late_output != late_output::repeat_last_block) {
+		return get_zeros_output(port);
+	}
+	if (port.ports->shm.data->format == sample_format::float64) {
+		return make_direct_output(port, nullptr, port.ports->last_good_audio_out64[port.port_index].data(), 0);
+	}
+	return make_direct_output(port, port.ports->last_good_audio_out[port.port_index].data(), nullptr, 0);
+}
+
+static
+// The host has already written the inputs, unless they had to go somewhere else
+// because the device's buffers weren't available at the time.
+auto write_audio_inputs(ez::audio_t, const scuff::model& m, const scuff::group& group, direct_ports_data* data, size_t buffer) -> void {
+	const auto late = any_late(m, group);
+	for (auto& port : data->inputs) {
+		if (!port.usable) {
+			continue;
+		}
+		if (late && is_late(group, m.sandboxes.at(port.sbox))) {
+			// Dropped. The sandbox may still be reading its inputs.
+			continue;
+		}
+		auto& shm_port = port.ports->shm.data->buffers[buffer].audio_in[port.port_index];
+		if (port.in_scratch) {
+			if (const auto samples = shm::get_samples<float>(shm_port)) { std::copy(port.scratch.begin(), port.scratch.end(), samples); }
+			else                                                         { std::copy(port.scratch64.begin(), port.scratch64.end(), shm::get_samples<double>(shm_port)); }
+		}
+		// We don't know anything about what was written.
+		shm_port.flags = {};
+	}
+}
+
+static
+auto process_inputs(ez::audio_t, const scuff::model& m, const scuff::group& group, const direct_process& process, uint32_t frames, size_t buffer) -> void {
+	// The sandboxes read this once they are signaled.
+	group.service->shm.data->frames[buffer].store(frames, std::memory_order_relaxed);
+	write_audio_inputs(ez::audio, m, group, process.ports->data.get(), buffer);
+	write_input_events(ez::audio, m, group, process.input_events, buffer);
+}
+
+static
+auto read_audio_outputs(ez::audio_t, const scuff::model& m, const scuff::group& group, direct_ports* ports, size_t buffer) -> void {
+	const auto& data  = *ports->data;
+	const auto missed = any_missed_cycle(m, group);
+	for (size_t i = 0; i < data.outputs.size(); i++) {
+		const auto& port = data.outputs[i];
+		if (!port.usable) {
+			ports->outputs[i] = {};
+			continue;
+		}
+		if (missed && missed_cycle(group, m.sandboxes.at(port.sbox))) {
+			ports->outputs[i] = get_late_output(group, port);
+			continue;
+		}
+		const auto& shm_port = port.ports->shm.data->buffers[buffer].audio_out[port.port_index];
+		ports->outputs[i] = make_direct_output(port, shm::get_samples<float>(shm_port), shm::get_samples<double>(shm_port), shm_port.flags.silent_mask);
+	}
+}
+
+static
+auto read_output_events(ez::audio_t, const scuff::model& m, const scuff::group& group, std::span<scuff::output_event> output_events, size_t buffer, direct_result* result) -> void {
+	read_output_events(ez::audio, m, group, buffer, [output_events, result](const scuff::output_event& event) {
+		if (result->output_event_count < output_events.size()) { output_events[result->output_event_count++] = event; }
+		else                                                   { result->output_events_dropped++; }
+	});
+}
+
+static
+auto process_outputs(ez::audio_t, const scuff::model& m, const scuff::group& group, const direct_process& process, size_t buffer) -> void {
+	save_last_good_audio_outputs(ez::audio, m, group);
+	read_audio_outputs(ez::audio, m, group, process.ports, buffer);
+	read_output_events(ez::audio, m, group, process.output_events, buffer, &process.ports->data->result);
+}
+
+static
+auto read_zeros(ez::audio_t, const scuff::group& group, const direct_process& process) -> void {
+	const auto& data = *process.ports->data;
+	for (size_t i = 0; i < data.outputs.size(); i++) {
+		const auto& port = data.outputs[i];
+		process.ports->outputs[i] = port.usable ? get_zeros_output(port) : direct_output{};
+	}
+}
+
+static
+// Point each input at where the host should write it for the next cycle.
+auto point_inputs(ez::audio_t, const scuff::model& m, const scuff::group& group, direct_ports* ports) -> void {
+	auto& data        = *ports->data;
+	const auto buffer = signaling::get_buffer_index(signaling::get_next_cycle(group.service->signaler));
+	const auto late   = any_late(m, group);
+	for (size_t i = 0; i < data.inputs.size(); i++) {
+		auto& port = data.inputs[i];
+		if (!port.usable) {
+			ports->inputs[i] = {};
+			continue;
+		}
+		// If the sandbox is still busy it might not be finished with
+		// that set of buffers by the time the host writes to it.
+		port.in_scratch = late && is_late(group, m.sandboxes.at(port.sbox));
+		if (port.in_scratch) {
+			ports->inputs[i] = get_scratch_input(&port);
+			continue;
+		}
+		const auto& shm_port = port.ports->shm.data->buffers[buffer].audio_in[port.port_index];
+		ports->inputs[i] = make_direct_input(port, shm::get_samples<float>(shm_port), shm::get_samples<double>(shm_port));
+	}
+}
+
+static
+// Any port which no longer matches its device becomes unusable until the
+// host resolves the ports again.
+auto check_ports(ez::audio_t, const scuff::model& m, const scuff::group& group, direct_ports_data* data) -> void {
+	const auto check = [&m, &group, data](direct_port* port) {
+		if (!port->usable) {
+			return;
+		}
+		const auto dev = m.devices.find(port->dev_id);
+		port->usable = dev && (dev->flags.value & client_device_flags::has_remote) && dev->ports == port->ports && group.max_frames == data->max_frames && ports_fit(group, *dev->ports);
+		data->stale  = data->stale || !port->usable;
+	};
+	for (auto& port : data->inputs)  { check(&port); }
+	for (auto& port : data->outputs) { check(&port); }
+}
+
+[[nodiscard]] static
+// Read the model for a call to audio_process(const direct_process&), checking
+// the ports again first if anything they were resolved against might have changed.
+auto read_model(ez::audio_t, direct_ports* ports) -> ez::immutable<model> {
+	auto& data = *ports->data;
+	{
+		auto audio       = DATA_->model.read(ez::audio);
+		const auto group = audio->groups.find(ports->group);
+		if (!group) {
+			return audio;
+		}
+		const auto version = group->service->ports_version.load(std::memory_order_acquire);
+		if (version == data.version && group->max_frames == data.max_frames) {
+			return audio;
+		}
+		data.version = version;
+	}
+	// Read again, because whatever the version was incremented
+	// for might have been published since the first read.
+	auto audio = DATA_->model.read(ez::audio);
+	if (const auto group = audio->groups.find(ports->group)) {
+		check_ports(ez::audio, *audio, *group, &data);
+	}
+	return audio;
 }
 
 [[nodiscard]] static
@@ -167,8 +581,7 @@ auto zero_inactive_device_outputs(ez::audio_t, const ez::immutable<model>& audio
 		const auto& sbox = audio->sandboxes.at(sbox_id);
 		for (const auto dev_id : sbox.devices) {
 			const auto& dev = audio->devices.at(dev_id);
-			const auto& shm = dev.service->shm;
-			if (!shm::is_valid(shm.seg)) {
+			if (!dev.ports) {
 				// Device may not have finished being created yet.
 				continue;
 			}
@@ -177,26 +590,81 @@ auto zero_inactive_device_outputs(ez::audio_t, const ez::immutable<model>& audio
 				continue;
 			}
 			// Device is not active so zero its output buffers.
-			for (auto& buffer : shm.data->audio_out) {
-				buffer.fill(0.0f);
+			for (auto& buffers : dev.ports->shm.data->buffers) {
+				for (auto& port : buffers.audio_out) {
+					const auto count = size_t{port.channel_count} * dev.ports->shm.data->max_frames;
+					if (port.samples64) { std::fill_n(port.samples64.get(), count, 0.0); }
+					else                { std::fill_n(port.samples.get(), count, 0.0f); }
+					port.flags = shm::SILENT_BUFFER;
+				}
 			}
 		}
 	}
 }
 
+static
+auto count_late_sandboxes(ez::audio_t, const ez::immutable<model>& audio, const scuff::group& group) -> void {
+	auto any_late = false;
+	for (const auto sbox_id : group.sandboxes) {
+		const auto& sbox = audio->sandboxes.at(sbox_id);
+		if (launched(sbox) && confirmed_active(sbox) && missed_cycle(group, sbox)) {
+			sbox.service->late_cycles.fetch_add(1, std::memory_order_relaxed);
+			any_late = true;
+		}
+	}
+	if (any_late) {
+		group.service->telemetry.late_cycles.fetch_add(1, std::memory_order_relaxed);
+	}
+}
+
 [[nodiscard]] static
-auto do_sandbox_processing(ez::audio_t, const ez::immutable<model>& audio, const scuff::group& group) -> bool {
-	auto sandbox_iterator = group.sandboxes.begin();
-	auto next_sandbox_signal = [&sandbox_iterator, &audio]() -> const ipc::local_event& {
-		const auto sandbox_id = *sandbox_iterator;
-		const auto& sandbox = audio->sandboxes.at(sandbox_id);
-		return sandbox.service->shm.signaling.work_begin;
-	};
-	if (!signaling::sandboxes_work_begin(group.service->signaler, group.total_active_sandboxes, next_sandbox_signal)) {
-		return false;
+// The number of frames to process in this cycle.
+auto get_frames(const scuff::group& group, uint32_t frames) -> uint32_t {
+	if (frames == 0) {
+		return group.max_frames;
 	}
+	return std::min(frames, group.max_frames);
+}
+
+[[nodiscard]] static
+auto get_deadline(const scuff::group& group, std::chrono::steady_clock::time_point start, uint32_t frames) -> std::chrono::steady_clock::time_point {
+	const auto period = std::chrono::duration<double>{frames / group.sample_rate};
+	return start + std::chrono::duration_cast<std::chrono::steady_clock::duration>(period * group.deadline);
+}
+
+[[nodiscard]] static
+// Signal the active sandboxes in the group to begin processing the next cycle.
+// Returns the number of sandboxes which were signaled.
+auto begin_sandbox_processing(ez::audio_t, const ez::immutable<model>& audio, const scuff::group& group) -> int {
+	auto visit_sandboxes = [&audio, &group](auto fn) {
+		for (const auto sbox_id : group.sandboxes) {
+			const auto& sandbox = audio->sandboxes.at(sbox_id);
+			if (launched(sandbox) && confirmed_active(sandbox)) {
+				fn(get_signaler(sandbox));
+			}
+		}
+	};
+	const auto sandbox_count = signaling::sandboxes_work_begin(group.service->signaler, visit_sandboxes);
 	zero_inactive_device_outputs(ez::audio, audio, group);
-	if (group.total_active_sandboxes <= 0) {
+	return sandbox_count;
+}
+
+[[nodiscard]] static
+// Wait for the sandboxes to finish the cycle begun by begin_sandbox_processing().
+// Returns false if the outputs of the cycle can't be used.
+auto finish_sandbox_processing(ez::audio_t, const ez::immutable<model>& audio, const scuff::group& group, int sandbox_count, std::chrono::steady_clock::time_point start, uint32_t frames) -> bool {
+	if (has_deadline(group)) {
+		if (sandbox_count > 0) {
+			// Whether every sandbox finished or we gave up on some of them, the
+			// outputs of the ones which are still busy get substituted.
+			std::ignore = signaling::wait_for_all_sandboxes_done(group.service->signaler, get_deadline(group, start, frames));
+		}
+		// This includes any sandboxes which were skipped this cycle
+		// because they were still busy with an earlier one.
+		count_late_sandboxes(ez::audio, audio, group);
+		return true;
+	}
+	if (sandbox_count <= 0) {
 		return true;
 	}
 	const auto result = signaling::wait_for_all_sandboxes_done(group.service->signaler);
@@ -213,6 +681,207 @@ auto do_sandbox_processing(ez::audio_t, const ez::immutable<model>& audio, const
 	}
 }
 
+[[nodiscard]] static
+// Wait for the cycle left in flight by the previous call to do_pipelined_processing(), if any.
+// Returns false if the outputs of that cycle can't be used.
+auto finish_cycle_in_flight(ez::audio_t, const scuff::group& group) -> bool {
+	const auto sandbox_count = std::exchange(group.service->sandboxes_in_flight, 0);
+	if (sandbox_count <= 0) {
+		return true;
+	}
+	// There is no deadline for pipelined cycles.
+	return signaling::wait_for_all_sandboxes_done(group.service->signaler) == signaling::client_wait_result::done;
+}
+
+static
+auto add(std::array<std::atomic<uint64_t>, duration_histogram::BUCKETS>* histogram, std::chrono::nanoseconds duration) -> void {
+	const auto us     = static_cast<uint64_t>(std::max<int64_t>(std::chrono::duration_cast<std::chrono::microseconds>(duration).count(), 0));
+	const auto bucket = std::min(static_cast<size_t>(std::bit_width(us)), duration_histogram::BUCKETS - 1);
+	(*histogram)[bucket].fetch_add(1, std::memory_order_relaxed);
+}
+
+static
+// Record the cycle in the group telemetry, and pass the timings
+// on to the caller if they asked for them.
+auto report_timings(ez::audio_t, const scuff::group& group, const process_timings& timings, process_timings* out) -> void {
+	auto& telemetry = group.service->telemetry;
+	telemetry.cycles.fetch_add(1, std::memory_order_relaxed);
+	if (!timings.outputs_used) {
+		telemetry.zeroed_cycles.fetch_add(1, std::memory_order_relaxed);
+	}
+	add(&telemetry.cycle_time, timings.inputs + timings.sandboxes + timings.outputs);
+	add(&telemetry.wait_time, timings.sandboxes);
+	if (out) {
+		*out = timings;
+	}
+}
+
+template <typename Process> static
+// Write the inputs for this cycle, process it, and read its outputs before returning.
+auto do_immediate_processing(ez::audio_t, const ez::immutable<model>& audio, const scuff::group& group, const Process& process) -> void {
+	// In case we just switched out of pipelined mode. Those outputs are discarded.
+	std::ignore = finish_cycle_in_flight(ez::audio, group);
+	const auto ring   = &group.service->audio_trace;
+	const auto start  = std::chrono::steady_clock::now();
+	const auto buffer = signaling::get_buffer_index(signaling::get_next_cycle(group.service->signaler));
+	const auto frames = get_frames(group, process.frames);
+	trace::begin(ring, trace::event::inputs);
+	process_inputs(ez::audio, *audio, group, process, frames, buffer);
+	trace::end(ring, trace::event::inputs);
+	const auto inputs_done    = std::chrono::steady_clock::now();
+	trace::begin(ring, trace::event::signal);
+	const auto sandbox_count  = begin_sandbox_processing(ez::audio, audio, group);
+	trace::end(ring, trace::event::signal);
+	trace::begin(ring, trace::event::wait);
+	const auto outputs_used   = finish_sandbox_processing(ez::audio, audio, group, sandbox_count, start, frames);
+	trace::end(ring, trace::event::wait);
+	const auto sandboxes_done = std::chrono::steady_clock::now();
+	trace::begin(ring, trace::event::outputs);
+	if (outputs_used) {
+		process_outputs(ez::audio, *audio, group, process, buffer);
+	}
+	else {
+		read_zeros(ez::audio, group, process);
+	}
+	trace::end(ring, trace::event::outputs);
+	process_timings timings;
+	timings.inputs       = inputs_done - start;
+	timings.sandboxes    = sandboxes_done - inputs_done;
+	timings.outputs      = std::chrono::steady_clock::now() - sandboxes_done;
+	timings.outputs_used = outputs_used;
+	report_timings(ez::audio, group, timings, process.timings);
+}
+
+template <typename Process> static
+// Write the inputs for this cycle and start processing it, then return the outputs of the
+// previous cycle without waiting. The sandboxes process this cycle in one set of device
+// buffers while we read the previous cycle's outputs from the other set.
+auto do_pipelined_processing(ez::audio_t, const ez::immutable<model>& audio, const scuff::group& group, const Process& process) -> void {
+	const auto ring        = &group.service->audio_trace;
+	const auto start       = std::chrono::steady_clock::now();
+	const auto prev_buffer = signaling::get_buffer_index(group.service->signaler.local->cycle);
+	const auto buffer      = signaling::get_buffer_index(signaling::get_next_cycle(group.service->signaler));
+	const auto frames      = get_frames(group, process.frames);
+	trace::begin(ring, trace::event::wait);
+	const auto prev_ok     = finish_cycle_in_flight(ez::audio, group);
+	trace::end(ring, trace::event::wait);
+	const auto wait_done   = std::chrono::steady_clock::now();
+	trace::begin(ring, trace::event::inputs);
+	process_inputs(ez::audio, *audio, group, process, frames, buffer);
+	trace::end(ring, trace::event::inputs);
+	const auto inputs_done = std::chrono::steady_clock::now();
+	trace::begin(ring, trace::event::signal);
+	group.service->sandboxes_in_flight = begin_sandbox_processing(ez::audio, audio, group);
+	trace::end(ring, trace::event::signal);
+	const auto signal_done = std::chrono::steady_clock::now();
+	trace::begin(ring, trace::event::outputs);
+	if (prev_ok) {
+		process_outputs(ez::audio, *audio, group, process, prev_buffer);
+	}
+	else {
+		read_zeros(ez::audio, group, process);
+	}
+	trace::end(ring, trace::event::outputs);
+	process_timings timings;
+	timings.inputs       = inputs_done - wait_done;
+	timings.sandboxes    = (wait_done - start) + (signal_done - inputs_done);
+	timings.outputs      = std::chrono::steady_clock::now() - signal_done;
+	timings.outputs_used = prev_ok;
+	report_timings(ez::audio, group, timings, process.timings);
+}
+
+[[nodiscard]] static
+auto describe_device_memory(id::device dev_id) -> std::string {
+	return std::format("the shared memory of device {}", dev_id.value);
+}
+
+template <typename Fn> static
+// Call fn for each segment or device shared with the sandbox which the audio
+// threads touch, as this process sees it.
+auto for_each_audio_memory(const model& m, const group& group, const sandbox& sbox, Fn&& fn) -> void {
+	fn(group.service->shm.seg, "the group's shared memory");
+	fn(sbox.service->shm.seg, std::format("the shared memory of sandbox {}", sbox.id.value));
+	for (const auto dev_id : sbox.devices) {
+		if (const auto& dev = m.devices.at(dev_id); dev.ports) {
+			fn(dev.ports->shm, describe_device_memory(dev_id));
+		}
+	}
+}
+
+template <typename Memory> static
+// Apply the group's memory options to this process's view of some memory shared
+// with the sandbox. Anything which couldn't be done is reported as a warning
+// about the sandbox, so that it goes to the same place as the sandbox's own.
+auto prepare_memory(ez::nort_t, const group& group, const sandbox& sbox, const Memory& memory, std::string_view what) -> void {
+	if (const auto warning = shm::apply_memory_options(memory, group.memory_options, what)) {
+		ui::on_sbox_warning(ez::nort, sbox, std::format("{} (client process)", *warning));
+	}
+}
+
+static
+auto prepare_memory(ez::nort_t, const model& m, const group& group, const sandbox& sbox) -> void {
+	for_each_audio_memory(m, group, sbox, [&group, &sbox](const auto& memory, std::string_view what) {
+		prepare_memory(ez::nort, group, sbox, memory, what);
+	});
+}
+
+static
+// Call this after publishing a change to the devices of the group which could
+// leave a direct_ports pointing at the wrong memory, so that the audio thread
+// checks the ports again.
+auto ports_changed(ez::nort_t, id::group group_id) -> void {
+	if (const auto group = DATA_->model.read(ez::nort).groups.find(group_id)) {
+		group->service->ports_version.fetch_add(1, std::memory_order_release);
+	}
+}
+
+[[nodiscard]] static
+auto open_device_ports(ez::nort_t, const sandbox& sbox, id::device dev_id, std::string_view shmid) -> std::shared_ptr<const device_ports> {
+	const auto m      = DATA_->model.read(ez::nort);
+	const auto& group = m.groups.at(sbox.group);
+	auto ports        = std::make_shared<device_ports>();
+	ports->shm        = shm::open_device(group.service->shm.arena.get(), shmid, true);
+	prepare_memory(ez::nort, group, sbox, ports->shm, describe_device_memory(dev_id));
+	for (const auto& port : ports->shm.data->buffers[0].audio_out) {
+		const auto count = size_t{port.channel_count} * ports->shm.data->max_frames;
+		if (ports->shm.data->format == sample_format::float64) { ports->last_good_audio_out64.emplace_back(count, 0.0); }
+		else                                                   { ports->last_good_audio_out.emplace_back(count, 0.0f); }
+	}
+	return ports;
+}
+
+static
+// Tell the sandbox of the input device where to find the shared memory of the output
+// device, so that it can read the output directly. Does nothing if either device
+// doesn't exist in its sandbox yet, in which case this is called again when it does.
+auto send_remote_connect(ez::nort_t, const model& m, const cross_sbox_connection& conn) -> void {
+	const auto dev_out = m.devices.find(conn.out_dev_id);
+	const auto dev_in  = m.devices.find(conn.in_dev_id);
+	if (!dev_out || !dev_in) {
+		return;
+	}
+	if (!dev_out->ports) {
+		return;
+	}
+	if (!(dev_in->flags.value & client_device_flags::has_remote)) {
+		return;
+	}
+	const auto& sbox_in = m.sandboxes.at(dev_in->sbox);
+	sbox_in.service->enqueue(msg::in::remote_connect{conn.out_dev_id.value, conn.out_port, dev_out->ports->shm.id, conn.in_dev_id.value, conn.in_port});
+}
+
+static
+// Called when a device has been (re)created in its sandbox.
+auto send_remote_connects(ez::nort_t, const model& m, id::device dev_id) -> void {
+	const auto& dev   = m.devices.at(dev_id);
+	const auto& group = m.groups.at(m.sandboxes.at(dev.sbox).group);
+	for (const auto& conn : group.cross_sbox_conns) {
+		if (conn.out_dev_id == dev_id || conn.in_dev_id == dev_id) {
+			send_remote_connect(ez::nort, m, conn);
+		}
+	}
+}
+
 static
 auto msg_from_sandbox_(poll_t, const sandbox& sbox, const msg::out::confirm_activated& msg) -> void {
 	DATA_->model.update_publish(ez::nort, [sbox = sbox](model&& m) mutable {
@@ -252,20 +921,20 @@ auto msg_from_sandbox_(poll_t, const sandbox& sbox, const msg::out::device_creat
 static
 auto msg_from_sandbox_(poll_t, const sandbox& sbox, const msg::out::device_create_success& msg) -> void {
 	// The sandbox succeeded in creating the remote device.
-	DATA_->model.update_publish(ez::nort, [sbox, msg](model&& m){
-		auto device             = m.devices.at({msg.dev_id});
-		const auto& sbox        = m.sandboxes.at(device.sbox);
-		const auto device_shmid = shm::make_device_id(sbox.service->get_shmid(), {msg.dev_id});
-		if (!shm::is_valid(device.service->shm.seg)) {
-			// Only open the shared memory segment if it's not already open. If we got here as
-			// the result of a sandbox being restarted then we will already have the shared memory
-			// open.
-			device.service->shm = shm::open_device(device_shmid, true);
+	// The shmid is empty if the sandbox reused the segment we already have open, which
+	// happens when a sandbox is restarted. Otherwise the sandbox created a new one.
+	const auto ports = msg.ports_shmid.empty() ? nullptr : open_device_ports(ez::nort, sbox, {msg.dev_id}, msg.ports_shmid);
+	DATA_->model.update_publish(ez::nort, [msg, ports](model&& m){
+		auto device = m.devices.at({msg.dev_id});
+		if (ports) {
+			device.ports = ports;
 		}
 		device.flags.value |= client_device_flags::has_remote;
 		m.devices = m.devices.insert(device);
 		return m;
 	});
+	ports_changed(ez::nort, sbox.group);
+	send_remote_connects(ez::nort, DATA_->model.read(ez::nort), {msg.dev_id});
 	sbox.service->return_buffers.device_create_results.take(msg.callback)({msg.dev_id, true});
 }
 
@@ -310,13 +979,25 @@ auto msg_from_sandbox_(poll_t, const sandbox& sbox, const msg::out::device_laten
 
 static
 auto msg_from_sandbox_(poll_t, const sandbox& sbox, const msg::out::device_port_info& msg) -> void {
-	DATA_->model.update(ez::nort, [msg](model&& m) {
-		m.devices = m.devices.update_if_exists({msg.dev_id}, [msg](device dev) {
+	// If the device's ports no longer fit in its segment then the sandbox has
+	// moved it to a new one, and the old one will be freed once nothing is
+	// using it.
+	const auto ports = msg.ports_shmid.empty() ? nullptr : open_device_ports(ez::nort, sbox, {msg.dev_id}, msg.ports_shmid);
+	DATA_->model.update_publish(ez::nort, [msg, ports](model&& m) {
+		m.devices = m.devices.update_if_exists({msg.dev_id}, [msg, ports](device dev) {
 			dev.port_info = msg.info;
+			if (ports) {
+				dev.ports = ports;
+			}
 			return dev;
 		});
 		return m;
 	});
+	ports_changed(ez::nort, sbox.group);
+	if (!msg.ports_shmid.empty()) {
+		// The sandboxes reading the device's outputs need to know where they are now.
+		send_remote_connects(ez::nort, DATA_->model.read(ez::nort), {msg.dev_id});
+	}
 	ui::on_device_ports_changed(poll, sbox, {msg.dev_id});
 }
 
@@ -365,6 +1046,23 @@ auto msg_from_sandbox_(poll_t, const sandbox& sbox, const msg::out::return_reque
 	sbox.service->return_buffers.states.take(msg.callback)(msg.bytes);
 }
 
+// A message which was cancelled before the sandbox received it. Anything
+// waiting for a reply is failed now rather than left to time out.
+template <typename Msg> static
+auto msg_cancelled_(poll_t, const sandbox& sbox, const Msg& msg) -> void {}
+
+static
+auto msg_cancelled_(poll_t, const sandbox& sbox, const msg::in::device_load& msg) -> void {
+	sbox.service->return_buffers.device_load_results.take(msg.callback)({msg.dev_id, false});
+}
+
+static
+auto msg_cancelled(poll_t, const sandbox& sbox, const msg::in::msg& msg) -> void {
+	 const auto proc = [sbox](const auto& msg) -> void { msg_cancelled_(poll, sbox, msg); };
+	 try                               { fast_visit(proc, msg); }
+	 catch (const std::exception& err) { ui::error(poll, err.what()); }
+}
+
 static
 auto msg_from_sandbox(poll_t, const sandbox& sbox, const msg::out::msg& msg) -> void {
 	 const auto proc = [sbox](const auto& msg) -> void { msg_from_sandbox_(poll, sbox, msg); };
@@ -391,6 +1089,7 @@ auto process_sandbox_messages(poll_t, const sandbox& sbox) -> void {
 			});
 			return m;
 		});
+		ports_changed(poll, sbox.group);
 		const auto m = DATA_->model.read(poll);
 		if (const auto group = m.groups.find(sbox.group)) {
 			signaling::unblock_self(group->service->signaler);
@@ -399,11 +1098,20 @@ auto process_sandbox_messages(poll_t, const sandbox& sbox) -> void {
 		return;
 	}
 	if (sbox.service) {
+		if (const auto missed = sbox.service->late_cycles.exchange(0, std::memory_order_relaxed)) {
+			ui::on_sbox_late(poll, sbox, missed);
+		}
 		sbox.service->send_msgs_to_sandbox();
+		for (const auto& msg : sbox.service->take_cancelled_msgs()) {
+			msg_cancelled(poll, sbox, msg);
+		}
 		const auto& msgs = sbox.service->receive_msgs_from_sandbox();
 		for (const auto& msg : msgs) {
 			msg_from_sandbox(poll, sbox, msg);
 		}
+		if (const auto progress = sbox.service->get_transfer_progress_change()) {
+			ui::on_sbox_transfer_progress(poll, sbox, *progress);
+		}
 	}
 }
 
@@ -434,7 +1142,9 @@ auto save_async(ez::nort_t, const scuff::device& dev, return_bytes return_bytes_
 	const auto m = DATA_->model.read(ez::nort);
 	const auto sbox = m.sandboxes.at(dev.sbox);
 	auto wrapper_fn = [dev_id = dev.id, sbox, return_bytes_fn](const scuff::bytes& bytes){
-		update_saved_state_with_returned_bytes(ez::nort, dev_id, bytes);
+		if (!bytes.empty()) {
+			update_saved_state_with_returned_bytes(ez::nort, dev_id, bytes);
+		}
 		ui::enqueue(ez::nort, sbox, [bytes, return_bytes_fn](const group_ui&){ return_bytes_fn(bytes); });
 	};
 	sbox.service->enqueue(msg::in::device_request_state{dev.id.value, sbox.service->return_buffers.states.put(wrapper_fn)});
@@ -466,6 +1176,16 @@ auto send_heartbeat(poll_t) -> void {
 	}
 }
 
+static
+// Keep a slab with room in it ahead of the sandboxes in each group,
+// so that they don't have to give devices segments of their own.
+auto reserve_device_memory(poll_t) -> void {
+	const auto m = DATA_->model.read(poll);
+	for (const auto& group : m.groups) {
+		shm::reserve_slab(group.service->shm.arena.get());
+	}
+}
+
 static
 auto poll_thread(std::stop_token stop_token) -> void {
 	auto now     = std::chrono::steady_clock::now();
@@ -474,6 +1194,7 @@ auto poll_thread(std::stop_token stop_token) -> void {
 	while (!stop_token.stop_requested()) {
 		now = std::chrono::steady_clock::now();
 		auto next_poll = now + std::chrono::milliseconds{POLL_INTERVAL_MS};
+		trace::begin(&DATA_->tracing.poll_ring, trace::event::poll);
 		if (now > next_gc) {
 			DATA_->model.gc(ez::nort);
 			next_gc = now + std::chrono::milliseconds{GC_INTERVAL_MS};
@@ -483,19 +1204,29 @@ auto poll_thread(std::stop_token stop_token) -> void {
 			next_hb = now + std::chrono::milliseconds{HEARTBEAT_INTERVAL_MS};
 		}
 		process_sandbox_messages(poll);
-		std::this_thread::sleep_until(next_poll);
+		reserve_device_memory(poll);
+		trace::end(&DATA_->tracing.poll_ring, trace::event::poll);
+		trace_::collect(poll, DATA_->model.read(poll), &DATA_->tracing);
+		// Sleep until the next timed poll, or until the doorbell is rung
+		// because a sandbox has sent us something or a message has been
+		// enqueued for one.
+		std::ignore = DATA_->doorbell.event.wait_until(next_poll, {});
 	}
 }
 
 static
-auto activate(ez::nort_t, id::group group_id, double sr) -> void {
-	DATA_->model.update(ez::nort, [group_id, sr](model&& m){
+auto activate(ez::nort_t, id::group group_id, double sr, uint32_t max_frames) -> void {
+	if (max_frames < 1 || max_frames > MAX_VECTOR_SIZE) {
+		throw std::runtime_error(std::format("max_frames must be between 1 and {}.", MAX_VECTOR_SIZE));
+	}
+	DATA_->model.update(ez::nort, [group_id, sr, max_frames](model&& m){
 		auto group = m.groups.at(group_id);
 		group.flags.value |= group_flags::is_active;
 		group.sample_rate = sr;
+		group.max_frames  = max_frames;
 		for (const auto sbox_id : group.sandboxes) {
 			const auto& sbox = m.sandboxes.at(sbox_id);
-			sbox.service->enqueue(scuff::msg::in::activate{sr});
+			sbox.service->enqueue(scuff::msg::in::activate{sr, max_frames});
 			sbox.service->enqueue(scuff::msg::in::set_render_mode{group.render_mode});
 		}
 		m.groups = m.groups.insert(group);
@@ -516,6 +1247,15 @@ auto deactivate(ez::nort_t, id::group group_id) -> void {
 	});
 }
 
+static
+auto cancel_transfers(ez::nort_t, id::sandbox sbox_id) -> void {
+	const auto m     = DATA_->model.read(ez::nort);
+	const auto& sbox = m.sandboxes.at(sbox_id);
+	if (sbox.service) {
+		sbox.service->cancel_transfers();
+	}
+}
+
 static
 auto close_all_editors(ez::nort_t) -> void {
 	const auto sandboxes = scuff::DATA_->model.read(ez::nort).sandboxes;
@@ -553,6 +1293,7 @@ auto connect(ez::nort_t, id::device dev_out_id, size_t port_out, id::device dev_
 		csc.out_port   = port_out;
 		group.cross_sbox_conns = group.cross_sbox_conns.insert(csc);
 		m.groups = m.groups.insert(group);
+		send_remote_connect(ez::nort, m, csc);
 		return m;
 	});
 }
@@ -594,7 +1335,7 @@ auto create_plugin_device_async(model&& m, id::device dev_id, const sandbox& sbo
 	// Plugin is available so we need to send a message to the sandbox to create the remote device.
 	const auto callback = sbox.service->return_buffers.device_create_results.put(return_fn);
 	const auto plugfile = m.plugfiles.at(plugin.plugfile);
-	sbox.service->enqueue(msg::in::device_create{dev.id.value, plugin.type, plugfile.path, plugin.ext_id.value, callback});
+	sbox.service->enqueue(msg::in::device_create{dev.id.value, plugin.type, plugfile.path, plugin.ext_id.value, {}, callback});
 	return m;
 }
 
@@ -744,6 +1485,7 @@ auto device_disconnect(ez::nort_t, id::device dev_out_id, size_t port_out, id::d
 		csc.out_port   = port_out;
 		group.cross_sbox_conns = group.cross_sbox_conns.erase(csc);
 		m.groups = m.groups.insert(group);
+		sbox_in.service->enqueue(scuff::msg::in::remote_disconnect{dev_out_id.value, port_out, dev_in_id.value, port_in});
 		return m;
 	});
 }
@@ -785,6 +1527,11 @@ auto duplicate_async(ez::nort_t, id::device src_dev_id, id::sandbox dst_sbox_id,
 	// We're going to send a message to the source sandbox to save the source device.
 	// When the saved state is returned, call this function with it:
 	const auto save_cb = src_sbox.service->return_buffers.states.put([return_fn, new_dev_id, dst_sbox, plugin](const std::vector<std::byte>& src_state) mutable {
+		if (src_state.empty()) {
+			// The source device couldn't be saved.
+			return_fn({new_dev_id, false});
+			return;
+		}
 		// Now we're going to send a message to the destination sandbox to actually create the new device.
 		// When the new device is created, call this function with it:
 		auto wrapper = [fn = return_fn, dst_sbox, src_state](create_device_result result) {
@@ -925,6 +1672,51 @@ auto has_rack_features(ez::nort_t, id::plugin id) -> bool {
 	}
 }
 
+static
+auto set_deadline(ez::nort_t, id::group group_id, double fraction, late_output output) -> void {
+	auto group        = DATA_->model.read(ez::nort).groups.at(group_id);
+	group.deadline    = std::max(fraction, 0.0);
+	group.late_output = output;
+	DATA_->model.update_publish(ez::nort, [group](model&& m){
+		m.groups = m.groups.insert(group);
+		return m;
+	});
+}
+
+static
+auto set_memory_options(ez::nort_t, id::group group_id, const memory_options& options) -> void {
+	const auto m      = DATA_->model.read(ez::nort);
+	auto group        = m.groups.at(group_id);
+	const auto unlock = group.memory_options.lock && !options.lock;
+	group.memory_options = options;
+	DATA_->model.update(ez::nort, [group](model&& m){
+		m.groups = m.groups.insert(group);
+		return m;
+	});
+	for (const auto sbox_id : group.sandboxes) {
+		const auto& sbox = m.sandboxes.at(sbox_id);
+		if (is_running(sbox)) {
+			sbox.service->enqueue(scuff::msg::in::set_memory_options{options});
+		}
+		for_each_audio_memory(m, group, sbox, [unlock, &group, &sbox](const auto& memory, std::string_view what) {
+			if (unlock) {
+				shm::unlock_memory(memory);
+			}
+			prepare_memory(ez::nort, group, sbox, memory, what);
+		});
+	}
+}
+
+static
+auto set_pipelined(ez::nort_t, id::group group_id, bool pipelined) -> void {
+	auto group      = DATA_->model.read(ez::nort).groups.at(group_id);
+	group.pipelined = pipelined;
+	DATA_->model.update_publish(ez::nort, [group](model&& m){
+		m.groups = m.groups.insert(group);
+		return m;
+	});
+}
+
 static
 auto set_render_mode(ez::nort_t, id::group group_id, render_mode mode) -> void {
 	const auto m = DATA_->model.read(ez::nort);
@@ -942,6 +1734,34 @@ auto set_render_mode(ez::nort_t, id::group group_id, render_mode mode) -> void {
 	});
 }
 
+static
+auto set_sample_format(ez::nort_t, id::group group_id, sample_format format) -> void {
+	const auto m = DATA_->model.read(ez::nort);
+	auto group   = m.groups.at(group_id);
+	if (group.sample_format == format) {
+		return;
+	}
+	if (format == sample_format::float64 && group.service->conversion_buffer.empty()) {
+		group.service->conversion_buffer.resize(MAX_CHANNELS * MAX_VECTOR_SIZE);
+	}
+	group.sample_format = format;
+	for (const auto sbox_id : group.sandboxes) {
+		const auto& sbox = m.sandboxes.at(sbox_id);
+		if (is_running(sbox)) {
+			sbox.service->enqueue(scuff::msg::in::set_sample_format{format});
+		}
+	}
+	DATA_->model.update_publish(ez::nort, [group](model&& m){
+		m.groups = m.groups.insert(group);
+		return m;
+	});
+}
+
+static
+auto set_spin_time(ez::nort_t, id::group group_id, std::chrono::microseconds spin) -> void {
+	signaling::set_spin_time(DATA_->model.read(ez::nort).groups.at(group_id).service->signaler, spin);
+}
+
 static
 auto set_track_color(ez::nort_t, id::device dev, std::optional<rgba32> color) -> void {
 	const auto m = DATA_->model.read(ez::nort);
@@ -958,6 +1778,16 @@ auto set_track_name(ez::nort_t, id::device dev, std::string_view name) -> void {
 	sbox.service->enqueue(scuff::msg::in::set_track_name{dev.value, std::string{name}});
 }
 
+static
+auto set_tracing(ez::nort_t, bool enabled) -> void {
+	trace_::set_enabled(ez::nort, DATA_->model.read(ez::nort), &DATA_->tracing, enabled);
+}
+
+static
+auto write_trace(ez::nort_t, std::string_view path) -> void {
+	trace_::write(ez::nort, &DATA_->tracing, path);
+}
+
 [[nodiscard]] static
 auto get_broken_plugfiles(ez::nort_t) -> std::vector<id::plugfile> {
 	std::vector<id::plugfile> out;
@@ -1052,6 +1882,51 @@ auto get_devices(ez::nort_t, id::sandbox sbox_id) -> std::vector<id::device> {
 	return out;
 }
 
+[[nodiscard]] static
+auto get_device_stats(ez::nort_t, id::device dev_id) -> device_stats {
+	const auto m    = DATA_->model.read(ez::nort);
+	const auto& dev = m.devices.at(dev_id);
+	device_stats stats;
+	if (!dev.ports) {
+		// Device may not have finished being created yet.
+		return stats;
+	}
+	const auto& counters = dev.ports->shm.data->stats;
+	stats.processed = counters.processed.load(std::memory_order_acquire);
+	stats.skipped   = counters.skipped.load(std::memory_order_relaxed);
+	stats.asleep    = counters.asleep.load(std::memory_order_relaxed);
+	stats.last      = std::chrono::nanoseconds{counters.last_ns.load(std::memory_order_relaxed)};
+	stats.max       = std::chrono::nanoseconds{counters.max_ns.load(std::memory_order_relaxed)};
+	if (stats.processed > 0) {
+		stats.average = std::chrono::nanoseconds{counters.total_ns.load(std::memory_order_relaxed) / stats.processed};
+	}
+	return stats;
+}
+
+[[nodiscard]] static
+auto get_device_meters(ez::nort_t, id::device dev_id) -> std::vector<port_meter> {
+	const auto m    = DATA_->model.read(ez::nort);
+	const auto& dev = m.devices.at(dev_id);
+	std::vector<port_meter> meters;
+	if (!dev.ports) {
+		// Device may not have finished being created yet.
+		return meters;
+	}
+	const auto& audio_out = dev.ports->shm.data->buffers[0].audio_out;
+	meters.resize(audio_out.size());
+	for (size_t i = 0; i < meters.size(); i++) {
+		const auto& port = audio_out[i];
+		meters[i].peak.resize(port.channel_count);
+		meters[i].rms.resize(port.channel_count);
+		for (size_t c = 0; c < port.channel_count; c++) {
+			auto& channel = port.meters[c];
+			meters[i].peak[c] = channel.peak.exchange(0.0f, std::memory_order_relaxed);
+			meters[i].rms[c]  = channel.rms.load(std::memory_order_relaxed);
+		}
+	}
+	return meters;
+}
+
 static
 auto gui_hide(ez::nort_t, id::device dev) -> void {
 	const auto m       = DATA_->model.read(ez::nort);
@@ -1085,6 +1960,7 @@ auto create_group(ez::nort_t, void* parent_window_handle) -> id::group {
 		group.service->shm = shm::create_group(shmid, true);
 		group.service->signaler.local = &group.service->shm.signaling;
 		group.service->signaler.shm   = &group.service->shm.data->signaling;
+		group.service->audio_trace.enabled = DATA_->tracing.enabled.load();
 		m.groups = m.groups.insert(group);
 		return m;
 	});
@@ -1187,6 +2063,93 @@ auto get_latency(ez::nort_t, id::device dev_id) -> uint32_t {
 	return DATA_->model.read(ez::nort).devices.at(dev_id).latency;
 }
 
+[[nodiscard]] static
+auto get_histogram(const std::array<std::atomic<uint64_t>, duration_histogram::BUCKETS>& counters) -> duration_histogram {
+	duration_histogram histogram;
+	for (size_t i = 0; i < duration_histogram::BUCKETS; i++) {
+		histogram.counts[i] = counters[i].load(std::memory_order_relaxed);
+	}
+	return histogram;
+}
+
+[[nodiscard]] static
+auto get_group_telemetry(ez::nort_t, id::group group_id) -> group_telemetry {
+	const auto m         = DATA_->model.read(ez::nort);
+	const auto& group    = m.groups.at(group_id);
+	const auto& counters = group.service->telemetry;
+	group_telemetry telemetry;
+	telemetry.cycles        = counters.cycles.load(std::memory_order_relaxed);
+	telemetry.late_cycles   = counters.late_cycles.load(std::memory_order_relaxed);
+	telemetry.zeroed_cycles = counters.zeroed_cycles.load(std::memory_order_relaxed);
+	telemetry.cycle_time    = get_histogram(counters.cycle_time);
+	telemetry.wait_time     = get_histogram(counters.wait_time);
+	for (const auto sbox_id : group.sandboxes) {
+		const auto& sbox_shm = m.sandboxes.at(sbox_id).service->shm.data->signaling;
+		telemetry.finished_last.push_back({sbox_id, sbox_shm.finished_last.load(std::memory_order_relaxed)});
+	}
+	return telemetry;
+}
+
+template <typename MsgT> [[nodiscard]] static
+auto get_message_type_stats(const msg::traffic<MsgT>& traffic, const auto& names) -> std::vector<message_type_stats> {
+	std::vector<message_type_stats> out;
+	for (size_t i = 0; i < names.size(); i++) {
+		message_type_stats stats;
+		stats.name  = names[i];
+		stats.count = traffic.counts[i].load(std::memory_order_relaxed);
+		stats.bytes = traffic.bytes[i].load(std::memory_order_relaxed);
+		out.push_back(stats);
+	}
+	return out;
+}
+
+template <typename T> [[nodiscard]] static
+auto get_round_trip_stats(std::string_view name, slot_buffer<T>* fns) -> round_trip_stats {
+	const auto stats = fns->get_stats();
+	round_trip_stats out;
+	out.name      = name;
+	out.completed = stats.taken;
+	out.pending   = stats.pending;
+	out.max       = std::chrono::duration_cast<std::chrono::nanoseconds>(stats.max_wait);
+	if (stats.taken > 0) {
+		out.average = std::chrono::duration_cast<std::chrono::nanoseconds>(stats.total_wait) / stats.taken;
+	}
+	return out;
+}
+
+[[nodiscard]] static
+auto get_message_stats(ez::nort_t, id::sandbox sbox_id) -> message_stats {
+	const auto m        = DATA_->model.read(ez::nort);
+	auto& service       = *m.sandboxes.at(sbox_id).service;
+	auto& fns           = service.return_buffers;
+	message_stats stats;
+	stats.sent                  = get_message_type_stats(service.get_traffic_in(), msg::in::names);
+	stats.received              = get_message_type_stats(service.get_traffic_out(), msg::out::names);
+	stats.send_queue_high_water = service.get_queue_high_water();
+	stats.round_trips.push_back(get_round_trip_stats("create_device", &fns.device_create_results));
+	stats.round_trips.push_back(get_round_trip_stats("get_value", &fns.doubles));
+	stats.round_trips.push_back(get_round_trip_stats("get_value_text", &fns.strings));
+	stats.round_trips.push_back(get_round_trip_stats("load", &fns.device_load_results));
+	stats.round_trips.push_back(get_round_trip_stats("save", &fns.states));
+	return stats;
+}
+
+[[nodiscard]] static
+auto get_wait_stats(ez::nort_t, id::group group_id) -> wait_stats {
+	const auto m      = DATA_->model.read(ez::nort);
+	const auto& group = m.groups.at(group_id);
+	const auto& shm   = group.service->shm.data->signaling;
+	wait_stats stats;
+	stats.client_spun  = shm.client_waits.spun.load(std::memory_order_relaxed);
+	stats.client_slept = shm.client_waits.slept.load(std::memory_order_relaxed);
+	for (const auto sbox_id : group.sandboxes) {
+		const auto& sbox_shm = m.sandboxes.at(sbox_id).service->shm.data->signaling;
+		stats.sandbox_spun  += sbox_shm.sandbox_waits.spun.load(std::memory_order_relaxed);
+		stats.sandbox_slept += sbox_shm.sandbox_waits.slept.load(std::memory_order_relaxed);
+	}
+	return stats;
+}
+
 [[nodiscard]] static
 auto get_name(ez::nort_t, id::plugin plugin) -> std::string_view {
 	return *DATA_->model.read(ez::nort).plugins.at({plugin}).name;
@@ -1271,6 +2234,63 @@ auto panic(ez::nort_t) -> void {
 	}
 }
 
+[[nodiscard]] static
+auto resolve_port(ez::nort_t, const model& m, const scuff::group& group, port_ref ref, bool input) -> direct_port {
+	const auto& dev = m.devices.at(ref.dev_id);
+	if (m.sandboxes.at(dev.sbox).group != group.id) {
+		throw std::runtime_error(std::format("Device {} doesn't belong to group {}.", ref.dev_id.value, group.id.value));
+	}
+	direct_port port;
+	port.dev_id     = ref.dev_id;
+	port.sbox       = dev.sbox;
+	port.port_index = ref.port_index;
+	if (!(dev.flags.value & client_device_flags::has_remote) || !dev.ports || !ports_fit(group, *dev.ports)) {
+		return port;
+	}
+	const auto& buffers = dev.ports->shm.data->buffers[0];
+	const auto& audio   = input ? buffers.audio_in : buffers.audio_out;
+	if (ref.port_index >= audio.size()) {
+		return port;
+	}
+	port.channel_count = audio[ref.port_index].channel_count;
+	port.ports         = dev.ports;
+	port.usable        = true;
+	if (input) {
+		// The host doesn't know which set of buffers the first cycle will use.
+		const auto count = size_t{port.channel_count} * group.max_frames;
+		if (dev.ports->shm.data->format == sample_format::float64) { port.scratch64.resize(count); }
+		else                                                        { port.scratch.resize(count); }
+		port.in_scratch = true;
+	}
+	return port;
+}
+
+[[nodiscard]] static
+auto resolve_ports(ez::nort_t, id::group group_id, std::span<const port_ref> inputs, std::span<const port_ref> outputs) -> direct_ports {
+	// Read before the model, so that the audio thread checks the ports
+	// again if anything changes before they have been resolved.
+	const auto version = DATA_->model.read(ez::nort).groups.at(group_id).service->ports_version.load(std::memory_order_acquire);
+	const auto m       = DATA_->model.read(ez::nort);
+	const auto& group  = m.groups.at(group_id);
+	auto data          = std::make_shared<direct_ports_data>();
+	data->max_frames   = group.max_frames;
+	data->version      = version;
+	direct_ports ports;
+	ports.group = group_id;
+	for (const auto& ref : inputs) {
+		auto& port = data->inputs.emplace_back(resolve_port(ez::nort, m, group, ref, true));
+		ports.inputs.push_back(port.usable ? get_scratch_input(&port) : direct_input{});
+		data->stale = data->stale || !port.usable;
+	}
+	for (const auto& ref : outputs) {
+		const auto& port = data->outputs.emplace_back(resolve_port(ez::nort, m, group, ref, false));
+		ports.outputs.push_back(port.usable ? get_zeros_output(port) : direct_output{});
+		data->stale = data->stale || !port.usable;
+	}
+	ports.data = std::move(data);
+	return ports;
+}
+
 static
 auto restart(ez::nort_t, id::sandbox sbox, std::string_view sbox_exe_path) -> void {
 	const auto m      = DATA_->model.read(ez::nort);
@@ -1279,11 +2299,18 @@ auto restart(ez::nort_t, id::sandbox sbox, std::string_view sbox_exe_path) -> vo
 	if (sandbox.service->proc.running()) {
 		sandbox.service->proc.terminate();
 	}
+	// The old process may have been killed partway through a cycle.
+	signaling::reset_cycle(get_signaler(sandbox));
+	sandbox.service->reset_transfers();
 	const auto group_shmid   = group.service->shm.seg.id;
 	const auto sandbox_shmid = sandbox.service->get_shmid();
-	const auto exe_args      = make_sbox_exe_args(std::to_string(os::get_process_id()), group_shmid, sandbox_shmid, reinterpret_cast<uint64_t>(group.parent_window_handle));
+	const auto exe_args      = make_sbox_exe_args(std::to_string(os::get_process_id()), DATA_->doorbell.seg.id, group_shmid, sandbox_shmid, reinterpret_cast<uint64_t>(group.parent_window_handle));
 	sandbox.service->proc   = bp::v1::child{std::string{sbox_exe_path}, exe_args};
 	sandbox.flags.value     |= sandbox_flags::launched;
+	// First, so that the sandbox can lock all of its memory before any plugins are loaded.
+	sandbox.service->enqueue(msg::in::set_memory_options{group.memory_options});
+	// Before the devices, so that they are laid out in the right format.
+	sandbox.service->enqueue(msg::in::set_sample_format{group.sample_format});
 	for (const auto dev_id : sandbox.devices) {
 		const auto& dev = m.devices.at(dev_id);
 		const auto with_created_device = [m, dev](create_device_result result){
@@ -1299,9 +2326,12 @@ auto restart(ez::nort_t, id::sandbox sbox, std::string_view sbox_exe_path) -> vo
 		const auto callback = sandbox.service->return_buffers.device_create_results.put(with_created_device);
 		const auto plugin   = m.plugins.at(dev.plugin);
 		const auto plugfile = m.plugfiles.at(plugin.plugfile);
-		sandbox.service->enqueue(msg::in::device_create{dev.id.value, dev.type, plugfile.path, dev.plugin_ext_id.value, callback});
+		// Pass the id of the shared memory we already have for the device so that
+		// the new sandbox process attaches to it rather than creating a new one.
+		const auto dev_shmid = dev.ports ? dev.ports->shm.id : std::string{};
+		sandbox.service->enqueue(msg::in::device_create{dev.id.value, dev.type, plugfile.path, dev.plugin_ext_id.value, dev_shmid, callback});
 	}
-	sandbox.service->enqueue(msg::in::activate{group.sample_rate});
+	sandbox.service->enqueue(msg::in::activate{group.sample_rate, group.max_frames});
 	sandbox.service->enqueue(msg::in::set_render_mode{group.render_mode});
 	DATA_->model.update(ez::nort, [sandbox](model&& m){
 		m.sandboxes = m.sandboxes.insert(sandbox);
@@ -1344,13 +2374,18 @@ auto save(ez::nort_t, id::device dev_id) -> scuff::bytes {
 	const auto& dev = m.devices.at(dev_id);
 	const auto sbox = m.sandboxes.at(dev.sbox);
 	auto wrapper_fn = [dev_id = dev.id, sbox, fn](const scuff::bytes& bytes){
-		update_saved_state_with_returned_bytes(ez::nort, dev_id, bytes);
+		if (!bytes.empty()) {
+			update_saved_state_with_returned_bytes(ez::nort, dev_id, bytes);
+		}
 		fn(bytes);
 	};
 	sbox.service->enqueue(msg::in::device_request_state{dev.id.value, sbox.service->return_buffers.states.put(wrapper_fn)});
 	if (!bso.wait_for(ready)) {
 		throw std::runtime_error("Timed out waiting for device save.");
 	}
+	if (bytes.empty()) {
+		throw std::runtime_error("Device save failed or was cancelled.");
+	}
 	return bytes;
 }
 
@@ -1381,27 +2416,38 @@ auto remove_sandbox_from_group(model&& m, id::group group, id::sandbox sbox) ->
 }
 
 [[nodiscard]] static
-auto create_sandbox(ez::nort_t, id::group group_id, std::string_view sbox_exe_path) -> id::sandbox {
+auto create_sandbox(ez::nort_t, id::group group_id, std::string_view sbox_exe_path, size_t msg_buffer_size) -> id::sandbox {
+	if (msg_buffer_size == 0) {
+		throw std::runtime_error("The message buffer size must be greater than zero.");
+	}
 	const auto sbox_id = id::sandbox{id_gen_++};
 	DATA_->model.update_publish(ez::nort, [=](model&& m){
 		sandbox sbox;
 		sbox.id = sbox_id;
 		const auto& group        = m.groups.at({group_id});
+		// The sandbox shared memory has to exist before the process is launched
+		// because the sandbox opens it using the id we pass on the command line.
+		sbox.service             = std::make_shared<sandbox_service>(shm::make_sandbox_id(DATA_->instance_id, sbox.id), &DATA_->doorbell, msg_buffer_size);
+		sbox.service->shm.data->main_trace.enabled  = DATA_->tracing.enabled.load();
+		sbox.service->shm.data->audio_trace.enabled = DATA_->tracing.enabled.load();
 		const auto group_shmid   = group.service->shm.seg.id;
-		const auto sandbox_shmid = shm::make_sandbox_id(DATA_->instance_id, sbox.id);
-		const auto exe_args      = make_sbox_exe_args(std::to_string(os::get_process_id()), group_shmid, sandbox_shmid, reinterpret_cast<uint64_t>(group.parent_window_handle));
-		auto proc                = bp::v1::child{std::string{sbox_exe_path}, exe_args};
-		if (!proc.running()) {
+		const auto sandbox_shmid = sbox.service->get_shmid();
+		const auto exe_args      = make_sbox_exe_args(std::to_string(os::get_process_id()), DATA_->doorbell.seg.id, group_shmid, sandbox_shmid, reinterpret_cast<uint64_t>(group.parent_window_handle));
+		sbox.service->proc       = bp::v1::child{std::string{sbox_exe_path}, exe_args};
+		if (!sbox.service->proc.running()) {
 			throw std::runtime_error("Failed to launch sandbox process.");
 		}
 		sbox.flags.value        |= sandbox_flags::launched;
 		sbox.group               = {group_id};
-		sbox.service            = std::make_shared<sandbox_service>(std::move(proc), sandbox_shmid);
+		sbox.service->enqueue(msg::in::set_memory_options{group.memory_options});
+		sbox.service->enqueue(msg::in::set_sample_format{group.sample_format});
 		m.sandboxes              = m.sandboxes.insert(sbox);
 		m = add_sandbox_to_group(m, {group_id}, sbox.id);
 		m.sandboxes = m.sandboxes.insert(sbox);
 		return m;
 	});
+	const auto m = DATA_->model.read(ez::nort);
+	prepare_memory(ez::nort, m, m.groups.at(group_id), m.sandboxes.at(sbox_id));
 	return sbox_id;
 }
 
@@ -1483,7 +2529,14 @@ auto erase(model&& m, id::device dev_id) -> model {
 
 static auto erase(ez::nort_t, id::group group_id) -> void  { DATA_->model.update_publish(ez::nort, [group_id](model&& m){ return erase(std::move(m), group_id); }); } 
 static auto erase(ez::nort_t, id::sandbox sbox_id) -> void { DATA_->model.update_publish(ez::nort, [sbox_id](model&& m){ return erase(std::move(m), sbox_id); }); } 
-static auto erase(ez::nort_t, id::device dev_id) -> void   { DATA_->model.update_publish(ez::nort, [dev_id](model&& m){ return erase(std::move(m), dev_id); }); }
+
+static
+auto erase(ez::nort_t, id::device dev_id) -> void {
+	const auto sbox_id  = DATA_->model.read(ez::nort).devices.at(dev_id).sbox;
+	const auto group_id = DATA_->model.read(ez::nort).sandboxes.at(sbox_id).group;
+	DATA_->model.update_publish(ez::nort, [dev_id](model&& m){ return erase(std::move(m), dev_id); });
+	ports_changed(ez::nort, group_id);
+}
 
 [[nodiscard]] static
 auto get_working_plugins(ez::nort_t) -> std::vector<id::plugin> {
@@ -1555,6 +2608,7 @@ auto init() -> void {
 	try {
 		scuff::DATA_               = std::make_unique<scuff::data>();
 		scuff::DATA_->instance_id  = "scuff+" + std::to_string(scuff::os::get_process_id());
+		scuff::DATA_->doorbell     = shm::create_doorbell(shm::make_doorbell_id(scuff::DATA_->instance_id), true);
 		scuff::DATA_->poll_thread  = std::jthread{impl::poll_thread};
 		scuff::DATA_->ui_thread_id = std::this_thread::get_id();
 		make_shm_emulation_process_folder();
@@ -1573,6 +2627,7 @@ auto shutdown() -> void {
 	if (!scuff::initialized_) { return; }
 	scuff::DATA_->poll_thread.request_stop();
 	scuff::DATA_->scan_thread.request_stop();
+	shm::ring(scuff::DATA_->doorbell);
 	if (scuff::DATA_->poll_thread.joinable()) {
 		scuff::DATA_->poll_thread.join();
 	}
@@ -1590,14 +2645,33 @@ namespace scuff {
 auto audio_process(const group_process& process) -> void {
 	const auto audio = scuff::DATA_->model.read(ez::audio);
 	if (const auto group = audio->groups.find({process.group})) {
-		impl::process_inputs(ez::audio, *audio, process.audio_inputs, process.input_events);
-		if (impl::do_sandbox_processing(ez::audio, audio, *group)) {
-			impl::process_outputs(ez::audio, *audio, *group, process.audio_outputs, process.output_events);
+		const auto cycle_trace = scuff::trace::scope{&group->service->audio_trace, scuff::trace::event::audio_process, static_cast<uint64_t>(group->id.value)};
+		if (group->pipelined) {
+			impl::do_pipelined_processing(ez::audio, audio, *group, process);
+		}
+		else {
+			impl::do_immediate_processing(ez::audio, audio, *group, process);
+		}
+	}
+}
+
+auto audio_process(const direct_process& process) -> direct_result {
+	const auto audio = impl::read_model(ez::audio, process.ports);
+	if (const auto group = audio->groups.find(process.ports->group)) {
+		const auto cycle_trace = scuff::trace::scope{&group->service->audio_trace, scuff::trace::event::audio_process, static_cast<uint64_t>(group->id.value)};
+		auto& data  = *process.ports->data;
+		data.result = {};
+		if (group->pipelined) {
+			impl::do_pipelined_processing(ez::audio, audio, *group, process);
 		}
 		else {
-			impl::read_zeros(ez::audio, *audio, process.audio_outputs);
+			impl::do_immediate_processing(ez::audio, audio, *group, process);
 		}
+		impl::point_inputs(ez::audio, *audio, *group, process.ports);
+		data.result.stale = data.stale;
+		return data.result;
 	}
+	return {};
 }
 
 auto init() -> void {
@@ -1608,8 +2682,12 @@ auto shutdown() -> void {
 	try { impl::shutdown(); } SCUFF_EXCEPTION_WRAPPER;
 }
 
-auto activate(id::group group, double sr) -> void {
-	try { impl::activate(ez::nort, group, sr); } SCUFF_EXCEPTION_WRAPPER;
+auto activate(id::group group, double sr, uint32_t max_frames) -> void {
+	try { impl::activate(ez::nort, group, sr, max_frames); } SCUFF_EXCEPTION_WRAPPER;
+}
+
+auto cancel_transfers(id::sandbox sbox) -> void {
+	try { impl::cancel_transfers(ez::nort, sbox); } SCUFF_EXCEPTION_WRAPPER;
 }
 
 auto close_all_editors() -> void {
@@ -1636,8 +2714,8 @@ auto create_device_async(id::sandbox sbox, plugin_type type, ext::id::plugin plu
 	try { return impl::create_device_async(ez::nort, sbox, type, plugin_id, fn); } SCUFF_EXCEPTION_WRAPPER;
 }
 
-auto create_sandbox(id::group group_id, std::string_view sbox_exe_path) -> id::sandbox {
-	try { return impl::create_sandbox(ez::nort, group_id, sbox_exe_path); } SCUFF_EXCEPTION_WRAPPER;
+auto create_sandbox(id::group group_id, std::string_view sbox_exe_path, size_t msg_buffer_size) -> id::sandbox {
+	try { return impl::create_sandbox(ez::nort, group_id, sbox_exe_path, msg_buffer_size); } SCUFF_EXCEPTION_WRAPPER;
 }
 
 auto deactivate(id::group group) -> void {
@@ -1716,6 +2794,14 @@ auto get_devices(id::sandbox sbox) -> std::vector<id::device> {
 	try { return impl::get_devices(ez::nort, sbox); } SCUFF_EXCEPTION_WRAPPER;
 }
 
+auto get_device_stats(id::device dev) -> device_stats {
+	try { return impl::get_device_stats(ez::nort, dev); } SCUFF_EXCEPTION_WRAPPER;
+}
+
+auto get_device_meters(id::device dev) -> std::vector<port_meter> {
+	try { return impl::get_device_meters(ez::nort, dev); } SCUFF_EXCEPTION_WRAPPER;
+}
+
 auto get_error(id::device device) -> std::string_view {
 	try { return impl::get_error(ez::nort, device); } SCUFF_EXCEPTION_WRAPPER;
 }
@@ -1748,6 +2834,18 @@ auto get_latency(id::device dev) -> uint32_t {
 	try { return impl::get_latency(ez::nort, dev); } SCUFF_EXCEPTION_WRAPPER;
 }
 
+auto get_message_stats(id::sandbox sbox) -> message_stats {
+	try { return impl::get_message_stats(ez::nort, sbox); } SCUFF_EXCEPTION_WRAPPER;
+}
+
+auto get_group_telemetry(id::group group) -> group_telemetry {
+	try { return impl::get_group_telemetry(ez::nort, group); } SCUFF_EXCEPTION_WRAPPER;
+}
+
+auto get_wait_stats(id::group group) -> wait_stats {
+	try { return impl::get_wait_stats(ez::nort, group); } SCUFF_EXCEPTION_WRAPPER;
+}
+
 auto get_name(id::plugin plugin) -> std::string_view {
 	try { return impl::get_name(ez::nort, plugin); } SCUFF_EXCEPTION_WRAPPER;
 }
@@ -1848,6 +2946,10 @@ auto panic() -> void {
 	try { impl::panic(ez::nort); } SCUFF_EXCEPTION_WRAPPER;
 }
 
+auto resolve_ports(id::group group, std::span<const port_ref> inputs, std::span<const port_ref> outputs) -> direct_ports {
+	try { return impl::resolve_ports(ez::nort, group, inputs, outputs); } SCUFF_EXCEPTION_WRAPPER;
+}
+
 auto restart(id::sandbox sbox, std::string_view sbox_exe_path) -> void {
 	try { impl::restart(ez::nort, sbox, sbox_exe_path); return; } SCUFF_EXCEPTION_WRAPPER;
 }
@@ -1864,10 +2966,30 @@ auto scan(std::string_view scan_exe_path, scan_flags flags) -> void {
 	try { impl::do_scan(ez::nort, scan_exe_path, flags); } SCUFF_EXCEPTION_WRAPPER;
 }
 
+auto set_deadline(id::group group, double fraction, late_output output) -> void {
+	try { impl::set_deadline(ez::nort, group, fraction, output); } SCUFF_EXCEPTION_WRAPPER;
+}
+
+auto set_memory_options(id::group group, const memory_options& options) -> void {
+	try { impl::set_memory_options(ez::nort, group, options); } SCUFF_EXCEPTION_WRAPPER;
+}
+
+auto set_pipelined(id::group group, bool pipelined) -> void {
+	try { impl::set_pipelined(ez::nort, group, pipelined); } SCUFF_EXCEPTION_WRAPPER;
+}
+
 auto set_render_mode(id::group group, render_mode mode) -> void {
 	try { impl::set_render_mode(ez::nort, group, mode); } SCUFF_EXCEPTION_WRAPPER;
 }
 
+auto set_sample_format(id::group group, sample_format format) -> void {
+	try { impl::set_sample_format(ez::nort, group, format); } SCUFF_EXCEPTION_WRAPPER;
+}
+
+auto set_spin_time(id::group group, std::chrono::microseconds spin) -> void {
+	try { impl::set_spin_time(ez::nort, group, spin); } SCUFF_EXCEPTION_WRAPPER;
+}
+
 auto set_track_color(id::device dev, std::optional<rgba32> color) -> void {
 	try { impl::set_track_color(ez::nort, dev, color); } SCUFF_EXCEPTION_WRAPPER;
 }
@@ -1876,10 +2998,18 @@ auto set_track_name(id::device dev, std::string_view name) -> void {
 	try { impl::set_track_name(ez::nort, dev, name); } SCUFF_EXCEPTION_WRAPPER;
 }
 
+auto set_tracing(bool enabled) -> void {
+	try { impl::set_tracing(ez::nort, enabled); } SCUFF_EXCEPTION_WRAPPER;
+}
+
 auto was_created_successfully(id::device dev) -> bool {
 	try { return impl::was_created_successfully(ez::nort, dev); } SCUFF_EXCEPTION_WRAPPER;
 }
 
+auto write_trace(std::string_view path) -> void {
+	try { impl::write_trace(ez::nort, path); } SCUFF_EXCEPTION_WRAPPER;
+}
+
 auto ref(id::device id) -> void {
 	try { impl::ref(ez::nort, id); } SCUFF_EXCEPTION_WRAPPER;
 }
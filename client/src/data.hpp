@@ -4,11 +4,13 @@
 #include "common-message-send-rcv.hpp"
 #include "common-shm.hpp"
 #include "common-slot-buffer.hpp"
+#include "common-trace.hpp"
 #include "jthread.hpp"
 #include "ui-types.hpp"
 #include <atomic>
 #include <boost/asio.hpp>
 #include <ez.hpp>
+#include <map>
 #pragma warning(push, 0)
 #include <immer/box.hpp>
 #include <immer/map.hpp>
@@ -39,25 +41,73 @@ struct sandbox_service {
 	bp::v1::child proc;
 	scuff::return_buffers return_buffers;
 	std::atomic_int ref_count = 0;
+	// Incremented by the audio thread each cycle the sandbox misses
+	// the group's deadline. Reported and reset by the poll thread.
+	std::atomic<uint64_t> late_cycles = 0;
+	// Audio thread only. The last cycle the sandbox was found to be late
+	// in, so that the start of a run of late cycles can be detected.
+	uint32_t late_cycle = 0;
 	shm::sandbox shm;
-	sandbox_service(bp::v1::child&& proc, std::string_view shmid)
-		: proc{std::move(proc)}
-		, shm{shm::create_sandbox(shmid, true)}
+	sandbox_service(std::string_view shmid, const shm::doorbell* doorbell, size_t msg_buffer_size)
+		: shm{shm::create_sandbox(shmid, true, msg_buffer_size)}
+		, doorbell_{doorbell}
 	{}
+	auto cancel_transfers() -> void {
+		msg_sender_.cancel();
+		msg_receiver_.cancel();
+	}
+	// Drop the bulk transfers with the old process when
+	// the sandbox is restarted.
+	auto reset_transfers() -> void {
+		msg_sender_.reset();
+		msg_receiver_.reset();
+	}
 	auto enqueue(msg::in::msg msg) -> void {
 		msg_sender_.enqueue(std::move(msg));
+		shm::ring(*doorbell_);
+	}
+	// Poll thread only. Returns the combined progress of the
+	// bulk transfers in both directions, if it has changed
+	// since the last time this was called.
+	[[nodiscard]]
+	auto get_transfer_progress_change() -> std::optional<msg::transfer_progress> {
+		const auto out = msg_sender_.progress();
+		const auto in  = msg_receiver_.progress();
+		const auto progress = msg::transfer_progress{out.transferred + in.transferred, out.total + in.total};
+		if (progress.transferred == last_transfer_progress_.transferred && progress.total == last_transfer_progress_.total) {
+			return std::nullopt;
+		}
+		last_transfer_progress_ = progress;
+		return progress;
 	}
 	[[nodiscard]]
 	auto get_shmid() const -> std::string_view {
 		return shm.seg.id;
 	}
 	[[nodiscard]]
+	auto get_queue_high_water() const -> size_t {
+		return msg_sender_.get_queue_high_water();
+	}
+	[[nodiscard]]
+	auto get_traffic_in() const -> const msg::traffic<msg::in::msg>& {
+		return msg_sender_.get_traffic();
+	}
+	[[nodiscard]]
+	auto get_traffic_out() const -> const msg::traffic<msg::out::msg>& {
+		return msg_receiver_.get_traffic();
+	}
+	[[nodiscard]]
 	auto receive_msgs_from_sandbox() -> const std::vector<msg::out::msg>& {
 		auto fn = [&shm = this->shm](std::byte* bytes, size_t count) -> size_t {
 			return shm::receive_bytes_from_sandbox(shm, bytes, count);
 		};
 		return msg_receiver_.receive(fn);
 	}
+	// Poll thread only.
+	[[nodiscard]]
+	auto take_cancelled_msgs() -> std::vector<msg::in::msg> {
+		return msg_sender_.take_cancelled();
+	}
 	auto send_msgs_to_sandbox() -> void {
 		auto fn = [&shm = this->shm](const std::byte* bytes, size_t count) -> size_t {
 			return shm::send_bytes_to_sandbox(shm, bytes, count);
@@ -67,6 +117,8 @@ struct sandbox_service {
 private:
 	msg::sender<msg::in::msg> msg_sender_;
 	msg::receiver<msg::out::msg> msg_receiver_;
+	msg::transfer_progress last_transfer_progress_;
+	const shm::doorbell* doorbell_;
 };
 
 struct group_flags {
@@ -77,12 +129,36 @@ struct group_flags {
 	int value = 0;
 };
 
+// Updated by the audio thread each cycle and read by
+// get_group_telemetry() from other threads.
+struct group_telemetry_counters {
+	std::atomic<uint64_t> cycles        = 0;
+	std::atomic<uint64_t> late_cycles   = 0;
+	std::atomic<uint64_t> zeroed_cycles = 0;
+	std::array<std::atomic<uint64_t>, duration_histogram::BUCKETS> cycle_time = {};
+	std::array<std::atomic<uint64_t>, duration_histogram::BUCKETS> wait_time  = {};
+};
+
 struct group_service {
 	ui::group_q ui;
 	shm::group shm;
 	signaling::group_local_data signaling;
 	signaling::clientside_group signaler;
 	std::atomic_int ref_count = 0;
+	// Audio thread only. In pipelined mode, the number of sandboxes
+	// which were signaled for the cycle that is still in flight.
+	int sandboxes_in_flight = 0;
+	group_telemetry_counters telemetry;
+	// Timeline trace records for the group's audio thread.
+	trace::ring audio_trace;
+	// Audio thread only. Where 64-bit ports are converted for the
+	// 32-bit callbacks. Allocated the first time the group is set
+	// to float64, before any of its ports can be 64-bit, and never
+	// resized after that.
+	std::vector<float> conversion_buffer;
+	// Incremented after publishing any change to the devices of the group
+	// which could leave a direct_ports pointing at the wrong memory.
+	std::atomic<uint64_t> ports_version = 0;
 };
 
 struct client_device_flags {
@@ -100,7 +176,54 @@ struct device_service {
 	// event is received, to signal that the last saved
 	// state is now dirty.
 	std::atomic_int ref_count = 0;
+};
+
+// The device's shared memory segment. This is replaced, rather than
+// resized, if the plugin's audio ports or the group's block size change,
+// so the audio thread can keep using whichever one it sees in its model.
+struct device_ports {
 	shm::device shm;
+	// Audio thread only. Audio output from the last cycle the device's
+	// sandbox finished on time, for late_output::repeat_last_block.
+	// Only written when the sandbox misses the deadline.
+	// One vector per output port, sized for its channels. Only the
+	// one for the sample format of the segment is used.
+	mutable std::vector<std::vector<float>> last_good_audio_out;
+	mutable std::vector<std::vector<double>> last_good_audio_out64;
+};
+
+// One of the ports of a direct_ports.
+struct direct_port {
+	id::device dev_id;
+	id::sandbox sbox;
+	size_t port_index      = 0;
+	uint32_t channel_count = 0;
+	// Keeps the segment mapped for as long as the host might be using it.
+	std::shared_ptr<const device_ports> ports;
+	// False if the port couldn't be found, or if the device's ports have changed
+	// since. The host is given null pointers for it from then on.
+	bool usable = false;
+	// Inputs only. Where the host writes the input when it can't go straight to
+	// the device, e.g. before the first cycle. Only the one for the sample format
+	// of the segment is used. Copied to the device at the start of the next cycle.
+	std::vector<float> scratch;
+	std::vector<double> scratch64;
+	bool in_scratch = false;
+};
+
+// Behind scuff::direct_ports. Only the audio thread touches
+// this once resolve_ports() has returned.
+struct direct_ports_data {
+	// The group's max_frames when the ports were resolved.
+	uint32_t max_frames = 0;
+	// The group_service::ports_version the ports were last checked against.
+	uint64_t version = 0;
+	std::vector<direct_port> inputs;
+	std::vector<direct_port> outputs;
+	// True if any of the ports are unusable.
+	bool stale = false;
+	// Of the current call to audio_process(const direct_process&).
+	direct_result result;
 };
 
 struct device {
@@ -119,6 +242,7 @@ struct device {
 	immer::box<scuff::bytes> last_saved_state;
 	immer::vector<client_param_info> param_info;
 	device_port_info port_info;
+	std::shared_ptr<const device_ports> ports;
 	std::shared_ptr<device_service> service;
 };
 
@@ -150,9 +274,15 @@ struct group {
 	id::group id;
 	group_flags flags;
 	double sample_rate = 0.0f;
+	uint32_t max_frames = VECTOR_SIZE;
 	void* parent_window_handle = nullptr;
 	int total_active_sandboxes = 0;
 	scuff::render_mode render_mode = scuff::render_mode::realtime;
+	scuff::sample_format sample_format = scuff::sample_format::float32;
+	scuff::memory_options memory_options;
+	bool pipelined = false;
+	double deadline = 0.0;
+	scuff::late_output late_output = scuff::late_output::silence;
 	immer::set<id::sandbox> sandboxes;
 	immer::set<cross_sbox_connection> cross_sbox_conns;
 	std::shared_ptr<group_service> service;
@@ -186,14 +316,40 @@ struct model {
 	immer::table<sandbox> sandboxes;
 };
 
+// A record drained from one of the trace rings, tagged with
+// the process and thread which wrote it.
+struct trace_entry {
+	trace::record record;
+	uint64_t pid;
+	uint64_t tid;
+};
+
+struct trace_log {
+	std::deque<trace_entry> entries;
+	std::map<uint64_t, std::string> process_names;
+	std::map<std::pair<uint64_t, uint64_t>, std::string> thread_names;
+};
+
+struct trace_data {
+	std::atomic_bool enabled = false;
+	// Timeline trace records for the poll thread.
+	trace::ring poll_ring;
+	// Poll thread only. Records are collected here
+	// before being appended to the log.
+	std::vector<trace_entry> drained;
+	lg::plain_guarded<trace_log> log;
+};
+
 struct data {
 	std::string            instance_id;
+	shm::doorbell          doorbell;
 	std::jthread           poll_thread;
 	std::jthread           scan_thread;
 	std::thread::id        ui_thread_id;
 	std::atomic_bool       scanning = false;
 	ui::general_q          ui;
 	ez::sync<scuff::model> model;
+	trace_data             tracing;
 };
 
 static std::atomic_bool      initialized_ = false;
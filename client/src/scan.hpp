@@ -211,7 +211,7 @@ auto retry_failed_devices(scuff::plugin plugin, scuff::scan_flags flags) -> void
 				dev.creation_callback = {};
 				m.devices = m.devices.insert(dev);
 				DATA_->model.set(ez::nort, m);
-				sbox.service->enqueue(msg::in::device_create{dev.id.value, dev.type, plugfile.path, plugin.ext_id.value, callback});
+				sbox.service->enqueue(msg::in::device_create{dev.id.value, dev.type, plugfile.path, plugin.ext_id.value, {}, callback});
 			}
 		}
 	}
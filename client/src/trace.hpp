@@ -0,0 +1,156 @@
+#pragma once
+
+#include "common-os.hpp"
+#include "common-trace.hpp"
+#include "data.hpp"
+#include <format>
+#include <fstream>
+#include <nlohmann/json.hpp>
+
+namespace scuff {
+namespace trace_ {
+
+// Once the log is this big the oldest records are discarded.
+static constexpr auto MAX_LOG_ENTRIES = size_t{1} << 20;
+
+// Thread ids as they appear in the trace. Client threads are
+// in the client process and sandbox threads are in the process
+// of their sandbox.
+static constexpr auto TID_POLL          = uint64_t{0};
+static constexpr auto TID_SANDBOX_MAIN  = uint64_t{1};
+static constexpr auto TID_SANDBOX_AUDIO = uint64_t{2};
+static constexpr auto TID_GROUP_AUDIO   = uint64_t{100}; // + group id
+
+[[nodiscard]] static
+auto get_client_pid() -> uint64_t {
+	return static_cast<uint64_t>(os::get_process_id());
+}
+
+static
+auto drain(ez::nort_t, trace::ring* ring, uint64_t pid, uint64_t tid, std::vector<trace_entry>* out) -> void {
+	trace::record record;
+	while (ring->pop(&record)) {
+		out->push_back({record, pid, tid});
+	}
+}
+
+static
+auto name_thread(trace_log* log, uint64_t pid, uint64_t tid, std::string_view process_name, std::string_view thread_name) -> void {
+	if (!log->process_names.contains(pid)) {
+		log->process_names[pid] = process_name;
+	}
+	if (!log->thread_names.contains({pid, tid})) {
+		log->thread_names[{pid, tid}] = thread_name;
+	}
+}
+
+static
+// Poll thread only. Move the records out of every trace ring and into the log.
+auto collect(ez::nort_t, const model& m, trace_data* tracing) -> void {
+	auto& drained = tracing->drained;
+	drained.clear();
+	const auto client_pid = get_client_pid();
+	drain(ez::nort, &tracing->poll_ring, client_pid, TID_POLL, &drained);
+	for (const auto& group : m.groups) {
+		drain(ez::nort, &group.service->audio_trace, client_pid, TID_GROUP_AUDIO + group.id.value, &drained);
+	}
+	for (const auto& sbox : m.sandboxes) {
+		if (!sbox.service || !sbox.service->shm.data) {
+			continue;
+		}
+		const auto pid = static_cast<uint64_t>(sbox.service->proc.id());
+		drain(ez::nort, &sbox.service->shm.data->main_trace, pid, TID_SANDBOX_MAIN, &drained);
+		drain(ez::nort, &sbox.service->shm.data->audio_trace, pid, TID_SANDBOX_AUDIO, &drained);
+	}
+	if (drained.empty()) {
+		return;
+	}
+	const auto log = tracing->log.lock();
+	name_thread(log.get(), client_pid, TID_POLL, "scuff client", "poll");
+	for (const auto& group : m.groups) {
+		name_thread(log.get(), client_pid, TID_GROUP_AUDIO + group.id.value, "scuff client", std::format("group {} audio", group.id.value));
+	}
+	for (const auto& sbox : m.sandboxes) {
+		if (sbox.service) {
+			const auto pid  = static_cast<uint64_t>(sbox.service->proc.id());
+			const auto name = std::format("scuff-sbox {}", sbox.id.value);
+			name_thread(log.get(), pid, TID_SANDBOX_MAIN, name, "main");
+			name_thread(log.get(), pid, TID_SANDBOX_AUDIO, name, "audio");
+		}
+	}
+	log->entries.insert(log->entries.end(), drained.begin(), drained.end());
+	while (log->entries.size() > MAX_LOG_ENTRIES) {
+		log->entries.pop_front();
+	}
+}
+
+static
+auto set_enabled(ez::nort_t, const model& m, trace_data* tracing, bool enabled) -> void {
+	if (enabled && !tracing->enabled) {
+		*tracing->log.lock() = {};
+	}
+	tracing->enabled = enabled;
+	tracing->poll_ring.enabled = enabled;
+	for (const auto& group : m.groups) {
+		group.service->audio_trace.enabled = enabled;
+	}
+	for (const auto& sbox : m.sandboxes) {
+		if (sbox.service && sbox.service->shm.data) {
+			sbox.service->shm.data->main_trace.enabled  = enabled;
+			sbox.service->shm.data->audio_trace.enabled = enabled;
+		}
+	}
+}
+
+[[nodiscard]] static
+auto get_phase_string(trace::phase phase) -> const char* {
+	switch (phase) {
+		case trace::phase::begin:   { return "B"; }
+		case trace::phase::end:     { return "E"; }
+		case trace::phase::instant: { return "i"; }
+	}
+	return "i";
+}
+
+[[nodiscard]] static
+// Chrome trace event format, which can be opened in Perfetto or chrome://tracing.
+auto make_json(const trace_log& log) -> nlohmann::json {
+	auto events = nlohmann::json::array();
+	for (const auto& [pid, name] : log.process_names) {
+		events.push_back({{"name", "process_name"}, {"ph", "M"}, {"pid", pid}, {"args", {{"name", name}}}});
+	}
+	for (const auto& [ids, name] : log.thread_names) {
+		events.push_back({{"name", "thread_name"}, {"ph", "M"}, {"pid", ids.first}, {"tid", ids.second}, {"args", {{"name", name}}}});
+	}
+	for (const auto& entry : log.entries) {
+		auto event = nlohmann::json{
+			{"name", trace::names[static_cast<size_t>(entry.record.what)]},
+			{"ph", get_phase_string(entry.record.phase)},
+			{"ts", static_cast<double>(entry.record.ns) / 1000.0},
+			{"pid", entry.pid},
+			{"tid", entry.tid},
+			{"args", {{"arg", entry.record.arg}}},
+		};
+		if (entry.record.phase == trace::phase::instant) {
+			event["s"] = "t";
+		}
+		events.push_back(std::move(event));
+	}
+	return {{"displayTimeUnit", "ns"}, {"traceEvents", std::move(events)}};
+}
+
+static
+auto write(ez::nort_t, trace_data* tracing, std::string_view path) -> void {
+	const auto log = *tracing->log.lock();
+	auto file = std::ofstream{std::string{path}};
+	if (!file) {
+		throw std::runtime_error{std::format("Failed to open '{}' for writing.", path)};
+	}
+	file << make_json(log).dump();
+	if (!file) {
+		throw std::runtime_error{std::format("Failed to write trace to '{}'.", path)};
+	}
+}
+
+} // trace_
+} // scuff
@@ -167,6 +167,20 @@ auto on_sbox_info(ez::nort_t, const sandbox& sbox, std::string_view info) -> voi
 	});
 }
 
+static
+auto on_sbox_late(ez::nort_t, const sandbox& sbox, uint64_t missed) -> void {
+	enqueue(ez::nort, sbox, [sbox_id = sbox.id, missed](const group_ui& ui) {
+		invoke_if_not_null(ui, &group_ui::on_sbox_late, sbox_id, missed);
+	});
+}
+
+static
+auto on_sbox_transfer_progress(ez::nort_t, const sandbox& sbox, msg::transfer_progress progress) -> void {
+	enqueue(ez::nort, sbox, [sbox_id = sbox.id, progress](const group_ui& ui) {
+		invoke_if_not_null(ui, &group_ui::on_sbox_transfer_progress, sbox_id, progress.transferred, progress.total);
+	});
+}
+
 static
 auto on_sbox_warning(ez::nort_t, const sandbox& sbox, std::string_view warning) -> void {
 	enqueue(ez::nort, sbox, [sbox_id = sbox.id, warning = std::string{warning}](const group_ui& ui) {
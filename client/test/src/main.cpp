@@ -1,11 +1,27 @@
 #define DOCTEST_CONFIG_IMPLEMENT
 #include "doctest.h"
+#include <algorithm>
+#include <array>
+#include <atomic>
 #include <boost/program_options.hpp>
+#include <cinttypes>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
 #include <filesystem>
+#include <fstream>
+#include <iterator>
+#include <numeric>
 #include <scuff/client.hpp>
 #include <scuff/managed.hpp>
+#include <scuff-test-plugins.hpp>
 #include <thread>
+#include <tuple>
 #include <vector>
+#if defined(__linux__)
+#include <sys/resource.h>
+#include <unistd.h>
+#endif
 
 namespace fs = std::filesystem;
 namespace po = boost::program_options;
@@ -13,6 +29,9 @@ namespace po = boost::program_options;
 static auto sbox_exe_path_ = fs::path{SBOX_EXE_PATH};
 static auto scan_exe_path_ = fs::path{SCAN_EXE_PATH};
 
+// Channels of the ports of the in-tree test plugins, apart from scuff.test.channels.
+static constexpr auto STEREO = 2;
+
 auto setup(int argc, const char* argv[]) -> void {
 	auto desc = po::options_description{"Allowed options"};
 	desc.add_options()
@@ -23,6 +42,7 @@ auto setup(int argc, const char* argv[]) -> void {
 	auto parsed_options = po::command_line_parser(argc, argv).options(desc).allow_unregistered().run();
 	po::store(parsed_options, vm);
 	po::notify(vm);
+	scuff::test_plugins::add_to_clap_path();
 	scuff::init();
 }
 
@@ -106,6 +126,323 @@ TEST_CASE("reload failed device") {
 	CHECK_NOTHROW(scuff::erase(group_id));
 }
 
+// Only scans the first time it is called, so
+// that tests can be run individually.
+auto scan_test_plugins() -> void {
+	static bool scanned = false;
+	if (scanned) {
+		return;
+	}
+	scanned = true;
+	bool done = false;
+	auto ui = make_empty_ui_reporter();
+	ui.on_scan_complete = [&done] { done = true; };
+	REQUIRE_NOTHROW(scuff::scan(scan_exe_path_.string(), {}));
+	while (!done) {
+		REQUIRE_NOTHROW(scuff::ui_update(ui));
+		std::this_thread::sleep_for(std::chrono::milliseconds(100));
+	}
+}
+
+// Create a device of one of the in-tree test plugins. It is erased when
+// the test is finished with it, even if the test fails part way through.
+auto create_test_device(const scuff::managed_sandbox& sbox, std::string_view plugin_id) -> scuff::managed_device {
+	INFO("creating device: ", plugin_id);
+	scuff::create_device_result device;
+	REQUIRE_NOTHROW(device = scuff::create_device(sbox.id(), scuff::plugin_type::clap, {std::string{plugin_id}}));
+	auto managed = scuff::managed_device{device.id};
+	REQUIRE(device.success);
+	REQUIRE(scuff::was_created_successfully(device.id));
+	return managed;
+}
+
+// An event which sets a parameter of a device globally,
+// rather than for a particular note, port, channel or key.
+auto make_param_value(size_t param, double value) -> scuff::events::param_value {
+	scuff::events::param_value event = {};
+	event.header.event_type = scuff::events::type::param_value;
+	event.param             = param;
+	event.note_id           = -1;
+	event.port_index        = -1;
+	event.channel           = -1;
+	event.key               = -1;
+	event.value             = value;
+	return event;
+}
+
+TEST_CASE("in-tree test plugins") {
+	scan_test_plugins();
+	const auto group = scuff::managed_group{scuff::create_group(nullptr)};
+	const auto sbox  = scuff::managed_sandbox{scuff::create_sandbox(group.id(), sbox_exe_path_.string())};
+	const auto passthrough = create_test_device(sbox, "scuff.test.passthrough");
+	const auto gain        = create_test_device(sbox, "scuff.test.gain");
+	const auto sine        = create_test_device(sbox, "scuff.test.sine");
+	const auto latency     = create_test_device(sbox, "scuff.test.latency");
+	const auto burn        = create_test_device(sbox, "scuff.test.burn");
+	const auto big_state   = create_test_device(sbox, "scuff.test.big-state");
+	const auto many_params = create_test_device(sbox, "scuff.test.many-params");
+	CHECK(scuff::get_param_count(passthrough.id()) == 0);
+	CHECK(scuff::get_param_count(many_params.id()) == 4096);
+	CHECK(scuff::get_value(gain.id(), scuff::idx::param{0}) == doctest::Approx(1.0));
+	// The default state is bigger than the bulk threshold,
+	// so it crosses between the processes in a bulk segment.
+	scuff::bytes state;
+	REQUIRE_NOTHROW(state = scuff::save(big_state.id()));
+	CHECK(state.size() > 1024 * 1024);
+	CHECK(scuff::load(big_state.id(), state));
+}
+
+TEST_CASE("message stats") {
+	scan_test_plugins();
+	const auto group   = scuff::managed_group{scuff::create_group(nullptr)};
+	const auto sbox    = scuff::managed_sandbox{scuff::create_sandbox(group.id(), sbox_exe_path_.string())};
+	const auto device1 = create_test_device(sbox, "scuff.test.passthrough");
+	const auto device2 = create_test_device(sbox, "scuff.test.big-state");
+	scuff::bytes state;
+	REQUIRE_NOTHROW(state = scuff::save(device2.id()));
+	CHECK(scuff::load(device2.id(), state));
+	const auto stats = scuff::get_message_stats(sbox.id());
+	const auto find  = [](const auto& list, std::string_view name) {
+		return *std::find_if(list.begin(), list.end(), [name](const auto& item) { return item.name == name; });
+	};
+	CHECK(find(stats.sent, "device_create").count == 2);
+	CHECK(find(stats.sent, "device_load").bytes >= state.size());
+	CHECK(find(stats.received, "return_requested_state").count == 1);
+	CHECK(find(stats.round_trips, "create_device").completed == 2);
+	CHECK(find(stats.round_trips, "save").completed == 1);
+	CHECK(find(stats.round_trips, "save").pending == 0);
+	CHECK(find(stats.round_trips, "load").completed == 1);
+}
+
+TEST_CASE("message buffer size") {
+	scan_test_plugins();
+	const auto group = scuff::managed_group{scuff::create_group(nullptr)};
+	CHECK_THROWS(std::ignore = scuff::create_sandbox(group.id(), sbox_exe_path_.string(), 0));
+	// Much smaller than a lot of the messages, which then have to be
+	// streamed through the buffer in several chunks.
+	const auto sbox   = scuff::managed_sandbox{scuff::create_sandbox(group.id(), sbox_exe_path_.string(), 64)};
+	const auto device = create_test_device(sbox, "scuff.test.many-params");
+	CHECK(scuff::get_param_count(device.id()) == 4096);
+	scuff::bytes state;
+	REQUIRE_NOTHROW(state = scuff::save(device.id()));
+	CHECK(scuff::load(device.id(), state));
+}
+
+TEST_CASE("cancelled transfers") {
+	scan_test_plugins();
+	const auto group  = scuff::managed_group{scuff::create_group(nullptr)};
+	const auto sbox   = scuff::managed_sandbox{scuff::create_sandbox(group.id(), sbox_exe_path_.string())};
+	const auto device = create_test_device(sbox, "scuff.test.big-state");
+	// Big enough that it takes many frames of the sandbox to stream it.
+	const auto state = scuff::bytes(64 * 1024 * 1024);
+	auto result = std::atomic<int>{-1};
+	scuff::load_async(device.id(), state, [&result](scuff::load_device_result r) { result = r.success ? 1 : 0; });
+	std::this_thread::sleep_for(std::chrono::milliseconds(200));
+	scuff::cancel_transfers(sbox.id());
+	// The load is failed straight away rather than left to time out.
+	const auto start = std::chrono::steady_clock::now();
+	while (result == -1 && std::chrono::steady_clock::now() - start < std::chrono::seconds(2)) {
+		std::this_thread::sleep_for(std::chrono::milliseconds(10));
+	}
+	CHECK(result == 0);
+}
+
+// A group_process without any events, which is all most of the tests need.
+auto make_group_process(scuff::id::group group, scuff::audio_inputs inputs = {}, scuff::audio_outputs outputs = {}) -> scuff::group_process {
+	scuff::group_process gp;
+	gp.group              = group;
+	gp.audio_inputs       = std::move(inputs);
+	gp.audio_outputs      = std::move(outputs);
+	gp.input_events.count = [] { return 0; };
+	gp.input_events.pop   = [](size_t, scuff::input_event*) { return 0; };
+	gp.output_events.push = [](const scuff::output_event&) {};
+	return gp;
+}
+
+// Keep processing until done() returns true, and return false if it never
+// does. The sandbox doesn't start processing until it has confirmed that it
+// is active, and changes to the group take a few cycles to reach it.
+template <typename Fn>
+auto process_until(const scuff::group_process& gp, Fn&& done) -> bool {
+	for (int i = 0; i < 200; i++) {
+		REQUIRE_NOTHROW(scuff::audio_process(gp));
+		if (done()) {
+			return true;
+		}
+		std::this_thread::sleep_for(std::chrono::milliseconds(10));
+	}
+	return false;
+}
+
+TEST_CASE("device stats") {
+	scan_test_plugins();
+	const auto group   = scuff::managed_group{scuff::create_group(nullptr)};
+	const auto sbox    = scuff::managed_sandbox{scuff::create_sandbox(group.id(), sbox_exe_path_.string())};
+	const auto device1 = create_test_device(sbox, "scuff.test.burn");
+	CHECK(scuff::get_device_stats(device1.id()).processed == 0);
+	REQUIRE_NOTHROW(scuff::activate(group.id(), 44100.0));
+	const auto in  = scuff::audio_input{device1.id(), 0, [](float* floats) { std::fill_n(floats, scuff::VECTOR_SIZE * STEREO, 0.0f); }};
+	const auto out = scuff::audio_output{device1.id(), 0, [](const float* floats) {}};
+	const auto gp  = make_group_process(group.id(), {in}, {out});
+	scuff::device_stats stats;
+	CHECK(process_until(gp, [&] { stats = scuff::get_device_stats(device1.id()); return stats.processed > 0; }));
+	CHECK(stats.max >= stats.last);
+	CHECK(stats.max >= stats.average);
+}
+
+TEST_CASE("group telemetry") {
+	scan_test_plugins();
+	const auto group   = scuff::managed_group{scuff::create_group(nullptr)};
+	const auto sbox    = scuff::managed_sandbox{scuff::create_sandbox(group.id(), sbox_exe_path_.string())};
+	const auto device1 = create_test_device(sbox, "scuff.test.passthrough");
+	REQUIRE_NOTHROW(scuff::activate(group.id(), 44100.0));
+	const auto in  = scuff::audio_input{device1.id(), 0, [](float* floats) { std::fill_n(floats, scuff::VECTOR_SIZE * STEREO, 0.0f); }};
+	const auto out = scuff::audio_output{device1.id(), 0, [](const float* floats) {}};
+	const auto gp  = make_group_process(group.id(), {in}, {out});
+	const auto total = [](const scuff::duration_histogram& histogram) {
+		return std::accumulate(histogram.counts.begin(), histogram.counts.end(), uint64_t{0});
+	};
+	// The sandbox only finishes cycles once it has confirmed that it is active.
+	REQUIRE(process_until(gp, [&] {
+		const auto telemetry = scuff::get_group_telemetry(group.id());
+		return telemetry.finished_last.size() == 1 && telemetry.finished_last[0].cycles > 0;
+	}));
+	const auto before = scuff::get_group_telemetry(group.id());
+	for (int i = 0; i < 4; i++) {
+		REQUIRE_NOTHROW(scuff::audio_process(gp));
+	}
+	const auto telemetry = scuff::get_group_telemetry(group.id());
+	CHECK(telemetry.cycles == before.cycles + 4);
+	CHECK(telemetry.zeroed_cycles == 0);
+	// Every cycle is recorded in both histograms.
+	CHECK(total(telemetry.cycle_time) == telemetry.cycles);
+	CHECK(total(telemetry.wait_time) == telemetry.cycles);
+	// The only sandbox is always the last one to finish.
+	REQUIRE(telemetry.finished_last.size() == 1);
+	CHECK(telemetry.finished_last[0].sbox == sbox.id());
+	CHECK(telemetry.finished_last[0].cycles == before.finished_last[0].cycles + 4);
+}
+
+TEST_CASE("wait stats") {
+	scan_test_plugins();
+	const auto group   = scuff::managed_group{scuff::create_group(nullptr)};
+	const auto sbox    = scuff::managed_sandbox{scuff::create_sandbox(group.id(), sbox_exe_path_.string())};
+	const auto device1 = create_test_device(sbox, "scuff.test.passthrough");
+	REQUIRE_NOTHROW(scuff::activate(group.id(), 44100.0));
+	const auto gp    = make_group_process(group.id());
+	const auto spun  = [](const scuff::wait_stats& stats) { return stats.client_spun + stats.sandbox_spun; };
+	const auto slept = [](const scuff::wait_stats& stats) { return stats.client_slept + stats.sandbox_slept; };
+	// Cycles straight after each other are caught while spinning, and
+	// the sandbox goes to sleep when the next one is a long way off.
+	const auto process_cycles = [&gp] {
+		for (int i = 0; i < 8; i++) {
+			REQUIRE_NOTHROW(scuff::audio_process(gp));
+			REQUIRE_NOTHROW(scuff::audio_process(gp));
+			std::this_thread::sleep_for(std::chrono::milliseconds(20));
+		}
+	};
+	REQUIRE(process_until(gp, [&] { return scuff::get_device_stats(device1.id()).processed > 0; }));
+	REQUIRE_NOTHROW(scuff::set_spin_time(group.id(), std::chrono::milliseconds(5)));
+	auto before = scuff::get_wait_stats(group.id());
+	process_cycles();
+	auto after = scuff::get_wait_stats(group.id());
+	CHECK(spun(after) > spun(before));
+	CHECK(slept(after) > slept(before));
+	// Without any spin time every wait sleeps. Any wait which started
+	// spinning before the change has given up by the time of the snapshot.
+	REQUIRE_NOTHROW(scuff::set_spin_time(group.id(), std::chrono::microseconds{0}));
+	std::this_thread::sleep_for(std::chrono::milliseconds(20));
+	before = scuff::get_wait_stats(group.id());
+	process_cycles();
+	after = scuff::get_wait_stats(group.id());
+	CHECK(spun(after) == spun(before));
+	CHECK(slept(after) > slept(before));
+}
+
+TEST_CASE("late output") {
+	scan_test_plugins();
+	const auto group   = scuff::managed_group{scuff::create_group(nullptr)};
+	const auto sbox    = scuff::managed_sandbox{scuff::create_sandbox(group.id(), sbox_exe_path_.string())};
+	const auto device1 = create_test_device(sbox, "scuff.test.burn");
+	REQUIRE_NOTHROW(scuff::activate(group.id(), 44100.0));
+	REQUIRE_NOTHROW(scuff::set_deadline(group.id(), 0.9, scuff::late_output::repeat_last_block));
+	// The input of each cycle is the number of the cycle,
+	// so it's possible to tell which one an output is from.
+	auto cycle  = 0.0f;
+	auto played = 0.0f;
+	auto burn   = false;
+	const auto in  = scuff::audio_input{device1.id(), 0, [&cycle](float* floats) { std::fill_n(floats, STEREO * scuff::VECTOR_SIZE, ++cycle); }};
+	const auto out = scuff::audio_output{device1.id(), 0, [&played](const float* floats) { played = floats[0]; }};
+	auto gp = make_group_process(group.id(), {in}, {out});
+	const auto burn_us = make_param_value(0, 20000.0);
+	gp.input_events.count = [&burn] { return burn ? 1 : 0; };
+	gp.input_events.pop   = [&burn, &burn_us, dev = device1.id()](size_t, scuff::input_event* events) {
+		if (!burn) {
+			return 0;
+		}
+		events[0] = {dev, burn_us};
+		burn      = false;
+		return 1;
+	};
+	REQUIRE(process_until(gp, [&] { return played == cycle; }));
+	const auto last_good = played;
+	// From the next cycle on, the device spins for several blocks each
+	// time it processes, so it misses every deadline.
+	burn = true;
+	for (int i = 0; i < 20; i++) {
+		REQUIRE_NOTHROW(scuff::audio_process(gp));
+		CHECK(played == last_good);
+	}
+	CHECK(scuff::get_group_telemetry(group.id()).late_cycles >= 20);
+}
+
+TEST_CASE("device meters") {
+	scan_test_plugins();
+	const auto group   = scuff::managed_group{scuff::create_group(nullptr)};
+	const auto sbox    = scuff::managed_sandbox{scuff::create_sandbox(group.id(), sbox_exe_path_.string())};
+	const auto device1 = create_test_device(sbox, "scuff.test.sine");
+	REQUIRE_NOTHROW(scuff::activate(group.id(), 44100.0));
+	// Nobody is reading the output, but the sandbox still meters it.
+	const auto gp = make_group_process(group.id());
+	auto peak = 0.0f;
+	auto rms  = 0.0f;
+	std::ignore = process_until(gp, [&] {
+		const auto meters = scuff::get_device_meters(device1.id());
+		REQUIRE(meters.size() == 1);
+		peak = std::max(peak, meters[0].peak[0]);
+		rms  = meters[0].rms[0];
+		return rms != 0.0f;
+	});
+	// The sine peaks at 0.25.
+	CHECK(peak == doctest::Approx(0.25f).epsilon(0.05));
+	CHECK(rms > 0.1f);
+	CHECK(rms < 0.25f);
+}
+
+TEST_CASE("timeline trace") {
+	scan_test_plugins();
+	REQUIRE_NOTHROW(scuff::set_tracing(true));
+	const auto group   = scuff::managed_group{scuff::create_group(nullptr)};
+	const auto sbox    = scuff::managed_sandbox{scuff::create_sandbox(group.id(), sbox_exe_path_.string())};
+	const auto device1 = create_test_device(sbox, "scuff.test.passthrough");
+	REQUIRE_NOTHROW(scuff::activate(group.id(), 44100.0));
+	const auto gp = make_group_process(group.id());
+	REQUIRE(process_until(gp, [&] { return scuff::get_device_stats(device1.id()).processed > 0; }));
+	// Give the poll thread a chance to collect the records.
+	std::this_thread::sleep_for(std::chrono::milliseconds(100));
+	const auto path = fs::temp_directory_path() / "scuff-test-trace.json";
+	REQUIRE_NOTHROW(scuff::write_trace(path.string()));
+	REQUIRE_NOTHROW(scuff::set_tracing(false));
+	auto file = std::ifstream{path};
+	const auto json = std::string{std::istreambuf_iterator<char>{file}, std::istreambuf_iterator<char>{}};
+	CHECK(json.find("\"traceEvents\"") != std::string::npos);
+	CHECK(json.find("\"audio_process\"") != std::string::npos);
+	CHECK(json.find("\"plugin_process\"") != std::string::npos);
+	CHECK(json.find("\"main_frame\"") != std::string::npos);
+	file.close();
+	fs::remove(path);
+}
+
 TEST_CASE("synchronous device duplication") {
 	scuff::id::group group1_id, group2_id;
 	scuff::id::sandbox sbox1_id, sbox2_id;
@@ -224,7 +561,7 @@ TEST_CASE("single-sandbox rack connections") {
 	scuff::audio_output out;
 	in.dev_id      = device1.id;
 	in.port_index  = 0;
-	in.write_to    = [](float* floats) { for (int i = 0; i < scuff::VECTOR_SIZE * scuff::CHANNEL_COUNT; i++) { floats[i] = 0.0f; } };
+	in.write_to    = [](float* floats) { for (int i = 0; i < scuff::VECTOR_SIZE * STEREO; i++) { floats[i] = 0.0f; } };
 	out.dev_id     = device4.id;
 	out.port_index = 0;
 	out.read_from  = [](const float* floats) {};
@@ -253,6 +590,442 @@ TEST_CASE("single-sandbox rack connections") {
 
 }
 
+TEST_CASE("port layouts") {
+	scan_test_plugins();
+	const auto group   = scuff::managed_group{scuff::create_group(nullptr)};
+	const auto sbox    = scuff::managed_sandbox{scuff::create_sandbox(group.id(), sbox_exe_path_.string())};
+	const auto device1 = create_test_device(sbox, "scuff.test.channels");
+	const auto info = scuff::get_port_info(device1.id());
+	CHECK(info.audio_input_channels == std::vector<uint32_t>{1});
+	CHECK(info.audio_output_channels == std::vector<uint32_t>{1, 8});
+	REQUIRE_NOTHROW(scuff::activate(group.id(), 44100.0));
+	auto mono_ok = false;
+	auto wide_ok = false;
+	const auto in   = scuff::audio_input{device1.id(), 0, [](float* floats) { std::fill_n(floats, scuff::VECTOR_SIZE, 0.5f); }};
+	const auto mono = scuff::audio_output{device1.id(), 0, [&mono_ok](const float* floats) { mono_ok = std::all_of(floats, floats + scuff::VECTOR_SIZE, [](float x) { return x == 0.5f; }); }};
+	const auto wide = scuff::audio_output{device1.id(), 1, [&wide_ok](const float* floats) { wide_ok = std::all_of(floats, floats + (scuff::VECTOR_SIZE * 8), [](float x) { return x == 0.5f; }); }};
+	const auto gp   = make_group_process(group.id(), {in}, {mono, wide});
+	// Every channel of both outputs is a copy of the mono input.
+	std::ignore = process_until(gp, [&] { return mono_ok && wide_ok; });
+	CHECK(mono_ok);
+	CHECK(wide_ok);
+	const auto meters = scuff::get_device_meters(device1.id());
+	REQUIRE(meters.size() == 2);
+	CHECK(meters[0].rms.size() == 1);
+	CHECK(meters[1].rms.size() == 8);
+	CHECK(meters[1].peak.size() == 8);
+}
+
+TEST_CASE("block sizes") {
+	scan_test_plugins();
+	const auto group   = scuff::managed_group{scuff::create_group(nullptr)};
+	const auto sbox    = scuff::managed_sandbox{scuff::create_sandbox(group.id(), sbox_exe_path_.string())};
+	const auto device1 = create_test_device(sbox, "scuff.test.passthrough");
+	CHECK_THROWS(scuff::activate(group.id(), 44100.0, 0));
+	CHECK_THROWS(scuff::activate(group.id(), 44100.0, scuff::MAX_VECTOR_SIZE + 1));
+	for (const auto max_frames : {32u, 64u, 128u, 256u, 512u, 1024u}) {
+		REQUIRE_NOTHROW(scuff::activate(group.id(), 44100.0, max_frames));
+		// A full block, and a shorter odd-sized one like the last block of a render.
+		for (const auto frames : {max_frames, (max_frames / 2) + 7}) {
+			INFO("max_frames: ", max_frames, ", frames: ", frames);
+			const auto value = [](uint32_t c, uint32_t i) { return static_cast<float>(c + 1) + (static_cast<float>(i) / 2048.0f); };
+			auto matched = false;
+			const auto in = scuff::audio_input{device1.id(), 0, [=](float* floats) {
+				for (uint32_t c = 0; c < STEREO; c++) {
+					for (uint32_t i = 0; i < max_frames; i++) {
+						// The frames after the end of the block shouldn't be processed.
+						floats[(c * max_frames) + i] = i < frames ? value(c, i) : -1.0f;
+					}
+				}
+			}};
+			const auto out = scuff::audio_output{device1.id(), 0, [=, &matched](const float* floats) {
+				matched = true;
+				for (uint32_t c = 0; c < STEREO; c++) {
+					for (uint32_t i = 0; i < frames; i++) {
+						matched = matched && floats[(c * max_frames) + i] == value(c, i);
+					}
+				}
+			}};
+			auto gp   = make_group_process(group.id(), {in}, {out});
+			gp.frames = frames;
+			// The sandbox has to reactivate the device first.
+			CHECK(process_until(gp, [&] { return matched; }));
+		}
+	}
+}
+
+TEST_CASE("64-bit processing") {
+	scan_test_plugins();
+	const auto group = scuff::managed_group{scuff::create_group(nullptr)};
+	REQUIRE_NOTHROW(scuff::set_sample_format(group.id(), scuff::sample_format::float64));
+	const auto sbox = scuff::managed_sandbox{scuff::create_sandbox(group.id(), sbox_exe_path_.string())};
+	// The passthrough plugin doesn't support 64-bit processing,
+	// so the sandbox has to convert its ports.
+	const auto device1 = create_test_device(sbox, "scuff.test.passthrough");
+	REQUIRE_NOTHROW(scuff::activate(group.id(), 44100.0));
+	static constexpr auto COUNT = STEREO * scuff::VECTOR_SIZE;
+	auto matched64 = false;
+	auto matched32 = false;
+	scuff::audio_input in;
+	scuff::audio_output out64, out32;
+	in.dev_id         = device1.id();
+	in.port_index     = 0;
+	in.write_to       = [](float* floats) { std::fill_n(floats, COUNT, 0.5f); };
+	in.write_to64     = [](double* doubles) { std::fill_n(doubles, COUNT, 0.1); };
+	out64.dev_id      = device1.id();
+	out64.port_index  = 0;
+	out64.read_from   = [&matched64](const float*) { matched64 = false; };
+	out64.read_from64 = [&matched64](const double* doubles) { matched64 = std::all_of(doubles, doubles + COUNT, [](double x) { return x == double{0.1f}; }); };
+	// Without a 64-bit callback the output is converted by the client.
+	out32.dev_id      = device1.id();
+	out32.port_index  = 0;
+	out32.read_from   = [&matched32](const float* floats) { matched32 = std::all_of(floats, floats + COUNT, [](float x) { return x == 0.1f; }); };
+	auto gp = make_group_process(group.id(), {in}, {out64, out32});
+	std::ignore = process_until(gp, [&] { return matched64 && matched32; });
+	CHECK(matched64);
+	CHECK(matched32);
+	// Back to 32-bit, where the 64-bit callbacks are ignored.
+	REQUIRE_NOTHROW(scuff::set_sample_format(group.id(), scuff::sample_format::float32));
+	matched32 = false;
+	gp.audio_outputs[1].read_from = [&matched32](const float* floats) { matched32 = std::all_of(floats, floats + COUNT, [](float x) { return x == 0.5f; }); };
+	CHECK(process_until(gp, [&] { return matched32; }));
+}
+
+TEST_CASE("device arena") {
+	scan_test_plugins();
+	const auto group = scuff::managed_group{scuff::create_group(nullptr)};
+	const auto sbox  = scuff::managed_sandbox{scuff::create_sandbox(group.id(), sbox_exe_path_.string())};
+	std::vector<scuff::managed_device> devices;
+	const auto create = [&] {
+		devices.push_back(create_test_device(sbox, "scuff.test.passthrough"));
+	};
+	for (int i = 0; i < 16; i++) {
+		create();
+	}
+	// Free some blocks in the middle of the arena so that they get reused.
+	std::vector<scuff::managed_device> kept;
+	for (size_t i = 1; i < devices.size(); i += 2) {
+		kept.push_back(std::move(devices[i]));
+	}
+	devices = std::move(kept);
+	for (int i = 0; i < 8; i++) {
+		create();
+	}
+	REQUIRE_NOTHROW(scuff::activate(group.id(), 44100.0));
+	auto matched = false;
+	const auto in  = scuff::audio_input{devices.back().id(), 0, [](float* floats) { std::fill_n(floats, STEREO * scuff::VECTOR_SIZE, 0.25f); }};
+	const auto out = scuff::audio_output{devices.back().id(), 0, [&matched](const float* floats) { matched = std::all_of(floats, floats + (STEREO * scuff::VECTOR_SIZE), [](float x) { return x == 0.25f; }); }};
+	const auto gp  = make_group_process(group.id(), {in}, {out});
+	CHECK(process_until(gp, [&] { return matched; }));
+}
+
+#if defined(__linux__)
+// True if the page at addr is locked into this process's memory,
+// going by the flags of the mapping which it is in.
+auto is_locked(const void* addr) -> bool {
+	const auto target = reinterpret_cast<uintptr_t>(addr);
+	auto smaps        = std::ifstream{"/proc/self/smaps"};
+	auto in_mapping   = false;
+	for (std::string line; std::getline(smaps, line);) {
+		uintptr_t begin, end;
+		if (std::sscanf(line.c_str(), "%" SCNxPTR "-%" SCNxPTR, &begin, &end) == 2) {
+			in_mapping = target >= begin && target < end;
+			continue;
+		}
+		if (in_mapping && line.starts_with("VmFlags:")) {
+			return line.find(" lo") != std::string::npos;
+		}
+	}
+	return false;
+}
+
+// True if nothing should stop this process from locking as much memory as it likes.
+auto can_lock_any_amount() -> bool {
+	rlimit limit;
+	return geteuid() == 0 || (getrlimit(RLIMIT_MEMLOCK, &limit) == 0 && limit.rlim_cur == RLIM_INFINITY);
+}
+#endif
+
+TEST_CASE("memory options") {
+	scan_test_plugins();
+	scuff::memory_options options;
+	options.lock       = true;
+	options.prefault   = true;
+	options.huge_pages = true;
+	options.lock_all   = true;
+	const auto group = scuff::managed_group{scuff::create_group(nullptr)};
+	REQUIRE_NOTHROW(scuff::set_memory_options(group.id(), options));
+	const auto sbox = scuff::managed_sandbox{scuff::create_sandbox(group.id(), sbox_exe_path_.string())};
+	// Next to each other in the arena, so they share a page.
+	auto device1       = create_test_device(sbox, "scuff.test.passthrough");
+	const auto device2 = create_test_device(sbox, "scuff.test.passthrough");
+	REQUIRE_NOTHROW(scuff::activate(group.id(), 44100.0));
+	static constexpr auto COUNT = STEREO * scuff::VECTOR_SIZE;
+	auto refs = std::vector{scuff::port_ref{device1.id(), 0}, scuff::port_ref{device2.id(), 0}};
+	scuff::direct_ports ports;
+	REQUIRE_NOTHROW(ports = scuff::resolve_ports(group.id(), refs, refs));
+	scuff::direct_process dp;
+	dp.ports = &ports;
+	// Processing still works if any of the options couldn't be applied.
+	const auto process_direct_until_passed_through = [&] {
+		for (int i = 0; i < 200; i++) {
+			for (const auto& in : ports.inputs) {
+				if (in.samples) {
+					std::fill_n(in.samples, COUNT, 0.25f);
+				}
+			}
+			scuff::direct_result result;
+			REQUIRE_NOTHROW(result = scuff::audio_process(dp));
+			if (result.stale) {
+				REQUIRE_NOTHROW(ports = scuff::resolve_ports(group.id(), refs, refs));
+				continue;
+			}
+			if (std::ranges::all_of(ports.outputs, [](const scuff::direct_output& out) {
+				return out.samples && std::all_of(out.samples, out.samples + COUNT, [](float x) { return x == 0.25f; });
+			})) {
+				return true;
+			}
+			std::this_thread::sleep_for(std::chrono::milliseconds(10));
+		}
+		return false;
+	};
+	REQUIRE(process_direct_until_passed_through());
+#if defined(__linux__)
+	// Locking can fail if the memory lock limit is too low, but then it is
+	// reported. The client's warnings are reported by the time it has
+	// opened the devices.
+	auto lock_failed = false;
+	auto ui          = make_empty_group_reporter();
+	ui.on_sbox_warning = [&lock_failed](scuff::id::sandbox sbox, std::string_view warning) {
+		lock_failed = lock_failed || (warning.find("lock") != warning.npos && warning.ends_with("(client process)"));
+	};
+	REQUIRE_NOTHROW(scuff::ui_update(group.id(), ui));
+	const auto locked = is_locked(ports.outputs[0].samples) && is_locked(ports.outputs[1].samples);
+	CHECK((locked || lock_failed));
+	if (can_lock_any_amount()) {
+		CHECK(locked);
+	}
+	// The second device's memory stays locked when the first
+	// one's is unlocked, although they share a page.
+	device1 = {};
+	refs.erase(refs.begin());
+	REQUIRE(process_direct_until_passed_through());
+	CHECK(is_locked(ports.outputs[0].samples) == locked);
+	CHECK_NOTHROW(scuff::set_memory_options(group.id(), {}));
+	CHECK_FALSE(is_locked(ports.outputs[0].samples));
+#else
+	CHECK_NOTHROW(scuff::set_memory_options(group.id(), {}));
+#endif
+}
+
+TEST_CASE("cross-sandbox connections") {
+	scan_test_plugins();
+	const auto group   = scuff::managed_group{scuff::create_group(nullptr)};
+	const auto sbox1   = scuff::managed_sandbox{scuff::create_sandbox(group.id(), sbox_exe_path_.string())};
+	const auto sbox2   = scuff::managed_sandbox{scuff::create_sandbox(group.id(), sbox_exe_path_.string())};
+	const auto device1 = create_test_device(sbox1, "scuff.test.sine");
+	const auto device2 = create_test_device(sbox2, "scuff.test.passthrough");
+	REQUIRE_NOTHROW(scuff::connect(device1.id(), 0, device2.id(), 0));
+	REQUIRE_NOTHROW(scuff::activate(group.id(), 44100.0));
+	auto peak = 0.0f;
+	const auto out = scuff::audio_output{device2.id(), 0, [&peak](const float* floats) {
+		for (int i = 0; i < scuff::VECTOR_SIZE * STEREO; i++) {
+			peak = std::max(peak, std::abs(floats[i]));
+		}
+	}};
+	const auto gp  = make_group_process(group.id(), {}, {out});
+	// The sine wave reaches the second sandbox without the client copying it.
+	std::ignore = process_until(gp, [&] { return peak > 0.0f; });
+	CHECK(peak > 0.1f);
+	CHECK_NOTHROW(scuff::disconnect(device1.id(), 0, device2.id(), 0));
+	CHECK_NOTHROW(scuff::audio_process(gp));
+}
+
+TEST_CASE("fan-in connections") {
+	scan_test_plugins();
+	const auto group   = scuff::managed_group{scuff::create_group(nullptr)};
+	const auto sbox    = scuff::managed_sandbox{scuff::create_sandbox(group.id(), sbox_exe_path_.string())};
+	const auto device1 = create_test_device(sbox, "scuff.test.sine");
+	const auto device2 = create_test_device(sbox, "scuff.test.sine");
+	const auto device3 = create_test_device(sbox, "scuff.test.passthrough");
+	REQUIRE_NOTHROW(scuff::connect(device1.id(), 0, device3.id(), 0));
+	REQUIRE_NOTHROW(scuff::connect(device2.id(), 0, device3.id(), 0));
+	REQUIRE_NOTHROW(scuff::activate(group.id(), 44100.0));
+	auto peak = 0.0f;
+	const auto out = scuff::audio_output{device3.id(), 0, [&peak](const float* floats) {
+		for (int i = 0; i < scuff::VECTOR_SIZE * STEREO; i++) {
+			peak = std::max(peak, std::abs(floats[i]));
+		}
+	}};
+	const auto gp  = make_group_process(group.id(), {}, {out});
+	std::ignore = process_until(gp, [&] { return peak > 0.0f; });
+	for (int i = 0; i < 10; i++) {
+		REQUIRE_NOTHROW(scuff::audio_process(gp));
+	}
+	// The sines are in phase and each one peaks at 0.25,
+	// so this only happens if both of them were summed.
+	CHECK(peak > 0.3f);
+	CHECK_NOTHROW(scuff::disconnect(device1.id(), 0, device3.id(), 0));
+	CHECK_NOTHROW(scuff::disconnect(device2.id(), 0, device3.id(), 0));
+}
+
+TEST_CASE("cross-sandbox fan-in connections") {
+	scan_test_plugins();
+	const auto group   = scuff::managed_group{scuff::create_group(nullptr)};
+	const auto sbox1   = scuff::managed_sandbox{scuff::create_sandbox(group.id(), sbox_exe_path_.string())};
+	const auto sbox2   = scuff::managed_sandbox{scuff::create_sandbox(group.id(), sbox_exe_path_.string())};
+	const auto sbox3   = scuff::managed_sandbox{scuff::create_sandbox(group.id(), sbox_exe_path_.string())};
+	const auto device1 = create_test_device(sbox1, "scuff.test.passthrough");
+	const auto device2 = create_test_device(sbox2, "scuff.test.passthrough");
+	const auto device3 = create_test_device(sbox3, "scuff.test.passthrough");
+	REQUIRE_NOTHROW(scuff::connect(device1.id(), 0, device3.id(), 0));
+	REQUIRE_NOTHROW(scuff::connect(device2.id(), 0, device3.id(), 0));
+	REQUIRE_NOTHROW(scuff::activate(group.id(), 44100.0));
+	// Constant inputs, so that the sum doesn't depend on the phase
+	// of either source when it arrives in the third sandbox.
+	const auto in1 = scuff::audio_input{device1.id(), 0, [](float* floats) { std::fill_n(floats, scuff::VECTOR_SIZE * STEREO, 0.25f); }};
+	const auto in2 = scuff::audio_input{device2.id(), 0, [](float* floats) { std::fill_n(floats, scuff::VECTOR_SIZE * STEREO, 0.5f); }};
+	auto played = 0.0f;
+	const auto out = scuff::audio_output{device3.id(), 0, [&played](const float* floats) {
+		const auto all_same = std::all_of(floats, floats + scuff::VECTOR_SIZE * STEREO, [floats](float f) { return f == floats[0]; });
+		played = all_same ? floats[0] : -1.0f;
+	}};
+	const auto gp = make_group_process(group.id(), {in1, in2}, {out});
+	// Both outputs are summed into the input in the third sandbox.
+	CHECK(process_until(gp, [&] { return played == 0.75f; }));
+	CHECK_NOTHROW(scuff::disconnect(device2.id(), 0, device3.id(), 0));
+	CHECK(process_until(gp, [&] { return played == 0.25f; }));
+	CHECK_NOTHROW(scuff::disconnect(device1.id(), 0, device3.id(), 0));
+}
+
+TEST_CASE("direct port access") {
+	scan_test_plugins();
+	const auto group = scuff::managed_group{scuff::create_group(nullptr)};
+	const auto sbox  = scuff::managed_sandbox{scuff::create_sandbox(group.id(), sbox_exe_path_.string())};
+	auto device1     = create_test_device(sbox, "scuff.test.gain");
+	REQUIRE_NOTHROW(scuff::activate(group.id(), 44100.0));
+	static constexpr auto COUNT = STEREO * scuff::VECTOR_SIZE;
+	const auto refs = std::array{scuff::port_ref{device1.id(), 0}};
+	scuff::direct_ports ports;
+	REQUIRE_NOTHROW(ports = scuff::resolve_ports(group.id(), refs, refs));
+	const auto input_events = std::array{scuff::input_event{device1.id(), make_param_value(0, 0.5)}};
+	std::array<scuff::output_event, 16> output_events;
+	scuff::direct_process dp;
+	dp.ports         = &ports;
+	dp.input_events  = input_events;
+	dp.output_events = output_events;
+	auto matched = false;
+	for (int i = 0; i < 200 && !matched; i++) {
+		if (const auto samples = ports.inputs[0].samples) {
+			std::fill_n(samples, COUNT, 0.5f);
+		}
+		scuff::direct_result result;
+		REQUIRE_NOTHROW(result = scuff::audio_process(dp));
+		CHECK(result.output_event_count <= output_events.size());
+		if (result.stale) {
+			REQUIRE_NOTHROW(ports = scuff::resolve_ports(group.id(), refs, refs));
+			continue;
+		}
+		const auto samples = ports.outputs[0].samples;
+		matched = samples && std::all_of(samples, samples + COUNT, [](float x) { return x == 0.25f; });
+		std::this_thread::sleep_for(std::chrono::milliseconds(10));
+	}
+	CHECK(matched);
+	// The ports of an erased device are unusable from the next cycle.
+	device1 = {};
+	scuff::direct_result result;
+	REQUIRE_NOTHROW(result = scuff::audio_process(dp));
+	CHECK(result.stale);
+	CHECK(ports.inputs[0].samples == nullptr);
+	CHECK(ports.outputs[0].samples == nullptr);
+}
+
+TEST_CASE("sleeping devices") {
+	scan_test_plugins();
+	const auto group   = scuff::managed_group{scuff::create_group(nullptr)};
+	const auto sbox    = scuff::managed_sandbox{scuff::create_sandbox(group.id(), sbox_exe_path_.string())};
+	const auto device1 = create_test_device(sbox, "scuff.test.sine");
+	const auto device2 = create_test_device(sbox, "scuff.test.passthrough");
+	REQUIRE_NOTHROW(scuff::connect(device1.id(), 0, device2.id(), 0));
+	REQUIRE_NOTHROW(scuff::activate(group.id(), 44100.0));
+	static constexpr auto COUNT = STEREO * scuff::VECTOR_SIZE;
+	static constexpr auto ALL_SILENT = uint64_t{0b11};
+	const auto refs = std::array{scuff::port_ref{device2.id(), 0}};
+	scuff::direct_ports ports;
+	REQUIRE_NOTHROW(ports = scuff::resolve_ports(group.id(), {}, refs));
+	std::array<scuff::output_event, 16> output_events;
+	scuff::direct_process dp;
+	dp.ports         = &ports;
+	dp.output_events = output_events;
+	const auto process_direct_until = [&](auto&& pred) {
+		for (int i = 0; i < 200; i++) {
+			scuff::direct_result result;
+			REQUIRE_NOTHROW(result = scuff::audio_process(dp));
+			if (result.stale) {
+				REQUIRE_NOTHROW(ports = scuff::resolve_ports(group.id(), {}, refs));
+				continue;
+			}
+			if (ports.outputs[0].samples && pred(ports.outputs[0])) {
+				return true;
+			}
+			std::this_thread::sleep_for(std::chrono::milliseconds(10));
+		}
+		return false;
+	};
+	const auto audible = [](const scuff::direct_output& out) {
+		return out.silent_mask == 0 && std::any_of(out.samples, out.samples + COUNT, [](float x) { return x != 0.0f; });
+	};
+	const auto silent = [](const scuff::direct_output& out) {
+		return out.silent_mask == ALL_SILENT;
+	};
+	CHECK(process_direct_until(audible));
+	// With no amplitude the sine goes to sleep. Its outputs are flagged as silent, so
+	// nothing is added to the passthrough's input, which stays flagged as silent too,
+	// and the passthrough passes the flag on. Adding the zeros would have cleared it.
+	auto input_events = std::array{scuff::input_event{device1.id(), make_param_value(1, 0.0)}};
+	dp.input_events = input_events;
+	CHECK(process_direct_until(silent));
+	CHECK(scuff::get_device_stats(device1.id()).asleep > 0);
+	const auto& out = ports.outputs[0];
+	CHECK(std::all_of(out.samples, out.samples + COUNT, [](float x) { return x == 0.0f; }));
+	// Raising the amplitude wakes it up again.
+	input_events[0] = scuff::input_event{device1.id(), make_param_value(1, 0.25)};
+	CHECK(process_direct_until(audible));
+	CHECK_NOTHROW(scuff::disconnect(device1.id(), 0, device2.id(), 0));
+}
+
+TEST_CASE("pipelined processing") {
+	scan_test_plugins();
+	const auto group   = scuff::managed_group{scuff::create_group(nullptr)};
+	const auto sbox    = scuff::managed_sandbox{scuff::create_sandbox(group.id(), sbox_exe_path_.string())};
+	const auto device1 = create_test_device(sbox, "scuff.test.passthrough");
+	REQUIRE_NOTHROW(scuff::activate(group.id(), 44100.0));
+	// The input of each cycle is the number of the cycle,
+	// so it's possible to tell which one an output is from.
+	auto cycle  = 0.0f;
+	auto played = 0.0f;
+	const auto in  = scuff::audio_input{device1.id(), 0, [&cycle](float* floats) { std::fill_n(floats, STEREO * scuff::VECTOR_SIZE, ++cycle); }};
+	const auto out = scuff::audio_output{device1.id(), 0, [&played](const float* floats) {
+		played = std::all_of(floats, floats + (STEREO * scuff::VECTOR_SIZE), [x = floats[0]](float y) { return y == x; }) ? floats[0] : -1.0f;
+	}};
+	const auto gp = make_group_process(group.id(), {in}, {out});
+	REQUIRE(process_until(gp, [&] { return played == cycle; }));
+	// Each cycle outputs what was input in the one before. The first
+	// pipelined cycle outputs the last one which was processed immediately.
+	REQUIRE_NOTHROW(scuff::set_pipelined(group.id(), true));
+	for (int i = 0; i < 16; i++) {
+		REQUIRE_NOTHROW(scuff::audio_process(gp));
+		CHECK(played == cycle - 1);
+	}
+	// Switching back while a cycle is still in flight. That
+	// cycle's output is discarded, and there is no more delay.
+	REQUIRE_NOTHROW(scuff::set_pipelined(group.id(), false));
+	for (int i = 0; i < 16; i++) {
+		REQUIRE_NOTHROW(scuff::audio_process(gp));
+		CHECK(played == cycle);
+	}
+}
+
 //TEST_CASE("stress test") {
 //	auto group = scuff::managed_group{scuff::create_group(nullptr)};
 //	const auto sbox    = scuff::managed_sandbox{scuff::create_sandbox(group.id(), sbox_exe_path_.string())};
@@ -4,7 +4,10 @@
 
 namespace scuff {
 
-static constexpr auto CHANNEL_COUNT         = 2;            // Hard-coded for now just to make things easier.
+static constexpr auto BULK_BUFFER_SIZE      = 1 << 20;      // Capacity of the buffer used to stream large messages.
+static constexpr auto BULK_THRESHOLD        = 16384;        // Messages bigger than this are streamed outside of the message buffers.
+static constexpr auto BULK_TIMEOUT_MS       = 10000;        // Bulk transfers are dropped if the receiver makes no progress on any of them for this long.
+static constexpr auto CACHE_LINE_SIZE       = 64;
 static constexpr auto CLAP_EXT              = ".clap";
 static constexpr auto CLAP_SYMBOL_ENTRY     = "clap_entry";
 static constexpr auto DEFAULT_AUTOSAVE_MS   = 1000;         // How often to save dirty device states.
@@ -13,12 +16,14 @@ static constexpr auto GC_INTERVAL_MS        = 1000;
 static constexpr auto HEARTBEAT_INTERVAL_MS = 1000;
 static constexpr auto HEARTBEAT_TIMEOUT_MS  = 5000;
 static constexpr auto INVALID_INDEX         = SIZE_MAX;
-static constexpr auto MAX_AUDIO_PORTS       = 16;
-static constexpr auto MSG_BUFFER_SIZE       = 4096;
+static constexpr auto MAX_CHANNELS          = 64;           // Most channels an audio port can have (one bit each in a constant_mask.)
+static constexpr auto MAX_VECTOR_SIZE       = 1024;         // Largest block size a group can be activated with.
+static constexpr auto MSG_BUFFER_SIZE       = 4096;         // Default capacity of the message buffers between the client and sandboxes.
 static constexpr auto PARAM_ID_MAX          = 32;
 static constexpr auto POLL_INTERVAL_MS      = 10;
 static constexpr auto STACK_FN_CAPACITY     = 32;
-static constexpr auto VECTOR_SIZE           = 256;          // Hard-coded for now just to make things easier.
+static constexpr auto TRACE_RING_SIZE       = 8192;         // Max number of undrained timeline trace records per thread.
+static constexpr auto VECTOR_SIZE           = 256;          // Default block size if activate() isn't given one.
 static constexpr auto VST3_EXT              = ".vst3";
 
 } // scuff
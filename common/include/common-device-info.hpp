@@ -1,6 +1,8 @@
 #pragma once
 
 #include <cstddef>
+#include <cstdint>
+#include <vector>
 
 namespace scuff {
 
@@ -15,6 +17,8 @@ struct device_flags {
 struct device_port_info {
 	size_t audio_input_port_count  = 0;
 	size_t audio_output_port_count = 0;
+	std::vector<uint32_t> audio_input_channels;  // Channel count of each audio input port.
+	std::vector<uint32_t> audio_output_channels; // Channel count of each audio output port.
 };
 
 } // scuff
@@ -0,0 +1,114 @@
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#if defined(__SSE__) || defined(_M_X64) || defined(_M_AMD64)
+#	define SCUFF_DSP_SSE 1
+#	include <xmmintrin.h>
+#elif defined(__ARM_NEON) || defined(__ARM_NEON__)
+#	define SCUFF_DSP_NEON 1
+#	include <arm_neon.h>
+#endif
+
+// Small buffer kernels for the audio thread.
+namespace scuff::dsp {
+
+static
+// dest[i] += src[i]. The buffers must not overlap.
+auto add(const float* src, float* dest, size_t count) -> void {
+	size_t i = 0;
+#if SCUFF_DSP_SSE
+	for (; i + 8 <= count; i += 8) {
+		const auto a = _mm_add_ps(_mm_loadu_ps(dest + i), _mm_loadu_ps(src + i));
+		const auto b = _mm_add_ps(_mm_loadu_ps(dest + i + 4), _mm_loadu_ps(src + i + 4));
+		_mm_storeu_ps(dest + i, a);
+		_mm_storeu_ps(dest + i + 4, b);
+	}
+#elif SCUFF_DSP_NEON
+	for (; i + 8 <= count; i += 8) {
+		const auto a = vaddq_f32(vld1q_f32(dest + i), vld1q_f32(src + i));
+		const auto b = vaddq_f32(vld1q_f32(dest + i + 4), vld1q_f32(src + i + 4));
+		vst1q_f32(dest + i, a);
+		vst1q_f32(dest + i + 4, b);
+	}
+#endif
+	for (; i < count; i++) {
+		dest[i] += src[i];
+	}
+}
+
+static
+// The 64-bit path is only used for offline rendering, so this is left
+// for the compiler to vectorize.
+auto add(const double* src, double* dest, size_t count) -> void {
+	for (size_t i = 0; i < count; i++) {
+		dest[i] += src[i];
+	}
+}
+
+struct level {
+	float peak = 0.0f; // Highest absolute sample.
+	float rms  = 0.0f;
+};
+
+[[nodiscard]] static
+auto measure(const float* src, size_t count) -> level {
+	if (count == 0) {
+		return {};
+	}
+	size_t i = 0;
+	auto peak = 0.0f;
+	auto sum  = 0.0f;
+#if SCUFF_DSP_SSE
+	const auto sign_bit = _mm_set1_ps(-0.0f);
+	auto peak4 = _mm_setzero_ps();
+	auto sum4  = _mm_setzero_ps();
+	for (; i + 4 <= count; i += 4) {
+		const auto x = _mm_loadu_ps(src + i);
+		peak4 = _mm_max_ps(peak4, _mm_andnot_ps(sign_bit, x));
+		sum4  = _mm_add_ps(sum4, _mm_mul_ps(x, x));
+	}
+	alignas(16) float peaks[4];
+	alignas(16) float sums[4];
+	_mm_store_ps(peaks, peak4);
+	_mm_store_ps(sums, sum4);
+	peak = std::max({peaks[0], peaks[1], peaks[2], peaks[3]});
+	sum  = (sums[0] + sums[1]) + (sums[2] + sums[3]);
+#elif SCUFF_DSP_NEON
+	auto peak4 = vdupq_n_f32(0.0f);
+	auto sum4  = vdupq_n_f32(0.0f);
+	for (; i + 4 <= count; i += 4) {
+		const auto x = vld1q_f32(src + i);
+		peak4 = vmaxq_f32(peak4, vabsq_f32(x));
+		sum4  = vmlaq_f32(sum4, x, x);
+	}
+	float peaks[4];
+	float sums[4];
+	vst1q_f32(peaks, peak4);
+	vst1q_f32(sums, sum4);
+	peak = std::max({peaks[0], peaks[1], peaks[2], peaks[3]});
+	sum  = (sums[0] + sums[1]) + (sums[2] + sums[3]);
+#endif
+	for (; i < count; i++) {
+		peak = std::max(peak, std::abs(src[i]));
+		sum += src[i] * src[i];
+	}
+	return {peak, std::sqrt(sum / static_cast<float>(count))};
+}
+
+[[nodiscard]] static
+auto measure(const double* src, size_t count) -> level {
+	if (count == 0) {
+		return {};
+	}
+	auto peak = 0.0;
+	auto sum  = 0.0;
+	for (size_t i = 0; i < count; i++) {
+		peak = std::max(peak, std::abs(src[i]));
+		sum += src[i] * src[i];
+	}
+	return {static_cast<float>(peak), static_cast<float>(std::sqrt(sum / static_cast<double>(count)))};
+}
+
+} // scuff::dsp
@@ -1,5 +1,8 @@
 #pragma once
 
+#include <atomic>
+#include <chrono>
+#include <cstdint>
 #include <string_view>
 
 // Cross-platform IPC signaling.
@@ -11,10 +14,21 @@
 
 // scuff::ipc::local_event is the process's local view of the event.
 
+// A wait can optionally spin for a while, polling the event, before it
+// goes to sleep. This trades CPU time for wake-up latency when the event
+// is expected to be signaled very soon.
+
+// scuff::ipc::shared_generation lets one thread wake a whole set of events
+// at once. Each event is armed (signaled without waking its waiter), then
+// the generation is bumped. Waiters which wait on their event *through* the
+// generation are woken by the bump. On Linux this costs a single futex wake
+// no matter how many events were armed. On other platforms arming an event
+// wakes its waiter immediately and the generation does nothing.
+
 // Implementation:
 //  - Windows: Event objects
 //  - Linux:   Futexes
-//  - macOS:   POSIX Semaphores
+//  - macOS:   POSIX Semaphores, plus a ulock for timed waits
 
 namespace scuff::ipc {
 
@@ -26,6 +40,17 @@ struct local_event_open   { shared_event* shared; };
 // Name is only required for macOS.
 struct shared_event_create { shared_event* shared; std::string_view name; };
 
+// Which path a spinning wait took to receive the signal.
+enum class wait_path {
+	spun,
+	slept,
+	timed_out,
+};
+
+struct shared_generation {
+	std::atomic<uint32_t> word;
+};
+
 } // scuff::ipc
 
 #if defined(_WIN32) ////////////////////////////////////////////////////////////////////
@@ -146,6 +171,47 @@ auto wait(const local_event_impl* impl) -> void {
 	}
 } 
 
+static auto arm(const local_event_impl* impl) -> void                            { set(impl); }
+static auto wait(const local_event_impl* impl, shared_generation* gen) -> void  { wait(impl); }
+static auto wake_all(shared_generation* gen) -> void                            {}
+
+[[nodiscard]] static
+auto try_wait(const local_event_impl* impl) -> bool {
+	if (WaitForSingleObject(impl->event.h, 0) != WAIT_OBJECT_0) {
+		return false;
+	}
+	if (!ResetEvent(impl->event.h)) {
+		auto msg = std::format("ResetEvent failed: '{}'", win32_error_message(GetLastError()));
+		throw std::runtime_error{msg};
+	}
+	return true;
+}
+
+[[nodiscard]] static
+auto wait_until(const local_event_impl* impl, std::chrono::steady_clock::time_point deadline) -> bool {
+	// Windows wait timeouts have millisecond resolution
+	// so this will tend to overshoot short deadlines.
+	for (;;) {
+		const auto remaining = std::chrono::ceil<std::chrono::milliseconds>(deadline - std::chrono::steady_clock::now());
+		if (remaining.count() <= 0) {
+			return try_wait(impl);
+		}
+		const auto result = WaitForSingleObject(impl->event.h, static_cast<DWORD>(remaining.count()));
+		if (result == WAIT_TIMEOUT) {
+			continue;
+		}
+		if (result != WAIT_OBJECT_0) {
+			auto msg = std::format("WaitForSingleObject failed");
+			throw std::runtime_error{msg};
+		}
+		if (!ResetEvent(impl->event.h)) {
+			auto msg = std::format("ResetEvent failed: '{}'", win32_error_message(GetLastError()));
+			throw std::runtime_error{msg};
+		}
+		return true;
+	}
+}
+
 static auto init(local_event_impl* impl, local_event_create create) -> void { impl->event = win32_local_event{create}; } 
 static auto init(local_event_impl* impl, local_event_open open) -> void     { impl->event = win32_local_event{open}; } 
 
@@ -177,6 +243,13 @@ auto futex_wait(std::atomic<uint32_t>* word, uint32_t expected_value) -> void {
 	syscall(SYS_futex, word, FUTEX_WAIT, expected_value, nullptr, nullptr, 0);
 }
 
+static
+auto futex_wait(std::atomic<uint32_t>* word, uint32_t expected_value, std::chrono::nanoseconds timeout) -> void {
+	const auto secs = std::chrono::floor<std::chrono::seconds>(timeout);
+	const auto ts   = timespec{static_cast<time_t>(secs.count()), static_cast<long>((timeout - secs).count())};
+	syscall(SYS_futex, word, FUTEX_WAIT, expected_value, &ts, nullptr, 0);
+}
+
 static
 auto futex_wake_all(std::atomic<uint32_t>* word) -> void {
 	syscall(SYS_futex, word, FUTEX_WAKE, INT_MAX, nullptr, nullptr, 0);
@@ -194,6 +267,55 @@ auto wait(const local_event_impl* impl) -> void {
 	impl->shared->word.store(0, std::memory_order_release);
 } 
 
+[[nodiscard]] static
+auto try_wait(const local_event_impl* impl) -> bool {
+	// Only read the word while it's unsignaled so that spinning
+	// doesn't keep stealing the cache line from the other side.
+	if (impl->shared->word.load(std::memory_order_acquire) == 0) {
+		return false;
+	}
+	impl->shared->word.store(0, std::memory_order_release);
+	return true;
+}
+
+[[nodiscard]] static
+auto wait_until(const local_event_impl* impl, std::chrono::steady_clock::time_point deadline) -> bool {
+	for (;;) {
+		if (try_wait(impl)) {
+			return true;
+		}
+		const auto remaining = deadline - std::chrono::steady_clock::now();
+		if (remaining.count() <= 0) {
+			return false;
+		}
+		futex_wait(&impl->shared->word, 0, remaining);
+	}
+}
+
+static
+auto arm(const local_event_impl* impl) -> void {
+	impl->shared->word.store(1, std::memory_order_release);
+}
+
+static
+auto wait(const local_event_impl* impl, shared_generation* gen) -> void {
+	for (;;) {
+		// Read the generation before checking the event. If the event is armed
+		// and the generation bumped after this point then the futex wait will
+		// return immediately because the word no longer matches.
+		const auto value = gen->word.load(std::memory_order_acquire);
+		if (try_wait(impl)) {
+			return;
+		}
+		futex_wait(&gen->word, value);
+	}
+}
+
+static
+auto wake_all(shared_generation* gen) -> void {
+	futex_wake_all(&gen->word);
+}
+
 static auto init(local_event_impl* impl, local_event_create create) -> void { impl->shared = create.shared; } 
 static auto init(local_event_impl* impl, local_event_open open) -> void     { impl->shared = open.shared; } 
 
@@ -204,12 +326,21 @@ static auto init(local_event_impl* impl, local_event_open open) -> void     { im
 #include <cerrno>
 #include <cstring>
 #include <format>
+#include <limits>
 #include <semaphore.h>
 
+// macOS doesn't have sem_timedwait(), so timed waits sleep on a counter
+// next to the semaphore instead, using the same private but stable API
+// which libc++ uses to implement std::atomic::wait().
+extern "C" auto __ulock_wait(uint32_t operation, void* addr, uint64_t value, uint32_t timeout_us) -> int;
+extern "C" auto __ulock_wake(uint32_t operation, void* addr, uint64_t wake_value) -> int;
+
 namespace scuff::ipc {
 
 struct shared_event {
 	char name[100];
+	// Incremented each time the event is set, after the semaphore is posted.
+	std::atomic<uint32_t> posts;
 };
 
 static
@@ -258,14 +389,20 @@ struct posix_local_event {
 
 struct local_event_impl {
 	posix_local_event event;
+	shared_event* shared = nullptr;
 };
 
+static constexpr auto UL_COMPARE_AND_WAIT_SHARED = uint32_t{3};
+static constexpr auto ULF_WAKE_ALL               = uint32_t{0x100};
+
 static
 auto set(const local_event_impl* impl) -> void {
 	if (sem_post(impl->event.sem) != 0) {
 		auto msg = std::format("sem_post failed: '{}'", std::strerror(errno));
 		throw std::runtime_error{msg};
 	}
+	impl->shared->posts.fetch_add(1, std::memory_order_release);
+	__ulock_wake(UL_COMPARE_AND_WAIT_SHARED | ULF_WAKE_ALL, &impl->shared->posts, 0);
 } 
 
 static
@@ -276,13 +413,133 @@ auto wait(const local_event_impl* impl) -> void {
 	}
 } 
 
-static auto init(local_event_impl* impl, local_event_create create) -> void { impl->event = posix_local_event{create}; } 
-static auto init(local_event_impl* impl, local_event_open open) -> void     { impl->event = posix_local_event{open}; } 
+static auto arm(const local_event_impl* impl) -> void                            { set(impl); }
+static auto wait(const local_event_impl* impl, shared_generation* gen) -> void  { wait(impl); }
+static auto wake_all(shared_generation* gen) -> void                            {}
+
+[[nodiscard]] static
+auto try_wait(const local_event_impl* impl) -> bool {
+	if (sem_trywait(impl->event.sem) == 0) {
+		return true;
+	}
+	if (errno == EAGAIN || errno == EINTR) {
+		return false;
+	}
+	auto msg = std::format("sem_trywait failed: '{}'", std::strerror(errno));
+	throw std::runtime_error{msg};
+}
+
+[[nodiscard]] static
+auto wait_until(const local_event_impl* impl, std::chrono::steady_clock::time_point deadline) -> bool {
+	for (;;) {
+		// Read the counter before checking the semaphore. If the event is set
+		// after this point then the ulock wait returns immediately because
+		// the counter no longer matches.
+		const auto posts = impl->shared->posts.load(std::memory_order_acquire);
+		if (try_wait(impl)) {
+			return true;
+		}
+		const auto remaining = std::chrono::ceil<std::chrono::microseconds>(deadline - std::chrono::steady_clock::now());
+		if (remaining.count() <= 0) {
+			return false;
+		}
+		// A timeout of zero would mean no timeout.
+		const auto timeout_us = static_cast<uint32_t>(std::min<int64_t>(remaining.count(), std::numeric_limits<uint32_t>::max()));
+		__ulock_wait(UL_COMPARE_AND_WAIT_SHARED, &impl->shared->posts, posts, timeout_us);
+	}
+}
+
+static auto init(local_event_impl* impl, local_event_create create) -> void { impl->event = posix_local_event{create}; impl->shared = create.shared; } 
+static auto init(local_event_impl* impl, local_event_open open) -> void     { impl->event = posix_local_event{open}; impl->shared = open.shared; } 
 
 } // scuff::ipc::detail
 
 #endif
 
+#if defined(_MSC_VER)
+#include <intrin.h>
+#endif
+
+namespace scuff::ipc::detail {
+
+static constexpr auto SPIN_BATCH = 64; // Number of polls between clock reads while spinning.
+
+static
+auto cpu_pause() -> void {
+#if defined(_MSC_VER) && (defined(_M_X64) || defined(_M_IX86))
+	_mm_pause();
+#elif defined(_MSC_VER) && defined(_M_ARM64)
+	__yield();
+#elif defined(__x86_64__) || defined(__i386__)
+	__builtin_ia32_pause();
+#elif defined(__aarch64__) || defined(__arm__)
+	asm volatile("yield");
+#endif
+}
+
+[[nodiscard]] static
+auto spin_until(const local_event_impl* impl, std::chrono::steady_clock::time_point deadline) -> bool {
+	do {
+		for (int i = 0; i < SPIN_BATCH; i++) {
+			if (try_wait(impl)) {
+				return true;
+			}
+			cpu_pause();
+		}
+	} while (std::chrono::steady_clock::now() < deadline);
+	return false;
+}
+
+[[nodiscard]] static
+auto spin(const local_event_impl* impl, std::chrono::microseconds spin) -> bool {
+	if (spin.count() <= 0) {
+		return false;
+	}
+	return spin_until(impl, std::chrono::steady_clock::now() + spin);
+}
+
+[[nodiscard]] static
+auto wait(const local_event_impl* impl, std::chrono::microseconds spin) -> wait_path {
+	if (detail::spin(impl, spin)) {
+		return wait_path::spun;
+	}
+	wait(impl);
+	return wait_path::slept;
+}
+
+[[nodiscard]] static
+auto wait(const local_event_impl* impl, shared_generation* gen, std::chrono::microseconds spin) -> wait_path {
+	if (detail::spin(impl, spin)) {
+		return wait_path::spun;
+	}
+	wait(impl, gen);
+	return wait_path::slept;
+}
+
+[[nodiscard]] static
+auto wait_until(const local_event_impl* impl, std::chrono::steady_clock::time_point deadline, std::chrono::microseconds spin) -> wait_path {
+	if (spin.count() > 0 && spin_until(impl, std::min(deadline, std::chrono::steady_clock::now() + spin))) {
+		return wait_path::spun;
+	}
+	if (wait_until(impl, deadline)) {
+		return wait_path::slept;
+	}
+	return wait_path::timed_out;
+}
+
+} // scuff::ipc::detail
+
+namespace scuff::ipc {
+
+// Wake everything waiting through the generation.
+static
+auto broadcast(shared_generation* gen) -> void {
+	gen->word.fetch_add(1, std::memory_order_acq_rel);
+	detail::wake_all(gen);
+}
+
+} // scuff::ipc
+
 namespace scuff::ipc {
 
 struct local_event {
@@ -291,6 +548,18 @@ struct local_event {
 	local_event(local_event_open open)      { ipc::detail::init(&impl, open); }
 	auto set() const -> void                { ipc::detail::set(&impl); }
 	auto wait() const -> void { ipc::detail::wait(&impl); }
+	// Spin for up to the given amount of time before going to sleep.
+	[[nodiscard]]
+	auto wait(std::chrono::microseconds spin) const -> wait_path { return ipc::detail::wait(&impl, spin); }
+	// Signal the event without waking the waiter. The waiter must be
+	// waiting through a generation which is then broadcast.
+	auto arm() const -> void { ipc::detail::arm(&impl); }
+	// Wait for the event, sleeping on the generation rather than the event itself.
+	[[nodiscard]]
+	auto wait(shared_generation* gen, std::chrono::microseconds spin) const -> wait_path { return ipc::detail::wait(&impl, gen, spin); }
+	// Give up waiting at the deadline. Spinning also stops at the deadline.
+	[[nodiscard]]
+	auto wait_until(std::chrono::steady_clock::time_point deadline, std::chrono::microseconds spin) const -> wait_path { return ipc::detail::wait_until(&impl, deadline, spin); }
 private:
 	detail::local_event_impl impl;
 };
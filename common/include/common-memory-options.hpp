@@ -0,0 +1,14 @@
+#pragma once
+
+namespace scuff {
+
+// What to do with the memory which the audio threads of a group touch:
+// its shared memory, and the stacks of the sandbox audio threads.
+struct memory_options {
+	bool lock       = false; // Lock it into RAM so that it can't be paged out.
+	bool prefault   = false; // Touch every page of it up front, rather than the first time it's used.
+	bool huge_pages = false; // Ask for transparent huge pages for it. Linux only.
+	bool lock_all   = false; // Lock all of the memory of each sandbox process, including whatever plugins allocate.
+};
+
+} // scuff
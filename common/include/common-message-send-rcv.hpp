@@ -1,18 +1,112 @@
 #include "common-serialize-messages.hpp"
+#include "common-shm.hpp"
+#include <array>
+#include <atomic>
+#include <chrono>
 #include <cs_plain_guarded.h>
 #include <iostream>
+#include <optional>
+#include <utility>
+#include <variant>
 
 namespace lg = libguarded;
 
 namespace scuff::msg {
 
+// Messages bigger than BULK_THRESHOLD are not written to the message buffer.
+// Instead the sender creates a bulk segment (see shm::bulk), streams the
+// message through that, and writes a small envelope containing the id,
+// name and nonce of the segment to the message buffer. The size of an
+// envelope has this bit set.
+static constexpr auto BULK_FLAG = size_t{1} << ((sizeof(size_t) * 8) - 1);
+
+// Some messages carry a big blob of bytes, e.g. a device state. In a bulk
+// transfer the rest of the message (the head) is sent first, framed like
+// an ordinary message, and then the payload is streamed straight out of
+// the sender's message and straight into the receiver's, so that it is
+// never copied into a serialized buffer on either side.
+static auto get_payload(in::device_load* msg) -> std::vector<std::byte>* { return &msg->state; }
+static auto get_payload(out::device_autosave* msg) -> std::vector<std::byte>* { return &msg->bytes; }
+static auto get_payload(out::return_requested_state* msg) -> std::vector<std::byte>* { return &msg->bytes; }
+template <typename T> static auto get_payload(T*) -> std::vector<std::byte>* { return nullptr; }
+
+template <typename MsgT> [[nodiscard]] static
+auto get_payload(MsgT* msg) -> std::vector<std::byte>* requires concepts::is_variant<MsgT> {
+	return std::visit([](auto& alt) { return get_payload(&alt); }, *msg);
+}
+
+struct transfer_progress {
+	uint64_t transferred = 0;
+	uint64_t total       = 0;
+};
+
+// How many messages of each type have passed through a sender or
+// receiver, and how many serialized bytes they took up. Written by
+// the sending or receiving thread and can be read from any thread.
+template <typename MsgT>
+struct traffic {
+	std::array<std::atomic<uint64_t>, std::variant_size_v<MsgT>> counts = {};
+	std::array<std::atomic<uint64_t>, std::variant_size_v<MsgT>> bytes  = {};
+};
+
+template <typename MsgT>
+auto count(traffic<MsgT>* t, const MsgT& msg, size_t bytes) -> void {
+	t->counts[msg.index()].fetch_add(1, std::memory_order_relaxed);
+	t->bytes[msg.index()].fetch_add(bytes, std::memory_order_relaxed);
+}
+
 template <typename MsgT>
 struct sender {
+	// Cancel any bulk transfers which are in progress.
+	// Can be called from any thread.
+	auto cancel() -> void {
+		cancel_requested_ = true;
+	}
+	// Drop any bulk transfers which are in progress without waiting for
+	// the receiver to close them, e.g. because the receiving process has
+	// been restarted. Can be called from any thread.
+	auto reset() -> void {
+		reset_requested_ = true;
+	}
 	auto enqueue(const MsgT& msg) -> void {
-		local_queue_.lock()->push_back(msg);
+		const auto local_queue = local_queue_.lock();
+		local_queue->push_back(msg);
+		if (local_queue->size() > queue_high_water_.load(std::memory_order_relaxed)) {
+			queue_high_water_.store(local_queue->size(), std::memory_order_relaxed);
+		}
+	}
+	// The most messages there have ever been waiting to be sent.
+	// Can be called from any thread.
+	[[nodiscard]]
+	auto get_queue_high_water() const -> size_t {
+		return queue_high_water_.load(std::memory_order_relaxed);
+	}
+	// Can be called from any thread.
+	[[nodiscard]]
+	auto get_traffic() const -> const msg::traffic<MsgT>& {
+		return traffic_;
+	}
+	// Call this from the same thread as send().
+	[[nodiscard]]
+	auto progress() const -> transfer_progress {
+		transfer_progress out;
+		for (const auto& transfer : bulk_transfers_) {
+			out.transferred += transfer.sent;
+			out.total       += transfer.head.size() + transfer.payload.size();
+		}
+		return out;
+	}
+	// Call this from the same thread as send(). The messages whose bulk
+	// transfers were cancelled, or given up on, before the receiver got
+	// them, so that whatever is waiting for a reply can be told. Their
+	// payloads have been stripped.
+	[[nodiscard]]
+	auto take_cancelled() -> std::vector<MsgT> {
+		return std::exchange(cancelled_, {});
 	}
 	template <typename SendFn>
 	auto send(SendFn send) -> void {
+		send_bulk();
 		for (;;) {
 			if (bytes_remaining_ > 0) {
 				const auto bytes_to_send = bytes_remaining_;
@@ -27,25 +121,160 @@ struct sender {
 			if (local_queue->empty()) {
 				return;
 			}
-			auto data = serialize(local_queue->front());
+			auto& msg    = local_queue->front();
+			auto payload = std::vector<std::byte>{};
+			if (const auto msg_payload = get_payload(&msg); msg_payload && msg_payload->size() > BULK_THRESHOLD) {
+				payload = std::exchange(*msg_payload, {});
+			}
+			auto data = serialize(msg);
+			count(&traffic_, msg, data.size() + payload.size());
 			buffer_.clear();
-			serialize(data, &buffer_);
+			if (data.size() + payload.size() > BULK_THRESHOLD) {
+				begin_bulk(std::move(msg), data, std::move(payload));
+			}
+			else {
+				serialize(data, &buffer_);
+			}
 			bytes_remaining_ = buffer_.size();
 			local_queue->pop_front();
 		}
 	}
 private:
+	struct bulk_transfer {
+		shm::bulk shm;
+		MsgT msg;
+		std::vector<std::byte> head;
+		std::vector<std::byte> payload;
+		size_t sent = 0;
+	};
+	auto begin_bulk(MsgT msg, const std::vector<std::byte>& head, std::vector<std::byte> payload) -> void {
+		auto transfer     = bulk_transfer{};
+		serialize(head, &transfer.head);
+		transfer.payload  = std::move(payload);
+		transfer.msg      = std::move(msg);
+		transfer.shm      = shm::create_bulk(transfer.head.size() + transfer.payload.size());
+		auto envelope     = std::vector<std::byte>{};
+		serialize(transfer.shm.seg.id, &envelope);
+		serialize(transfer.shm.name, &envelope);
+		serialize(transfer.shm.data->nonce, &envelope);
+		serialize(envelope.size() | BULK_FLAG, &buffer_);
+		buffer_.insert(buffer_.end(), envelope.begin(), envelope.end());
+		bulk_transfers_.push_back(std::move(transfer));
+		send_bulk();
+	}
+	// Returns the number of bytes written.
+	[[nodiscard]] static
+	auto write_bulk(bulk_transfer* transfer) -> size_t {
+		auto& ring             = transfer->shm.data->ring;
+		const auto head_size   = transfer->head.size();
+		const auto total_size  = head_size + transfer->payload.size();
+		const auto sent_before = transfer->sent;
+		if (transfer->sent < head_size) {
+			transfer->sent += ring.write(transfer->head.data() + transfer->sent, head_size - transfer->sent);
+		}
+		if (transfer->sent >= head_size && transfer->sent < total_size) {
+			const auto offset = transfer->sent - head_size;
+			transfer->sent += ring.write(transfer->payload.data() + offset, total_size - transfer->sent);
+		}
+		return transfer->sent - sent_before;
+	}
+	auto send_bulk() -> void {
+		const auto cancel = cancel_requested_.exchange(false);
+		const auto reset  = reset_requested_.exchange(false);
+		const auto now    = std::chrono::steady_clock::now();
+		if (bulk_transfers_.empty()) {
+			last_bulk_progress_ = now;
+			return;
+		}
+		for (auto& transfer : bulk_transfers_) {
+			auto& data = *transfer.shm.data;
+			if (cancel || reset) {
+				shm::cancel_bulk(&data);
+			}
+			if (data.closed.load(std::memory_order_acquire)) {
+				last_bulk_progress_ = now;
+				continue;
+			}
+			if (data.outcome.load() != shm::bulk_outcome::pending) {
+				continue;
+			}
+			if (write_bulk(&transfer) > 0) {
+				last_bulk_progress_ = now;
+			}
+		}
+		// If the receiver hasn't touched any of the transfers in this long
+		// then it has probably gone away, so stop holding on to them.
+		const auto stalled = now - last_bulk_progress_ > std::chrono::milliseconds{BULK_TIMEOUT_MS};
+		std::erase_if(bulk_transfers_, [this, reset, stalled](bulk_transfer& transfer) {
+			auto& data = *transfer.shm.data;
+			if (!data.closed.load(std::memory_order_acquire) && !reset && !stalled) {
+				return false;
+			}
+			shm::cancel_bulk(&data);
+			if (shm::is_cancelled(data)) {
+				cancelled_.push_back(std::move(transfer.msg));
+			}
+			return true;
+		});
+	}
 	std::vector<std::byte> buffer_;
 	size_t bytes_remaining_ = 0;
 	lg::plain_guarded<std::deque<MsgT>> local_queue_;
+	std::deque<bulk_transfer> bulk_transfers_;
+	std::vector<MsgT> cancelled_;
+	std::chrono::steady_clock::time_point last_bulk_progress_;
+	std::atomic_bool cancel_requested_ = false;
+	std::atomic_bool reset_requested_ = false;
+	std::atomic<size_t> queue_high_water_ = 0;
+	msg::traffic<MsgT> traffic_;
 };
 
 template <typename MsgT>
 struct receiver {
+	// Cancel the bulk transfer which is in progress, if there is one.
+	// Can be called from any thread.
+	auto cancel() -> void {
+		cancel_requested_ = true;
+	}
+	// Abandon the bulk transfer which is in progress, if there is one,
+	// e.g. because the sending process has been restarted.
+	// Can be called from any thread.
+	auto reset() -> void {
+		reset_requested_ = true;
+	}
+	// Can be called from any thread.
+	[[nodiscard]]
+	auto get_traffic() const -> const msg::traffic<MsgT>& {
+		return traffic_;
+	}
+	// Call this from the same thread as receive().
+	[[nodiscard]]
+	auto progress() const -> transfer_progress {
+		if (!bulk_) {
+			return {};
+		}
+		return {bulk_->received, bulk_->shm.data->size};
+	}
 	template <typename ReceiveFn>
 	auto receive(ReceiveFn receive) -> const std::vector<MsgT>& {
 		msg_buffer_.clear();
+		const auto cancel = cancel_requested_.exchange(false);
+		if (reset_requested_.exchange(false) && bulk_) {
+			shm::cancel_bulk(bulk_->shm.data);
+			end_bulk();
+		}
 		for (;;) {
+			if (bulk_) {
+				// Nothing else is received until the bulk transfer
+				// is over, so that messages stay in order.
+				if (cancel) {
+					shm::cancel_bulk(bulk_->shm.data);
+				}
+				if (!receive_bulk()) {
+					return msg_buffer_;
+				}
+				continue;
+			}
 			if (bytes_remaining_ > 0) {
 				const auto bytes_to_get = bytes_remaining_;
 				const auto offset       = byte_buffer_.size() - bytes_remaining_;
@@ -59,15 +288,21 @@ struct receiver {
 					// Just got the message size
 					assert (byte_buffer_.size() == sizeof(size_t));
 					msg_size_ = *reinterpret_cast<size_t*>(byte_buffer_.data());
-					assert (msg_size_ < 1'000'000); // sanity check
-					bytes_remaining_ = msg_size_;
+					bytes_remaining_ = msg_size_ & ~BULK_FLAG;
+					assert (bytes_remaining_ < 1'000'000); // sanity check
 					byte_buffer_.resize(bytes_remaining_);
 					continue;
 				}
+				if (msg_size_ & BULK_FLAG) {
+					// Just got the envelope for a bulk transfer
+					begin_bulk();
+					continue;
+				}
 				// Finished receiving all the bytes for a message
 				MsgT msg;
 				deserialize(byte_buffer_, &msg);
-				msg_buffer_.push_back(msg);
+				count(&traffic_, msg, byte_buffer_.size());
+				msg_buffer_.push_back(std::move(msg));
 				msg_size_        = 0;
 				bytes_remaining_ = 0;
 				continue;
@@ -78,10 +313,95 @@ struct receiver {
 		}
 	}
 private:
+	struct bulk_transfer {
+		shm::bulk shm;
+		size_t received  = 0;
+		size_t head_size = 0;
+		MsgT msg;
+	};
+	auto begin_bulk() -> void {
+		auto bytes = std::span<const std::byte>{byte_buffer_};
+		auto shmid = std::string{};
+		auto name  = std::string{};
+		auto nonce = uint64_t{};
+		deserialize(&bytes, &shmid);
+		deserialize(&bytes, &name);
+		deserialize(&bytes, &nonce);
+		msg_size_        = 0;
+		bytes_remaining_ = 0;
+		try {
+			bulk_ = bulk_transfer{shm::open_bulk(shmid, name, nonce)};
+		}
+		catch (const std::exception&) {
+			// The sender already gave up on the transfer and removed the
+			// segment, or the id now refers to something else. Either way
+			// the sender will have reported the message as cancelled.
+			return;
+		}
+		byte_buffer_.resize(sizeof(size_t));
+	}
+	auto end_bulk() -> void {
+		bulk_->shm.data->closed.store(true, std::memory_order_release);
+		bulk_.reset();
+	}
+	// Returns true if the bulk transfer is over, whether
+	// it finished or was cancelled by either side.
+	[[nodiscard]]
+	auto receive_bulk() -> bool {
+		auto& transfer = *bulk_;
+		auto& data     = *transfer.shm.data;
+		if (shm::is_cancelled(data)) {
+			end_bulk();
+			return true;
+		}
+		// First the size of the head, then the head, into the byte buffer.
+		const auto frame_size = sizeof(size_t);
+		if (transfer.received < frame_size) {
+			transfer.received += data.ring.read(byte_buffer_.data() + transfer.received, frame_size - transfer.received);
+			if (transfer.received < frame_size) {
+				return false;
+			}
+			transfer.head_size = *reinterpret_cast<size_t*>(byte_buffer_.data());
+			byte_buffer_.resize(transfer.head_size);
+		}
+		const auto head_end = frame_size + transfer.head_size;
+		if (transfer.received < head_end) {
+			const auto offset = transfer.received - frame_size;
+			transfer.received += data.ring.read(byte_buffer_.data() + offset, head_end - transfer.received);
+			if (transfer.received < head_end) {
+				return false;
+			}
+			deserialize(byte_buffer_, &transfer.msg);
+			if (data.size > head_end) {
+				const auto payload = get_payload(&transfer.msg);
+				assert (payload && "bulk transfer has bytes left over after the head");
+				payload->resize(data.size - head_end);
+			}
+		}
+		// Then the payload, if there is one, straight into the message.
+		if (transfer.received < data.size) {
+			const auto payload = get_payload(&transfer.msg);
+			const auto offset  = transfer.received - head_end;
+			transfer.received += data.ring.read(payload->data() + offset, data.size - transfer.received);
+			if (transfer.received < data.size) {
+				return false;
+			}
+		}
+		if (shm::deliver_bulk(&data)) {
+			count(&traffic_, transfer.msg, data.size - frame_size);
+			msg_buffer_.push_back(std::move(transfer.msg));
+		}
+		end_bulk();
+		return true;
+	}
 	std::vector<MsgT> msg_buffer_;
 	std::vector<std::byte> byte_buffer_;
 	size_t bytes_remaining_ = 0;
 	size_t msg_size_ = 0;
+	std::optional<bulk_transfer> bulk_;
+	std::atomic_bool cancel_requested_ = false;
+	std::atomic_bool reset_requested_ = false;
+	msg::traffic<MsgT> traffic_;
 };
 
 } // scuff::msg
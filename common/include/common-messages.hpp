@@ -2,12 +2,16 @@
 
 #include "common-colors.hpp"
 #include "common-device-info.hpp"
+#include "common-memory-options.hpp"
 #include "common-param-info.hpp"
 #include "common-plugin-type.hpp"
 #include "common-render-mode.hpp"
+#include "common-sample-format.hpp"
+#include <array>
 #include <clap/id.h>
 #include <deque>
 #include <iterator>
+#include <string_view>
 #include <variant>
 #include <vector>
 
@@ -15,12 +19,12 @@ namespace scuff::msg::in {
 
 // These messages are sent from the client to a sandbox process.
 
-struct activate               { double sr; };
+struct activate               { double sr; uint32_t max_frames; };
 struct close_all_editors      {};
 struct crash                  {}; // Tell the sandbox process to crash. Important for testing.
 struct deactivate             {};
 struct device_connect         { int64_t out_dev_id; size_t out_port; int64_t in_dev_id; size_t in_port; };
-struct device_create          { id::device::type dev_id; plugin_type type; std::string plugfile_path; std::string plugin_id; size_t callback; };
+struct device_create          { id::device::type dev_id; plugin_type type; std::string plugfile_path; std::string plugin_id; std::string shmid; size_t callback; };
 struct device_disconnect      { int64_t out_dev_id; size_t out_port; int64_t in_dev_id; size_t in_port; };
 struct device_erase           { id::device::type dev_id; };
 struct device_gui_hide        { id::device::type dev_id; };
@@ -32,8 +36,12 @@ struct get_param_value        { id::device::type dev_id; size_t param_idx; size_
 struct get_param_value_text   { id::device::type dev_id; size_t param_idx; double value; size_t callback; };
 struct heartbeat              {}; // Sandbox shuts itself down if this isn't received within a certain time.
 struct panic                  {}; // "Panic" all devices.
+struct remote_connect         { int64_t out_dev_id; size_t out_port; std::string out_shmid; int64_t in_dev_id; size_t in_port; }; // The output device is in another sandbox.
+struct remote_disconnect      { int64_t out_dev_id; size_t out_port; int64_t in_dev_id; size_t in_port; };
 struct set_autosave_interval  { id::device::type dev_id; double interval_in_ms; };
+struct set_memory_options     { memory_options options; };
 struct set_render_mode        { render_mode mode; };
+struct set_sample_format      { sample_format format; };
 struct set_track_color        { id::device::type dev_id; std::optional<rgba32> color; };
 struct set_track_name         { id::device::type dev_id; std::string name; };
 
@@ -55,17 +63,59 @@ using msg = std::variant<
 	get_param_value_text,
 	heartbeat,
 	panic,
+	remote_connect,
+	remote_disconnect,
 	set_autosave_interval,
+	set_memory_options,
 	set_render_mode,
+	set_sample_format,
 	set_track_color,
 	set_track_name
 >;
 
+// In the same order as the alternatives of msg.
+static constexpr auto names = std::to_array<std::string_view>({
+	"activate",
+	"close_all_editors",
+	"crash",
+	"deactivate",
+	"device_connect",
+	"device_create",
+	"device_disconnect",
+	"device_erase",
+	"device_gui_hide",
+	"device_gui_show",
+	"device_load",
+	"device_request_state",
+	"event",
+	"get_param_value",
+	"get_param_value_text",
+	"heartbeat",
+	"panic",
+	"remote_connect",
+	"remote_disconnect",
+	"set_autosave_interval",
+	"set_memory_options",
+	"set_render_mode",
+	"set_sample_format",
+	"set_track_color",
+	"set_track_name",
+});
+static_assert(names.size() == std::variant_size_v<msg>);
+
 } // scuff::msg::in
 
 namespace scuff::msg::out {
 
 // These messages are sent back from a sandbox process to the client.
+//
+// A ports_shmid is empty if the device is still using the shared memory
+// segment the client already has open. Otherwise the device has been moved
+// to a new segment, because the segment is sized for the device's audio
+// ports and they have changed.
+//
+// A return_requested_state with no bytes means the state couldn't be saved,
+// or the transfer of the state was cancelled.
 
 struct confirm_activated             {};
 struct device_autosave               { id::device::type dev_id; std::vector<std::byte> bytes; };
@@ -73,7 +123,7 @@ struct device_create_fail            { id::device::type dev_id; std::string erro
 struct device_create_success         { id::device::type dev_id; std::string ports_shmid; size_t callback; };
 struct device_editor_visible_changed { id::device::type dev_id; bool visible; int64_t native_handle; };
 struct device_flags                  { id::device::type dev_id; int flags; };
-struct device_port_info              { id::device::type dev_id; scuff::device_port_info info; };
+struct device_port_info              { id::device::type dev_id; scuff::device_port_info info; std::string ports_shmid; };
 struct device_latency                { id::device::type dev_id; uint32_t latency; };
 struct device_load_fail              { id::device::type dev_id; size_t callback; };
 struct device_load_success           { id::device::type dev_id; size_t callback; };
@@ -105,6 +155,28 @@ using msg = std::variant<
 	return_requested_state
 >;
 
+// In the same order as the alternatives of msg.
+static constexpr auto names = std::to_array<std::string_view>({
+	"confirm_activated",
+	"device_autosave",
+	"device_create_fail",
+	"device_create_success",
+	"device_editor_visible_changed",
+	"device_flags",
+	"device_port_info",
+	"device_latency",
+	"device_load_fail",
+	"device_load_success",
+	"device_param_info",
+	"report_error",
+	"report_info",
+	"report_warning",
+	"return_param_value",
+	"return_param_value_text",
+	"return_requested_state",
+});
+static_assert(names.size() == std::variant_size_v<msg>);
+
 using buf = std::vector<msg>;
 
 } // scuff::msg::out
@@ -9,16 +9,30 @@
 
 namespace scuff::os {
 
+// Memory functions return false if they failed. The addresses
+// don't need to be page aligned.
+//  - Huge pages are only asked for on Linux. Elsewhere this does nothing.
+//  - Locking all memory isn't supported on Windows or macOS.
+//  - prepare_stack() touches the next size bytes of the calling thread's stack,
+//    below the caller's frame, and optionally locks them.
+
+[[nodiscard]] auto advise_huge_pages(void* addr, size_t size) -> bool;
 [[nodiscard]] auto could_be_a_vst2_file(const std::filesystem::path& path) -> bool;
 [[nodiscard]] auto get_clap_window_api() -> const char*;
 [[nodiscard]] auto get_env_search_paths(char path_delimiter) -> std::vector<std::filesystem::path>;
+[[nodiscard]] auto get_page_size() -> size_t;
 [[nodiscard]] auto get_process_id() -> int;
 [[nodiscard]] auto get_system_search_paths() -> std::vector<std::filesystem::path>;
 [[nodiscard]] auto is_clap_file(const std::filesystem::path& path) -> bool;
 [[nodiscard]] auto is_vst3_file(const std::filesystem::path& path) -> bool;
+[[nodiscard]] auto lock_all_memory() -> bool;
+[[nodiscard]] auto lock_memory(void* addr, size_t size) -> bool;
+[[nodiscard]] auto prepare_stack(size_t size, bool lock) -> bool;
 [[nodiscard]] auto process_is_running(int pid) -> bool;
 [[nodiscard]] auto redirect_stream(FILE* stream) -> int;
 auto restore_stream(FILE* stream, int old) -> void;
 auto set_realtime_priority(std::jthread* thread) -> void;
+auto unlock_all_memory() -> void;
+auto unlock_memory(void* addr, size_t size) -> void;
 
 } // scuff::os
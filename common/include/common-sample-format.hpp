@@ -0,0 +1,7 @@
+#pragma once
+
+namespace scuff {
+
+enum class sample_format { float32, float64 };
+
+} // scuff
@@ -10,6 +10,8 @@ auto deserialize<scuff::msg::in::device_create>(std::span<const std::byte>* byte
 	deserialize(bytes, &msg->type);
 	deserialize(bytes, &msg->plugfile_path);
 	deserialize(bytes, &msg->plugin_id);
+	deserialize(bytes, &msg->shmid);
+	deserialize(bytes, &msg->callback);
 }
 
 template <> inline
@@ -19,6 +21,23 @@ auto deserialize<scuff::msg::in::device_load>(std::span<const std::byte>* bytes,
 	deserialize(bytes, &msg->callback);
 }
 
+template <> inline
+auto deserialize<scuff::msg::in::remote_connect>(std::span<const std::byte>* bytes, scuff::msg::in::remote_connect* msg) -> void {
+	deserialize(bytes, &msg->out_dev_id);
+	deserialize(bytes, &msg->out_port);
+	deserialize(bytes, &msg->out_shmid);
+	deserialize(bytes, &msg->in_dev_id);
+	deserialize(bytes, &msg->in_port);
+}
+
+template <> inline
+auto deserialize<scuff::msg::in::set_memory_options>(std::span<const std::byte>* bytes, scuff::msg::in::set_memory_options* msg) -> void {
+	deserialize(bytes, &msg->options.lock);
+	deserialize(bytes, &msg->options.prefault);
+	deserialize(bytes, &msg->options.huge_pages);
+	deserialize(bytes, &msg->options.lock_all);
+}
+
 template <> inline
 auto deserialize<scuff::msg::in::set_track_color>(std::span<const std::byte>* bytes, scuff::msg::in::set_track_color* msg) -> void {
 	bool engaged = false;
@@ -68,6 +87,9 @@ auto deserialize<scuff::msg::out::device_port_info>(std::span<const std::byte>*
 	deserialize(bytes, &msg->dev_id);
 	deserialize(bytes, &msg->info.audio_input_port_count);
 	deserialize(bytes, &msg->info.audio_output_port_count);
+	deserialize(bytes, &msg->info.audio_input_channels);
+	deserialize(bytes, &msg->info.audio_output_channels);
+	deserialize(bytes, &msg->ports_shmid);
 }
 
 template <> inline
@@ -119,6 +141,8 @@ auto serialize<scuff::msg::in::device_create>(const scuff::msg::in::device_creat
 	serialize(msg.type, bytes);
 	serialize(std::string_view{msg.plugfile_path}, bytes);
 	serialize(std::string_view{msg.plugin_id}, bytes);
+	serialize(std::string_view{msg.shmid}, bytes);
+	serialize(msg.callback, bytes);
 }
 
 template <> inline
@@ -128,6 +152,23 @@ auto serialize<scuff::msg::in::device_load>(const scuff::msg::in::device_load& m
 	serialize(msg.callback, bytes);
 }
 
+template <> inline
+auto serialize<scuff::msg::in::remote_connect>(const scuff::msg::in::remote_connect& msg, std::vector<std::byte>* bytes) -> void {
+	serialize(msg.out_dev_id, bytes);
+	serialize(msg.out_port, bytes);
+	serialize(std::string_view{msg.out_shmid}, bytes);
+	serialize(msg.in_dev_id, bytes);
+	serialize(msg.in_port, bytes);
+}
+
+template <> inline
+auto serialize<scuff::msg::in::set_memory_options>(const scuff::msg::in::set_memory_options& msg, std::vector<std::byte>* bytes) -> void {
+	serialize(msg.options.lock, bytes);
+	serialize(msg.options.prefault, bytes);
+	serialize(msg.options.huge_pages, bytes);
+	serialize(msg.options.lock_all, bytes);
+}
+
 template <> inline
 auto serialize<scuff::msg::in::set_track_color>(const scuff::msg::in::set_track_color& msg, std::vector<std::byte>* bytes) -> void {
 	serialize(msg.dev_id, bytes);
@@ -174,6 +215,9 @@ auto serialize<scuff::msg::out::device_port_info>(const scuff::msg::out::device_
 	serialize(msg.dev_id, bytes);
 	serialize(msg.info.audio_input_port_count, bytes);
 	serialize(msg.info.audio_output_port_count, bytes);
+	serialize(msg.info.audio_input_channels, bytes);
+	serialize(msg.info.audio_output_channels, bytes);
+	serialize(std::string_view{msg.ports_shmid}, bytes);
 }
 
 template <> inline
@@ -3,6 +3,7 @@
 #include <format>
 #include <span>
 #include <type_traits>
+#include <utility>
 #include <variant>
 #include <vector>
 
@@ -36,7 +37,9 @@ auto deserialize(std::span<const std::byte>* bytes, std::vector<std::byte>* out)
 	size_t size;
 	deserialize(bytes, &size);
 	out->resize(size);
-	std::memcpy(out->data(), bytes->data(), size);
+	if (size > 0) {
+		std::memcpy(out->data(), bytes->data(), size);
+	}
 	*bytes = bytes->subspan(size);
 }
 
@@ -55,7 +58,7 @@ auto deserialize(size_t type, std::span<const std::byte>* bytes, VariantT* out,
 	if (type == Index) {
 		auto alt = std::variant_alternative_t<Index, VariantT>{};
 		deserialize(bytes, &alt);
-		*out = alt;
+		*out = std::move(alt);
 		return;
 	}
 	if constexpr (Index + 1 < std::variant_size_v<VariantT>) {
@@ -109,7 +112,9 @@ auto serialize(const std::vector<std::byte>& value, std::vector<std::byte>* byte
 	serialize(value.size(), bytes);
 	const auto offset = bytes->size();
 	bytes->resize(offset + value.size());
-	std::memcpy(bytes->data() + offset, value.data(), value.size());
+	if (!value.empty()) {
+		std::memcpy(bytes->data() + offset, value.data(), value.size());
+	}
 }
 
 template <typename T> static
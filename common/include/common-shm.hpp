@@ -3,18 +3,43 @@
 #include "common-event-buffer.hpp"
 #include "common-param-info.hpp"
 #include "common-signaling.hpp"
+#include "common-memory-options.hpp"
 #include "common-messages.hpp"
+#include "common-os.hpp"
+#include "common-sample-format.hpp"
+#include "common-trace.hpp"
+#include <algorithm>
 #include <array>
 #include <boost/container/static_vector.hpp>
 #include <boost/interprocess/containers/string.hpp>
 #include <boost/interprocess/containers/vector.hpp>
+#include <boost/interprocess/managed_external_buffer.hpp>
 #include <boost/interprocess/managed_shared_memory.hpp>
+#include <boost/interprocess/offset_ptr.hpp>
 #include <boost/interprocess/segment_manager.hpp>
 #include <boost/interprocess/ipc/message_queue.hpp>
 #include <boost/static_string.hpp>
+#include <charconv>
 #include <deque>
+#include <memory>
+#include <mutex>
 #include <numeric>
+#include <optional>
+#include <random>
+#include <span>
 #include <string>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#if defined(__linux__)
+#include <cerrno>
+#include <cstring>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
 
 namespace bc  = boost::container;
 namespace bip = boost::interprocess;
@@ -26,16 +51,79 @@ static constexpr auto SEGMENT_OVERHEAD = 2048;
 static constexpr auto OBJECT_AUDIO_IN  = "+audio+in";
 static constexpr auto OBJECT_AUDIO_OUT = "+audio+out";
 static constexpr auto OBJECT_DATA      = "+data";
+static constexpr auto OBJECT_MSGS_IN   = "+msgs+in";
+static constexpr auto OBJECT_MSGS_OUT  = "+msgs+out";
+static constexpr auto OBJECT_BULK      = "+bulk";
+static constexpr auto OBJECT_SLAB      = "+slab";
+
+#if defined(__linux__) ///////////////////////////////////////////////////////////////
+
+// On Linux, segments are anonymous memfds which are mapped directly, rather
+// than named objects which are looked up by name. The id of a segment is a
+// /proc/<pid>/fd/<fd> path which any other process can use to open the same
+// memory, for as long as the process which owns that descriptor is alive.
+// Segment names are only used to label the memfds for debugging.
+
+using segment = bip::managed_external_buffer;
+
+struct memfd_region {
+	int fd      = -1;
+	void* addr  = nullptr;
+	size_t size = 0;
+	memfd_region() = default;
+	memfd_region(const memfd_region&) = delete;
+	memfd_region& operator=(const memfd_region&) = delete;
+	memfd_region(memfd_region&& rhs) noexcept
+		: fd{std::exchange(rhs.fd, -1)}
+		, addr{std::exchange(rhs.addr, nullptr)}
+		, size{std::exchange(rhs.size, 0)}
+	{}
+	memfd_region& operator=(memfd_region&& rhs) noexcept {
+		if (this != &rhs) {
+			release();
+			fd   = std::exchange(rhs.fd, -1);
+			addr = std::exchange(rhs.addr, nullptr);
+			size = std::exchange(rhs.size, 0);
+		}
+		return *this;
+	}
+	~memfd_region() {
+		release();
+	}
+private:
+	auto release() -> void {
+		if (addr) { ::munmap(addr, size); }
+		if (fd >= 0) { ::close(fd); }
+		fd   = -1;
+		addr = nullptr;
+		size = 0;
+	}
+};
+
+#else //////////////////////////////////////////////////////////////////////////////////
+
+using segment = bip::managed_shared_memory;
+
+#endif /////////////////////////////////////////////////////////////////////////////////
 
 struct segment_raii {
-	bip::managed_shared_memory seg;
+#if defined(__linux__)
+	// Declared before seg so that it is unmapped after seg is destroyed.
+	memfd_region region;
+#endif
+	shm::segment seg;
 	std::string id;
 	bool remove_when_done = false;
 	segment_raii() = default;
 	segment_raii(const segment_raii&) = delete;
 	segment_raii& operator=(const segment_raii&) = delete;
 	segment_raii(segment_raii&& rhs) noexcept
+#if defined(__linux__)
+		: region{std::move(rhs.region)}
+		, seg{std::move(rhs.seg)}
+#else
 		: seg{std::move(rhs.seg)}
+#endif
 		, id{std::move(rhs.id)}
 		, remove_when_done{rhs.remove_when_done}
 	{
@@ -44,6 +132,9 @@ struct segment_raii {
 	segment_raii& operator=(segment_raii&& rhs) noexcept {
 		if (this != &rhs) {
 			seg              = std::move(rhs.seg);
+#if defined(__linux__)
+			region           = std::move(rhs.region);
+#endif
 			id               = std::move(rhs.id);
 			remove_when_done = rhs.remove_when_done;
 			rhs.remove_when_done = false;
@@ -51,113 +142,640 @@ struct segment_raii {
 		return *this;
 	}
 	~segment_raii() {
+#if !defined(__linux__)
+		// memfds go away by themselves when the last descriptor or
+		// mapping is closed so there is nothing to remove on Linux.
 		if (remove_when_done) {
 			bip::shared_memory_object::remove(id.c_str());
 		}
+#endif
 	}
 };
 
-struct open_or_create_segment_result {
-	bip::managed_shared_memory seg;
-	bool was_created;
-};
-
 [[nodiscard]] static
 auto is_valid(const segment_raii& seg) -> bool {
 	return !seg.id.empty();
 }
 
+#if defined(__linux__) ///////////////////////////////////////////////////////////////
+
+[[nodiscard]] static
+auto make_memfd_path(int fd) -> std::string {
+	return std::format("/proc/{}/fd/{}", ::getpid(), fd);
+}
+
+static
+auto map_region(memfd_region* region, size_t size) -> void {
+	const auto addr = ::mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, region->fd, 0);
+	if (addr == MAP_FAILED) {
+		throw std::runtime_error{std::format("Failed to map shared memory segment: {}", std::strerror(errno))};
+	}
+	region->addr = addr;
+	region->size = size;
+}
+
 [[nodiscard]] static
-auto open_or_create_segment(std::string_view id, size_t segment_size) -> open_or_create_segment_result {
-	open_or_create_segment_result result;
-	try {
-		result.seg         = bip::managed_shared_memory{bip::open_only, id.data()};
-		result.was_created = false;
+auto create_segment(std::string_view name, size_t segment_size, bool remove_when_done) -> segment_raii {
+	segment_raii result;
+	result.region.fd = ::memfd_create(std::string{name}.c_str(), MFD_CLOEXEC);
+	if (result.region.fd < 0) {
+		throw std::runtime_error{std::format("Failed to create shared memory segment '{}': {}", name, std::strerror(errno))};
 	}
-	catch (const bip::interprocess_exception&) {
-		result.seg         = bip::managed_shared_memory{bip::create_only, id.data(), segment_size};
-		result.was_created = true;
+	if (::ftruncate(result.region.fd, segment_size) != 0) {
+		throw std::runtime_error{std::format("Failed to size shared memory segment '{}': {}", name, std::strerror(errno))};
 	}
+	map_region(&result.region, segment_size);
+	result.seg              = segment{bip::create_only, result.region.addr, result.region.size};
+	result.id               = make_memfd_path(result.region.fd);
+	result.remove_when_done = remove_when_done;
+	return result;
+}
+
+[[nodiscard]] static
+// Returns true if fd is a memfd which was created with the given name.
+auto is_memfd_named(int fd, std::string_view name) -> bool {
+	auto link       = std::array<char, 512>{};
+	const auto size = ::readlink(std::format("/proc/self/fd/{}", fd).c_str(), link.data(), link.size());
+	if (size < 0) {
+		return false;
+	}
+	const auto path     = std::string_view{link.data(), static_cast<size_t>(size)};
+	const auto expected = std::format("/memfd:{}", name);
+	return path == expected || path == expected + " (deleted)";
+}
+
+[[nodiscard]] static
+// A segment's id is the path of another process's descriptor, and once that
+// descriptor is closed its number can be reused for anything. If name isn't
+// empty then the segment has to be a memfd that was created with that name,
+// which is checked before anything is mapped.
+auto open_segment(std::string_view id, bool remove_when_done, std::string_view name = {}) -> segment_raii {
+	segment_raii result;
+	result.region.fd = ::open(std::string{id}.c_str(), O_RDWR | O_CLOEXEC);
+	if (result.region.fd < 0) {
+		throw std::runtime_error{std::format("Failed to open shared memory segment '{}': {}", id, std::strerror(errno))};
+	}
+	if (!name.empty() && !is_memfd_named(result.region.fd, name)) {
+		throw std::runtime_error{std::format("Shared memory segment '{}' isn't '{}' any more.", id, name)};
+	}
+	struct stat st;
+	if (::fstat(result.region.fd, &st) != 0) {
+		throw std::runtime_error{std::format("Failed to stat shared memory segment '{}': {}", id, std::strerror(errno))};
+	}
+	map_region(&result.region, static_cast<size_t>(st.st_size));
+	result.seg              = segment{bip::open_only, result.region.addr, result.region.size};
+	// Refer to our own descriptor from now on, so that the id remains
+	// valid for other processes even if the creator goes away.
+	result.id               = make_memfd_path(result.region.fd);
+	result.remove_when_done = remove_when_done;
+	return result;
+}
+
+#else //////////////////////////////////////////////////////////////////////////////////
+
+[[nodiscard]] static
+auto create_segment(std::string_view name, size_t segment_size, bool remove_when_done) -> segment_raii {
+	segment_raii result;
+	result.seg              = bip::managed_shared_memory{bip::create_only, name.data(), segment_size};
+	result.id               = name;
+	result.remove_when_done = remove_when_done;
 	return result;
 }
 
+[[nodiscard]] static
+// Segments are opened by name here, so name doesn't need checking.
+auto open_segment(std::string_view id, bool remove_when_done, std::string_view name = {}) -> segment_raii {
+	segment_raii result;
+	result.seg              = bip::managed_shared_memory{bip::open_only, id.data()};
+	result.id               = id;
+	result.remove_when_done = remove_when_done;
+	return result;
+}
+
+#endif /////////////////////////////////////////////////////////////////////////////////
+
+// Wait-free single-producer/single-consumer byte ring. The bytes live in a
+// separate array in the same segment so that the capacity can be chosen
+// when the segment is created. The read and write positions only ever
+// increase, and are kept on separate cache lines.
 struct msg_buffer {
+	msg_buffer(std::byte* storage, size_t capacity)
+		: storage_{storage}
+		, capacity_{capacity}
+	{}
 	[[nodiscard]]
 	auto read(std::byte* bytes, size_t count) -> size_t {
-		const auto time = std::chrono::steady_clock::now() + std::chrono::seconds{1};
-		const auto lock = bip::scoped_lock{mutex_, time};
-		if (!lock) {
-			return 0;
-		}
-		count = std::min(count, bytes_.size());
+		const auto read_pos  = read_pos_.load(std::memory_order_relaxed);
+		const auto write_pos = write_pos_.load(std::memory_order_acquire);
+		count = std::min(count, static_cast<size_t>(write_pos - read_pos));
 		if (count <= 0) {
 			return 0;
 		}
-		std::copy(bytes_.begin(), bytes_.begin() + count, bytes);
-		bytes_.erase(bytes_.begin(), bytes_.begin() + count);
+		const auto offset = static_cast<size_t>(read_pos % capacity_);
+		const auto first  = std::min(count, capacity_ - offset);
+		std::copy(storage_.get() + offset, storage_.get() + offset + first, bytes);
+		std::copy(storage_.get(), storage_.get() + (count - first), bytes + first);
+		read_pos_.store(read_pos + count, std::memory_order_release);
 		return count;
 	}
 	[[nodiscard]]
 	auto write(const std::byte* bytes, size_t count) -> size_t {
-		const auto time = std::chrono::steady_clock::now() + std::chrono::seconds{1};
-		const auto lock = bip::scoped_lock{mutex_, time};
-		if (!lock) {
+		const auto write_pos = write_pos_.load(std::memory_order_relaxed);
+		const auto read_pos  = read_pos_.load(std::memory_order_acquire);
+		count = std::min(count, capacity_ - static_cast<size_t>(write_pos - read_pos));
+		if (count <= 0) {
 			return 0;
 		}
-		count = std::min(count, bytes_.capacity() - bytes_.size());
-		bytes_.insert(bytes_.end(), bytes, bytes + count);
+		const auto offset = static_cast<size_t>(write_pos % capacity_);
+		const auto first  = std::min(count, capacity_ - offset);
+		std::copy(bytes, bytes + first, storage_.get() + offset);
+		std::copy(bytes + first, bytes + count, storage_.get());
+		write_pos_.store(write_pos + count, std::memory_order_release);
 		return count;
 	}
+	[[nodiscard]]
+	auto capacity() const -> size_t {
+		return capacity_;
+	}
 private:
-	bc::static_vector<std::byte, MSG_BUFFER_SIZE> bytes_;
-	bip::interprocess_mutex mutex_;
+	// Padded rather than aligned because the segment manager
+	// doesn't respect alignments greater than its own.
+	using padding = std::array<std::byte, CACHE_LINE_SIZE - sizeof(std::atomic<uint64_t>)>;
+	std::atomic<uint64_t> read_pos_  = 0; // Only the reader writes this.
+	padding pad0_;
+	std::atomic<uint64_t> write_pos_ = 0; // Only the writer writes this.
+	padding pad1_;
+	bip::offset_ptr<std::byte> storage_;
+	size_t capacity_;
 };
 
-using audio_buffer = std::array<float, VECTOR_SIZE * CHANNEL_COUNT>;
+// What is known about the contents of an audio port. Bit N of each
+// mask refers to channel N. A constant channel holds the same value in
+// every frame (this is the same as clap_audio_buffer::constant_mask) and
+// a silent channel is a constant channel of zeros. The samples are still
+// valid either way, so anything which ignores these sees the same audio.
+struct audio_buffer_flags {
+	uint64_t constant_mask = 0;
+	uint64_t silent_mask   = 0;
+};
 
-struct device_data {
+// Silence, whatever the number of channels.
+static constexpr auto SILENT_BUFFER = audio_buffer_flags{~uint64_t{0}, ~uint64_t{0}};
+
+[[nodiscard]] static
+auto get_channels_mask(uint32_t channel_count) -> uint64_t {
+	return channel_count >= 64 ? ~uint64_t{0} : (uint64_t{1} << channel_count) - 1;
+}
+
+[[nodiscard]] static
+auto is_silent(const audio_buffer_flags& flags, uint32_t channel_count) -> bool {
+	const auto mask = get_channels_mask(channel_count);
+	return (flags.silent_mask & mask) == mask;
+}
+
+// Output levels of one channel of an audio output port. Written by the sandbox
+// audio thread after each call to the plugin's process function and read by the
+// client without any locking. See scuff::get_device_meters().
+struct channel_meter {
+	// Highest absolute sample since the client last read it. The client resets it
+	// to zero when reading, so if the audio thread is updating it at the same time
+	// the reset may be lost and the peak is just held for a little longer.
+	std::atomic<float> peak;
+	std::atomic<float> rms; // Of the last block.
+};
+
+// An audio port of a device. Channel N starts at N * the max_frames of the
+// device's segment, which is the max_frames its group was activated with. The
+// samples are allocated separately in the device's segment, so a port only
+// takes up as much memory as its channels need. They are in the sample format
+// of the segment, so only one of the sample pointers is set.
+struct audio_port {
+	bip::offset_ptr<float> samples;
+	bip::offset_ptr<double> samples64;
+	// One for each channel. Output ports only. Both sets of buffers share them.
+	bip::offset_ptr<channel_meter> meters;
+	uint32_t channel_count = 0;
+	// Whoever writes to the samples also updates these.
+	audio_buffer_flags flags;
+};
+
+[[nodiscard]] static
+auto is_silent(const audio_port& port) -> bool {
+	return is_silent(port.flags, port.channel_count);
+}
+
+template <typename T> [[nodiscard]] static
+// Null if the port's samples aren't in this format.
+auto get_samples(const audio_port& port) -> T* {
+	if constexpr (std::is_same_v<T, double>) { return port.samples64.get(); }
+	else                                     { return port.samples.get(); }
+}
+
+// The audio inputs or outputs of a device, allocated in its segment.
+// Like a span, being const doesn't make the ports themselves const.
+struct audio_ports {
+	bip::offset_ptr<audio_port> ports;
+	size_t count = 0;
+	[[nodiscard]] auto size() const -> size_t                       { return count; }
+	[[nodiscard]] auto begin() const -> audio_port*                 { return ports.get(); }
+	[[nodiscard]] auto end() const -> audio_port*                   { return ports.get() + count; }
+	[[nodiscard]] auto operator[](size_t index) const -> audio_port& { return ports[index]; }
+	[[nodiscard]]
+	auto at(size_t index) const -> audio_port& {
+		if (index >= count) {
+			throw std::out_of_range{std::format("Audio port index {} is out of range.", index)};
+		}
+		return ports[index];
+	}
+};
+
+// The channel count of each of a device's audio ports, the format of
+// their samples and the number of frames each channel has room for. The
+// device's segment is sized to fit them, so if they change then the
+// device has to be moved to a new segment.
+struct port_layout {
+	std::vector<uint32_t> audio_in;
+	std::vector<uint32_t> audio_out;
+	sample_format format = sample_format::float32;
+	uint32_t max_frames  = MAX_VECTOR_SIZE;
+	auto operator==(const port_layout&) const -> bool = default;
+};
+
+struct device_buffers {
 	scuff::event_buffer events_in;
 	scuff::event_buffer events_out;
-	bc::static_vector<audio_buffer, MAX_AUDIO_PORTS> audio_in;
-	bc::static_vector<audio_buffer, MAX_AUDIO_PORTS> audio_out;
+	shm::audio_ports audio_in;
+	shm::audio_ports audio_out;
+};
+
+// Written by the sandbox audio thread each cycle and read by the
+// client without any locking. See scuff::get_device_stats().
+struct device_stats {
+	std::atomic<uint64_t> processed; // Cycles the plugin's process function was called.
+	std::atomic<uint64_t> skipped;   // Cycles the device wasn't processed because it isn't active.
+	std::atomic<uint64_t> asleep;    // Cycles the device wasn't processed because it is asleep.
+	std::atomic<uint64_t> last_ns;   // Duration of the last call to the plugin's process function.
+	std::atomic<uint64_t> total_ns;
+	std::atomic<uint64_t> max_ns;
+};
+
+// Stored in device_data::output_cycle while the outputs are being written.
+static constexpr auto OUTPUT_BEING_WRITTEN = UINT32_MAX;
+
+struct device_data {
+	// Processing cycle N uses buffers[N & 1]. This lets the client read
+	// the outputs of one cycle and write the inputs of the next while the
+	// sandbox is still processing (see scuff::set_pipelined().)
+	std::array<device_buffers, 2> buffers;
+	// Of every audio port in both sets of buffers.
+	sample_format format = sample_format::float32;
+	// The stride of the channels of every audio port. A device whose group has
+	// been activated with a different max_frames hasn't been moved yet, and its
+	// buffers can't be used until it has.
+	uint32_t max_frames = MAX_VECTOR_SIZE;
+	// The cycle whose outputs are in each set of buffers. Written by the
+	// device's sandbox so that devices in other sandboxes can read the
+	// outputs directly without racing with it. See read_output().
+	std::array<std::atomic<uint32_t>, 2> output_cycle;
+	// The number of frames in each set of outputs. Published by output_cycle.
+	std::array<uint32_t, 2> output_frames;
+	shm::device_stats stats;
 };
 
 struct sandbox_data {
+	sandbox_data(std::byte* msgs_in_storage, std::byte* msgs_out_storage, size_t msg_buffer_size)
+		: msgs_in{msgs_in_storage, msg_buffer_size}
+		, msgs_out{msgs_out_storage, msg_buffer_size}
+	{}
 	msg_buffer msgs_in;
 	msg_buffer msgs_out;
 	signaling::sandbox_shm_data signaling;
+	// Timeline trace records for the sandbox's audio thread and main
+	// thread. Drained by the client's poll thread.
+	trace::ring audio_trace;
+	trace::ring main_trace;
+};
+
+// DEVICE ARENA
+// ------------
+// The devices of a group are carved out of a few large slabs, rather than each
+// getting a segment of its own, so that a process only has to map a handful of
+// segments however many devices there are, and creating a device doesn't have to
+// create a segment. The client creates the slabs and keeps one with room in it
+// ahead of the sandboxes (see reserve_slab().) The sandboxes allocate blocks from
+// them without locking, and whichever process lets go of a block last frees it.
+// A process which crashes never lets go, so the blocks it had open aren't reused
+// until the group is erased.
+
+static constexpr auto ARENA_MAX_SLABS         = 64;
+static constexpr auto ARENA_MAX_ID_SIZE       = 256;
+static constexpr auto ARENA_SLAB_SIZE         = size_t{32} << 20;
+static constexpr auto ARENA_MIN_BLOCK_SIZE    = size_t{128} << 10; // Enough for a stereo device.
+static constexpr auto ARENA_SIZE_CLASSES      = uint32_t{9};       // Blocks of ARENA_MIN_BLOCK_SIZE << [0, 9).
+static constexpr auto ARENA_BLOCK_HEADER_SIZE = size_t{CACHE_LINE_SIZE};
+
+static_assert((ARENA_MIN_BLOCK_SIZE << (ARENA_SIZE_CLASSES - 1)) == ARENA_SLAB_SIZE);
+
+// At the start of every block. Blocks which have never been allocated are
+// zeros, which is what the operating system gives us.
+struct block_header {
+	std::atomic<uint32_t> refs;       // Processes which have the block open. Zero if it's free.
+	std::atomic<uint32_t> generation; // Incremented each time the block is allocated, so a stale id can't open it.
+	std::atomic<uint32_t> next_free;  // The index + 1 of the next block on the free list, or zero.
+	uint32_t size_class;
+};
+
+struct slab_data {
+	slab_data(std::byte* storage, size_t capacity)
+		: storage{storage}
+		, capacity{capacity}
+	{}
+	bip::offset_ptr<std::byte> storage;
+	size_t capacity;
+	// Bytes of storage which have been carved into blocks. Blocks are
+	// carved off the end, and after that they go back and forth between
+	// being allocated and being on the free list for their size.
+	std::atomic<uint64_t> used = 0;
+	// The top of the free list for each size class. The low 32 bits are the
+	// index + 1 of a block and the high bits are incremented by every change,
+	// so that a pop can't succeed against a list which changed underneath it.
+	std::array<std::atomic<uint64_t>, ARENA_SIZE_CLASSES> free_lists = {};
+};
+
+struct arena_data {
+	// Slabs [0, slab_count) can be opened with these ids. Only the
+	// client adds slabs, and it writes the id before the count.
+	std::array<std::array<char, ARENA_MAX_ID_SIZE>, ARENA_MAX_SLABS> slab_ids;
+	std::atomic<uint32_t> slab_count = 0;
 };
 
 struct group_data {
 	signaling::group_shm_data signaling;
+	// The number of frames to process in the cycles which use each set of
+	// device buffers. Written by the client before it signals the sandboxes.
+	std::array<std::atomic<uint32_t>, 2> frames;
+	shm::arena_data arena;
+};
+
+// The client's poll thread sleeps on this between passes. The sandbox
+// processes ring it when they have written to their msgs_out buffers,
+// and the client rings it when a message is enqueued for a sandbox.
+struct doorbell_data {
+	ipc::shared_event event;
 };
 
-template <typename T> static
-auto find_shm_obj(bip::managed_shared_memory* seg, std::string_view id, T** out_ptr) -> size_t {
-	const auto [found_ptr, count] = seg->find<T>(id.data());
+enum class bulk_outcome { pending, cancelled, delivered };
+
+// A transient segment for streaming one large payload between the client
+// and a sandbox process, so that it doesn't have to squeeze through the
+// message buffers. Either side can cancel the transfer until the receiver
+// has delivered the message, and whichever gets there first decides the
+// outcome. The sender keeps the segment alive until the receiver says it
+// is closed, or until it gives up on the receiver.
+struct bulk_data {
+	bulk_data(std::byte* storage, size_t capacity, uint64_t size, uint64_t nonce)
+		: ring{storage, capacity}
+		, size{size}
+		, nonce{nonce}
+	{}
+	msg_buffer ring;
+	uint64_t size;
+	// Random, and also sent in the envelope, so that the receiver can tell
+	// if the id it was given has since come to mean some other segment.
+	uint64_t nonce;
+	std::atomic<bulk_outcome> outcome = bulk_outcome::pending;
+	std::atomic<bool> closed          = false;
+};
+
+template <typename T, typename Segment> static
+auto find_shm_obj(Segment* seg, std::string_view id, T** out_ptr) -> size_t {
+	const auto [found_ptr, count] = seg->template find<T>(id.data());
 	*out_ptr = found_ptr;
 	return count;
 }
 
-template <typename T> [[nodiscard]] static
-auto find_shm_obj_value(bip::managed_shared_memory* seg, std::string_view id, T* out_value) -> size_t {
-	const auto [found_ptr, count] = seg->find<T>(id.data());
+template <typename T, typename Segment> [[nodiscard]] static
+auto find_shm_obj_value(Segment* seg, std::string_view id, T* out_value) -> size_t {
+	const auto [found_ptr, count] = seg->template find<T>(id.data());
 	*out_value = *found_ptr;
 	return count;
 }
 
-template <typename T> static
-auto require_shm_obj(bip::managed_shared_memory* seg, std::string_view id, size_t required_count, T** out_ptr) -> void {
+template <typename T, typename Segment> static
+auto require_shm_obj(Segment* seg, std::string_view id, size_t required_count, T** out_ptr) -> void {
 	const auto count = find_shm_obj(seg, id, out_ptr);
 	if (count < required_count) {
 		throw std::runtime_error{"Could not find shared memory object: " + std::string{id}};
 	}
 }
 
+// A process's mapping of one of the slabs of its group's arena.
+struct slab {
+	segment_raii seg;
+	slab_data* data = nullptr;
+	// How many of this process's block_refs have locked each page of the storage,
+	// counting from the page the storage starts in. Blocks don't start or end on
+	// page boundaries, so a page can be shared by two blocks, and it can only be
+	// unlocked once neither of them wants it locked. Memory locks belong to the
+	// process, so this isn't shared with the other processes.
+	mutable std::mutex lock_mutex;
+	mutable std::vector<uint32_t> page_locks;
+};
+
+[[nodiscard]] static
+auto get_block_header(const slab_data& slab, uint64_t offset) -> block_header* {
+	return reinterpret_cast<block_header*>(slab.storage.get() + offset);
+}
+
+[[nodiscard]] static
+auto get_block_size(uint32_t size_class) -> size_t {
+	return ARENA_MIN_BLOCK_SIZE << size_class;
+}
+
+[[nodiscard]] static
+auto make_free_list_head(uint64_t old_head, uint32_t index) -> uint64_t {
+	return (((old_head >> 32) + 1) << 32) | index;
+}
+
+static
+auto push_free_block(slab_data* slab, uint64_t offset) -> void {
+	const auto block = get_block_header(*slab, offset);
+	const auto index = static_cast<uint32_t>(offset / ARENA_MIN_BLOCK_SIZE) + 1;
+	auto& head       = slab->free_lists[block->size_class];
+	auto old_head    = head.load(std::memory_order_relaxed);
+	do {
+		block->next_free.store(static_cast<uint32_t>(old_head), std::memory_order_relaxed);
+	} while (!head.compare_exchange_weak(old_head, make_free_list_head(old_head, index), std::memory_order_release, std::memory_order_relaxed));
+}
+
+[[nodiscard]] static
+// Returns the offset of the block.
+auto pop_free_block(slab_data* slab, uint32_t size_class) -> std::optional<uint64_t> {
+	auto& head    = slab->free_lists[size_class];
+	auto old_head = head.load(std::memory_order_acquire);
+	for (;;) {
+		const auto index = static_cast<uint32_t>(old_head);
+		if (index == 0) {
+			return std::nullopt;
+		}
+		// The next link is garbage if another process popped this block in the
+		// meantime, but then the list has changed so the exchange will fail.
+		const auto offset = uint64_t{index - 1} * ARENA_MIN_BLOCK_SIZE;
+		const auto next   = get_block_header(*slab, offset)->next_free.load(std::memory_order_relaxed);
+		if (head.compare_exchange_weak(old_head, make_free_list_head(old_head, next), std::memory_order_acquire, std::memory_order_acquire)) {
+			return offset;
+		}
+	}
+}
+
+[[nodiscard]] static
+// Returns the offset of the block.
+auto carve_block(slab_data* slab, uint32_t size_class) -> std::optional<uint64_t> {
+	const auto size = get_block_size(size_class);
+	auto used       = slab->used.load(std::memory_order_relaxed);
+	do {
+		if (used + size > slab->capacity) {
+			return std::nullopt;
+		}
+	} while (!slab->used.compare_exchange_weak(used, used + size, std::memory_order_relaxed));
+	get_block_header(*slab, used)->size_class = size_class;
+	return used;
+}
+
+template <typename Fn> static
+// Call fn(addr, size) for each run of pages in [first, last) of the
+// slab which this process doesn't have locked. Call with the slab's
+// lock_mutex locked.
+auto for_each_unlocked_run(const slab& slab, size_t first, size_t last, Fn&& fn) -> void {
+	const auto page = os::get_page_size();
+	const auto base = reinterpret_cast<uintptr_t>(slab.data->storage.get()) & ~(page - 1);
+	for (auto p = first; p < last; p++) {
+		if (slab.page_locks[p] > 0) {
+			continue;
+		}
+		const auto run_first = p;
+		while (p < last && slab.page_locks[p] == 0) {
+			p++;
+		}
+		fn(reinterpret_cast<void*>(base + (run_first * page)), (p - run_first) * page);
+	}
+}
+
+[[nodiscard]] static
+// The pages [first, last) of the slab which the block is on.
+auto get_block_pages(const slab& slab, uint64_t offset) -> std::pair<size_t, size_t> {
+	const auto page  = os::get_page_size();
+	const auto start = reinterpret_cast<uintptr_t>(slab.data->storage.get());
+	const auto base  = start & ~(page - 1);
+	const auto begin = start + offset;
+	const auto end   = begin + get_block_size(get_block_header(*slab.data, offset)->size_class);
+	return {(begin - base) / page, (end - base + page - 1) / page};
+}
+
+[[nodiscard]] static
+// Lock the pages of the block which this process doesn't already have locked.
+// If that fails, none of them are left locked.
+auto lock_block_pages(const slab& slab, uint64_t offset) -> bool {
+	const auto lock          = std::lock_guard{slab.lock_mutex};
+	const auto [first, last] = get_block_pages(slab, offset);
+	if (slab.page_locks.size() < last) {
+		slab.page_locks.resize(last, 0);
+	}
+	auto ok = true;
+	for_each_unlocked_run(slab, first, last, [&ok](void* addr, size_t size) {
+		ok = ok && os::lock_memory(addr, size);
+	});
+	if (!ok) {
+		for_each_unlocked_run(slab, first, last, [](void* addr, size_t size) {
+			os::unlock_memory(addr, size);
+		});
+		return false;
+	}
+	for (auto p = first; p < last; p++) {
+		slab.page_locks[p]++;
+	}
+	return true;
+}
+
+static
+// Undo lock_block_pages(), leaving locked any pages which
+// are shared with a block that this process still has locked.
+auto unlock_block_pages(const slab& slab, uint64_t offset) -> void {
+	const auto lock          = std::lock_guard{slab.lock_mutex};
+	const auto [first, last] = get_block_pages(slab, offset);
+	for (auto p = first; p < last; p++) {
+		slab.page_locks[p]--;
+	}
+	for_each_unlocked_run(slab, first, last, [](void* addr, size_t size) {
+		os::unlock_memory(addr, size);
+	});
+}
+
+// One process's reference to a block in its group's arena. The block goes
+// back on its free list when the last process which had it open lets go.
+struct block_ref {
+	std::shared_ptr<const shm::slab> slab;
+	uint64_t offset = 0;
+	// True if this reference has the block's pages locked (see lock_memory().)
+	// Mutable because it's about this process's view of the memory, which
+	// can be locked through a const device.
+	mutable bool locked = false;
+	block_ref() = default;
+	block_ref(std::shared_ptr<const shm::slab> slab, uint64_t offset)
+		: slab{std::move(slab)}
+		, offset{offset}
+	{}
+	block_ref(const block_ref&) = delete;
+	block_ref& operator=(const block_ref&) = delete;
+	block_ref(block_ref&& rhs) noexcept
+		: slab{std::move(rhs.slab)}
+		, offset{rhs.offset}
+		, locked{std::exchange(rhs.locked, false)}
+	{}
+	block_ref& operator=(block_ref&& rhs) noexcept {
+		if (this != &rhs) {
+			release();
+			slab   = std::move(rhs.slab);
+			offset = rhs.offset;
+			locked = std::exchange(rhs.locked, false);
+		}
+		return *this;
+	}
+	~block_ref() {
+		release();
+	}
+	[[nodiscard]]
+	auto header() const -> block_header* {
+		return get_block_header(*slab->data, offset);
+	}
+private:
+	auto release() -> void {
+		if (slab && locked) {
+			unlock_block_pages(*slab, offset);
+			locked = false;
+		}
+		if (slab && header()->refs.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+			push_free_block(slab->data, offset);
+		}
+		slab = nullptr;
+	}
+};
+
+// A process's view of its group's arena. Slabs are mapped the first time
+// they are needed and stay mapped for as long as anything is using them.
+struct arena {
+	arena_data* data = nullptr;
+	std::string group_shmid;
+	bool remove_when_done = false;
+	std::mutex mutex;
+	std::vector<std::shared_ptr<const shm::slab>> slabs;
+};
+
 struct group {
 	segment_raii seg;
 	group_data* data = nullptr;
 	signaling::group_local_data signaling;
+	std::shared_ptr<shm::arena> arena;
 };
 
 struct sandbox {
@@ -167,21 +785,92 @@ struct sandbox {
 };
 
 struct device {
+	// Only used by a device which didn't fit in its group's arena.
 	segment_raii seg;
+	block_ref block;
+	// The id of the segment, or of the block (see make_block_id().)
+	std::string id;
 	device_data* data = nullptr;
+	// True if this process created the segment, rather
+	// than opening one which already existed.
+	bool created = false;
+};
+
+struct bulk {
+	segment_raii seg;
+	// What the segment was created as, which isn't the same as its id on Linux.
+	std::string name;
+	bulk_data* data = nullptr;
 };
 
-static constexpr auto GROUP_SEGMENT_SIZE   = sizeof(group_data) + SEGMENT_OVERHEAD;
-static constexpr auto SANDBOX_SEGMENT_SIZE = sizeof(sandbox_data) + SEGMENT_OVERHEAD;
-static constexpr auto DEVICE_SEGMENT_SIZE  = sizeof(device_data) + SEGMENT_OVERHEAD;
+struct doorbell {
+	segment_raii seg;
+	doorbell_data* data = nullptr;
+	ipc::local_event event;
+};
+
+static constexpr auto GROUP_SEGMENT_SIZE    = sizeof(group_data) + SEGMENT_OVERHEAD;
+static constexpr auto DOORBELL_SEGMENT_SIZE = sizeof(doorbell_data) + SEGMENT_OVERHEAD;
+
+[[nodiscard]] static
+auto make_arena(arena_data* data, std::string_view group_shmid, bool remove_when_done) -> std::shared_ptr<arena> {
+	auto out = std::make_shared<arena>();
+	out->data             = data;
+	out->group_shmid      = group_shmid;
+	out->remove_when_done = remove_when_done;
+	return out;
+}
+
+static
+// Client only. Add a slab to the arena if the newest one is getting full, so that
+// the sandboxes don't run out of room. Memory which is never touched isn't
+// committed, so an empty slab costs little more than the address space.
+auto reserve_slab(shm::arena* arena) -> void {
+	const auto lock  = std::lock_guard{arena->mutex};
+	const auto count = arena->slabs.size();
+	if (count >= ARENA_MAX_SLABS) {
+		return;
+	}
+	if (count > 0) {
+		const auto& newest = *arena->slabs.back()->data;
+		if (newest.capacity - newest.used.load(std::memory_order_relaxed) >= ARENA_SLAB_SIZE / 2) {
+			return;
+		}
+	}
+	auto slab = std::make_shared<shm::slab>();
+	slab->seg = create_segment(std::format("{}+slab+{}", arena->group_shmid, count), ARENA_SLAB_SIZE + sizeof(slab_data) + (2 * SEGMENT_OVERHEAD), arena->remove_when_done);
+	if (slab->seg.id.size() >= ARENA_MAX_ID_SIZE) {
+		throw std::runtime_error{std::format("Shared memory segment id '{}' is too long.", slab->seg.id)};
+	}
+	// Not constructed, so that the pages aren't touched until they're used.
+	const auto storage = static_cast<std::byte*>(slab->seg.seg.allocate(ARENA_SLAB_SIZE));
+	slab->data = slab->seg.seg.construct<slab_data>(OBJECT_DATA)(storage, ARENA_SLAB_SIZE);
+	auto& id   = arena->data->slab_ids[count];
+	std::ranges::fill(id, '\0');
+	std::ranges::copy(slab->seg.id, id.begin());
+	arena->slabs.push_back(std::move(slab));
+	arena->data->slab_count.store(static_cast<uint32_t>(count + 1), std::memory_order_release);
+}
+
+static
+// Map any slabs which have been added since last time. Call with the arena's mutex locked.
+auto map_slabs(shm::arena* arena) -> void {
+	const auto count = arena->data->slab_count.load(std::memory_order_acquire);
+	while (arena->slabs.size() < count) {
+		auto slab = std::make_shared<shm::slab>();
+		slab->seg = open_segment(arena->data->slab_ids[arena->slabs.size()].data(), false);
+		require_shm_obj<slab_data>(&slab->seg.seg, OBJECT_DATA, 1, &slab->data);
+		arena->slabs.push_back(std::move(slab));
+	}
+}
 
 [[nodiscard]] static
 auto create_group(std::string_view shmid, bool remove_when_done) -> group {
 	group shm;
-	shm.seg.seg              = bip::managed_shared_memory{bip::create_only, shmid.data(), GROUP_SEGMENT_SIZE};
-	shm.seg.id               = shmid;
-	shm.seg.remove_when_done = remove_when_done;
-	shm.data                 = shm.seg.seg.construct<group_data>(OBJECT_DATA)();
+	shm.seg   = create_segment(shmid, GROUP_SEGMENT_SIZE, remove_when_done);
+	shm.data  = shm.seg.seg.construct<group_data>(OBJECT_DATA)();
+	shm.arena = make_arena(&shm.data->arena, shmid, remove_when_done);
+	reserve_slab(shm.arena.get());
 	signaling::init(signaling::clientside_group_init{shmid, {&shm.signaling, &shm.data->signaling}});
 	return shm;
 }
@@ -189,9 +878,9 @@ auto create_group(std::string_view shmid, bool remove_when_done) -> group {
 [[nodiscard]] static
 auto open_group(std::string_view shmid) -> group {
 	group shm;
-	shm.seg.seg             = bip::managed_shared_memory{bip::open_only, shmid.data()};
-	shm.seg.id              = shmid;
+	shm.seg = open_segment(shmid, false);
 	require_shm_obj<group_data>(&shm.seg.seg, OBJECT_DATA, 1, &shm.data);
+	shm.arena = make_arena(&shm.data->arena, shmid, false);
 	signaling::init(signaling::sandboxside_group_init{shmid, {&shm.signaling, &shm.data->signaling}});
 	return shm;
 }
@@ -202,12 +891,19 @@ auto make_group_id(std::string_view instance_id, id::group group_id) -> std::str
 }
 
 [[nodiscard]] static
-auto create_sandbox(std::string_view shmid, bool remove_when_done) -> sandbox {
+auto get_sandbox_segment_size(size_t msg_buffer_size) -> size_t {
+	return sizeof(sandbox_data) + (msg_buffer_size * 2) + SEGMENT_OVERHEAD;
+}
+
+[[nodiscard]] static
+// msg_buffer_size is the capacity in bytes of each of the message
+// buffers between the client and the sandbox process.
+auto create_sandbox(std::string_view shmid, bool remove_when_done, size_t msg_buffer_size = MSG_BUFFER_SIZE) -> sandbox {
 	sandbox shm;
-	shm.seg.seg              = bip::managed_shared_memory{bip::create_only, shmid.data(), SANDBOX_SEGMENT_SIZE};
-	shm.seg.id               = shmid;
-	shm.seg.remove_when_done = remove_when_done;
-	shm.data = shm.seg.seg.construct<sandbox_data>(OBJECT_DATA)();
+	shm.seg  = create_segment(shmid, get_sandbox_segment_size(msg_buffer_size), remove_when_done);
+	const auto msgs_in  = shm.seg.seg.construct<std::byte>(OBJECT_MSGS_IN)[msg_buffer_size]();
+	const auto msgs_out = shm.seg.seg.construct<std::byte>(OBJECT_MSGS_OUT)[msg_buffer_size]();
+	shm.data = shm.seg.seg.construct<sandbox_data>(OBJECT_DATA)(msgs_in, msgs_out, msg_buffer_size);
 	signaling::init(signaling::clientside_sandbox_init{shmid, {&shm.signaling, &shm.data->signaling}});
 	return shm;
 }
@@ -215,8 +911,7 @@ auto create_sandbox(std::string_view shmid, bool remove_when_done) -> sandbox {
 [[nodiscard]] static
 auto open_sandbox(std::string_view shmid) -> sandbox {
 	sandbox shm;
-	shm.seg.seg             = bip::managed_shared_memory{bip::open_only, shmid.data()};
-	shm.seg.id              = shmid;
+	shm.seg = open_segment(shmid, false);
 	require_shm_obj<sandbox_data>(&shm.seg.seg, OBJECT_DATA, 1, &shm.data);
 	signaling::init(signaling::sandboxside_sandbox_init{shmid, {&shm.signaling, &shm.data->signaling}});
 	return shm;
@@ -227,6 +922,97 @@ auto make_sandbox_id(std::string_view instance_id, id::sandbox sbox_id) -> std::
 	return std::format("{}+sbox+{}", instance_id, sbox_id.value);
 }
 
+[[nodiscard]] static
+auto create_doorbell(std::string_view shmid, bool remove_when_done) -> doorbell {
+	doorbell shm;
+	shm.seg   = create_segment(shmid, DOORBELL_SEGMENT_SIZE, remove_when_done);
+	shm.data  = shm.seg.seg.construct<doorbell_data>(OBJECT_DATA)();
+	ipc::init(ipc::shared_event_create{&shm.data->event, shmid});
+	shm.event = ipc::local_event{ipc::local_event_create{&shm.data->event}};
+	return shm;
+}
+
+[[nodiscard]] static
+auto open_doorbell(std::string_view shmid) -> doorbell {
+	doorbell shm;
+	shm.seg   = open_segment(shmid, false);
+	require_shm_obj<doorbell_data>(&shm.seg.seg, OBJECT_DATA, 1, &shm.data);
+	shm.event = ipc::local_event{ipc::local_event_open{&shm.data->event}};
+	return shm;
+}
+
+[[nodiscard]] static
+auto make_doorbell_id(std::string_view instance_id) -> std::string {
+	return std::format("{}+doorbell", instance_id);
+}
+
+static
+// Wake the client's poll thread. Does nothing if the doorbell was never opened.
+auto ring(const doorbell& shm) -> void {
+	if (shm.data) {
+		shm.event.set();
+	}
+}
+
+[[nodiscard]] static
+auto make_bulk_nonce() -> uint64_t {
+	thread_local auto rng = std::mt19937_64{std::random_device{}()};
+	return rng();
+}
+
+[[nodiscard]] static
+auto make_bulk_id(uint64_t nonce) -> std::string {
+	static auto next = std::atomic<uint64_t>{0};
+	return std::format("scuff+bulk+{}+{}+{:016x}", os::get_process_id(), next++, nonce);
+}
+
+[[nodiscard]] static
+// Create a segment for streaming a payload of the given size.
+auto create_bulk(uint64_t size) -> bulk {
+	const auto capacity = static_cast<size_t>(std::min<uint64_t>(size, BULK_BUFFER_SIZE));
+	const auto nonce    = make_bulk_nonce();
+	bulk shm;
+	shm.name = make_bulk_id(nonce);
+	shm.seg  = create_segment(shm.name, sizeof(bulk_data) + capacity + SEGMENT_OVERHEAD, true);
+	const auto storage = shm.seg.seg.construct<std::byte>(OBJECT_BULK)[capacity]();
+	shm.data = shm.seg.seg.construct<bulk_data>(OBJECT_DATA)(storage, capacity, size, nonce);
+	return shm;
+}
+
+[[nodiscard]] static
+// The sender can give up on a transfer and close the segment before the
+// receiver gets to it, and on Linux the id can then refer to something else,
+// so it's checked against the name and nonce from the envelope.
+auto open_bulk(std::string_view shmid, std::string_view name, uint64_t nonce) -> bulk {
+	bulk shm;
+	shm.seg  = open_segment(shmid, false, name);
+	shm.name = name;
+	require_shm_obj<bulk_data>(&shm.seg.seg, OBJECT_DATA, 1, &shm.data);
+	if (shm.data->nonce != nonce) {
+		throw std::runtime_error{std::format("Bulk transfer segment '{}' belongs to a different transfer.", shmid)};
+	}
+	return shm;
+}
+
+static
+// Returns false if the transfer had already been delivered or cancelled.
+auto cancel_bulk(bulk_data* data) -> bool {
+	auto expected = bulk_outcome::pending;
+	return data->outcome.compare_exchange_strong(expected, bulk_outcome::cancelled);
+}
+
+[[nodiscard]] static
+// Returns false if the transfer had already been cancelled.
+auto deliver_bulk(bulk_data* data) -> bool {
+	auto expected = bulk_outcome::pending;
+	return data->outcome.compare_exchange_strong(expected, bulk_outcome::delivered);
+}
+
+[[nodiscard]] static
+auto is_cancelled(const bulk_data& data) -> bool {
+	return data.outcome.load() == bulk_outcome::cancelled;
+}
+
 [[nodiscard]] static
 auto send_bytes_to_client(const sandbox& shm, const std::byte* bytes, size_t count) -> size_t {
 	return shm.data->msgs_out.write(bytes, count);
@@ -247,45 +1033,403 @@ auto receive_bytes_from_sandbox(const sandbox& shm, std::byte* bytes, size_t cou
 	return shm.data->msgs_out.read(bytes, count);
 }
 
-static
-auto on_device_created(device* shm) -> void {
-	shm->data = shm->seg.seg.construct<device_data>(OBJECT_DATA)();
+[[nodiscard]] static
+auto get_sample_size(sample_format format) -> size_t {
+	return format == sample_format::float64 ? sizeof(double) : sizeof(float);
 }
 
-static
-auto on_device_opened(device* shm) -> void {
-	require_shm_obj<device_data>(&shm->seg.seg, OBJECT_DATA, 1, &shm->data);
+[[nodiscard]] static
+auto get_device_segment_size(const port_layout& layout) -> size_t {
+	// Allowance for the segment manager's header and alignment padding on each allocation.
+	static constexpr auto ALLOCATION_OVERHEAD = 64;
+	const auto in_channels  = std::accumulate(layout.audio_in.begin(), layout.audio_in.end(), size_t{0});
+	const auto out_channels = std::accumulate(layout.audio_out.begin(), layout.audio_out.end(), size_t{0});
+	const auto port_count   = layout.audio_in.size() + layout.audio_out.size();
+	const auto samples      = (in_channels + out_channels) * layout.max_frames * get_sample_size(layout.format);
+	const auto ports        = port_count * sizeof(audio_port);
+	const auto meters       = out_channels * sizeof(channel_meter);
+	const auto allocations  = (2 * (2 + port_count)) + layout.audio_out.size();
+	return sizeof(device_data) + (2 * (samples + ports)) + meters + (allocations * ALLOCATION_OVERHEAD) + SEGMENT_OVERHEAD;
+}
+
+template <typename Segment> [[nodiscard]] static
+auto construct_audio_ports(Segment* seg, const std::vector<uint32_t>& channel_counts, sample_format format, uint32_t max_frames) -> audio_ports {
+	audio_ports out;
+	if (channel_counts.empty()) {
+		return out;
+	}
+	out.ports = seg->template construct<audio_port>(bip::anonymous_instance)[channel_counts.size()]();
+	out.count = channel_counts.size();
+	for (size_t i = 0; i < out.count; i++) {
+		auto& port = out.ports[i];
+		port.channel_count = channel_counts[i];
+		// The samples start out as zeros.
+		port.flags         = SILENT_BUFFER;
+		if (port.channel_count == 0) {
+			continue;
+		}
+		const auto count = size_t{port.channel_count} * max_frames;
+		if (format == sample_format::float64) {
+			port.samples64 = seg->template construct<double>(bip::anonymous_instance)[count](0.0);
+		}
+		else {
+			port.samples = seg->template construct<float>(bip::anonymous_instance)[count](0.0f);
+		}
+	}
+	return out;
+}
+
+template <typename Segment> [[nodiscard]] static
+// Construct the data for a device with the given audio ports, in a
+// segment which is at least get_device_segment_size(layout) bytes.
+auto construct_device_data(Segment* seg, const port_layout& layout) -> device_data* {
+	const auto too_many_channels = [](uint32_t channel_count) { return channel_count > MAX_CHANNELS; };
+	if (std::ranges::any_of(layout.audio_in, too_many_channels) || std::ranges::any_of(layout.audio_out, too_many_channels)) {
+		throw std::runtime_error{std::format("Audio ports with more than {} channels aren't supported.", MAX_CHANNELS)};
+	}
+	if (layout.max_frames < 1 || layout.max_frames > MAX_VECTOR_SIZE) {
+		throw std::runtime_error{std::format("max_frames must be between 1 and {}.", MAX_VECTOR_SIZE)};
+	}
+	const auto data  = seg->template construct<device_data>(OBJECT_DATA)();
+	data->format     = layout.format;
+	data->max_frames = layout.max_frames;
+	for (auto& buffers : data->buffers) {
+		buffers.audio_in  = construct_audio_ports(seg, layout.audio_in, layout.format, layout.max_frames);
+		buffers.audio_out = construct_audio_ports(seg, layout.audio_out, layout.format, layout.max_frames);
+	}
+	for (size_t i = 0; i < layout.audio_out.size(); i++) {
+		if (layout.audio_out[i] > 0) {
+			const auto meters = seg->template construct<channel_meter>(bip::anonymous_instance)[layout.audio_out[i]]();
+			for (auto& buffers : data->buffers) {
+				buffers.audio_out[i].meters = meters;
+			}
+		}
+	}
+	return data;
 }
 
 [[nodiscard]] static
-auto open_device(std::string_view id, bool remove_when_done) -> device {
+auto get_channel_counts(const audio_ports& ports) -> std::vector<uint32_t> {
+	std::vector<uint32_t> out;
+	for (const auto& port : ports) {
+		out.push_back(port.channel_count);
+	}
+	return out;
+}
+
+[[nodiscard]] static
+auto get_port_layout(const device& shm) -> port_layout {
+	const auto& buffers = shm.data->buffers[0];
+	return {get_channel_counts(buffers.audio_in), get_channel_counts(buffers.audio_out), shm.data->format, shm.data->max_frames};
+}
+
+[[nodiscard]] static
+auto create_device(std::string_view id, const port_layout& layout, bool remove_when_done) -> device {
 	device shm;
-	shm.seg.seg              = bip::managed_shared_memory{bip::open_only, id.data()};
-	shm.seg.id               = id;
-	shm.seg.remove_when_done = remove_when_done;
-	on_device_opened(&shm);
+	shm.seg     = create_segment(id, get_device_segment_size(layout), remove_when_done);
+	shm.id      = shm.seg.id;
+	shm.data    = construct_device_data(&shm.seg.seg, layout);
+	shm.created = true;
 	return shm;
 }
 
 [[nodiscard]] static
-auto open_or_create_device(std::string_view id, bool remove_when_done) -> device {
+auto open_device(std::string_view id, bool remove_when_done) -> device {
 	device shm;
-	auto result              = open_or_create_segment(id, DEVICE_SEGMENT_SIZE);
-	shm.seg.seg              = std::move(result.seg);
-	shm.seg.id               = id;
-	shm.seg.remove_when_done = remove_when_done;
-	if (result.was_created) {
-		on_device_created(&shm);
+	shm.seg = open_segment(id, remove_when_done);
+	shm.id  = shm.seg.id;
+	require_shm_obj<device_data>(&shm.seg.seg, OBJECT_DATA, 1, &shm.data);
+	return shm;
+}
+
+static constexpr auto BLOCK_ID_PREFIX = std::string_view{"arena+"};
+
+struct block_id {
+	uint32_t slab;
+	uint64_t offset;
+	uint32_t generation;
+};
+
+[[nodiscard]] static
+auto make_block_id(const block_id& id) -> std::string {
+	return std::format("{}{}+{}+{}", BLOCK_ID_PREFIX, id.slab, id.offset, id.generation);
+}
+
+[[nodiscard]] static
+// nullopt if this is the id of a segment rather than a block.
+auto parse_block_id(std::string_view id) -> std::optional<block_id> {
+	if (!id.starts_with(BLOCK_ID_PREFIX)) {
+		return std::nullopt;
+	}
+	block_id out;
+	auto pos       = id.data() + BLOCK_ID_PREFIX.size();
+	const auto end = id.data() + id.size();
+	const auto parse_field = [&pos, end](auto* value, bool last) {
+		const auto [ptr, ec] = std::from_chars(pos, end, *value);
+		if (ec != std::errc{} || (last ? ptr != end : (ptr == end || *ptr != '+'))) {
+			return false;
+		}
+		pos = last ? ptr : ptr + 1;
+		return true;
+	};
+	if (!parse_field(&out.slab, false) || !parse_field(&out.offset, false) || !parse_field(&out.generation, true)) {
+		throw std::runtime_error{std::format("Invalid device id '{}'.", id)};
+	}
+	return out;
+}
+
+[[nodiscard]] static
+auto get_block_buffer_size(const block_ref& block) -> size_t {
+	return get_block_size(block.header()->size_class) - ARENA_BLOCK_HEADER_SIZE;
+}
+
+[[nodiscard]] static
+auto get_block_buffer(const block_ref& block) -> std::byte* {
+	return reinterpret_cast<std::byte*>(block.header()) + ARENA_BLOCK_HEADER_SIZE;
+}
+
+[[nodiscard]] static
+// Sandbox only. Allocate a block for the device in the group's arena. Returns nullopt
+// if there isn't room in any of the slabs, in which case it needs a segment of its own.
+auto create_device(shm::arena* arena, const port_layout& layout) -> std::optional<device> {
+	const auto size = get_device_segment_size(layout) + ARENA_BLOCK_HEADER_SIZE;
+	auto size_class = uint32_t{0};
+	while (size_class < ARENA_SIZE_CLASSES && get_block_size(size_class) < size) {
+		size_class++;
+	}
+	if (size_class == ARENA_SIZE_CLASSES) {
+		return std::nullopt;
+	}
+	const auto lock = std::lock_guard{arena->mutex};
+	map_slabs(arena);
+	for (size_t i = 0; i < arena->slabs.size(); i++) {
+		const auto& slab = arena->slabs[i];
+		auto offset = pop_free_block(slab->data, size_class);
+		if (!offset) {
+			offset = carve_block(slab->data, size_class);
+		}
+		if (!offset) {
+			continue;
+		}
+		const auto header     = get_block_header(*slab->data, *offset);
+		const auto generation = header->generation.fetch_add(1, std::memory_order_relaxed) + 1;
+		header->refs.store(1, std::memory_order_release);
+		device shm;
+		shm.block   = block_ref{slab, *offset};
+		shm.id      = make_block_id({static_cast<uint32_t>(i), *offset, generation});
+		auto buffer = bip::managed_external_buffer{bip::create_only, get_block_buffer(shm.block), get_block_buffer_size(shm.block)};
+		shm.data    = construct_device_data(&buffer, layout);
+		shm.created = true;
+		return shm;
+	}
+	return std::nullopt;
+}
+
+[[nodiscard]] static
+// Open a device by the id its sandbox gave it, whether it's a block in the group's
+// arena or a segment of its own. The arena can be null if it's known to be a segment.
+auto open_device(shm::arena* arena, std::string_view id, bool remove_when_done) -> device {
+	const auto parsed = parse_block_id(id);
+	if (!parsed) {
+		return open_device(id, remove_when_done);
 	}
-	else {
-		on_device_opened(&shm);
+	if (!arena) {
+		throw std::runtime_error{std::format("Device '{}' is in a group's arena, but there isn't one.", id)};
 	}
+	auto slab = std::shared_ptr<const shm::slab>{};
+	{
+		const auto lock = std::lock_guard{arena->mutex};
+		map_slabs(arena);
+		if (parsed->slab >= arena->slabs.size()) {
+			throw std::runtime_error{std::format("Device '{}' is in a slab which doesn't exist.", id)};
+		}
+		slab = arena->slabs[parsed->slab];
+	}
+	if (parsed->offset % ARENA_MIN_BLOCK_SIZE != 0 || parsed->offset >= slab->data->used.load(std::memory_order_relaxed)) {
+		throw std::runtime_error{std::format("Device '{}' is outside of its slab.", id)};
+	}
+	const auto header = get_block_header(*slab->data, parsed->offset);
+	auto refs         = header->refs.load(std::memory_order_relaxed);
+	do {
+		if (refs == 0) {
+			throw std::runtime_error{std::format("Device '{}' no longer exists.", id)};
+		}
+	} while (!header->refs.compare_exchange_weak(refs, refs + 1, std::memory_order_acquire, std::memory_order_relaxed));
+	device shm;
+	shm.block = block_ref{std::move(slab), parsed->offset};
+	if (header->generation.load(std::memory_order_acquire) != parsed->generation) {
+		// The device was freed and the block has been given to another one.
+		throw std::runtime_error{std::format("Device '{}' no longer exists.", id)};
+	}
+	auto buffer = bip::managed_external_buffer{bip::open_only, get_block_buffer(shm.block), get_block_buffer_size(shm.block)};
+	require_shm_obj<device_data>(&buffer, OBJECT_DATA, 1, &shm.data);
+	shm.id = id;
 	return shm;
 }
 
+static
+// Call before the device's sandbox writes the outputs for a cycle.
+auto begin_writing_outputs(const device& shm, size_t buffer) -> void {
+	shm.data->output_cycle[buffer].store(OUTPUT_BEING_WRITTEN, std::memory_order_relaxed);
+	std::atomic_thread_fence(std::memory_order_release);
+}
+
+static
+// Call after the device's sandbox has written the outputs for a cycle.
+auto end_writing_outputs(const device& shm, size_t buffer, uint32_t cycle, uint32_t frames) -> void {
+	shm.data->output_frames[buffer] = frames;
+	shm.data->output_cycle[buffer].store(cycle, std::memory_order_release);
+}
+
+// An output port of a device in another process. See read_output().
+struct output_copy {
+	// Room for MAX_VECTOR_SIZE frames of each channel. Sized by the reader,
+	// because this is too big to go on the stack of the audio thread. Only
+	// the one for the sample format of the output's segment is used.
+	std::vector<float> samples;
+	std::vector<double> samples64;
+	sample_format format = sample_format::float32;
+	audio_buffer_flags flags;
+	uint32_t channel_count = 0;
+	uint32_t frames        = 0;
+};
+
 [[nodiscard]] static
+// Copy an output port of a device from another process. Returns false if the
+// outputs for the given cycle were never finished, or were overwritten while
+// we were reading them, in which case whatever was copied is garbage, or if
+// the device hasn't been moved to fit the reader's stride yet. The
+// samples of a silent output aren't copied, and neither are any channels
+// which don't fit in the copy.
+auto read_output(const device& shm, size_t port_index, uint32_t cycle, size_t stride, output_copy* out) -> bool {
+	if (shm.data->max_frames != stride) {
+		return false;
+	}
+	const auto buffer = signaling::get_buffer_index(cycle);
+	const auto& stamp = shm.data->output_cycle[buffer];
+	if (stamp.load(std::memory_order_acquire) != cycle) {
+		return false;
+	}
+	const auto& buffers = shm.data->buffers[buffer];
+	if (port_index >= buffers.audio_out.size()) {
+		return false;
+	}
+	const auto& port    = buffers.audio_out[port_index];
+	const auto is_64bit = shm.data->format == sample_format::float64;
+	const auto room     = (is_64bit ? out->samples64.size() : out->samples.size()) / MAX_VECTOR_SIZE;
+	out->format         = shm.data->format;
+	out->flags          = port.flags;
+	out->channel_count  = std::min(port.channel_count, static_cast<uint32_t>(room));
+	out->frames         = std::min(shm.data->output_frames[buffer], static_cast<uint32_t>(stride));
+	if (!is_silent(port)) {
+		if (is_64bit) { std::copy_n(port.samples64.get(), stride * out->channel_count, out->samples64.begin()); }
+		else          { std::copy_n(port.samples.get(), stride * out->channel_count, out->samples.begin()); }
+	}
+	std::atomic_thread_fence(std::memory_order_acquire);
+	return stamp.load(std::memory_order_relaxed) == cycle;
+}
+
+[[nodiscard]] static
+// Every segment gets a new name, because when a device is moved to a new
+// segment the client may still have the old one open, and a restarted
+// sandbox may still be using the segments of the sandbox it replaced.
 auto make_device_id(std::string_view sbox_shmid, id::device dev_id) -> std::string {
-	return std::format("{}+dev+{}", sbox_shmid, dev_id.value);
+	static auto next = std::atomic<uint64_t>{0};
+	return std::format("{}+dev+{}+{}+{}", sbox_shmid, dev_id.value, os::get_process_id(), next++);
+}
+
+// The smallest page size of any platform we support, so touching
+// memory at this stride touches every page of it.
+static constexpr auto PREFAULT_STRIDE = size_t{4096};
+
+[[nodiscard]] static
+// This process's mapping of the segment.
+auto get_memory(const segment_raii& seg) -> std::span<std::byte> {
+#if defined(__linux__)
+	return {static_cast<std::byte*>(seg.region.addr), seg.region.size};
+#else
+	return {static_cast<std::byte*>(seg.seg.get_address()), seg.seg.get_size()};
+#endif
+}
+
+[[nodiscard]] static
+// The block or segment which the device's buffers are in.
+auto get_memory(const device& shm) -> std::span<std::byte> {
+	if (shm.block.slab) {
+		return {reinterpret_cast<std::byte*>(shm.block.header()), get_block_size(shm.block.header()->size_class)};
+	}
+	return get_memory(shm.seg);
+}
+
+static
+// Read every page, so that none of them fault the first time they're used.
+auto prefault(std::span<const std::byte> memory) -> void {
+	const volatile std::byte* bytes = memory.data();
+	for (size_t i = 0; i < memory.size(); i += PREFAULT_STRIDE) {
+		static_cast<void>(bytes[i]);
+	}
+}
+
+[[nodiscard]] static
+// Segments start and end on page boundaries, so they can be locked as they are.
+auto lock_memory(const segment_raii& seg) -> bool {
+	const auto memory = get_memory(seg);
+	return os::lock_memory(memory.data(), memory.size());
+}
+
+[[nodiscard]] static
+// Does nothing if this process's view of the device is already locked.
+auto lock_memory(const device& shm) -> bool {
+	if (!shm.block.slab) {
+		return lock_memory(shm.seg);
+	}
+	if (!shm.block.locked) {
+		shm.block.locked = lock_block_pages(*shm.block.slab, shm.block.offset);
+	}
+	return shm.block.locked;
+}
+
+static
+auto unlock_memory(const segment_raii& seg) -> void {
+	const auto memory = get_memory(seg);
+	os::unlock_memory(memory.data(), memory.size());
+}
+
+static
+// Pages the device's block shares with another block which is still
+// locked stay locked. Locking all of the process's memory is separate
+// from this, and isn't undone.
+auto unlock_memory(const device& shm) -> void {
+	if (!shm.block.slab) {
+		unlock_memory(shm.seg);
+		return;
+	}
+	if (shm.block.locked) {
+		unlock_block_pages(*shm.block.slab, shm.block.offset);
+		shm.block.locked = false;
+	}
+}
+
+template <typename Memory> [[nodiscard]] static
+// Returns a warning if any of the options couldn't be applied. memory is a
+// segment or a device, and what is how it is described in the warning.
+// lock_all is left to the caller because it isn't about any memory in particular.
+auto apply_memory_options(const Memory& memory, const memory_options& options, std::string_view what) -> std::optional<std::string> {
+	const auto bytes = get_memory(memory);
+	auto failed      = std::string{};
+	if (options.huge_pages && !os::advise_huge_pages(bytes.data(), bytes.size())) {
+		failed = "get huge pages for";
+	}
+	if (options.lock && !lock_memory(memory)) {
+		failed = failed.empty() ? "lock" : failed + " or lock";
+	}
+	if (options.prefault) {
+		prefault(bytes);
+	}
+	if (failed.empty()) {
+		return std::nullopt;
+	}
+	return std::format("Failed to {} {} ({} bytes.)", failed, what, bytes.size());
 }
 
 [[nodiscard]] static
@@ -1,7 +1,9 @@
 #pragma once
 
 #include "common-ipc-event.hpp"
+#include <algorithm>
 #include <atomic>
+#include <chrono>
 #include <format>
 #include <mutex>
 #include <stop_token>
@@ -24,6 +26,7 @@ struct sandboxside_sandbox_init { std::string_view sbox_shmid; signaling::sandbo
 enum class client_wait_result {
 	done,
 	not_responding,
+	late,
 };
 
 enum class sandbox_wait_result {
@@ -31,16 +34,37 @@ enum class sandbox_wait_result {
 	stop_requested,
 };
 
+// Counts how often a waiting thread received its signal
+// while spinning, versus having to go to sleep.
+struct wait_counters {
+	std::atomic<uint64_t> spun;
+	std::atomic<uint64_t> slept;
+};
+
 struct group_local_data {
 	ipc::local_event all_sandboxes_done;
+	// Clientside count of the processing cycles started so far.
+	uint32_t cycle = 0;
 };
 
 struct group_shm_data {
-	// Each sandbox process decrements this
-	// counter when it is finished processing.
-	std::atomic<uint32_t> sandboxes_processing;
+	// The current processing cycle in the upper 32 bits, and the
+	// number of sandboxes which have yet to finish it in the lower
+	// 32 bits. Each sandbox process decrements the count when it is
+	// finished processing, unless the client has already moved on
+	// to the next cycle.
+	std::atomic<uint64_t> sandboxes_processing;
 	// The last sandbox to finish processing signals this.
 	ipc::shared_event all_sandboxes_done;
+	// Sandbox audio threads sleep on this while they wait for their
+	// work_begin event, so that the client can wake all of them at once.
+	ipc::shared_generation work_begin;
+	// How long the client and sandbox audio threads should spin
+	// before going to sleep when they wait for each other.
+	// Zero means go straight to sleep.
+	std::atomic<uint32_t> spin_us;
+	// How the client's waits for all_sandboxes_done were satisfied.
+	wait_counters client_waits;
 };
 
 struct sandbox_local_data {
@@ -49,6 +73,15 @@ struct sandbox_local_data {
 
 struct sandbox_shm_data {
 	ipc::shared_event work_begin;
+	// The last cycle the client asked this sandbox to process, and the
+	// last cycle the sandbox finished processing. While these differ the
+	// sandbox is busy (it missed a deadline and is still processing.)
+	std::atomic<uint32_t> cycle;
+	std::atomic<uint32_t> done_cycle;
+	// How the sandbox's waits for work_begin were satisfied.
+	wait_counters sandbox_waits;
+	// How many cycles this sandbox was the last one in the group to finish.
+	std::atomic<uint64_t> finished_last;
 };
 
 static
@@ -89,34 +122,123 @@ static
 // The sandbox process calls this to unblock itself in cases where it is waiting for a
 // signal from the client but wants to abort the operation (e.g. if the sandbox process
 // is shutting down.)
-auto unblock_self(signaling::sandboxside_sandbox sandbox) -> void {
+auto unblock_self(signaling::sandboxside_group group, signaling::sandboxside_sandbox sandbox) -> void {
 	sandbox.local->work_begin.set();
+	// The audio thread is sleeping on the group's generation rather than
+	// its own event. The generation has to be bumped, or the wake could be
+	// lost if the audio thread read it just before going to sleep. The other
+	// sandboxes will wake too, see that their own events are not set, and go
+	// back to sleep.
+	ipc::broadcast(&group.shm->work_begin);
 }
 
-[[nodiscard]] static
-// Signal all sandboxes in the group to begin processing.
-auto sandboxes_work_begin(signaling::clientside_group group, int sandbox_count, auto next_sandbox_signal) -> bool {
-	group.shm->sandboxes_processing.store(sandbox_count);
-	for (int i = 0; i < sandbox_count; ++i) {
-		next_sandbox_signal().set();
+static
+auto count(wait_counters* counters, ipc::wait_path path) -> void {
+	switch (path) {
+		case ipc::wait_path::spun:      { counters->spun.fetch_add(1, std::memory_order_relaxed); break; }
+		case ipc::wait_path::slept:     { counters->slept.fetch_add(1, std::memory_order_relaxed); break; }
+		case ipc::wait_path::timed_out: { break; }
 	}
-	return true;
+}
+
+[[nodiscard]] static auto make_processing_state(uint32_t cycle, uint32_t count) -> uint64_t { return (uint64_t{cycle} << 32) | count; }
+[[nodiscard]] static auto get_cycle(uint64_t processing_state) -> uint32_t                  { return static_cast<uint32_t>(processing_state >> 32); }
+[[nodiscard]] static auto get_count(uint64_t processing_state) -> uint32_t                  { return static_cast<uint32_t>(processing_state); }
+
+[[nodiscard]] static
+// Returns true if the sandbox is still processing an earlier cycle.
+auto is_busy(signaling::clientside_sandbox sandbox) -> bool {
+	return sandbox.shm->done_cycle.load(std::memory_order_acquire) != sandbox.shm->cycle.load(std::memory_order_relaxed);
+}
+
+static
+// The client calls this when a sandbox process is restarted, so that
+// a cycle which the old process never finished doesn't leave it busy.
+auto reset_cycle(signaling::clientside_sandbox sandbox) -> void {
+	sandbox.shm->done_cycle.store(sandbox.shm->cycle.load(std::memory_order_relaxed), std::memory_order_release);
+}
+
+[[nodiscard]] static auto get_buffer_index(uint32_t cycle) -> size_t                      { return cycle & 1; }
+[[nodiscard]] static auto get_buffer_index(signaling::sandboxside_sandbox sandbox) -> size_t { return get_buffer_index(sandbox.shm->cycle.load(std::memory_order_relaxed)); }
+[[nodiscard]] static auto get_next_cycle(signaling::clientside_group group) -> uint32_t      { return group.local->cycle + 1; }
+
+[[nodiscard]] static
+auto get_spin_time(const group_shm_data& shm) -> std::chrono::microseconds {
+	return std::chrono::microseconds{shm.spin_us.load(std::memory_order_relaxed)};
+}
+
+static
+// The client calls this to set how long the audio threads in the group
+// should spin before going to sleep when they wait for each other.
+auto set_spin_time(signaling::clientside_group group, std::chrono::microseconds spin) -> void {
+	group.shm->spin_us.store(static_cast<uint32_t>(std::max<int64_t>(spin.count(), 0)), std::memory_order_relaxed);
+}
+
+[[nodiscard]] static
+// Signal the sandboxes in the group to begin processing.
+// visit_sandboxes(fn) should call fn(clientside_sandbox) for each active sandbox in the group.
+// Sandboxes which are still busy with an earlier cycle are skipped.
+// Each sandbox's event is armed, then they are all woken together.
+// Returns the number of sandboxes which were signaled.
+auto sandboxes_work_begin(signaling::clientside_group group, auto visit_sandboxes) -> int {
+	const auto cycle = ++group.local->cycle;
+	uint32_t count   = 0;
+	visit_sandboxes([cycle, &count](signaling::clientside_sandbox sandbox) {
+		if (!is_busy(sandbox)) {
+			sandbox.shm->cycle.store(cycle, std::memory_order_relaxed);
+			count++;
+		}
+	});
+	// The count has to be in place before any sandbox is signaled.
+	group.shm->sandboxes_processing.store(make_processing_state(cycle, count), std::memory_order_release);
+	visit_sandboxes([cycle](signaling::clientside_sandbox sandbox) {
+		if (sandbox.shm->cycle.load(std::memory_order_relaxed) == cycle) {
+			sandbox.local->work_begin.arm();
+		}
+	});
+	ipc::broadcast(&group.shm->work_begin);
+	return static_cast<int>(count);
+}
+
+[[nodiscard]] static
+auto all_sandboxes_done(signaling::clientside_group group) -> bool {
+	return get_count(group.shm->sandboxes_processing.load(std::memory_order_acquire)) == 0;
 }
 
 [[nodiscard]] static
 // Wait for all sandboxes in the group to finish processing.
 auto wait_for_all_sandboxes_done(signaling::clientside_group group) -> client_wait_result {
-	group.local->all_sandboxes_done.wait();
-	if (group.shm->sandboxes_processing.load(std::memory_order_acquire) > 0) {
+	count(&group.shm->client_waits, group.local->all_sandboxes_done.wait(get_spin_time(*group.shm)));
+	if (!all_sandboxes_done(group)) {
 		return client_wait_result::not_responding;
 	}
 	return client_wait_result::done;
 }
 
+[[nodiscard]] static
+// Wait for all sandboxes in the group to finish processing, giving up at the deadline.
+// If this returns client_wait_result::late then the sandboxes which didn't make it are
+// the ones for which is_busy() returns true.
+auto wait_for_all_sandboxes_done(signaling::clientside_group group, std::chrono::steady_clock::time_point deadline) -> client_wait_result {
+	const auto spin = get_spin_time(*group.shm);
+	for (;;) {
+		const auto path = group.local->all_sandboxes_done.wait_until(deadline, spin);
+		if (all_sandboxes_done(group)) {
+			count(&group.shm->client_waits, path);
+			return client_wait_result::done;
+		}
+		if (path == ipc::wait_path::timed_out) {
+			return client_wait_result::late;
+		}
+		// We were woken by a signal left over from a cycle which finished after
+		// its deadline, or by unblock_self(). Keep waiting until the deadline.
+	}
+}
+
 [[nodiscard]] static
 // The sandbox process calls this to wait for a signal from the client that it should begin its processing.
-auto wait_for_work_begin(signaling::sandboxside_sandbox sandbox, std::stop_token stop_token) -> sandbox_wait_result {
-	sandbox.local->work_begin.wait();
+auto wait_for_work_begin(signaling::sandboxside_group group, signaling::sandboxside_sandbox sandbox, std::stop_token stop_token) -> sandbox_wait_result {
+	count(&sandbox.shm->sandbox_waits, sandbox.local->work_begin.wait(&group.shm->work_begin, get_spin_time(*group.shm)));
 	if (stop_token.stop_requested()) {
 		return sandbox_wait_result::stop_requested;
 	}
@@ -126,10 +248,22 @@ auto wait_for_work_begin(signaling::sandboxside_sandbox sandbox, std::stop_token
 static
 // The sandbox process calls this to notify that it has finished processing.
 // If it is the last sandbox to finish processing, the client is notified.
-auto notify_sandbox_done(signaling::sandboxside_group group) -> void {
-	const auto prev_value = group.shm->sandboxes_processing.fetch_sub(1, std::memory_order_release);
-	if (prev_value == 1) {
+auto notify_sandbox_done(signaling::sandboxside_group group, signaling::sandboxside_sandbox sandbox) -> void {
+	const auto cycle = sandbox.shm->cycle.load(std::memory_order_relaxed);
+	sandbox.shm->done_cycle.store(cycle, std::memory_order_release);
+	auto state = group.shm->sandboxes_processing.load(std::memory_order_acquire);
+	for (;;) {
+		if (get_cycle(state) != cycle || get_count(state) == 0) {
+			// We missed the deadline and the client has moved on without us.
+			return;
+		}
+		if (group.shm->sandboxes_processing.compare_exchange_weak(state, state - 1, std::memory_order_acq_rel, std::memory_order_acquire)) {
+			break;
+		}
+	}
+	if (get_count(state) == 1) {
 		// Notify the client that all sandboxes have finished their work.
+		sandbox.shm->finished_last.fetch_add(1, std::memory_order_relaxed);
 		group.local->all_sandboxes_done.set();
 	}
 }
@@ -1,10 +1,22 @@
 #pragma once
 
+#include <algorithm>
 #include <cassert>
+#include <chrono>
 #include <mutex>
 #include <numeric>
 #include <vector>
 
+// How long values waited in a slot_buffer between put() and take().
+// When the values are callbacks waiting for a response from another
+// process, this is the round-trip time of the request.
+struct slot_buffer_stats {
+	uint64_t taken = 0;
+	size_t pending = 0;
+	std::chrono::steady_clock::duration total_wait = {};
+	std::chrono::steady_clock::duration max_wait   = {};
+};
+
 template <typename T>
 struct slot_buffer {
 	slot_buffer() {
@@ -16,15 +28,27 @@ struct slot_buffer {
 			add_capacity();
 		}
 		const auto index = pop_free_index();
-		buffer[index] = value;
+		buffer[index]    = value;
+		put_times[index] = std::chrono::steady_clock::now();
 		return index;
 	}
 	auto take(size_t index) -> T {
 		auto lock = std::unique_lock(mutex);
 		const auto value = buffer[index];
+		const auto wait  = std::chrono::steady_clock::now() - put_times[index];
+		stats.taken++;
+		stats.total_wait += wait;
+		stats.max_wait    = std::max(stats.max_wait, wait);
 		push_free_index(index);
 		return value;
 	}
+	[[nodiscard]]
+	auto get_stats() -> slot_buffer_stats {
+		auto lock = std::unique_lock(mutex);
+		auto out    = stats;
+		out.pending = buffer.size() - free_indices.size();
+		return out;
+	}
 private:
 	auto add_capacity() -> void {
 		static constexpr auto STRANGE_CAPACITY = 1024;
@@ -34,6 +58,7 @@ private:
 		const auto new_capacity = old_capacity + extra;
 		free_indices.resize(extra);
 		buffer.resize(new_capacity);
+		put_times.resize(new_capacity);
 		std::iota(free_indices.rbegin(), free_indices.rend(), old_capacity);
 	}
 	auto pop_free_index() -> size_t {
@@ -47,5 +72,7 @@ private:
 	}
 	std::mutex mutex;
 	std::vector<T> buffer{32};
+	std::vector<std::chrono::steady_clock::time_point> put_times{32};
 	std::vector<size_t> free_indices{32};
+	slot_buffer_stats stats;
 };
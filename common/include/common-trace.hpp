@@ -0,0 +1,146 @@
+#pragma once
+
+#include "common-constants.hpp"
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <string_view>
+
+// Timeline tracing. Each traced thread, in the client or in a sandbox
+// process, writes begin/end records into its own ring. The client's
+// poll thread drains all of the rings and the records can then be
+// written out as a Chrome trace (see scuff::write_trace().)
+//
+// Timestamps come from std::chrono::steady_clock, which is a
+// system-wide clock on every platform we support (CLOCK_MONOTONIC on
+// Linux) so records from different processes can be put on the same
+// timeline without any adjustment.
+namespace scuff::trace {
+
+enum class phase : uint32_t {
+	begin,
+	end,
+	instant,
+};
+
+enum class event : uint32_t {
+	// Client audio thread
+	audio_process,   // One call to audio_process(). arg is the group id.
+	inputs,          // Writing the inputs for the cycle.
+	signal,          // Waking up the sandboxes.
+	wait,            // Waiting for the sandboxes to finish.
+	outputs,         // Reading the outputs of the cycle.
+	// Client poll thread
+	poll,            // One pass of the poll thread.
+	// Sandbox audio thread
+	wake,            // The audio thread received the work_begin signal.
+	sandbox_process, // Processing one cycle. arg is the cycle.
+	plugin_process,  // One call to a plugin's process function. arg is the device id.
+	notify_done,     // The sandbox reported that it has finished the cycle.
+	// Sandbox main thread
+	main_frame,      // One pass of the sandbox main loop.
+};
+
+static constexpr auto names = std::array{
+	"audio_process",
+	"inputs",
+	"signal",
+	"wait",
+	"outputs",
+	"poll",
+	"wake",
+	"sandbox_process",
+	"plugin_process",
+	"notify_done",
+	"main_frame",
+};
+
+static_assert(names.size() == static_cast<size_t>(event::main_frame) + 1);
+
+struct record {
+	uint64_t ns;
+	uint64_t arg;
+	trace::event what;
+	trace::phase phase;
+};
+
+// Wait-free single-producer/single-consumer ring of trace records. The
+// traced thread is the producer. If the ring is full the record is
+// dropped and counted rather than blocking the traced thread.
+struct ring {
+	[[nodiscard]]
+	auto pop(record* out) -> bool {
+		const auto read_pos  = read_pos_.load(std::memory_order_relaxed);
+		const auto write_pos = write_pos_.load(std::memory_order_acquire);
+		if (read_pos == write_pos) {
+			return false;
+		}
+		*out = records_[read_pos % TRACE_RING_SIZE];
+		read_pos_.store(read_pos + 1, std::memory_order_release);
+		return true;
+	}
+	auto push(const record& r) -> void {
+		const auto write_pos = write_pos_.load(std::memory_order_relaxed);
+		const auto read_pos  = read_pos_.load(std::memory_order_acquire);
+		if (write_pos - read_pos >= TRACE_RING_SIZE) {
+			dropped.fetch_add(1, std::memory_order_relaxed);
+			return;
+		}
+		records_[write_pos % TRACE_RING_SIZE] = r;
+		write_pos_.store(write_pos + 1, std::memory_order_release);
+	}
+	// Set by the client. The traced thread doesn't write
+	// anything while this is false.
+	std::atomic<bool> enabled     = false;
+	std::atomic<uint64_t> dropped = 0;
+private:
+	// Padded rather than aligned because the segment manager
+	// doesn't respect alignments greater than its own.
+	using padding = std::array<std::byte, CACHE_LINE_SIZE - sizeof(std::atomic<uint64_t>)>;
+	padding pad0_;
+	std::atomic<uint64_t> read_pos_  = 0; // Only the reader writes this.
+	padding pad1_;
+	std::atomic<uint64_t> write_pos_ = 0; // Only the writer writes this.
+	padding pad2_;
+	std::array<record, TRACE_RING_SIZE> records_;
+};
+
+[[nodiscard]] static
+auto now() -> uint64_t {
+	return static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count());
+}
+
+static
+auto write(ring* r, trace::event what, trace::phase phase, uint64_t arg) -> void {
+	if (!r || !r->enabled.load(std::memory_order_relaxed)) {
+		return;
+	}
+	r->push({now(), arg, what, phase});
+}
+
+static auto begin(ring* r, trace::event what, uint64_t arg = 0) -> void   { write(r, what, phase::begin, arg); }
+static auto end(ring* r, trace::event what, uint64_t arg = 0) -> void     { write(r, what, phase::end, arg); }
+static auto instant(ring* r, trace::event what, uint64_t arg = 0) -> void { write(r, what, phase::instant, arg); }
+
+// Writes the end record when it goes out of scope.
+struct scope {
+	scope(ring* r, trace::event what, uint64_t arg = 0)
+		: ring_{r}
+		, what_{what}
+		, arg_{arg}
+	{
+		begin(ring_, what_, arg_);
+	}
+	~scope() {
+		end(ring_, what_, arg_);
+	}
+	scope(const scope&) = delete;
+	scope& operator=(const scope&) = delete;
+private:
+	ring* ring_;
+	trace::event what_;
+	uint64_t arg_;
+};
+
+} // scuff::trace
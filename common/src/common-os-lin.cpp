@@ -2,11 +2,14 @@
 #include "common-os.hpp"
 #include "common-os-dso.hpp"
 #include "common-util.hpp"
+#include <alloca.h>
+#include <cstdint>
 #include <dlfcn.h>
 #include <flux.hpp>
 #include <pthread.h>
 #include <sched.h>
 #include <signal.h>
+#include <sys/mman.h>
 #include <sys/types.h>
 #include <unistd.h>
 
@@ -28,10 +31,26 @@ auto release_lib(void* lib) -> void {
 
 namespace scuff::os {
 
+auto advise_huge_pages(void* addr, size_t size) -> bool {
+#if defined(MADV_HUGEPAGE)
+	// madvise() wants the start of a page.
+	const auto page  = static_cast<uintptr_t>(sysconf(_SC_PAGESIZE));
+	const auto begin = reinterpret_cast<uintptr_t>(addr) & ~(page - 1);
+	const auto end   = reinterpret_cast<uintptr_t>(addr) + size;
+	return madvise(reinterpret_cast<void*>(begin), end - begin, MADV_HUGEPAGE) == 0;
+#else
+	return false;
+#endif
+}
+
 auto could_be_a_vst2_file(const std::filesystem::path& path) -> bool {
 	return path.extension() == ".so";
 }
 
+auto get_page_size() -> size_t {
+	return static_cast<size_t>(sysconf(_SC_PAGESIZE));
+}
+
 auto get_process_id() -> int {
 	return getpid();
 }
@@ -68,6 +87,26 @@ auto is_vst3_file(const std::filesystem::path& path) -> bool {
 	return util::has_extension_case_insensitive(path, VST3_EXT);
 }
 
+auto lock_all_memory() -> bool {
+	return mlockall(MCL_CURRENT | MCL_FUTURE) == 0;
+}
+
+auto lock_memory(void* addr, size_t size) -> bool {
+	return mlock(addr, size) == 0;
+}
+
+// Not inlined, so that the buffer is below the caller's frame, which is
+// where the functions the caller goes on to call will put theirs.
+[[gnu::noinline]]
+auto prepare_stack(size_t size, bool lock) -> bool {
+	const auto page   = static_cast<size_t>(sysconf(_SC_PAGESIZE));
+	const auto buffer = static_cast<volatile std::byte*>(alloca(size));
+	for (size_t i = 0; i < size; i += page) {
+		buffer[i] = std::byte{0};
+	}
+	return !lock || mlock(const_cast<std::byte*>(buffer), size) == 0;
+}
+
 auto process_is_running(int pid) -> bool {
 	if (kill(pid, 0) == 0) {
 		return true; // Process is running
@@ -110,4 +149,12 @@ auto set_realtime_priority(std::jthread* thread) -> void {
 	pthread_setschedparam(handle, SCHED_FIFO, &param);
 }
 
+auto unlock_all_memory() -> void {
+	munlockall();
+}
+
+auto unlock_memory(void* addr, size_t size) -> void {
+	munlock(addr, size);
+}
+
 } // scuff::os
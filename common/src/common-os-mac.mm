@@ -5,9 +5,11 @@
 #include <CoreFoundation/CoreFoundation.h>
 #include <flux.hpp>
 #include <Foundation/Foundation.h>
+#include <alloca.h>
 #include <pthread.h>
 #include <sched.h>
 #include <signal.h>
+#include <sys/mman.h>
 #include <sys/types.h>
 #include <unistd.h>
 
@@ -40,10 +42,18 @@ auto release_lib(void* lib) -> void {
 
 namespace scuff::os {
 
+auto advise_huge_pages(void* addr, size_t size) -> bool {
+	return true;
+}
+
 auto could_be_a_vst2_file(const std::filesystem::path& path) -> bool {
 	return path.extension() == ".dylib";
 }
 
+auto get_page_size() -> size_t {
+	return static_cast<size_t>(getpagesize());
+}
+
 auto get_process_id() -> int {
 	return getpid();
 }
@@ -91,6 +101,26 @@ auto is_vst3_file(const std::filesystem::path& path) -> bool {
 	return util::has_extension_case_insensitive(path, VST3_EXT);
 }
 
+auto lock_all_memory() -> bool {
+	return false;
+}
+
+auto lock_memory(void* addr, size_t size) -> bool {
+	return mlock(addr, size) == 0;
+}
+
+// Not inlined, so that the buffer is below the caller's frame, which is
+// where the functions the caller goes on to call will put theirs.
+[[gnu::noinline]]
+auto prepare_stack(size_t size, bool lock) -> bool {
+	const auto page   = static_cast<size_t>(getpagesize());
+	const auto buffer = static_cast<volatile std::byte*>(alloca(size));
+	for (size_t i = 0; i < size; i += page) {
+		buffer[i] = std::byte{0};
+	}
+	return !lock || mlock(const_cast<std::byte*>(buffer), size) == 0;
+}
+
 auto process_is_running(int pid) -> bool {
 	if (kill(pid, 0) == 0) {
 		return true; // Process is running
@@ -133,4 +163,10 @@ auto set_realtime_priority(std::jthread* thread) -> void {
 	pthread_setschedparam(handle, SCHED_FIFO, &param);
 }
 
+auto unlock_all_memory() -> void {}
+
+auto unlock_memory(void* addr, size_t size) -> void {
+	munlock(addr, size);
+}
+
 } // scuff::os
@@ -4,6 +4,7 @@
 #include "common-util.hpp"
 #include <flux.hpp>
 #include <io.h>
+#include <malloc.h>
 #include <optional>
 #include <Windows.h>
 #include <Psapi.h>
@@ -40,10 +41,20 @@ auto get_known_folder(KNOWNFOLDERID id) -> std::optional<std::filesystem::path>
 	return std::nullopt;
 }
 
+auto advise_huge_pages(void* addr, size_t size) -> bool {
+	return true;
+}
+
 auto could_be_a_vst2_file(const std::filesystem::path& path) -> bool {
 	return path.extension() == ".dll";
 }
 
+auto get_page_size() -> size_t {
+	SYSTEM_INFO info;
+	GetSystemInfo(&info);
+	return info.dwPageSize;
+}
+
 auto get_process_id() -> int {
 	return int(GetCurrentProcessId());
 }
@@ -88,6 +99,45 @@ auto is_vst3_file(const std::filesystem::path& path) -> bool {
 	return scuff::util::has_extension_case_insensitive(path, VST3_EXT);
 }
 
+auto lock_all_memory() -> bool {
+	return false;
+}
+
+auto lock_memory(void* addr, size_t size) -> bool {
+	if (VirtualLock(addr, size)) {
+		return true;
+	}
+	if (GetLastError() != ERROR_WORKING_SET_QUOTA) {
+		return false;
+	}
+	// A process can only lock as much as its minimum working set, which
+	// is small by default, so make room for this and try again.
+	const auto process = GetCurrentProcess();
+	SIZE_T min_size, max_size;
+	if (!GetProcessWorkingSetSize(process, &min_size, &max_size)) {
+		return false;
+	}
+	if (!SetProcessWorkingSetSize(process, min_size + size, max_size + size)) {
+		return false;
+	}
+	return VirtualLock(addr, size) != 0;
+}
+
+// Not inlined, so that the buffer is below the caller's frame, which is
+// where the functions the caller goes on to call will put theirs.
+__declspec(noinline)
+auto prepare_stack(size_t size, bool lock) -> bool {
+	SYSTEM_INFO info;
+	GetSystemInfo(&info);
+	const auto page   = static_cast<size_t>(info.dwPageSize);
+	const auto buffer = static_cast<volatile std::byte*>(_alloca(size));
+	// From the top down, so that the stack guard page moves down ahead of us.
+	for (size_t i = 0; i < size; i += page) {
+		buffer[size - 1 - i] = std::byte{0};
+	}
+	return !lock || lock_memory(const_cast<std::byte*>(buffer), size);
+}
+
 auto process_is_running(int pid) -> bool {
 	DWORD pid_count;
 	if (!EnumProcesses(nullptr, 0, &pid_count)) {
@@ -133,4 +183,10 @@ auto set_realtime_priority(std::jthread* thread) -> void {
 	SetThreadPriority(handle, THREAD_PRIORITY_TIME_CRITICAL);
 }
 
+auto unlock_all_memory() -> void {}
+
+auto unlock_memory(void* addr, size_t size) -> void {
+	VirtualUnlock(addr, size);
+}
+
 } // scuff::os
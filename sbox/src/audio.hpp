@@ -1,6 +1,7 @@
 #pragma once
 
 #include "clap.hpp"
+#include "common-dsp.hpp"
 #include "common-shm.hpp"
 #include "data.hpp"
 #include <fulog.hpp>
@@ -8,38 +9,194 @@
 namespace scuff::sbox {
 
 static
-auto copy_data_from_output(ez::audio_t, const shm::device& dest, size_t dest_port_index, const shm::device& source, size_t src_port_index) -> void {
-	const auto& output_buffer = source.data->audio_out.at(src_port_index);
-	auto& input_buffer        = dest.data->audio_in.at(dest_port_index);
-	input_buffer = output_buffer;
+auto zero_port(ez::audio_t, shm::audio_port* port, uint32_t max_frames) -> void {
+	// Already zero if it's known to be silent.
+	if (!shm::is_silent(*port)) {
+		const auto count = max_frames * port->channel_count;
+		if (port->samples64) { std::fill_n(port->samples64.get(), count, 0.0); }
+		else                 { std::fill_n(port->samples.get(), count, 0.0f); }
+		port->flags = shm::SILENT_BUFFER;
+	}
+}
+
+static
+// Inputs which are fed by connections hold the sum of everything connected
+// to them, so they start each cycle silent and the outputs are added to them.
+// Audio written to these inputs by the client is discarded.
+auto zero_connected_inputs(ez::audio_t, const sbox::app& app, size_t buffer) -> void {
+	const auto max_frames = app.audio_model->max_frames;
+	for (const auto& dev : app.audio_model->devices) {
+		for (const auto& conn : dev.output_conns) {
+			const auto& inputs = app.audio_model->devices.at(conn.other_device).shm->data->buffers[buffer].audio_in;
+			if (conn.other_port_index < inputs.size()) {
+				zero_port(ez::audio, &inputs[conn.other_port_index], max_frames);
+			}
+		}
+		const auto& inputs = dev.shm->data->buffers[buffer].audio_in;
+		for (const auto& conn : dev.remote_input_conns) {
+			if (conn.this_port_index < inputs.size()) {
+				zero_port(ez::audio, &inputs[conn.this_port_index], max_frames);
+			}
+		}
+	}
+}
+
+template <typename T> static
+// Add an output to an input, one channel at a time. Silent channels are skipped
+// and a channel which is still silent in the input is copied rather than added.
+// If the ports have different numbers of channels, only the channels they have
+// in common are added. Nothing is added if the input's samples are in a different
+// format, which only happens briefly while the group's sample format is changing.
+auto add_to_input(ez::audio_t, const T* src, uint32_t src_channels, shm::audio_buffer_flags src_flags, shm::audio_port* dest, uint32_t max_frames, uint32_t frames) -> void {
+	const auto dest_samples = shm::get_samples<T>(*dest);
+	if (!src || !dest_samples || shm::is_silent(src_flags, src_channels)) {
+		return;
+	}
+	auto& dest_flags    = dest->flags;
+	const auto channels = std::min(src_channels, dest->channel_count);
+	for (size_t c = 0; c < channels; c++) {
+		const auto bit = uint64_t{1} << c;
+		if (src_flags.silent_mask & bit) {
+			continue;
+		}
+		const auto src_channel  = src + (max_frames * c);
+		const auto dest_channel = dest_samples + (max_frames * c);
+		if (dest_flags.silent_mask & bit) {
+			std::copy(src_channel, src_channel + frames, dest_channel);
+			dest_flags.silent_mask   &= ~bit;
+			dest_flags.constant_mask = (dest_flags.constant_mask & ~bit) | (src_flags.constant_mask & bit);
+			continue;
+		}
+		dsp::add(src_channel, dest_channel, frames);
+		// The sum of two constant channels is constant.
+		dest_flags.constant_mask &= src_flags.constant_mask | ~bit;
+	}
 }
 
 static
-auto copy_data_from_connected_outputs(ez::audio_t, const sbox::app& app, const sbox::device& dev) -> void {
+auto add_data_from_output(ez::audio_t, const shm::device& dest, size_t dest_port_index, const shm::device& source, size_t src_port_index, size_t buffer, uint32_t max_frames, uint32_t frames) -> void {
+	const auto& outputs = source.data->buffers[buffer].audio_out;
+	const auto& inputs  = dest.data->buffers[buffer].audio_in;
+	if (src_port_index >= outputs.size() || dest_port_index >= inputs.size()) {
+		return;
+	}
+	const auto& output = outputs[src_port_index];
+	const auto input   = &inputs[dest_port_index];
+	if (output.samples64) { add_to_input(ez::audio, output.samples64.get(), output.channel_count, output.flags, input, max_frames, frames); }
+	else                  { add_to_input(ez::audio, output.samples.get(), output.channel_count, output.flags, input, max_frames, frames); }
+}
+
+static
+auto add_data_from_connected_outputs(ez::audio_t, const sbox::app& app, const sbox::device& dev, size_t buffer, uint32_t frames) -> void {
 	for (const auto& conn : dev.output_conns) {
-		copy_data_from_output(ez::audio, app.audio_model->devices.at(conn.other_device).service->shm, conn.other_port_index, dev.service->shm, conn.this_port_index);
+		add_data_from_output(ez::audio, *app.audio_model->devices.at(conn.other_device).shm, conn.other_port_index, *dev.shm, conn.this_port_index, buffer, app.audio_model->max_frames, frames);
 	}
 }
 
 static
-auto transfer_input_events_from_main(ez::audio_t, const sbox::app& app, const sbox::device& dev) -> void {
+// Read the outputs of the previous cycle directly from the shared memory of devices in
+// other sandboxes. They were written to the other set of buffers, which won't be written
+// to again until the next cycle, so the connection has one block of latency. If the other
+// sandbox didn't finish the previous cycle in time it contributes silence instead. If
+// the previous block was shorter than this one, the rest of this one is silent.
+auto add_data_from_remote_outputs(ez::audio_t, const sbox::app& app, const sbox::device& dev, uint32_t cycle, size_t buffer, uint32_t frames) -> void {
+	const auto max_frames = app.audio_model->max_frames;
+	const auto& inputs    = dev.shm->data->buffers[buffer].audio_in;
+	for (const auto& conn : dev.remote_input_conns) {
+		if (conn.this_port_index >= inputs.size()) {
+			continue;
+		}
+		// Read into a scratch buffer first because a failed
+		// read leaves garbage behind.
+		const auto copy = conn.scratch.get();
+		if (!shm::read_output(*conn.other_shm, conn.other_port_index, cycle - 1, max_frames, copy)) {
+			continue;
+		}
+		const auto input         = &inputs[conn.this_port_index];
+		const auto frames_to_add = std::min(copy->frames, frames);
+		if (copy->format == sample_format::float64) { add_to_input(ez::audio, copy->samples64.data(), copy->channel_count, copy->flags, input, max_frames, frames_to_add); }
+		else                                        { add_to_input(ez::audio, copy->samples.data(), copy->channel_count, copy->flags, input, max_frames, frames_to_add); }
+	}
+}
+
+static
+auto transfer_input_events_from_main(ez::audio_t, const sbox::app& app, const sbox::device& dev, size_t buffer) -> void {
 	scuff::event event;
-	auto& events_in = dev.service->shm.data->events_in;
+	auto& events_in = dev.shm->data->buffers[buffer].events_in;
 	while (dev.service->input_events_from_main.try_dequeue(event)) {
 		if (events_in.size() == events_in.max_size()) {
 			fu::debug_log("ERROR: Dropping input events because the input event queue is full. This is a bug!");
 			break;
 		}
-		dev.service->shm.data->events_in.push_back(event);
+		events_in.push_back(event);
+	}
+}
+
+static
+auto update_stats(ez::audio_t, const sbox::device& dev, process_result result, std::chrono::steady_clock::duration elapsed) -> void {
+	// This is the only thread which writes to the stats, so
+	// there is no need for read-modify-write operations.
+	auto& stats = dev.shm->data->stats;
+	switch (result) {
+		case process_result::processed: {
+			const auto ns = static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(elapsed).count());
+			stats.last_ns.store(ns, std::memory_order_relaxed);
+			stats.total_ns.store(stats.total_ns.load(std::memory_order_relaxed) + ns, std::memory_order_relaxed);
+			stats.max_ns.store(std::max(stats.max_ns.load(std::memory_order_relaxed), ns), std::memory_order_relaxed);
+			// Released last so that a reader who sees the new count
+			// also sees the time it was added with.
+			stats.processed.store(stats.processed.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+			return;
+		}
+		case process_result::skipped: {
+			stats.skipped.store(stats.skipped.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+			return;
+		}
+		case process_result::asleep: {
+			stats.asleep.store(stats.asleep.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+			return;
+		}
+	}
+}
+
+static
+// The plugin isn't producing any audio so the meters
+// shouldn't keep showing the level of the last block.
+auto clear_meters(ez::audio_t, const sbox::device& dev) -> void {
+	for (const auto& port : dev.shm->data->buffers[0].audio_out) {
+		for (uint32_t c = 0; c < port.channel_count; c++) {
+			port.meters[c].rms.store(0.0f, std::memory_order_relaxed);
+		}
 	}
 }
 
 static
-auto do_processing(ez::audio_t, const sbox::app& app, const sbox::device& dev) -> void {
-	transfer_input_events_from_main(ez::audio, app, dev);
+// A device which didn't process this cycle has nothing to output, and whatever
+// it output the last time it processed mustn't be heard again. Marking the
+// outputs silent also means connections from them are skipped.
+auto silence_outputs(ez::audio_t, const sbox::app& app, const sbox::device& dev, size_t buffer) -> void {
+	for (auto& port : dev.shm->data->buffers[buffer].audio_out) {
+		zero_port(ez::audio, &port, app.audio_model->max_frames);
+	}
+}
+
+static
+auto do_processing(ez::audio_t, const sbox::app& app, const sbox::device& dev, uint32_t cycle, size_t buffer, uint32_t frames) -> void {
+	transfer_input_events_from_main(ez::audio, app, dev, buffer);
+	add_data_from_remote_outputs(ez::audio, app, dev, cycle, buffer, frames);
+	shm::begin_writing_outputs(*dev.shm, buffer);
 	switch (dev.type) {
 		case plugin_type::clap: {
-			scuff::sbox::clap::process(ez::audio, app, dev);
+			const auto ring   = &app.shm_sbox.data->audio_trace;
+			trace::begin(ring, trace::event::plugin_process, dev.id.value);
+			const auto start  = std::chrono::steady_clock::now();
+			const auto result = scuff::sbox::clap::process(ez::audio, app, dev, buffer, frames);
+			update_stats(ez::audio, dev, result, std::chrono::steady_clock::now() - start);
+			if (result != process_result::processed) {
+				clear_meters(ez::audio, dev);
+				silence_outputs(ez::audio, app, dev, buffer);
+			}
+			trace::end(ring, trace::event::plugin_process, dev.id.value);
 			break;
 		}
 		case plugin_type::vst3: {
@@ -47,31 +204,60 @@ auto do_processing(ez::audio_t, const sbox::app& app, const sbox::device& dev) -
 			break;
 		}
 	}
-	copy_data_from_connected_outputs(ez::audio, app, dev);
+	add_data_from_connected_outputs(ez::audio, app, dev, buffer, frames);
+	shm::end_writing_outputs(*dev.shm, buffer, cycle, frames);
 }
 
 static
 auto do_processing(ez::audio_t, sbox::app* app) -> void {
+	const auto ring  = &app->shm_sbox.data->audio_trace;
+	const auto cycle = app->sandbox_signaler.shm->cycle.load(std::memory_order_relaxed);
+	trace::begin(ring, trace::event::sandbox_process, cycle);
 	app->audio_model = app->model.read(ez::audio);
+	const auto buffer = signaling::get_buffer_index(cycle);
+	// Written by the client before it signaled us.
+	const auto frames = std::min(app->shm_group.data->frames[buffer].load(std::memory_order_relaxed), app->audio_model->max_frames);
+	zero_connected_inputs(ez::audio, *app, buffer);
 	for (const auto dev_id : app->audio_model->device_processing_order) {
 		const auto dev = app->audio_model->devices.at(dev_id);
-		do_processing(ez::audio, *app, dev);
+		do_processing(ez::audio, *app, dev, cycle, buffer, frames);
 	}
-	signaling::notify_sandbox_done(app->group_signaler);
+	trace::end(ring, trace::event::sandbox_process, cycle);
+	trace::instant(ring, trace::event::notify_done, cycle);
+	signaling::notify_sandbox_done(app->group_signaler, app->sandbox_signaler);
 	app->audio_model = {};
 }
 
+// How much of the audio thread's stack is prefaulted or locked, if the client
+// asked for that. Plenty for us, and for most plugins.
+static constexpr auto AUDIO_THREAD_STACK_PREPARE_SIZE = size_t{256} << 10;
+
+static
+auto prepare_stack(ez::audio_t, sbox::app* app, const memory_options& options) -> void {
+	if (!options.lock && !options.prefault) {
+		return;
+	}
+	if (!scuff::os::prepare_stack(AUDIO_THREAD_STACK_PREPARE_SIZE, options.lock)) {
+		fu::debug_log("msg out -> report_warning");
+		app->msgs_out.lock()->push_back(msg::out::report_warning{"Failed to lock the stack of the sandbox's audio thread."});
+	}
+}
+
 static
-auto thread_proc(std::stop_token stop_token, ez::audio_t, sbox::app* app) -> void {
+// The memory options are passed in rather than read from the app,
+// because the main thread can change them while this is running.
+auto thread_proc(std::stop_token stop_token, ez::audio_t, sbox::app* app, memory_options options) -> void {
 	try {
 		fu::debug_log("INFO: Audio thread has started.");
+		prepare_stack(ez::audio, app, options);
 		for (;;) {
 			if (stop_token.stop_requested()) {
 				fu::debug_log("INFO: Audio thread is stopping because it was requested to.");
 				return;
 			}
-			auto result = signaling::wait_for_work_begin(app->sandbox_signaler, stop_token);
+			auto result = signaling::wait_for_work_begin(app->group_signaler, app->sandbox_signaler, stop_token);
 			if (result == signaling::sandbox_wait_result::signaled) {
+				trace::instant(&app->shm_sbox.data->audio_trace, trace::event::wake);
 				do_processing(ez::audio, app);
 				continue;
 			}
@@ -96,7 +282,7 @@ auto start_audio(ez::main_t, sbox::app* app) -> void {
 	if (app->audio_thread.joinable()) {
 		return;
 	}
-	app->audio_thread = std::jthread{thread_proc, ez::audio, app};
+	app->audio_thread = std::jthread{thread_proc, ez::audio, app, app->memory_options};
 	scuff::os::set_realtime_priority(&app->audio_thread);
 }
 
@@ -105,7 +291,7 @@ auto stop_audio(ez::main_t, sbox::app* app) -> void {
 	fu::debug_log("INFO: stop_audio()");
 	if (app->audio_thread.joinable()) {
 		app->audio_thread.request_stop();
-		signaling::unblock_self(app->sandbox_signaler);
+		signaling::unblock_self(app->group_signaler, app->sandbox_signaler);
 		app->audio_thread.join();
 	}
 }
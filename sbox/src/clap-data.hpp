@@ -99,7 +99,12 @@ struct audio_port_info {
 
 struct audio_buffers_detail {
 	std::vector<std::vector<float*>> arrays;
+	std::vector<std::vector<double*>> arrays64;
 	std::vector<clap_audio_buffer_t> buffers;
+	// If the device's samples are 64-bit but a port of the plugin can't
+	// process 64-bit audio, the plugin is given this instead and the samples
+	// are converted around each call to process(). Empty for other ports.
+	std::vector<std::vector<float>> converted;
 };
 
 struct audio_buffers {
@@ -142,10 +147,12 @@ struct event_queue_context {
 };
 
 struct device_service_audio {
-	clap::audio_buffers buffers;
+	// One of each for each set of device buffers in shared memory.
+	// The constant masks and frame counts are written by the audio thread.
+	mutable std::array<clap::audio_buffers, 2> buffers;
+	mutable std::array<clap_process_t, 2> process;
 	clap_input_events_t input_events;
 	clap_output_events_t output_events;
-	clap_process_t process;
 };
 
 struct device_log_collector {
@@ -1,6 +1,7 @@
 #pragma once
 
 #include "common-clap.hpp"
+#include "common-dsp.hpp"
 #include "common-messages.hpp"
 #include "common-os-dso.hpp"
 #include "common-shm.hpp"
@@ -222,7 +223,7 @@ auto cb_state_mark_dirty(ez::main_t, sbox::app* app, id::device dev_id) -> void
 }
 
 static
-auto convert_input_events(ez::safe_t, const sbox::device& dev, const clap::device& clap_dev) -> void {
+auto convert_input_events(ez::safe_t, const sbox::device& dev, const clap::device& clap_dev, size_t buffer) -> void {
 	auto get_cookie = [dev](idx::param param) -> void* {
 		return dev.param_info[param.value].clap.cookie;
 	};
@@ -231,7 +232,8 @@ auto convert_input_events(ez::safe_t, const sbox::device& dev, const clap::devic
 	};
 	auto fns = scuff::events::clap::scuff_to_clap_conversion_fns{get_cookie, get_id};
 	scuff::events::clap::event_buffer input_clap_events;
-	for (const auto& event : dev.service->shm.data->events_in) {
+	auto& events_in = dev.shm->data->buffers[buffer].events_in;
+	for (const auto& event : events_in) {
 		// If a parameter is changing, mark the device state as dirty
 		if (std::holds_alternative<scuff::events::param_value>(event)) {
 			dev.service->dirty_marker++;
@@ -239,11 +241,11 @@ auto convert_input_events(ez::safe_t, const sbox::device& dev, const clap::devic
 		input_clap_events.push_back(scuff::events::clap::from_scuff(event, fns));
 	}
 	clap_dev.service.data->input_event_buffer = std::move(input_clap_events);
-	dev.service->shm.data->events_in.clear();
+	events_in.clear();
 }
 
 static
-auto convert_output_events(ez::safe_t, const sbox::device& dev, const clap::device& clap_dev) -> void {
+auto convert_output_events(ez::safe_t, const sbox::device& dev, const clap::device& clap_dev, size_t buffer) -> void {
 	auto find_param = [dev](clap_id id) -> idx::param {
 		auto has_id = [id](const scuff::sbox_param_info& info) -> bool {
 			return info.id.value == id;
@@ -263,14 +265,14 @@ auto convert_output_events(ez::safe_t, const sbox::device& dev, const clap::devi
 		}
 		output_scuff_events.push_back(scuff::events::clap::to_scuff(event, fns));
 	}
-	dev.service->shm.data->events_out = std::move(output_scuff_events);
+	dev.shm->data->buffers[buffer].events_out = std::move(output_scuff_events);
 	clap_dev.service.data->output_event_buffer.clear();
 }
 
 static
 // Could be called from main thread or audio thread, but
 // never both simultaneously, for the same device.
-auto flush_device_events(ez::safe_t, const sbox::device& dev, const clap::device& clap_dev) -> void {
+auto flush_device_events(ez::safe_t, const sbox::device& dev, const clap::device& clap_dev, size_t buffer) -> void {
 	const auto& input_events  = clap_dev.service.audio->input_events;
 	const auto& output_events = clap_dev.service.audio->output_events;
 	const auto& iface         = clap_dev.iface->plugin;
@@ -278,9 +280,9 @@ auto flush_device_events(ez::safe_t, const sbox::device& dev, const clap::device
 		// May not actually be intialized
 		return;
 	}
-	convert_input_events(ez::safe, dev, clap_dev);
+	convert_input_events(ez::safe, dev, clap_dev, buffer);
 	iface.params->flush(iface.plugin, &input_events, &output_events);
-	convert_output_events(ez::safe, dev, clap_dev);
+	convert_output_events(ez::safe, dev, clap_dev, buffer);
 }
 
 [[nodiscard]] static
@@ -302,19 +304,39 @@ auto try_to_wake_up(ez::audio_t, const clap::device& dev) -> bool {
 	return true;
 }
 
+static
+auto update_meter(ez::audio_t, shm::channel_meter* meter, dsp::level level) -> void {
+	// This is the only thread which writes to the meters, apart from the
+	// client resetting the peak, so there is no need for a compare-exchange.
+	meter->peak.store(std::max(meter->peak.load(std::memory_order_relaxed), level.peak), std::memory_order_relaxed);
+	meter->rms.store(level.rms, std::memory_order_relaxed);
+}
+
 [[nodiscard]] static
-auto output_is_quiet(ez::audio_t, const shm::device& shm) -> bool {
-	static constexpr auto THRESHOLD = 0.0001f;
-	for (size_t i = 0; i < shm.data->audio_out.size(); i++) {
-		const auto& buffer = shm.data->audio_out[i];
-		for (size_t j = 0; j < buffer.size(); j++) {
-			const auto frame = buffer[j];
-			if (std::abs(frame) > THRESHOLD) {
-				return false;
+// Update the output meters. This is the only pass we make over the output
+// samples, so it also returns the highest peak, which is used to decide if
+// the outputs are quiet.
+auto update_meters(ez::audio_t, const shm::device& shm, size_t buffer_index, uint32_t max_frames, uint32_t frames) -> float {
+	auto peak = 0.0f;
+	for (const auto& port : shm.data->buffers[buffer_index].audio_out) {
+		for (uint32_t c = 0; c < port.channel_count; c++) {
+			if (port.flags.silent_mask & (uint64_t{1} << c)) {
+				update_meter(ez::audio, &port.meters[c], {});
+				continue;
 			}
+			const auto offset = max_frames * c;
+			const auto level  = port.samples64 ? dsp::measure(port.samples64.get() + offset, frames) : dsp::measure(port.samples.get() + offset, frames);
+			update_meter(ez::audio, &port.meters[c], level);
+			peak = std::max(peak, level.peak);
 		}
 	}
-	return true;
+	return peak;
+}
+
+[[nodiscard]] static
+auto output_is_quiet(ez::audio_t, float output_peak) -> bool {
+	static constexpr auto THRESHOLD = 0.0001f;
+	return output_peak <= THRESHOLD;
 }
 
 static
@@ -324,13 +346,13 @@ auto go_to_sleep(ez::audio_t, const clap::device& dev) -> void {
 }
 
 static
-auto handle_audio_process_result(ez::audio_t, const shm::device& shm, const clap::device& dev, clap_process_status status) -> void {
+auto handle_audio_process_result(ez::audio_t, float output_peak, const clap::device& dev, clap_process_status status) -> void {
 	switch (status) {
 		case CLAP_PROCESS_CONTINUE: {
 			return;
 		}
 		case CLAP_PROCESS_CONTINUE_IF_NOT_QUIET: {
-			if (output_is_quiet(ez::audio, shm)) {
+			if (output_is_quiet(ez::audio, output_peak)) {
 				go_to_sleep(ez::audio, dev);
 			}
 			return;
@@ -362,26 +384,99 @@ auto handle_event_process_result(ez::audio_t, const clap::device& dev, clap_proc
 }
 
 static
-auto process_audio_device(ez::audio_t, const sbox::device& dev, const clap::device& clap_dev) -> void {
-	const auto& iface   = clap_dev.iface->plugin;
-	const auto& process = clap_dev.service.audio->process;
-	auto& flags         = clap_dev.service.data->atomic_flags;
-	auto& audio_buffers = clap_dev.service.audio->buffers;
-	convert_input_events(ez::audio, dev, clap_dev);
+// Tell the plugin which input channels are constant, and clear the
+// output masks so that we can see which ones the plugin sets.
+auto write_constant_masks(ez::audio_t, const shm::device_buffers& shm_buffers, clap::audio_buffers* buffers) -> void {
+	for (size_t i = 0; i < buffers->inputs.buffers.size(); i++) {
+		auto& buffer = buffers->inputs.buffers[i];
+		buffer.constant_mask = shm_buffers.audio_in[i].flags.constant_mask & shm::get_channels_mask(buffer.channel_count);
+	}
+	for (auto& buffer : buffers->outputs.buffers) {
+		buffer.constant_mask = 0;
+	}
+}
+
+static
+// A constant channel is also silent if its first sample is zero. Channels
+// the plugin didn't report as constant are assumed not to be.
+auto read_constant_masks(ez::audio_t, const clap::audio_buffers& buffers, const shm::device_buffers& shm_buffers) -> void {
+	for (size_t i = 0; i < buffers.outputs.buffers.size(); i++) {
+		const auto& buffer = buffers.outputs.buffers[i];
+		auto& flags        = shm_buffers.audio_out[i].flags;
+		flags.constant_mask = buffer.constant_mask & shm::get_channels_mask(buffer.channel_count);
+		flags.silent_mask   = 0;
+		for (uint32_t c = 0; c < buffer.channel_count; c++) {
+			const auto bit = uint64_t{1} << c;
+			const auto first = buffer.data64 ? buffer.data64[c][0] : double{buffer.data32[c][0]};
+			if ((flags.constant_mask & bit) && first == 0.0) {
+				flags.silent_mask |= bit;
+			}
+		}
+	}
+}
+
+static
+// Convert the 64-bit input samples for ports which the plugin
+// is processing in 32 bits. See audio_buffers_detail::converted.
+auto convert_inputs(ez::audio_t, const shm::device_buffers& shm_buffers, clap::audio_buffers* buffers, uint32_t max_frames, uint32_t frames) -> void {
+	for (size_t i = 0; i < buffers->inputs.converted.size(); i++) {
+		auto& converted = buffers->inputs.converted[i];
+		if (converted.empty()) {
+			continue;
+		}
+		const auto& port = shm_buffers.audio_in[i];
+		for (uint32_t c = 0; c < port.channel_count; c++) {
+			const auto src = port.samples64.get() + (max_frames * c);
+			std::transform(src, src + frames, converted.data() + (max_frames * c), [](double x) { return static_cast<float>(x); });
+		}
+	}
+}
+
+static
+// The other way around from convert_inputs().
+auto convert_outputs(ez::audio_t, const shm::device_buffers& shm_buffers, const clap::audio_buffers& buffers, uint32_t max_frames, uint32_t frames) -> void {
+	for (size_t i = 0; i < buffers.outputs.converted.size(); i++) {
+		const auto& converted = buffers.outputs.converted[i];
+		if (converted.empty()) {
+			continue;
+		}
+		const auto& port = shm_buffers.audio_out[i];
+		for (uint32_t c = 0; c < port.channel_count; c++) {
+			std::copy_n(converted.data() + (max_frames * c), frames, port.samples64.get() + (max_frames * c));
+		}
+	}
+}
+
+static
+auto process_audio_device(ez::audio_t, const sbox::app& app, const sbox::device& dev, const clap::device& clap_dev, size_t buffer, uint32_t frames) -> void {
+	const auto& iface       = clap_dev.iface->plugin;
+	auto& process           = clap_dev.service.audio->process[buffer];
+	auto& buffers           = clap_dev.service.audio->buffers[buffer];
+	const auto& shm_buffers = dev.shm->data->buffers[buffer];
+	auto& flags             = clap_dev.service.data->atomic_flags;
+	const auto max_frames   = app.audio_model->max_frames;
+	convert_input_events(ez::audio, dev, clap_dev, buffer);
+	write_constant_masks(ez::audio, shm_buffers, &buffers);
+	convert_inputs(ez::audio, shm_buffers, &buffers, max_frames, frames);
+	process.frames_count = frames;
 	const auto status = iface.plugin->process(iface.plugin, &process);
-	handle_audio_process_result(ez::audio, dev.service->shm, clap_dev, status);
-	convert_output_events(ez::audio, dev, clap_dev);
+	convert_outputs(ez::audio, shm_buffers, buffers, max_frames, frames);
+	read_constant_masks(ez::audio, buffers, shm_buffers);
+	const auto peak = update_meters(ez::audio, *dev.shm, buffer, max_frames, frames);
+	handle_audio_process_result(ez::audio, peak, clap_dev, status);
+	convert_output_events(ez::audio, dev, clap_dev, buffer);
 }
 
 static
-auto process_event_device(ez::audio_t, const sbox::device& dev, const clap::device& clap_dev) -> void {
+auto process_event_device(ez::audio_t, const sbox::device& dev, const clap::device& clap_dev, size_t buffer, uint32_t frames) -> void {
 	const auto& iface   = clap_dev.iface->plugin;
-	const auto& process = clap_dev.service.audio->process;
+	auto& process       = clap_dev.service.audio->process[buffer];
 	auto& flags         = clap_dev.service.data->atomic_flags;
-	convert_input_events(ez::audio, dev, clap_dev);
+	convert_input_events(ez::audio, dev, clap_dev, buffer);
+	process.frames_count = frames;
 	const auto status   = iface.plugin->process(iface.plugin, &process);
 	handle_event_process_result(ez::audio, clap_dev, status);
-	convert_output_events(ez::audio, dev, clap_dev);
+	convert_output_events(ez::audio, dev, clap_dev, buffer);
 }
 
 auto is_scheduled_to_panic(ez::safe_t, const clap::device& device) -> bool {
@@ -393,67 +488,91 @@ auto panic(ez::audio_t, const clap::device& device) -> void {
 	unset_flags(&device.service.data->atomic_flags, device_atomic_flags::schedule_panic);
 }
 
-auto process(ez::audio_t, const sbox::app& app, const sbox::device& dev) -> void {
+auto process(ez::audio_t, const sbox::app& app, const sbox::device& dev, size_t buffer, uint32_t frames) -> process_result {
 	const auto& clap_dev = app.audio_model->clap_devices.at(dev.id);
 	const auto& iface    = clap_dev.iface->plugin;
 	if (!is_active(ez::audio, clap_dev)) {
-		return;
+		return process_result::skipped;
 	}
 	if (is_scheduled_to_panic(ez::audio, clap_dev)) {
 		panic(ez::audio, clap_dev);
 	}
 	if (!is_processing(ez::audio, clap_dev)) {
-		flush_device_events(ez::audio, dev, clap_dev);
+		flush_device_events(ez::audio, dev, clap_dev, buffer);
 		if (!is_scheduled_to_process(ez::audio, clap_dev)) {
-			return;
+			return process_result::asleep;
 		}
 		if (!try_to_wake_up(ez::audio, clap_dev)) {
-			return;
+			return process_result::asleep;
 		}
 	}
 	if (iface.audio_ports) {
-		if (can_render_audio(ez::audio, clap_dev.service.audio->buffers)) {
-			process_audio_device(ez::audio, dev, clap_dev);
-			return;
+		if (can_render_audio(ez::audio, clap_dev.service.audio->buffers[buffer])) {
+			process_audio_device(ez::audio, app, dev, clap_dev, buffer, frames);
+			return process_result::processed;
 		}
 		else {
-			flush_device_events(ez::audio, dev, clap_dev);
-			return;
+			flush_device_events(ez::audio, dev, clap_dev, buffer);
+			return process_result::processed;
 		}
 	}
-	process_event_device(ez::audio, dev, clap_dev);
+	process_event_device(ez::audio, dev, clap_dev, buffer, frames);
+	return process_result::processed;
 }
 
 static
-auto make_audio_buffers(ez::main_t, bc::static_vector<shm::audio_buffer, MAX_AUDIO_PORTS>* shm_buffers, const std::vector<clap_audio_port_info_t>& port_info, audio_buffers_detail* out) -> void {
+// The shared memory ports were laid out from the same port info,
+// so they have the same number of channels.
+auto make_audio_buffers(ez::main_t, const shm::audio_ports& shm_ports, const std::vector<clap_audio_port_info_t>& port_info, uint32_t max_frames, audio_buffers_detail* out) -> void {
 	out->arrays.resize(port_info.size());
+	out->arrays64.resize(port_info.size());
 	out->buffers.resize(port_info.size());
+	out->converted.resize(port_info.size());
 	for (size_t port_index = 0; port_index < port_info.size(); port_index++) {
-		const auto& info = port_info[port_index];
-		auto& arr = out->arrays[port_index];
-		arr.resize(info.channel_count);
-	}
-	for (size_t port_index = 0; port_index < port_info.size(); port_index++) {
-		const auto& info = port_info[port_index];
-		auto& arr = out->arrays[port_index];
+		const auto& port     = shm_ports.at(port_index);
+		const auto plugin_64 = (port_info[port_index].flags & CLAP_AUDIO_PORT_SUPPORTS_64BITS) != 0;
 		auto& buf = out->buffers[port_index];
-		for (uint32_t c = 0; c < info.channel_count; c++) {
-			auto& vec = (*shm_buffers)[port_index];
-			arr[c] = vec.data() + (scuff::VECTOR_SIZE * c);
-		}
-		buf.channel_count = info.channel_count;
+		buf.channel_count = port.channel_count;
 		buf.constant_mask = 0;
-		buf.data32        = arr.data();
+		buf.data32        = nullptr;
 		buf.data64        = nullptr;
 		buf.latency       = 0;
+		if (port.samples64 && plugin_64) {
+			auto& arr = out->arrays64[port_index];
+			arr.resize(port.channel_count);
+			for (uint32_t c = 0; c < port.channel_count; c++) {
+				arr[c] = port.samples64.get() + (max_frames * c);
+			}
+			buf.data64 = arr.data();
+			continue;
+		}
+		auto samples = port.samples.get();
+		if (port.samples64) {
+			auto& converted = out->converted[port_index];
+			converted.resize(size_t{port.channel_count} * max_frames);
+			samples = converted.data();
+		}
+		auto& arr = out->arrays[port_index];
+		arr.resize(port.channel_count);
+		for (uint32_t c = 0; c < port.channel_count; c++) {
+			arr[c] = samples + (max_frames * c);
+		}
+		buf.data32 = arr.data();
 	}
 }
 
 static
-auto make_audio_buffers(ez::main_t, const shm::device& shm, const audio_port_info& port_info, clap::audio_buffers* out) -> void {
+auto make_audio_buffers(ez::main_t, const shm::device_buffers& shm_buffers, const audio_port_info& port_info, uint32_t max_frames, clap::audio_buffers* out) -> void {
 	*out = {};
-	make_audio_buffers(ez::main, &shm.data->audio_in, port_info.inputs, &out->inputs);
-	make_audio_buffers(ez::main, &shm.data->audio_out, port_info.outputs, &out->outputs);
+	make_audio_buffers(ez::main, shm_buffers.audio_in, port_info.inputs, max_frames, &out->inputs);
+	make_audio_buffers(ez::main, shm_buffers.audio_out, port_info.outputs, max_frames, &out->outputs);
+}
+
+static
+auto make_audio_buffers(ez::main_t, const shm::device& shm, const audio_port_info& port_info, uint32_t max_frames, std::array<clap::audio_buffers, 2>* out) -> void {
+	for (size_t i = 0; i < out->size(); i++) {
+		make_audio_buffers(ez::main, shm.data->buffers[i], port_info, max_frames, &(*out)[i]);
+	}
 }
 
 [[nodiscard]] static
@@ -476,6 +595,77 @@ auto retrieve_audio_port_info(ez::main_t, const iface_plugin& iface) -> audio_po
 	return out;
 }
 
+[[nodiscard]] static
+auto get_channel_counts(const std::vector<clap_audio_port_info_t>& port_info) -> std::vector<uint32_t> {
+	std::vector<uint32_t> out;
+	for (const auto& info : port_info) {
+		out.push_back(info.channel_count);
+	}
+	return out;
+}
+
+[[nodiscard]] static
+auto make_port_layout(const audio_port_info& port_info, sample_format format, uint32_t max_frames) -> shm::port_layout {
+	return {get_channel_counts(port_info.inputs), get_channel_counts(port_info.outputs), format, max_frames};
+}
+
+template <typename Memory> static
+// Apply the memory options the client asked for to a segment or device which
+// the audio thread touches, and report anything which couldn't be done.
+auto prepare_memory(ez::main_t, sbox::app* app, const Memory& memory, std::string_view what) -> void {
+	if (const auto warning = shm::apply_memory_options(memory, app->memory_options, what)) {
+		fu::debug_log("msg out -> report_warning");
+		app->msgs_out.lock()->push_back(msg::out::report_warning{*warning});
+	}
+}
+
+[[nodiscard]] static
+auto describe_device_memory(id::device dev_id) -> std::string {
+	return std::format("the shared memory of device {}", dev_id.value);
+}
+
+[[nodiscard]] static
+// dev_shmid is the shared memory the client already has for this device, if any (this
+// happens when the sandbox is restarted.) It's only reused if it was laid out for
+// the same audio ports. Otherwise the device gets a block in the group's arena, or
+// a segment of its own if it doesn't fit.
+auto open_or_create_shm_device(ez::main_t, const sbox::app& app, id::device dev_id, std::string_view dev_shmid, const shm::port_layout& layout) -> std::shared_ptr<const shm::device> {
+	const auto remove_when_done = app.mode != sbox::mode::sandbox;
+	const auto arena            = app.shm_group.arena.get();
+	if (!dev_shmid.empty()) {
+		auto shm = shm::open_device(arena, dev_shmid, remove_when_done);
+		if (shm::get_port_layout(shm) == layout) {
+			return std::make_shared<const shm::device>(std::move(shm));
+		}
+	}
+	if (arena) {
+		if (auto shm = shm::create_device(arena, layout)) {
+			return std::make_shared<const shm::device>(std::move(*shm));
+		}
+	}
+	return std::make_shared<const shm::device>(shm::create_device(shm::make_device_id(app.shm_sbox.seg.id, dev_id), layout, remove_when_done));
+}
+
+[[nodiscard]] static
+auto make_shm_device(ez::main_t, sbox::app* app, id::device dev_id, std::string_view dev_shmid, const shm::port_layout& layout) -> std::shared_ptr<const shm::device> {
+	auto shm = open_or_create_shm_device(ez::main, *app, dev_id, dev_shmid, layout);
+	prepare_memory(ez::main, app, *shm, describe_device_memory(dev_id));
+	return shm;
+}
+
+static
+// So that the counters still accumulate from when the device was created.
+auto copy_stats(ez::main_t, const shm::device& from, const shm::device& to) -> void {
+	const auto& src = from.data->stats;
+	auto& dest      = to.data->stats;
+	dest.processed.store(src.processed.load(std::memory_order_relaxed), std::memory_order_relaxed);
+	dest.skipped.store(src.skipped.load(std::memory_order_relaxed), std::memory_order_relaxed);
+	dest.asleep.store(src.asleep.load(std::memory_order_relaxed), std::memory_order_relaxed);
+	dest.last_ns.store(src.last_ns.load(std::memory_order_relaxed), std::memory_order_relaxed);
+	dest.total_ns.store(src.total_ns.load(std::memory_order_relaxed), std::memory_order_relaxed);
+	dest.max_ns.store(src.max_ns.load(std::memory_order_relaxed), std::memory_order_relaxed);
+}
+
 [[nodiscard]] static
 auto make_input_event_list(ez::main_t, const clap::device& dev) -> clap_input_events_t {
 	clap_input_events_t list;
@@ -506,42 +696,48 @@ auto make_output_event_list(ez::main_t, const clap::device& dev) -> clap_output_
 static
 // AUDIO DEVICE
 auto initialize_process_struct_for_audio_device(ez::main_t, const clap::device& dev, clap::device_service_audio* audio) -> void {
-	audio->input_events                = make_input_event_list(ez::main, dev);
-	audio->output_events               = make_output_event_list(ez::main, dev);
-	audio->process.frames_count        = VECTOR_SIZE;
-	audio->process.audio_inputs_count  = static_cast<uint32_t>(audio->buffers.inputs.buffers.size());
-	audio->process.audio_inputs        = audio->buffers.inputs.buffers.data();
-	audio->process.audio_outputs_count = static_cast<uint32_t>(audio->buffers.outputs.buffers.size());
-	audio->process.audio_outputs       = audio->buffers.outputs.buffers.data();
-	audio->process.steady_time         = -1;
-	audio->process.transport           = nullptr;
-	audio->process.in_events           = &audio->input_events;
-	audio->process.out_events          = &audio->output_events;
+	audio->input_events  = make_input_event_list(ez::main, dev);
+	audio->output_events = make_output_event_list(ez::main, dev);
+	for (size_t i = 0; i < audio->process.size(); i++) {
+		auto& process               = audio->process[i];
+		const auto& buffers         = audio->buffers[i];
+		process.frames_count        = 0; // Set each cycle.
+		process.audio_inputs_count  = static_cast<uint32_t>(buffers.inputs.buffers.size());
+		process.audio_inputs        = buffers.inputs.buffers.data();
+		process.audio_outputs_count = static_cast<uint32_t>(buffers.outputs.buffers.size());
+		process.audio_outputs       = buffers.outputs.buffers.data();
+		process.steady_time         = -1;
+		process.transport           = nullptr;
+		process.in_events           = &audio->input_events;
+		process.out_events          = &audio->output_events;
+	}
 }
 
 static
 // EVENT-ONLY DEVICE
 auto initialize_process_struct_for_event_device(ez::main_t, const clap::device& dev, clap::device_service_audio* audio) -> void {
-	audio->input_events                = make_input_event_list(ez::main, dev);
-	audio->output_events               = make_output_event_list(ez::main, dev);
-	static auto dummy_buffer           = clap_audio_buffer_t{0};
-	audio->process.frames_count        = VECTOR_SIZE;
-	audio->process.audio_inputs_count  = 0;
-	audio->process.audio_inputs        = &dummy_buffer;
-	audio->process.audio_outputs_count = 0;
-	audio->process.audio_outputs       = &dummy_buffer;
-	audio->process.steady_time         = -1;
-	audio->process.transport           = nullptr;
-	audio->process.in_events           = &audio->input_events;
-	audio->process.out_events          = &audio->output_events;
+	audio->input_events      = make_input_event_list(ez::main, dev);
+	audio->output_events     = make_output_event_list(ez::main, dev);
+	static auto dummy_buffer = clap_audio_buffer_t{0};
+	for (auto& process : audio->process) {
+		process.frames_count        = 0; // Set each cycle.
+		process.audio_inputs_count  = 0;
+		process.audio_inputs        = &dummy_buffer;
+		process.audio_outputs_count = 0;
+		process.audio_outputs       = &dummy_buffer;
+		process.steady_time         = -1;
+		process.transport           = nullptr;
+		process.in_events           = &audio->input_events;
+		process.out_events          = &audio->output_events;
+	}
 }
 
 [[nodiscard]] static
-auto init_audio(ez::main_t, const sbox::device& dev, const clap::device& clap_dev) -> std::shared_ptr<const device_service_audio> {
+auto init_audio(ez::main_t, const sbox::device& dev, const clap::device& clap_dev, uint32_t max_frames) -> std::shared_ptr<const device_service_audio> {
 	auto out = std::make_shared<device_service_audio>();
 	if (clap_dev.iface->plugin.audio_ports) {
 		// AUDIO PLUGIN
-		make_audio_buffers(ez::main, dev.service->shm, clap_dev.service.audio_port_info, &out->buffers);
+		make_audio_buffers(ez::main, *dev.shm, clap_dev.service.audio_port_info, max_frames, &out->buffers);
 		initialize_process_struct_for_audio_device(ez::main, clap_dev, out.get());
 	}
 	else {
@@ -552,21 +748,47 @@ auto init_audio(ez::main_t, const sbox::device& dev, const clap::device& clap_de
 }
 
 [[nodiscard]] static
-auto init_audio(ez::main_t, clap::device&& clap_dev, const sbox::device& dev) -> device {
-	clap_dev.service.audio = init_audio(ez::main, dev, clap_dev);
+auto init_audio(ez::main_t, clap::device&& clap_dev, const sbox::device& dev, uint32_t max_frames) -> device {
+	clap_dev.service.audio = init_audio(ez::main, dev, clap_dev, max_frames);
 	return clap_dev;
 }
 
-static
-auto init_audio(ez::main_t, sbox::app* app, id::device dev_id) -> void {
-	app->model.update_publish(ez::main, [=](model&& m) {
-		auto dev                         = m.devices.at(dev_id);
-		auto clap_dev                    = m.clap_devices.at(dev_id);
-		clap_dev.service.audio_port_info = retrieve_audio_port_info(ez::main, clap_dev.iface->plugin);
-		clap_dev                         = init_audio(ez::main, std::move(clap_dev), dev);
-		m.clap_devices                   = m.clap_devices.insert(clap_dev);
+[[nodiscard]] static
+// Call when the plugin's audio ports may have changed. If they no longer fit in the
+// device's segment then the device is moved to a new one, and its id is returned.
+auto init_audio(ez::main_t, sbox::app* app, id::device dev_id) -> std::string {
+	const auto m                     = app->model.read(ez::main);
+	auto dev                         = m.devices.at(dev_id);
+	auto clap_dev                    = m.clap_devices.at(dev_id);
+	auto new_shmid                   = std::string{};
+	clap_dev.service.audio_port_info = retrieve_audio_port_info(ez::main, clap_dev.iface->plugin);
+	const auto layout                = make_port_layout(clap_dev.service.audio_port_info, m.sample_format, m.max_frames);
+	if (shm::get_port_layout(*dev.shm) != layout) {
+		const auto old_shm = dev.shm;
+		dev.shm   = make_shm_device(ez::main, app, dev_id, {}, layout);
+		new_shmid = dev.shm->id;
+		copy_stats(ez::main, *old_shm, *dev.shm);
+	}
+	clap_dev = init_audio(ez::main, std::move(clap_dev), dev, m.max_frames);
+	app->model.update_publish(ez::main, [dev, clap_dev](model&& m) {
+		m.devices      = m.devices.insert(dev);
+		m.clap_devices = m.clap_devices.insert(clap_dev);
 		return m;
 	});
+	return new_shmid;
+}
+
+static
+// Move the device to a segment whose ports have room for max_frames frames,
+// and remake its audio buffers there. Nothing is published, so that the new
+// block size can be published along with every device which was moved.
+auto move_audio(ez::main_t, sbox::app* app, sbox::device* dev, clap::device* clap_dev, uint32_t max_frames) -> void {
+	auto layout        = shm::get_port_layout(*dev->shm);
+	layout.max_frames  = max_frames;
+	const auto old_shm = dev->shm;
+	dev->shm           = make_shm_device(ez::main, app, dev->id, {}, layout);
+	copy_stats(ez::main, *old_shm, *dev->shm);
+	*clap_dev = init_audio(ez::main, std::move(*clap_dev), *dev, max_frames);
 }
 
 [[nodiscard]] static
@@ -574,6 +796,8 @@ auto make_device_port_info(ez::main_t, const clap::device& clap_dev) -> device_p
 	scuff::device_port_info info;
 	info.audio_input_port_count  = clap_dev.service.audio_port_info->inputs.size();
 	info.audio_output_port_count = clap_dev.service.audio_port_info->outputs.size();
+	info.audio_input_channels    = get_channel_counts(clap_dev.service.audio_port_info->inputs);
+	info.audio_output_channels   = get_channel_counts(clap_dev.service.audio_port_info->outputs);
 	return info;
 }
 
@@ -584,6 +808,15 @@ auto make_device_port_info(ez::main_t, const sbox::app& app, id::device dev_id)
 	return make_device_port_info(ez::main, clap_dev);
 }
 
+static
+// Remake the device's audio buffers and tell the client about its ports,
+// and where they are now if the device had to be moved to a new segment.
+auto update_audio_ports(ez::main_t, sbox::app* app, id::device dev_id) -> void {
+	auto ports_shmid = init_audio(ez::main, app, dev_id);
+	fu::debug_log("msg out -> device_port_info");
+	app->msgs_out.lock()->push_back(scuff::msg::out::device_port_info{dev_id.value, make_device_port_info(ez::main, *app, dev_id), std::move(ports_shmid)});
+}
+
 static
 auto rescan_audio_ports(ez::main_t, sbox::app* app, id::device dev_id, uint32_t flags) -> void {
 	const auto requires_not_active =
@@ -601,9 +834,7 @@ auto rescan_audio_ports(ez::main_t, sbox::app* app, id::device dev_id, uint32_t
 			return;
 		}
 	}
-	init_audio(ez::main, app, dev_id);
-	fu::debug_log("msg out -> device_port_info");
-	app->msgs_out.lock()->push_back(scuff::msg::out::device_port_info{dev_id.value, make_device_port_info(ez::main, *app, dev_id)});
+	update_audio_ports(ez::main, app, dev_id);
 }
 
 [[nodiscard]] static
@@ -774,6 +1005,16 @@ auto process_msg(ez::main_t, sbox::app* app, const device& dev, const clap::devi
 	fast_visit([app, dev](const auto& msg) { process_msg_(ez::main, app, dev, msg); }, msg);
 }
 
+[[nodiscard]] static
+// The set of device buffers the main thread should use when flushing events.
+auto get_main_thread_buffer_index(ez::main_t, const sbox::app& app) -> size_t {
+	if (!app.sandbox_signaler.shm) {
+		// Not connected to a client (e.g. GUI testing.)
+		return 0;
+	}
+	return signaling::get_buffer_index(app.sandbox_signaler);
+}
+
 static
 auto update(ez::main_t, sbox::app* app) -> void {
 	const auto m = app->model.read(ez::main);
@@ -783,7 +1024,7 @@ auto update(ez::main_t, sbox::app* app) -> void {
 			process_msg(ez::main, app, dev, msg);
 		}
 		if (!is_active(ez::main, dev)) {
-			flush_device_events(ez::main, m.devices.at(dev.id), dev);
+			flush_device_events(ez::main, m.devices.at(dev.id), dev, get_main_thread_buffer_index(ez::main, *app));
 		}
 	}
 }
@@ -944,14 +1185,8 @@ auto make_ext_data(ez::main_t, sbox::app* app, id::device id) -> std::shared_ptr
 	return data;
 }
 
-[[nodiscard]] static
-auto make_shm_device(ez::main_t, std::string_view sbox_shmid, id::device dev_id, sbox::mode mode) -> shm::device {
-	const auto remove_when_done = mode != sbox::mode::sandbox;
-	return shm::open_or_create_device(shm::make_device_id(sbox_shmid, dev_id), remove_when_done);
-}
-
 static
-auto create_device(ez::main_t, sbox::app* app, id::device dev_id, std::string_view plugfile_path, std::string_view plugin_id) -> void {
+auto create_device(ez::main_t, sbox::app* app, id::device dev_id, std::string_view plugfile_path, std::string_view plugin_id, std::string_view dev_shmid) -> void {
 	const auto entry = scuff::os::dso::find_fn<clap_plugin_entry_t>({plugfile_path}, {CLAP_SYMBOL_ENTRY});
 	if (!entry) {
 		throw std::runtime_error("Couldn't resolve clap_entry");
@@ -983,16 +1218,13 @@ auto create_device(ez::main_t, sbox::app* app, id::device dev_id, std::string_vi
 		throw std::runtime_error("clap_plugin.init failed");
 	}
 	get_extensions(ez::main, &iface.plugin);
+	const auto m                     = app->model.read(ez::main);
 	auto dev                         = sbox::device{};
 	auto clap_dev                    = clap::device{};
 	dev.id                           = dev_id;
 	dev.type                         = plugin_type::clap;
-	dev.service->shm = make_shm_device(ez::main, app->shm_sbox.seg.id, dev_id, app->mode);
 	clap_dev.service.audio_port_info = retrieve_audio_port_info(ez::main, iface.plugin);
-	const auto audio_in_count    = clap_dev.service.audio_port_info->inputs.size();
-	const auto audio_out_count   = clap_dev.service.audio_port_info->outputs.size();
-	dev.service->shm.data->audio_in.resize(audio_in_count);
-	dev.service->shm.data->audio_out.resize(audio_out_count);
+	dev.shm                          = make_shm_device(ez::main, app, dev_id, dev_shmid, make_port_layout(clap_dev.service.audio_port_info, m.sample_format, m.max_frames));
 	clap_dev.id           = dev_id;
 	clap_dev.iface        = std::move(iface);
 	clap_dev.name         = clap_dev.iface->plugin.plugin->desc->name;
@@ -1000,7 +1232,7 @@ auto create_device(ez::main_t, sbox::app* app, id::device dev_id, std::string_vi
 	clap_dev.service.data = std::move(ext_data);
 	dev                   = init_gui(ez::main, std::move(dev), clap_dev);
 	dev                   = init_params(ez::main, std::move(dev), clap_dev);
-	clap_dev              = init_audio(ez::main, std::move(clap_dev), dev);
+	clap_dev              = init_audio(ez::main, std::move(clap_dev), dev, m.max_frames);
 	clap_dev              = init_params(ez::main, std::move(clap_dev));
 	dev                   = init_local_params(ez::main, std::move(dev), clap_dev);
 	app->model.update_publish(ez::main, [=](model&& m) {
@@ -1086,19 +1318,22 @@ auto activate(ez::main_t, sbox::app* app, id::device dev_id, double sr) -> bool
 	const auto clap_dev       = m.clap_devices.at(dev_id);
 	const auto already_active = clap_dev.flags.value & device_flags::active;
 	const auto current_sr     = dev.sample_rate;
-	if (already_active && current_sr == sr) {
+	const auto max_frames     = m.max_frames;
+	if (already_active && current_sr == sr && dev.max_frames == max_frames) {
 		return true;
 	}
 	if (already_active) {
 		clap_dev.iface->plugin.plugin->deactivate(clap_dev.iface->plugin.plugin);
 	}
-	auto result = clap_dev.iface->plugin.plugin->activate(clap_dev.iface->plugin.plugin, sr, VECTOR_SIZE, VECTOR_SIZE);
+	// Any block can be shorter than the maximum.
+	auto result = clap_dev.iface->plugin.plugin->activate(clap_dev.iface->plugin.plugin, sr, 1, max_frames);
 	if (!result) {
 		return false;
 	}
-	app->model.update_publish(ez::main, [dev_id, sr](model&& m) {
-		m.devices = m.devices.update(dev_id, [sr](sbox::device dev) {
+	app->model.update_publish(ez::main, [dev_id, sr, max_frames](model&& m) {
+		m.devices = m.devices.update(dev_id, [sr, max_frames](sbox::device dev) {
 			dev.sample_rate = sr;
+			dev.max_frames  = max_frames;
 			return dev;
 		});
 		m.clap_devices = m.clap_devices.update(dev_id, [](clap::device clap_dev) {
@@ -12,6 +12,7 @@ auto get_options(const sbox::app& app, int argc, char** argv) -> sbox::options {
 	po::options_description desc("Allowed options");
 	uint64_t parent_window = 0;
 	desc.add_options()
+		("doorbell",      po::value<std::string>(&options.doorbell_shmid),"Client doorbell shared memory ID")
 		("group",         po::value<std::string>(&options.group_shmid),"Group shared memory ID")
 		("sandbox",       po::value<std::string>(&options.sbox_shmid), "Sandbox shared memory ID")
 		("gui-file",      po::value<std::string>(&options.gui_file), "Path to plugfile to open for GUI testing")
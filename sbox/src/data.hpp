@@ -41,8 +41,28 @@ struct port_conn {
 	auto operator<=>(const port_conn&) const = default;
 };
 
+// An input connection from a device in another sandbox. The other
+// device's shared memory is mapped into this process so that its
+// output can be read directly. The mapping stays open for as long
+// as the audio thread might be using it.
+struct remote_port_conn {
+	id::device other_device;
+	size_t this_port_index;
+	size_t other_port_index;
+	std::shared_ptr<const shm::device> other_shm;
+	// Audio thread only. The output is copied into this before it is added
+	// to the input. Sized for the channels of the output port.
+	std::shared_ptr<shm::output_copy> scratch;
+};
+
+// What happened to a device in a processing cycle.
+enum class process_result {
+	processed,
+	skipped, // The device isn't active.
+	asleep,
+};
+
 struct device_service {
-	shm::device shm;
 	std::optional<window_size_f> scheduled_window_resize;
 	rwq<scuff::event> input_events_from_main = rwq<scuff::event>(EVENT_PORT_SIZE);
 	std::chrono::steady_clock::time_point next_save = std::chrono::steady_clock::now();
@@ -56,12 +76,18 @@ struct device {
 	device_ui ui;
 	plugin_type type;
 	double sample_rate = 0.0;
+	uint32_t max_frames = 0;
 	std::chrono::steady_clock::duration autosave_interval = std::chrono::milliseconds{DEFAULT_AUTOSAVE_MS};
 	std::optional<rgba32> track_color;
 	immer::box<std::string> track_name;
 	immer::box<std::string> name;
 	immer::flex_vector<port_conn> output_conns;
+	immer::flex_vector<remote_port_conn> remote_input_conns;
 	immer::vector<scuff::sbox_param_info> param_info;
+	// The segment is sized for the device's audio ports and the block size,
+	// so it is replaced if they change. The audio thread keeps using the old
+	// one until it picks up the new model.
+	std::shared_ptr<const shm::device> shm;
 	std::shared_ptr<device_service> service = std::make_shared<device_service>();
 };
 
@@ -69,6 +95,11 @@ struct model {
 	immer::table<device> devices;
 	immer::table<clap::device> clap_devices;
 	immer::vector<id::device> device_processing_order;
+	// Frames per channel in the audio buffers in shared memory. Set when
+	// the sandbox is activated.
+	uint32_t max_frames = VECTOR_SIZE;
+	// Of the samples in the audio buffers in shared memory. Set by the client.
+	scuff::sample_format sample_format = scuff::sample_format::float32;
 };
 
 using heartbeat_time = std::chrono::time_point<std::chrono::steady_clock>;
@@ -89,6 +120,8 @@ struct app {
 	sbox::options                     options;
 	sbox::mode                        mode;
 	scuff::render_mode                render_mode = scuff::render_mode::realtime;
+	scuff::memory_options             memory_options;
+	shm::doorbell                     shm_doorbell;
 	shm::group                        shm_group;
 	shm::sandbox                      shm_sbox;
 	signaling::sandboxside_group      group_signaler;
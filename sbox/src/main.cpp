@@ -67,11 +67,14 @@ auto get_mode(const sbox::app& app) -> sbox::mode {
 static
 auto send_msgs_out(sbox::app* app) -> void {
 	if (app->mode == sbox::mode::sandbox) {
-		const auto msgs_out = app->msgs_out.lock();
-		for (const auto& msg : *msgs_out) {
-			app->client_msg_sender.enqueue(msg);
+		{
+			const auto msgs_out = app->msgs_out.lock();
+			for (const auto& msg : *msgs_out) {
+				app->client_msg_sender.enqueue(msg);
+			}
+			msgs_out->clear();
 		}
-		msgs_out->clear();
+		send_client_messages(ez::main, app);
 	}
 	else {
 		const auto msgs_out = app->msgs_out.lock();
@@ -112,6 +115,9 @@ auto sandbox(sbox::app* app) -> int {
 	fu::log(std::format("INFO: client PID: {}", app->options.client_pid));
 	fu::log(std::format("INFO: group: {}", app->options.group_shmid));
 	fu::log(std::format("INFO: sandbox: {}", app->options.sbox_shmid));
+	if (!app->options.doorbell_shmid.empty()) {
+		app->shm_doorbell = shm::open_doorbell(app->options.doorbell_shmid);
+	}
 	app->shm_group              = shm::open_group(app->options.group_shmid);
 	app->shm_sbox               = shm::open_sandbox(app->options.sbox_shmid);
 	app->group_signaler.local   = &app->shm_group.signaling;
@@ -121,6 +127,7 @@ auto sandbox(sbox::app* app) -> int {
 	app->main_thread_id         = std::this_thread::get_id();
 	app->last_heartbeat         = std::chrono::steady_clock::now();
 	auto frame = [app]{
+		const auto frame_trace = trace::scope{&app->shm_sbox.data->main_trace, trace::event::main_frame};
 		process_client_messages(ez::main, app);
 		do_scheduled_window_resizes(app);
 		edwin::process_messages();
@@ -148,7 +155,7 @@ auto gui_test(sbox::app* app) -> int {
 	auto on_window_closed = [app]{
 		app->schedule_terminate = true;
 	};
-	op::device_create(ez::main, app, plugin_type::clap, id::device{1}, app->options.gui_file, app->options.gui_id);
+	op::device_create(ez::main, app, plugin_type::clap, id::device{1}, app->options.gui_file, app->options.gui_id, {});
 	gui::show(ez::main, app, id::device{1}, {on_window_closed});
 	auto frame = [app]{
 		do_scheduled_window_resizes(app);
@@ -232,7 +239,7 @@ auto go(int argc, char** argv) -> int {
 
 TEST_CASE("com.FabFilter.preset-discovery.Saturn.2") {
 	const auto plugfile_path = "C:\\Program Files\\Common Files\\CLAP\\FabFilter Saturn 2.clap";
-	op::device_create(ez::main, app_, plugin_type::clap, id::device{1}, plugfile_path, "com.FabFilter.preset-discovery.Saturn.2");
+	op::device_create(ez::main, app_, plugin_type::clap, id::device{1}, plugfile_path, "com.FabFilter.preset-discovery.Saturn.2", {});
 }
 
 } // scuff::sbox::main
@@ -32,16 +32,18 @@ static
 auto msg_from_client(ez::main_t, sbox::app* app, const scuff::msg::in::device_create& msg) -> void {
 	fu::debug_log("INFO: msg::in::device_create");
 	try {
-		const auto dev = op::device_create(ez::main, app, msg.type, id::device{msg.dev_id}, msg.plugfile_path, msg.plugin_id);
+		const auto dev = op::device_create(ez::main, app, msg.type, id::device{msg.dev_id}, msg.plugfile_path, msg.plugin_id, msg.shmid);
 		op::set_render_mode(ez::main, app, dev.id, app->render_mode);
-		fu::debug_log("msg out -> device_create_success");
 		fu::debug_log("msg out -> device_flags");
 		fu::debug_log("msg out -> device_port_info");
 		fu::debug_log("msg out -> device_param_info");
-		app->msgs_out.lock()->push_back(scuff::msg::out::device_create_success{msg.dev_id, dev.service->shm.seg.id.data(), msg.callback});
+		fu::debug_log("msg out -> device_create_success");
 		app->msgs_out.lock()->push_back(scuff::msg::out::device_flags{msg.dev_id, dev.flags.value});
-		app->msgs_out.lock()->push_back(scuff::msg::out::device_port_info{msg.dev_id, op::make_device_port_info(ez::main, *app, dev)});
+		app->msgs_out.lock()->push_back(scuff::msg::out::device_port_info{msg.dev_id, op::make_device_port_info(ez::main, *app, dev), {}});
 		app->msgs_out.lock()->push_back(scuff::msg::out::device_param_info{msg.dev_id, op::make_client_param_info(dev)});
+		// Last, so that everything else about the device is known by the time
+		// the client's creation callback is called.
+		app->msgs_out.lock()->push_back(scuff::msg::out::device_create_success{msg.dev_id, dev.shm->created ? dev.shm->id : std::string{}, msg.callback});
 		fu::debug_log(std::format("INFO: Passing flags to client: {}", dev.flags.value));
 	}
 	catch (const std::exception& err) {
@@ -107,6 +109,7 @@ auto msg_from_client(ez::main_t, sbox::app* app, const scuff::msg::in::device_re
 	if (state.empty()) {
 		fu::debug_log("msg out -> report_error");
 		app->msgs_out.lock()->push_back(scuff::msg::out::report_error{"Failed to save device state"});
+		app->msgs_out.lock()->push_back(scuff::msg::out::return_requested_state{{}, msg.callback});
 		return;
 	}
 	fu::debug_log("msg out -> return_requested_state");
@@ -122,6 +125,24 @@ auto msg_from_client(ez::main_t, sbox::app* app, const scuff::msg::in::panic& ms
 	}
 }
 
+static
+auto msg_from_client(ez::main_t, sbox::app* app, const scuff::msg::in::remote_connect& msg) -> void {
+	fu::debug_log("INFO: msg::in::remote_connect");
+	op::remote_connect(ez::main, app, {msg.out_dev_id}, msg.out_port, msg.out_shmid, {msg.in_dev_id}, msg.in_port);
+}
+
+static
+auto msg_from_client(ez::main_t, sbox::app* app, const scuff::msg::in::remote_disconnect& msg) -> void {
+	fu::debug_log("INFO: msg::in::remote_disconnect");
+	op::remote_disconnect(ez::main, app, {msg.out_dev_id}, msg.out_port, {msg.in_dev_id}, msg.in_port);
+}
+
+static
+auto msg_from_client(ez::main_t, sbox::app* app, const scuff::msg::in::set_memory_options& msg) -> void {
+	fu::debug_log("INFO: msg::in::set_memory_options");
+	op::set_memory_options(ez::main, app, msg.options);
+}
+
 static
 auto msg_from_client(ez::main_t, sbox::app* app, const scuff::msg::in::set_render_mode& msg) -> void {
 	fu::debug_log("INFO: msg::in::set_render_mode");
@@ -132,6 +153,12 @@ auto msg_from_client(ez::main_t, sbox::app* app, const scuff::msg::in::set_rende
 	}
 }
 
+static
+auto msg_from_client(ez::main_t, sbox::app* app, const scuff::msg::in::set_sample_format& msg) -> void {
+	fu::debug_log("INFO: msg::in::set_sample_format");
+	op::set_sample_format(ez::main, app, msg.format);
+}
+
 static
 auto msg_from_client(ez::main_t, sbox::app* app, const scuff::msg::in::event& msg) -> void {
 	fu::debug_log("INFO: msg::in::event");
@@ -170,8 +197,8 @@ auto msg_from_client(ez::main_t, sbox::app* app, const scuff::msg::in::get_param
 
 static
 auto msg_from_client(ez::main_t, sbox::app* app, const scuff::msg::in::activate& msg) -> void {
-	fu::debug_log(std::format("INFO: msg::in::activate: {}", msg.sr));
-	op::activate(ez::main, app, msg.sr);
+	fu::debug_log(std::format("INFO: msg::in::activate: {} {}", msg.sr, msg.max_frames));
+	op::activate(ez::main, app, msg.sr, msg.max_frames);
 }
 
 static
@@ -237,14 +264,41 @@ auto process_client_messages(ez::main_t, sbox::app* app) -> void {
 		const auto receive = [app](std::byte* bytes, size_t count) -> size_t {
 			return shm::receive_bytes_from_client(app->shm_sbox, bytes, count);
 		};
-		const auto send = [app](const std::byte* bytes, size_t count) -> size_t {
-			return shm::send_bytes_to_client(app->shm_sbox, bytes, count);
-		};
 		const auto& input_msgs = app->client_msg_receiver.receive(receive);
 		for (const auto& msg : input_msgs) {
 			msg_from_client(ez::main, app, msg);
 		}
+	}
+	catch (const std::exception& err) {
+		fu::log(std::format("ERROR: {}", err.what()), std::source_location::current());
+		fu::debug_log("msg out -> report_error");
+		app->msgs_out.lock()->push_back(scuff::msg::out::report_error{err.what()});
+	}
+}
+
+static
+// Called at the end of each frame so that replies to the messages which
+// were processed at the start of the frame go out without waiting for the
+// next one. Rings the client's doorbell if anything was written.
+auto send_client_messages(ez::main_t, sbox::app* app) -> void {
+	try {
+		auto bytes_sent = size_t{0};
+		const auto send = [app, &bytes_sent](const std::byte* bytes, size_t count) -> size_t {
+			const auto sent = shm::send_bytes_to_client(app->shm_sbox, bytes, count);
+			bytes_sent += sent;
+			return sent;
+		};
 		app->client_msg_sender.send(send);
+		if (bytes_sent > 0) {
+			shm::ring(app->shm_doorbell);
+		}
+		for (const auto& msg : app->client_msg_sender.take_cancelled()) {
+			if (const auto state = std::get_if<scuff::msg::out::return_requested_state>(&msg)) {
+				// Tell the client the state isn't coming so that it doesn't wait for it.
+				fu::debug_log("msg out -> return_requested_state (cancelled)");
+				app->msgs_out.lock()->push_back(scuff::msg::out::return_requested_state{{}, state->callback});
+			}
+		}
 	}
 	catch (const std::exception& err) {
 		fu::log(std::format("ERROR: {}", err.what()), std::source_location::current());
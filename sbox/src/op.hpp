@@ -73,7 +73,40 @@ auto activate(ez::main_t, sbox::app* app, const sbox::device& dev, double sr) ->
 }
 
 static
-auto activate(ez::main_t, sbox::app* app, double sr) -> void {
+// The audio ports of every device only have room for the block size they
+// were laid out for, so every device is moved to a segment sized for the new
+// one. The devices are published along with the block size, so that the audio
+// thread never sees one without the other, and then the client is told where
+// they are now.
+auto set_max_frames(ez::main_t, sbox::app* app, uint32_t max_frames) -> void {
+	max_frames = std::clamp(max_frames, uint32_t{1}, uint32_t{MAX_VECTOR_SIZE});
+	const auto m = app->model.read(ez::main);
+	if (m.max_frames == max_frames) {
+		return;
+	}
+	auto devices      = m.devices;
+	auto clap_devices = m.clap_devices;
+	for (auto clap_dev : m.clap_devices) {
+		auto dev = m.devices.at(clap_dev.id);
+		clap::move_audio(ez::main, app, &dev, &clap_dev, max_frames);
+		devices      = devices.insert(dev);
+		clap_devices = clap_devices.insert(clap_dev);
+	}
+	app->model.update_publish(ez::main, [max_frames, devices, clap_devices](model&& m) {
+		m.max_frames   = max_frames;
+		m.devices      = devices;
+		m.clap_devices = clap_devices;
+		return m;
+	});
+	for (const auto& clap_dev : clap_devices) {
+		fu::debug_log("msg out -> device_port_info");
+		app->msgs_out.lock()->push_back(scuff::msg::out::device_port_info{clap_dev.id.value, clap::make_device_port_info(ez::main, clap_dev), devices.at(clap_dev.id).shm->id});
+	}
+}
+
+static
+auto activate(ez::main_t, sbox::app* app, double sr, uint32_t max_frames) -> void {
+	set_max_frames(ez::main, app, max_frames);
 	start_audio(ez::main, app);
 	const auto m = app->model.read(ez::main);
 	for (const auto& dev : m.devices) {
@@ -105,6 +138,69 @@ auto deactivate(ez::main_t, sbox::app* app) -> void {
 	app->active = false;
 }
 
+static
+// Every device is moved to a segment with samples in the new format. The
+// plugins are reactivated, because a plugin might only check whether it is
+// being given 32-bit or 64-bit buffers when it is activated.
+auto set_sample_format(ez::main_t, sbox::app* app, scuff::sample_format format) -> void {
+	if (app->model.read(ez::main).sample_format == format) {
+		return;
+	}
+	app->model.update_publish(ez::main, [format](model&& m) {
+		m.sample_format = format;
+		return m;
+	});
+	const auto m = app->model.read(ez::main);
+	for (const auto& dev : m.devices) {
+		deactivate(ez::main, app, dev);
+		switch (dev.type) {
+			case plugin_type::clap: { clap::update_audio_ports(ez::main, app, dev.id); break; }
+			default:                { throw std::runtime_error("Unsupported device type"); }
+		}
+		if (app->active && activate(ez::main, app, dev, app->sample_rate)) {
+			fu::debug_log("msg out -> device_latency");
+			app->msgs_out.lock()->push_back(msg::out::device_latency{dev.id.value, get_latency(ez::main, *app, dev)});
+		}
+	}
+}
+
+static
+// The audio thread's stack is prepared when the audio thread starts, so
+// that only changes the next time the sandbox is activated.
+auto set_memory_options(ez::main_t, sbox::app* app, const memory_options& options) -> void {
+	const auto old = app->memory_options;
+	app->memory_options = options;
+	if (old.lock_all && !options.lock_all) {
+		// This unlocks everything, so anything which should still be
+		// locked is locked again below.
+		scuff::os::unlock_all_memory();
+	}
+	if (options.lock_all && !old.lock_all && !scuff::os::lock_all_memory()) {
+		fu::debug_log("msg out -> report_warning");
+		app->msgs_out.lock()->push_back(msg::out::report_warning{"Failed to lock all of the sandbox process's memory."});
+	}
+	// Also forget what is locked if munlockall() unlocked it, so that it can
+	// be locked again.
+	const auto unlock  = old.lock && (!options.lock || (old.lock_all && !options.lock_all));
+	const auto prepare = [app, unlock](const auto& memory, std::string_view what) {
+		if (unlock) {
+			shm::unlock_memory(memory);
+		}
+		clap::prepare_memory(ez::main, app, memory, what);
+	};
+	if (shm::is_valid(app->shm_group.seg)) { prepare(app->shm_group.seg, "the group's shared memory"); }
+	if (shm::is_valid(app->shm_sbox.seg))  { prepare(app->shm_sbox.seg, "the sandbox's shared memory"); }
+	const auto m = app->model.read(ez::main);
+	for (const auto& dev : m.devices) {
+		if (dev.shm) {
+			prepare(*dev.shm, clap::describe_device_memory(dev.id));
+		}
+		for (const auto& conn : dev.remote_input_conns) {
+			prepare(*conn.other_shm, clap::describe_device_memory(conn.other_device));
+		}
+	}
+}
+
 static
 auto device_connect(ez::main_t, sbox::app* app, id::device out_dev_id, size_t out_port, id::device in_dev_id, size_t in_port) -> void {
 	app->model.update_publish(ez::main, [out_dev_id, out_port, in_dev_id, in_port](model&& m){
@@ -147,10 +243,70 @@ auto device_disconnect(ez::main_t, sbox::app* app, id::device out_dev_id, size_t
 	});
 }
 
+[[nodiscard]] static
+auto is_same_connection(const remote_port_conn& conn, id::device out_dev_id, size_t out_port, size_t in_port) -> bool {
+	return conn.other_device == out_dev_id && conn.other_port_index == out_port && conn.this_port_index == in_port;
+}
+
+[[nodiscard]] static
+auto erase_remote_conn(immer::flex_vector<remote_port_conn> conns, id::device out_dev_id, size_t out_port, size_t in_port) -> immer::flex_vector<remote_port_conn> {
+	for (size_t i = 0; i < conns.size(); i++) {
+		if (is_same_connection(conns[i], out_dev_id, out_port, in_port)) {
+			return conns.erase(i);
+		}
+	}
+	return conns;
+}
+
+static
+// Connect the output of a device in another sandbox to the input of one of ours.
+// The client sends this again whenever either device is recreated, so if the
+// connection already exists it is replaced.
+auto remote_connect(ez::main_t, sbox::app* app, id::device out_dev_id, size_t out_port, std::string_view out_shmid, id::device in_dev_id, size_t in_port) -> void {
+	auto out_shm  = std::make_shared<const shm::device>(shm::open_device(app->shm_group.arena.get(), out_shmid, false));
+	clap::prepare_memory(ez::main, app, *out_shm, clap::describe_device_memory(out_dev_id));
+	auto scratch  = std::make_shared<shm::output_copy>();
+	auto channels = out_port < out_shm->data->buffers[0].audio_out.size() ? out_shm->data->buffers[0].audio_out[out_port].channel_count : 0;
+	if (out_shm->data->format == sample_format::float64) { scratch->samples64.resize(size_t{channels} * MAX_VECTOR_SIZE); }
+	else                                                 { scratch->samples.resize(size_t{channels} * MAX_VECTOR_SIZE); }
+	app->model.update_publish(ez::main, [out_dev_id, out_port, in_dev_id, in_port, out_shm, scratch](model&& m){
+		const auto in_dev_ptr = m.devices.find(in_dev_id);
+		if (!in_dev_ptr) {
+			// The device failed to load. The client will send
+			// this again if it is ever created successfully.
+			return m;
+		}
+		auto in_dev = *in_dev_ptr;
+		remote_port_conn conn;
+		conn.other_device     = out_dev_id;
+		conn.other_port_index = out_port;
+		conn.this_port_index  = in_port;
+		conn.other_shm        = out_shm;
+		conn.scratch          = scratch;
+		in_dev.remote_input_conns = erase_remote_conn(in_dev.remote_input_conns, out_dev_id, out_port, in_port).push_back(conn);
+		m.devices = m.devices.insert(in_dev);
+		return m;
+	});
+}
+
+static
+auto remote_disconnect(ez::main_t, sbox::app* app, id::device out_dev_id, size_t out_port, id::device in_dev_id, size_t in_port) -> void {
+	app->model.update_publish(ez::main, [out_dev_id, out_port, in_dev_id, in_port](model&& m){
+		const auto in_dev_ptr = m.devices.find(in_dev_id);
+		if (!in_dev_ptr) {
+			return m;
+		}
+		auto in_dev = *in_dev_ptr;
+		in_dev.remote_input_conns = erase_remote_conn(in_dev.remote_input_conns, out_dev_id, out_port, in_port);
+		m.devices = m.devices.insert(in_dev);
+		return m;
+	});
+}
+
 static
-auto device_create(ez::main_t, sbox::app* app, plugin_type type, id::device dev_id, std::string_view plugfile_path, std::string_view plugin_id) -> sbox::device {
+auto device_create(ez::main_t, sbox::app* app, plugin_type type, id::device dev_id, std::string_view plugfile_path, std::string_view plugin_id, std::string_view shmid) -> sbox::device {
 	if (type == plugin_type::clap) {
-		clap::create_device(ez::main, app, dev_id, plugfile_path, plugin_id);
+		clap::create_device(ez::main, app, dev_id, plugfile_path, plugin_id, shmid);
 		app->model.update_publish(ez::main, [dev_id](model&& m){
 			m.device_processing_order = make_device_processing_order(m.devices);
 			return m;
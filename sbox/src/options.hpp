@@ -7,6 +7,7 @@
 namespace scuff::sbox {
 
 struct options {
+	std::string doorbell_shmid;
 	std::string group_shmid;
 	std::string sbox_shmid;
 	std::string gui_file;
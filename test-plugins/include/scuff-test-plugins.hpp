@@ -0,0 +1,35 @@
+#pragma once
+
+#include <cstdlib>
+#include <string>
+
+// Shared by the client tests and benchmarks, which are given the location
+// of the test plugin bundle through TEST_PLUGINS_DIR.
+
+namespace scuff::test_plugins {
+
+// Prepend the directory containing the in-tree test plugins to CLAP_PATH
+// so that the scanner finds them. Call this before scuff::init().
+static
+auto add_to_clap_path() -> void {
+#if defined(_WIN32)
+	static constexpr auto DELIMITER = ';';
+	auto path    = std::string{TEST_PLUGINS_DIR};
+	char* value  = nullptr;
+	size_t size  = 0;
+	if (_dupenv_s(&value, &size, "CLAP_PATH") == 0 && value) {
+		path = path + DELIMITER + value;
+		free(value);
+	}
+	_putenv_s("CLAP_PATH", path.c_str());
+#else
+	static constexpr auto DELIMITER = ':';
+	auto path = std::string{TEST_PLUGINS_DIR};
+	if (const auto value = std::getenv("CLAP_PATH")) {
+		path = path + DELIMITER + value;
+	}
+	setenv("CLAP_PATH", path.c_str(), 1);
+#endif
+}
+
+} // scuff::test_plugins
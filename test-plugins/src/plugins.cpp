@@ -0,0 +1,514 @@
+// A CLAP bundle of small reference plugins with predictable behaviour, so that
+// the audio, state and param paths of the sandboxing system can be tested and
+// benchmarked without depending on third-party plugins.
+//
+// Every plugin has one stereo audio input and one stereo audio output, because
+// the sandbox only renders audio for devices which have both. The exception is
+// the channels plugin, which exists to test other port layouts.
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <clap/clap.h>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <numbers>
+#include <string>
+#include <vector>
+
+namespace scuff::test_plugins {
+
+enum class kind {
+	passthrough,
+	gain,
+	sine,
+	latency,
+	burn,
+	big_state,
+	many_params,
+	channels,
+};
+
+static constexpr auto CHANNELS         = 2;
+static constexpr auto LATENCY_FRAMES   = 256;
+static constexpr auto MANY_PARAM_COUNT = 4096;
+static constexpr auto WIDE_CHANNELS    = 8; // Of the second output of the channels plugin.
+static constexpr auto STATE_MAGIC      = uint32_t{0x73637566}; // 'scuf'
+
+struct param {
+	std::string name;
+	double min;
+	double max;
+	double def;
+};
+
+struct instance {
+	clap_plugin plugin;
+	const clap_host* host;
+	kind type;
+	double sr = 48000.0;
+	double phase = 0.0;
+	std::vector<double> values;
+	std::array<std::vector<float>, CHANNELS> delay;
+	size_t delay_pos = 0;
+};
+
+static const char* features_effect[]     = {CLAP_PLUGIN_FEATURE_AUDIO_EFFECT, CLAP_PLUGIN_FEATURE_UTILITY, nullptr};
+static const char* features_instrument[] = {CLAP_PLUGIN_FEATURE_INSTRUMENT, CLAP_PLUGIN_FEATURE_SYNTHESIZER, nullptr};
+
+[[nodiscard]] static
+auto make_descriptor(const char* id, const char* name, const char* description, const char** features) -> clap_plugin_descriptor {
+	clap_plugin_descriptor d = {};
+	d.clap_version = CLAP_VERSION_INIT;
+	d.id           = id;
+	d.name         = name;
+	d.vendor       = "scuff";
+	d.url          = "";
+	d.manual_url   = "";
+	d.support_url  = "";
+	d.version      = "1.0.0";
+	d.description  = description;
+	d.features     = features;
+	return d;
+}
+
+static const clap_plugin_descriptor descriptors[] = {
+	make_descriptor("scuff.test.passthrough", "scuff passthrough", "Copies its input to its output.", features_effect),
+	make_descriptor("scuff.test.gain",        "scuff gain",        "Multiplies its input by the gain parameter.", features_effect),
+	make_descriptor("scuff.test.sine",        "scuff sine",        "Outputs a sine wave and ignores its input.", features_instrument),
+	make_descriptor("scuff.test.latency",     "scuff latency",     "Delays its input by a fixed number of frames, and reports it as latency.", features_effect),
+	make_descriptor("scuff.test.burn",        "scuff burn",        "Passes its input through after spinning for a configurable time each block.", features_effect),
+	make_descriptor("scuff.test.big-state",   "scuff big state",   "Passes its input through. Saves a state blob of configurable size.", features_effect),
+	make_descriptor("scuff.test.many-params", "scuff many params", "Passes its input through. Has thousands of parameters.", features_effect),
+	make_descriptor("scuff.test.channels",    "scuff channels",    "Copies its mono input to every channel of a mono output and an 8 channel output.", features_effect),
+};
+
+static constexpr auto PLUGIN_COUNT = std::size(descriptors);
+
+[[nodiscard]] static
+auto get_params(kind type) -> const std::vector<param>& {
+	static const auto none        = std::vector<param>{};
+	static const auto gain        = std::vector<param>{{"Gain", 0.0, 2.0, 1.0}};
+	static const auto sine        = std::vector<param>{{"Frequency", 20.0, 20000.0, 440.0}, {"Amplitude", 0.0, 1.0, 0.25}};
+	static const auto burn        = std::vector<param>{{"Burn us", 0.0, 20000.0, 0.0}};
+	static const auto big_state   = std::vector<param>{{"State KB", 0.0, 65536.0, 1024.0}};
+	static const auto many_params = [] {
+		auto params = std::vector<param>{};
+		for (int i = 0; i < MANY_PARAM_COUNT; i++) {
+			params.push_back({"Param " + std::to_string(i), 0.0, 1.0, 0.5});
+		}
+		return params;
+	}();
+	switch (type) {
+		case kind::gain:        { return gain; }
+		case kind::sine:        { return sine; }
+		case kind::burn:        { return burn; }
+		case kind::big_state:   { return big_state; }
+		case kind::many_params: { return many_params; }
+		default:                { return none; }
+	}
+}
+
+[[nodiscard]] static
+auto get(const clap_plugin* plugin) -> instance* {
+	return static_cast<instance*>(plugin->plugin_data);
+}
+
+// Audio ports ///////////////////////////////////////////////////////////////////////////
+
+static const clap_plugin_audio_ports audio_ports = {
+	.count = [](const clap_plugin* plugin, bool is_input) -> uint32_t {
+		return 1;
+	},
+	.get = [](const clap_plugin* plugin, uint32_t index, bool is_input, clap_audio_port_info* info) -> bool {
+		if (index != 0) {
+			return false;
+		}
+		info->id            = 0;
+		info->flags         = CLAP_AUDIO_PORT_IS_MAIN;
+		info->channel_count = CHANNELS;
+		info->port_type     = CLAP_PORT_STEREO;
+		info->in_place_pair = CLAP_INVALID_ID;
+		std::snprintf(info->name, sizeof(info->name), "%s", is_input ? "Input" : "Output");
+		return true;
+	},
+};
+
+// One mono input, then a mono output and a wide output.
+static const clap_plugin_audio_ports channels_audio_ports = {
+	.count = [](const clap_plugin* plugin, bool is_input) -> uint32_t {
+		return is_input ? 1 : 2;
+	},
+	.get = [](const clap_plugin* plugin, uint32_t index, bool is_input, clap_audio_port_info* info) -> bool {
+		if (index >= (is_input ? 1u : 2u)) {
+			return false;
+		}
+		const auto wide = index == 1;
+		info->id            = index;
+		info->flags         = wide ? 0 : CLAP_AUDIO_PORT_IS_MAIN;
+		info->channel_count = wide ? WIDE_CHANNELS : 1;
+		info->port_type     = wide ? nullptr : CLAP_PORT_MONO;
+		info->in_place_pair = CLAP_INVALID_ID;
+		std::snprintf(info->name, sizeof(info->name), "%s", is_input ? "Input" : wide ? "Wide" : "Mono");
+		return true;
+	},
+};
+
+// Latency ///////////////////////////////////////////////////////////////////////////////
+
+static const clap_plugin_latency latency = {
+	.get = [](const clap_plugin* plugin) -> uint32_t {
+		return LATENCY_FRAMES;
+	},
+};
+
+// Params ////////////////////////////////////////////////////////////////////////////////
+
+static
+auto handle_event(instance* inst, const clap_event_header* header) -> void {
+	if (header->space_id != CLAP_CORE_EVENT_SPACE_ID || header->type != CLAP_EVENT_PARAM_VALUE) {
+		return;
+	}
+	const auto event = reinterpret_cast<const clap_event_param_value*>(header);
+	if (event->param_id < inst->values.size()) {
+		const auto& info = get_params(inst->type)[event->param_id];
+		inst->values[event->param_id] = std::clamp(event->value, info.min, info.max);
+	}
+	// The sine sleeps while it is silent, so it has to ask to be woken up
+	// when its amplitude is turned back up.
+	if (inst->type == kind::sine && event->param_id == 1 && inst->values[1] > 0.0) {
+		inst->host->request_process(inst->host);
+	}
+}
+
+static
+auto handle_events(instance* inst, const clap_input_events* events) -> void {
+	const auto count = events->size(events);
+	for (uint32_t i = 0; i < count; i++) {
+		handle_event(inst, events->get(events, i));
+	}
+}
+
+static const clap_plugin_params params = {
+	.count = [](const clap_plugin* plugin) -> uint32_t {
+		return static_cast<uint32_t>(get(plugin)->values.size());
+	},
+	.get_info = [](const clap_plugin* plugin, uint32_t index, clap_param_info* info) -> bool {
+		const auto& list = get_params(get(plugin)->type);
+		if (index >= list.size()) {
+			return false;
+		}
+		*info = {};
+		info->id            = index;
+		info->flags         = CLAP_PARAM_IS_AUTOMATABLE;
+		info->min_value     = list[index].min;
+		info->max_value     = list[index].max;
+		info->default_value = list[index].def;
+		std::snprintf(info->name, sizeof(info->name), "%s", list[index].name.c_str());
+		return true;
+	},
+	.get_value = [](const clap_plugin* plugin, clap_id id, double* value) -> bool {
+		const auto inst = get(plugin);
+		if (id >= inst->values.size()) {
+			return false;
+		}
+		*value = inst->values[id];
+		return true;
+	},
+	.value_to_text = [](const clap_plugin* plugin, clap_id id, double value, char* display, uint32_t size) -> bool {
+		if (id >= get(plugin)->values.size()) {
+			return false;
+		}
+		std::snprintf(display, size, "%.3f", value);
+		return true;
+	},
+	.text_to_value = [](const clap_plugin* plugin, clap_id id, const char* display, double* value) -> bool {
+		if (id >= get(plugin)->values.size()) {
+			return false;
+		}
+		*value = std::atof(display);
+		return true;
+	},
+	.flush = [](const clap_plugin* plugin, const clap_input_events* in, const clap_output_events* out) -> void {
+		handle_events(get(plugin), in);
+	},
+};
+
+// State /////////////////////////////////////////////////////////////////////////////////
+// [magic][param count][param values...][blob size][blob...]
+// Only the big state plugin has a blob, of the size set by its parameter.
+
+[[nodiscard]] static
+auto write_all(const clap_ostream* stream, const void* data, uint64_t size) -> bool {
+	auto bytes = static_cast<const std::byte*>(data);
+	while (size > 0) {
+		const auto written = stream->write(stream, bytes, size);
+		if (written <= 0) {
+			return false;
+		}
+		bytes += written;
+		size  -= static_cast<uint64_t>(written);
+	}
+	return true;
+}
+
+[[nodiscard]] static
+auto read_all(const clap_istream* stream, void* data, uint64_t size) -> bool {
+	auto bytes = static_cast<std::byte*>(data);
+	while (size > 0) {
+		const auto got = stream->read(stream, bytes, size);
+		if (got <= 0) {
+			return false;
+		}
+		bytes += got;
+		size  -= static_cast<uint64_t>(got);
+	}
+	return true;
+}
+
+[[nodiscard]] static
+auto get_blob_size(const instance& inst) -> uint64_t {
+	if (inst.type != kind::big_state) {
+		return 0;
+	}
+	return static_cast<uint64_t>(inst.values[0]) * 1024;
+}
+
+static const clap_plugin_state state = {
+	.save = [](const clap_plugin* plugin, const clap_ostream* stream) -> bool {
+		const auto inst        = get(plugin);
+		const auto param_count = static_cast<uint32_t>(inst->values.size());
+		const auto blob_size   = get_blob_size(*inst);
+		if (!write_all(stream, &STATE_MAGIC, sizeof(STATE_MAGIC)))                       { return false; }
+		if (!write_all(stream, &param_count, sizeof(param_count)))                       { return false; }
+		if (!write_all(stream, inst->values.data(), param_count * sizeof(double)))       { return false; }
+		if (!write_all(stream, &blob_size, sizeof(blob_size)))                           { return false; }
+		auto chunk = std::vector<std::byte>(std::min<uint64_t>(blob_size, 65536));
+		for (uint64_t offset = 0; offset < blob_size; offset += chunk.size()) {
+			const auto size = std::min<uint64_t>(chunk.size(), blob_size - offset);
+			for (uint64_t i = 0; i < size; i++) {
+				chunk[i] = static_cast<std::byte>((offset + i) * 31);
+			}
+			if (!write_all(stream, chunk.data(), size)) {
+				return false;
+			}
+		}
+		return true;
+	},
+	.load = [](const clap_plugin* plugin, const clap_istream* stream) -> bool {
+		const auto inst = get(plugin);
+		uint32_t magic       = 0;
+		uint32_t param_count = 0;
+		uint64_t blob_size   = 0;
+		if (!read_all(stream, &magic, sizeof(magic)) || magic != STATE_MAGIC)          { return false; }
+		if (!read_all(stream, &param_count, sizeof(param_count)))                      { return false; }
+		if (param_count != inst->values.size())                                        { return false; }
+		auto values = std::vector<double>(param_count);
+		if (!read_all(stream, values.data(), param_count * sizeof(double)))            { return false; }
+		if (!read_all(stream, &blob_size, sizeof(blob_size)))                          { return false; }
+		auto chunk = std::vector<std::byte>(std::min<uint64_t>(blob_size, 65536));
+		for (uint64_t offset = 0; offset < blob_size; offset += chunk.size()) {
+			const auto size = std::min<uint64_t>(chunk.size(), blob_size - offset);
+			if (!read_all(stream, chunk.data(), size)) {
+				return false;
+			}
+			for (uint64_t i = 0; i < size; i++) {
+				if (chunk[i] != static_cast<std::byte>((offset + i) * 31)) {
+					return false;
+				}
+			}
+		}
+		inst->values = std::move(values);
+		return true;
+	},
+};
+
+// Processing ////////////////////////////////////////////////////////////////////////////
+
+[[nodiscard]] static
+auto can_process(const clap_process* process) -> bool {
+	return process->audio_inputs_count > 0
+	    && process->audio_outputs_count > 0
+	    && process->audio_inputs[0].channel_count >= CHANNELS
+	    && process->audio_outputs[0].channel_count >= CHANNELS;
+}
+
+static
+// Constant input channels are still constant when they are copied.
+auto copy(const clap_process* process) -> void {
+	for (uint32_t c = 0; c < CHANNELS; c++) {
+		const auto in  = process->audio_inputs[0].data32[c];
+		const auto out = process->audio_outputs[0].data32[c];
+		std::copy(in, in + process->frames_count, out);
+	}
+	process->audio_outputs[0].constant_mask = process->audio_inputs[0].constant_mask;
+}
+
+static
+auto process_gain(instance* inst, const clap_process* process) -> void {
+	const auto gain = static_cast<float>(inst->values[0]);
+	for (uint32_t c = 0; c < CHANNELS; c++) {
+		const auto in  = process->audio_inputs[0].data32[c];
+		const auto out = process->audio_outputs[0].data32[c];
+		for (uint32_t i = 0; i < process->frames_count; i++) {
+			out[i] = in[i] * gain;
+		}
+	}
+}
+
+[[nodiscard]] static
+// Goes to sleep while the amplitude is zero.
+auto process_sine(instance* inst, const clap_process* process) -> clap_process_status {
+	const auto increment = inst->values[0] / inst->sr;
+	const auto amplitude = inst->values[1];
+	if (amplitude <= 0.0) {
+		for (uint32_t c = 0; c < CHANNELS; c++) {
+			std::fill_n(process->audio_outputs[0].data32[c], process->frames_count, 0.0f);
+		}
+		process->audio_outputs[0].constant_mask = (uint64_t{1} << CHANNELS) - 1;
+		return CLAP_PROCESS_SLEEP;
+	}
+	for (uint32_t i = 0; i < process->frames_count; i++) {
+		const auto value = static_cast<float>(std::sin(inst->phase * 2.0 * std::numbers::pi) * amplitude);
+		for (uint32_t c = 0; c < CHANNELS; c++) {
+			process->audio_outputs[0].data32[c][i] = value;
+		}
+		inst->phase = std::fmod(inst->phase + increment, 1.0);
+	}
+	return CLAP_PROCESS_CONTINUE;
+}
+
+static
+auto process_latency(instance* inst, const clap_process* process) -> void {
+	auto pos = inst->delay_pos;
+	for (uint32_t i = 0; i < process->frames_count; i++) {
+		for (uint32_t c = 0; c < CHANNELS; c++) {
+			auto& line     = inst->delay[c];
+			const auto in = process->audio_inputs[0].data32[c][i];
+			process->audio_outputs[0].data32[c][i] = line[pos];
+			line[pos] = in;
+		}
+		pos = (pos + 1) % LATENCY_FRAMES;
+	}
+	inst->delay_pos = pos;
+}
+
+static
+auto process_burn(instance* inst, const clap_process* process) -> void {
+	const auto until = std::chrono::steady_clock::now() + std::chrono::microseconds{static_cast<int64_t>(inst->values[0])};
+	while (std::chrono::steady_clock::now() < until) {}
+	copy(process);
+}
+
+static
+auto process_channels(const clap_process* process) -> void {
+	if (process->audio_inputs_count < 1 || process->audio_inputs[0].channel_count < 1) {
+		return;
+	}
+	const auto in = process->audio_inputs[0].data32[0];
+	for (uint32_t port = 0; port < process->audio_outputs_count; port++) {
+		const auto& out = process->audio_outputs[port];
+		for (uint32_t c = 0; c < out.channel_count; c++) {
+			std::copy(in, in + process->frames_count, out.data32[c]);
+		}
+	}
+}
+
+static
+auto process(instance* inst, const clap_process* process) -> clap_process_status {
+	handle_events(inst, process->in_events);
+	if (inst->type == kind::channels) {
+		process_channels(process);
+		return CLAP_PROCESS_CONTINUE;
+	}
+	if (!can_process(process)) {
+		return CLAP_PROCESS_CONTINUE;
+	}
+	switch (inst->type) {
+		case kind::gain:    { process_gain(inst, process); break; }
+		case kind::sine:    { return process_sine(inst, process); }
+		case kind::latency: { process_latency(inst, process); break; }
+		case kind::burn:    { process_burn(inst, process); break; }
+		default:            { copy(process); break; }
+	}
+	return CLAP_PROCESS_CONTINUE;
+}
+
+// Plugin ////////////////////////////////////////////////////////////////////////////////
+
+[[nodiscard]] static
+auto make_plugin(const clap_host* host, const clap_plugin_descriptor* desc, kind type) -> const clap_plugin* {
+	const auto inst = new instance{};
+	inst->host = host;
+	inst->type = type;
+	for (const auto& p : get_params(type)) {
+		inst->values.push_back(p.def);
+	}
+	for (auto& line : inst->delay) {
+		line.resize(LATENCY_FRAMES, 0.0f);
+	}
+	auto& plugin = inst->plugin;
+	plugin.desc        = desc;
+	plugin.plugin_data = inst;
+	plugin.init        = [](const clap_plugin* plugin) -> bool { return true; };
+	plugin.destroy     = [](const clap_plugin* plugin) -> void { delete get(plugin); };
+	plugin.activate    = [](const clap_plugin* plugin, double sr, uint32_t min_frames, uint32_t max_frames) -> bool {
+		get(plugin)->sr = sr;
+		return true;
+	};
+	plugin.deactivate       = [](const clap_plugin* plugin) -> void {};
+	plugin.start_processing = [](const clap_plugin* plugin) -> bool { return true; };
+	plugin.stop_processing  = [](const clap_plugin* plugin) -> void {};
+	plugin.reset            = [](const clap_plugin* plugin) -> void {
+		const auto inst = get(plugin);
+		inst->phase     = 0.0;
+		inst->delay_pos = 0;
+		for (auto& line : inst->delay) {
+			std::fill(line.begin(), line.end(), 0.0f);
+		}
+	};
+	plugin.process = [](const clap_plugin* plugin, const clap_process* p) -> clap_process_status {
+		return process(get(plugin), p);
+	};
+	plugin.get_extension = [](const clap_plugin* plugin, const char* id) -> const void* {
+		const auto ext = std::string_view{id};
+		if (ext == CLAP_EXT_AUDIO_PORTS) { return get(plugin)->type == kind::channels ? &channels_audio_ports : &audio_ports; }
+		if (ext == CLAP_EXT_PARAMS)      { return &params; }
+		if (ext == CLAP_EXT_STATE)       { return &state; }
+		if (ext == CLAP_EXT_LATENCY && get(plugin)->type == kind::latency) { return &latency; }
+		return nullptr;
+	};
+	plugin.on_main_thread = [](const clap_plugin* plugin) -> void {};
+	return &plugin;
+}
+
+static const clap_plugin_factory factory = {
+	.get_plugin_count = [](const clap_plugin_factory* factory) -> uint32_t {
+		return static_cast<uint32_t>(PLUGIN_COUNT);
+	},
+	.get_plugin_descriptor = [](const clap_plugin_factory* factory, uint32_t index) -> const clap_plugin_descriptor* {
+		return index < PLUGIN_COUNT ? &descriptors[index] : nullptr;
+	},
+	.create_plugin = [](const clap_plugin_factory* factory, const clap_host* host, const char* plugin_id) -> const clap_plugin* {
+		for (size_t i = 0; i < PLUGIN_COUNT; i++) {
+			if (std::strcmp(descriptors[i].id, plugin_id) == 0) {
+				return make_plugin(host, &descriptors[i], static_cast<kind>(i));
+			}
+		}
+		return nullptr;
+	},
+};
+
+} // scuff::test_plugins
+
+extern "C" CLAP_EXPORT const clap_plugin_entry clap_entry = {
+	.clap_version = CLAP_VERSION_INIT,
+	.init         = [](const char* path) -> bool { return true; },
+	.deinit       = []() -> void {},
+	.get_factory  = [](const char* factory_id) -> const void* {
+		if (std::strcmp(factory_id, CLAP_PLUGIN_FACTORY_ID) == 0) {
+			return &scuff::test_plugins::factory;
+		}
+		return nullptr;
+	},
+};